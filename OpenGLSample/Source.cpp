@@ -1,5 +1,14 @@
 ﻿#include <iostream>
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <vector>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -9,6 +18,38 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include "benchmark_report.h"
+#include "benchmarks.h"
+#include "camera_path.h"
+#include "cpu_profiler.h"
+#include "culling.h"
+#include "dynamic_resolution.h"
+#include "entity_store.h"
+#include "frame_capture.h"
+#include "frame_clock.h"
+#include "frame_pacer.h"
+#include "frame_timeline.h"
+#include "gbuffer.h"
+#include "gl_trace.h"
+#include "gpu_profiler.h"
+#include "headless_context.h"
+#include "image_writer.h"
+#include "light_clusters.h"
+#include "mesh_lod.h"
+#include "meshlet.h"
+#include "ocean_surface.h"
+#include "parallel.h"
+#include "pipeline_stats.h"
+#include "planar_reflection.h"
+#include "render_thread.h"
+#include "ring_buffer.h"
+#include "scene_graph.h"
+#include "shadow_cache.h"
+#include "soft_rasterizer.h"
+#include "stress_scene.h"
+#include "water_simulation.h"
+#include "water_surface.h"
+
 
 using namespace std;
 
@@ -16,16 +57,43 @@ using namespace std;
 #define GLSL(Version, Source) "#version " #Version " core \n" #Source
 #endif
 
+// Shader code appended as a second source string, so it carries no #version line
+#ifndef GLSL_LIBRARY
+#define GLSL_LIBRARY(Source) "\n" #Source
+#endif
+
+// Per-frame camera, streamed through the ring buffer; written once here so every stage
+// that reads it declares the block identically
+#define CAMERA_DATA_SOURCE GLSL_LIBRARY( \
+layout(std140, binding = 0) uniform CameraData { \
+    mat4 view; \
+    mat4 projection; \
+    mat4 inverseViewProjection; \
+    vec3 viewPos; \
+};)
+
+// A shader that reads the CameraData block, declared right after the #version line
+#define GLSL_CAMERA(Version, Source) "#version " #Version " core \n" CAMERA_DATA_SOURCE "\n" #Source
+
 namespace {
     glm::vec3 cameraPosition = glm::vec3(0.0f, 0.5f, 3.0f);
     glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
     glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
 
-    float rotationAngle = 0.0f;
-    float cameraSpeed = 0.05f;
+    float cameraSpeed = 3.0f;       // units per second
+    float rotationSpeed = 60.0f;    // degrees per second
     float yaw = -90.0f;
     float pitch = 0.0f;
 
+    // The camera above is advanced in fixed steps. Rendering draws a blend of the
+    // previous step and the current one, so motion stays smooth at any display rate.
+    glm::vec3 previousCameraPosition = cameraPosition;
+    float previousYaw = yaw;
+    glm::vec3 renderCameraPosition = cameraPosition;
+    glm::vec3 renderCameraFront = cameraFront;
+
+    FrameClock gFrameClock;
+
     const char* const WINDOW_TITLE = "Final Project - Swimming Pool Courtyard";
     const int WINDOW_WIDTH = 1800;
     const int WINDOW_HEIGHT = 1600;
@@ -34,26 +102,316 @@ namespace {
         GLuint vao;
         GLuint vbos[2];
         GLuint nIndices;
+        bool indexed;           // drawn with glDrawElements instead of glDrawArrays
+        glm::vec3 boundsCenter; // model-space bounding sphere
+        float boundsRadius;
+        const char* name;       // GPU profiler scope for its draws
+        SoftMesh soft;          // CPU copy for the software rasterizer
+        GLuint positionVao;     // packed positions only, for the depth pre-pass
+        GLuint positionVbo;
+        std::vector<LodLevel> lods;         // simplified levels after level 0 in the index buffer; empty for small meshes
+        std::vector<Meshlet> meshlets;      // clusters of level 0, which is stored in cluster order
+    };
+
+    struct Material {
+        GLuint textureId;
+        bool isPool;            // pool surfaces blend the ripple texture with water colour
+        const SoftTexture* softTexture;     // null unless textures are kept for --software
+        bool isOcean;           // displaced and shaded from the --ocean maps
     };
 
     GLFWwindow* gWindow = nullptr;
-    GLMesh gPool;
-    GLMesh gWalkway;
-    GLMesh gTable1, gTable2;
     GLuint gProgramId;
     GLuint textureID;  // Global variable for brick texture ID
     GLuint rippleTextureID; // Global variable for ripple texture ID
+
+    // Scene data; entities refer to meshes and materials by their index in these tables
+    std::vector<GLMesh> gMeshes;
+    std::vector<Material> gMaterials;
+    EntityStore gEntities;
+    std::vector<DrawItem> gVisible;
+
+    // Transform hierarchy for the courtyard; world matrices only change when a node moves
+    SceneGraph gSceneGraph;
+    SceneGraph::NodeId gCourtyardNode;
+    SceneGraph::NodeId gFloatNode = SceneGraph::kNoParent;     // bobs across the pool; absent in the stress scene
+    size_t gTransformFrames = 0;        // frames that updated any world matrix
+    size_t gTransformNodesUpdated = 0;
+    size_t gTransformMaxNodes = 0;
+    size_t gTransformMaxLevels = 0;     // most levels updated in parallel in one frame
+    const int NUM_TABLES = 6;
+
+    // --stress <objects> replaces the courtyard with a generated grid of courtyards;
+    // --stress-meshes and --stress-textures set how many distinct meshes and textures
+    // the objects are spread over. Stress objects have no scene nodes: they never move,
+    // and ten million nodes would cost more than the objects themselves.
+    StressSceneSettings gStressSettings;
+
+    // --table-segments <n> builds the tables as rounded boxes with n x n quads a face, so
+    // they carry LOD chains and meshlets. Levels are picked per instance from the error in
+    // world units; the drawn level's triangles are counted against level 0 for the report.
+    int gTableSegments = 1;
+    MeshletDrawList gMeshletScratch;
+    size_t gDetailFrames = 0;
+    size_t gDetailTrianglesFull = 0;
+    size_t gDetailTrianglesDrawn = 0;
+
+    // Extra point and spot lights, shaded through the clustered light grid
+    std::shared_ptr<const std::vector<ClusterLight> > gLights = std::make_shared<const std::vector<ClusterLight> >();
+    glm::vec3 gLightAreaMin = glm::vec3(-2.5f, -0.2f, -2.5f);  // lights are scattered over this box
+    glm::vec3 gLightAreaMax = glm::vec3(2.5f, 1.0f, 2.5f);
+    LightClusterGrid gLightGrid;
+
+    // Deferred path: G-buffer pass, then one lighting pass over visible pixels.
+    // Toggled at runtime with the G key.
+    bool gDeferred = false;
+    GBuffer gGBuffer;
+    GLuint gGBufferProgramId;
+    GLuint gLightingProgramId;
+
+    // --depth-prepass (toggled with Z) lays down forward-path depth with a position-only
+    // pass, nearest draws first, then shades with GL_EQUAL so each pixel is lit once.
+    // --front-to-back shades nearest first instead of grouped by material, for early-z
+    // rejection without a pre-pass. --pipeline-stats counts shader invocations per pass.
+    bool gDepthPrepass = false;
+    bool gFrontToBack = false;
+    GLuint gDepthProgramId;
+    PipelineStatistics gPipelineStatistics;
+    bool gPipelineStats = false;
+
+    // Directional light shadows; static casters are cached until one of them or the light moves
+    const glm::vec3 LIGHT_POSITION = glm::vec3(2.0f, 6.0f, 3.0f);
+    const int SHADOW_MAP_SIZE = 2048;
+    ShadowCache gShadowCache;
+    GLuint gShadowProgramId;
+    uint64_t gStaticShadowVersion = 0;   // bumped whenever a static caster moves
+    // Shared with the packets like gLights; rebuilt only when gStaticShadowVersion changes
+    std::shared_ptr<const std::vector<FramePacket::ShadowCaster> > gStaticCasters;
+    uint64_t gStaticCastersVersion = 0;
+
+    // The main thread simulates and culls, then hands a FramePacket to the render thread,
+    // which owns the GL context from then on. Resizes reach it through the packets.
+    RenderThread gRenderThread;
+    int gFramebufferWidth = WINDOW_WIDTH;
+    int gFramebufferHeight = WINDOW_HEIGHT;
+    float gProjectionAspect = static_cast<float>(WINDOW_WIDTH) / WINDOW_HEIGHT;
+
+    // Frame pacing. Low-latency mode samples input only once the previous frame is
+    // finished, trading CPU/GPU overlap for a shorter input-to-present path.
+    FramePacer gFramePacer;
+    FrameTimeline gFrameTimeline;
+    bool gLowLatency = false;
+
+    // Per-frame shader constants go through a persistently mapped ring buffer, bound as
+    // uniform blocks instead of being set with glUniform calls on every program
+    const size_t RING_REGION_SIZE = 64 * 1024;
+    const GLuint CAMERA_BLOCK_BINDING = 0;
+    const GLuint LIGHT_BLOCK_BINDING = 1;
+    PersistentRingBuffer gRingBuffer;
+
+    // GPU time per pass and per mesh group, enabled with --gpu-profile
+    GpuProfiler gGpuProfiler;
+    bool gGpuProfile = false;
+
+    // Frames left to report GL call counts for, set with --gl-trace
+    size_t gGLTraceFrames = 0;
+
+    // --headless renders into an offscreen framebuffer with no window, for machines
+    // without a display or GPU; --frame-output writes each finished frame as a PNG.
+    // gOutputFramebuffer is where the final image goes: the window's or the offscreen one.
+    bool gHeadless = false;
+    HeadlessContext gHeadlessContext;
+    size_t gHeadlessFrames = 0;     // frames left to submit
+    const char* gFrameOutput = nullptr;
+    size_t gFramesPresented = 0;
+    GLuint gOutputFramebuffer = 0;
+
+    // --benchmark flies the camera along a path for a fixed number of frames, simulating
+    // a constant step per frame from a fixed scene seed, and writes frame-time percentiles
+    // as JSON. The first frames compile shaders and fill caches, so they are not recorded.
+    // --record-path saves the live camera as a path that --benchmark can replay.
+    const size_t BENCHMARK_WARMUP_FRAMES = 30;
+    const double BENCHMARK_FRAME_SECONDS = 1.0 / 60.0;
+    const float RECORD_KEY_SECONDS = 0.1f;
+    bool gBenchmark = false;
+    size_t gBenchmarkFramesLeft = 0;    // frames left to submit, warm-up included
+    CameraPath gCameraPath;
+    BenchmarkReport gBenchmarkReport;
+    FramePacket::Clock::time_point gLastPresent;   // render thread
+    size_t gBenchmarkGpuSeen = 0;                  // GPU profiler frames already added to the report
+    const char* gRecordPathOut = nullptr;
+    CameraPath gRecordedPath;
+    uint32_t gSceneSeed = 2024u;
+
+    // --capture <path> reads every frame back without stalling and writes PNG or QOI
+    // images or a Y4M video; without it, F12 in a window saves a PNG screenshot
+    FrameCapture gCapture;
+    bool gCaptureEveryFrame = false;
+    bool gScreenshotRequested = false;
+
+    // --software draws every frame with the CPU rasterizer and copies the image into the
+    // output framebuffer; --compare-software renders one frame both ways, reports the
+    // difference and times the rasterizer at increasing thread counts. Both keep CPU
+    // copies of the textures, keyed by GL texture name. The rasterizer itself makes no GL
+    // calls, but the scene is still loaded through GL and the image presented through it,
+    // so both need a GL 4.4 context; without a GPU, a software driver such as Mesa's
+    // llvmpipe (LIBGL_ALWAYS_SOFTWARE=1) provides one.
+    bool gSoftware = false;
+    bool gKeepSoftTextures = false;
+    std::map<GLuint, SoftTexture> gSoftTextures;
+    SoftRasterizer gSoftRasterizer;
+    GLuint gSoftwareTexture = 0;
+    GLuint gSoftwareFramebuffer = 0;
+    const int SOFTWARE_MATCH_LEVELS = 8;     // per-channel difference still counted as a match
+    const double SOFTWARE_MAX_MISMATCH_PERCENT = 5.0;   // --compare-software fails above this
+
+    // --dynamic-res <budget ms> draws the scene below the window resolution, at a scale
+    // the controller picks from the GPU frame time, and upsamples it temporally. The
+    // render thread publishes the scale; the main thread builds the next packet with it.
+    bool gDynamicResolution = false;
+    ResolutionController gResolutionController;
+    std::atomic<float> gResolutionScale(1.0f);
+    size_t gResolutionSamplesSeen = 0;      // GPU profiler frames already fed to the controller
+    TemporalUpscaler gUpscaler;
+    GLuint gUpscaleProgramId = 0;
+
+    // --water ripples the pool at a fixed step rate of its own: the main thread steps the
+    // heightfield and sends the changed texels, which the render thread uploads into the
+    // surface texture. --water-gpu runs the steps in a compute shader instead. Rain and
+    // small objects moving through the surface disturb it.
+    const float WATER_OBJECT_STRENGTH = 0.004f;     // depth an object pushes the water down per frame
+    const float WATER_MAX_OBJECT_RADIUS = 0.5f;     // larger bounds crossing the surface are scenery
+    bool gWater = false;
+    bool gWaterCompute = false;
+    WaterSimulation gWaterSimulation;
+    WaterSurface gWaterSurface;
+    GLuint gWaterComputeProgramId = 0;
+
+    // Pools the moving objects can disturb, listed as they are created; each keeps its
+    // world-to-pool matrix until its node moves
+    struct WaterPool {
+        Entity entity;
+        glm::mat4 toPool;
+        bool current;
+    };
+    std::vector<WaterPool> gWaterPools;
+    std::vector<Bounds> gWaterMoved;    // objects that moved this frame, reused across frames
+
+    // --ocean <grid> surrounds the courtyard with open sea. The main thread evaluates the
+    // spectrum into a map set each frame and hands it over in the packet; the render thread
+    // streams it into the ocean textures. Map sets are reused once no packet holds them.
+    const float OCEAN_EXTENT = 16.0f;               // half the side of the sea mesh
+    const int OCEAN_GRID_VERTICES = 256;            // per side; the most 16-bit indices reach
+    bool gOcean = false;
+    OceanSpectrum gOceanSpectrum;
+    OceanSurface gOceanSurface;
+    MeshHandle gOceanMesh = ~0u;
+    std::vector<std::shared_ptr<OceanSpectrum::Maps> > gOceanMaps;
+
+    // --reflections <every N frames> mirrors the scene in the pools. The main thread picks
+    // the mirror plane from the first visible pool and schedules updates; the render thread
+    // redraws the packet's visible list, minus the mirror surfaces, with a cheaper shader
+    // into a reduced-resolution target. Anything the main camera culled stays out of the
+    // reflection.
+    bool gReflections = false;
+    ReflectionSchedule gReflectionSchedule;
+    PlanarReflection gPlanarReflection;
+    GLuint gReflectionProgramId = 0;
+
+    // std140 mirrors of the CameraData and LightData shader blocks
+    struct CameraData {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::mat4 inverseViewProjection;
+        glm::vec3 viewPos;
+        float padding;
+    };
+
+    struct LightData {
+        // struct Light
+        glm::vec3 lightPosition;
+        float padding0;
+        glm::vec3 lightColor;
+        float lightAmbientStrength;
+        float lightDiffuseStrength;
+        float lightSpecularStrength;
+        float padding1[2];
+        // struct Spotlight
+        glm::vec3 spotlightPosition;
+        float padding2;
+        glm::vec3 spotlightDirection;
+        float padding3;
+        glm::vec3 spotlightColor;
+        float spotlightCutOff;
+        float spotlightOuterCutOff;
+        float spotlightAmbientStrength;
+        float spotlightDiffuseStrength;
+        float spotlightSpecularStrength;
+    };
+
+    static_assert(sizeof(CameraData) == 208, "CameraData must match the std140 block");
+    static_assert(sizeof(LightData) == 112, "LightData must match the std140 block");
 }
 
 bool UInitialize(int, char* [], GLFWwindow** window);
+bool UInitializeHeadless();
+void UMakeContextCurrent(bool current);
+void UPollEvents();
+void UPresent();
 void UResizeWindow(GLFWwindow* window, int width, int height);
 void UProcessInput(GLFWwindow* window);
+void USimulate(GLFWwindow* window, float dt);
+void UInterpolateCamera(float alpha);
+void UFollowCameraPath(float time);
+void UAnimateScene(float time);
+void URecordCameraKey(float time);
+glm::vec3 UFrontFromAngles(float yawDegrees, float pitchDegrees);
 void UCreatePool(GLMesh& mesh);
 void UCreateWalkway(GLMesh& mesh);
 void UCreateCube(GLMesh& mesh);
+void UCreateRoundedCube(GLMesh& mesh);
+void UCreateOceanGrid(GLMesh& mesh);
+void UCreatePositionStream(GLMesh& mesh);
+void UBuildMeshDetail(GLMesh& mesh);
+float UMaxAxisScale(const glm::mat4& world);
 void UDestroyMesh(GLMesh& mesh);
-void URender();
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
+void UComputeMeshBounds(const GLfloat* verts, size_t vertexCount, size_t floatsPerVertex, GLMesh& mesh);
+void UKeepSoftMesh(const GLfloat* verts, size_t vertexCount, const GLushort* indices, size_t indexCount, GLMesh& mesh);
+MeshHandle UAddMesh(void (*createMesh)(GLMesh&), const char* name, bool simplify = true);
+MaterialHandle UAddMaterial(GLuint textureId, bool isPool);
+Entity UCreateEntity(SceneGraph::NodeId parent, const glm::mat4& local, MeshHandle mesh, MaterialHandle material, ComponentMask tags = 0);
+void UCreateScene();
+void UCreateStressScene();
+void UCreateOcean();
+std::vector<GLuint> ULoadTextureVariants(const char* texImagePath, size_t count);
+Bounds UWorldBounds(const GLMesh& mesh, const glm::mat4& world);
+void UCreateLights(size_t count);
+void USyncEntityTransforms();
+void UDisturbWater();
+void UBindMaterial(GLuint programId, const Material& material, bool reflection);
+void UBuildFramePacket(FramePacket& packet);
+void URender(const FramePacket& packet);
+void URenderFrame(const FramePacket& packet);
+bool URenderTiled(int width, int height, int tileSize, const char* path);
+void URenderForward(const FramePacket& packet);
+void URenderDeferred(const FramePacket& packet);
+void UUploadFrameData(const FramePacket& packet);
+void UBindCamera(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& position);
+void URenderReflection(const FramePacket& packet);
+LightData UFrameLights(const FramePacket& packet);
+glm::mat4 ULightSpace();
+void URenderShadows(const FramePacket& packet);
+void URenderSoftware(const FramePacket& packet);
+void UBlitSoftware();
+bool UCompareSoftware();
+void UDrawShadowCasters(const std::vector<FramePacket::ShadowCaster>& casters);
+void UDrawVisible(GLuint programId, const FramePacket& packet);
+void UDrawMesh(const GLMesh& mesh, const FramePacket::Draw& item, const FramePacket* culled);
+void UDrawDepthPrepass(const FramePacket& packet);
+void UComparePaths();
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId,
+    const char* fragLibrarySource = nullptr);
+bool UCreateComputeProgram(const char* computeShaderSource, GLuint& programId);
 void UDestroyShaderProgram(GLuint programId);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
@@ -63,29 +421,40 @@ GLuint loadTexture(const char* texImagePath);
 
 
 // VERTEX SHADER
-const GLchar* vertexShaderSource = GLSL(440,
+const GLchar* vertexShaderSource = GLSL_CAMERA(440,
     layout(location = 0) in vec3 position;
 layout(location = 1) in vec2 texCoords;
 
 out vec2 TexCoords;
-out vec3 FragPos;
+out vec3 WorldPos;
+out float ViewDepth;
+
+// The depth pre-pass computes the same position; GL_EQUAL needs the results bit-identical
+invariant gl_Position;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform bool isOcean;                   // --ocean: moved by the tiling displacement map
+uniform sampler2D oceanDisplacement;
+uniform float oceanPatchSize;
 
 void main() {
-    FragPos = position;
-    gl_Position = projection * view * model * vec4(position, 1.0f);
+    vec3 displaced = position;
+    if (isOcean)
+        displaced += textureLod(oceanDisplacement, position.xz / oceanPatchSize, 0.0).xyz;
+
+    WorldPos = vec3(model * vec4(displaced, 1.0f));
+    ViewDepth = -(view * vec4(WorldPos, 1.0f)).z;
+    gl_Position = projection * view * model * vec4(displaced, 1.0f);
     TexCoords = texCoords;
 }
 );
 
 
 // FRAGMENT SHADER
-const GLchar* fragmentShaderSource = GLSL(440,
+const GLchar* fragmentShaderSource = GLSL_CAMERA(440,
     in vec2 TexCoords;
-in vec3 FragPos;
+in vec3 WorldPos;
+in float ViewDepth;
 out vec4 fragmentColor;
 
 struct Light {
@@ -107,48 +476,78 @@ struct Spotlight {
     float specularStrength;
 };
 
-uniform Light light;
-uniform Spotlight spotlight;
-uniform vec3 viewPos;
+layout(std140, binding = 1) uniform LightData {
+    Light light;
+    Spotlight spotlight;
+};
+
 uniform sampler2D ourTexture;
 uniform sampler2D rippleTexture;
 uniform bool isPool;
+uniform sampler2D waterTexture;     // --water surface: normal in xyz, height in w
+uniform bool hasWater;
+uniform bool isOcean;
+uniform sampler2D oceanNormals;     // --ocean: unit normal in xyz, Jacobian in w
+uniform bool hasReflection;
+uniform sampler2D reflectionTexture;    // --reflections: the scene mirrored in the pool
+uniform mat4 reflectionViewProjection;  // the mirrored camera it was drawn from
+
+// Defined in lightingLibrarySource, which is compiled alongside this shader
+vec3 ClusteredLights(vec3 worldPos, float viewDepth, vec3 norm, vec3 viewDir);
+float ShadowVisibility(vec3 worldPos, vec3 norm);
 
 void main() {
     vec3 norm;
-    if (isPool) {
-        norm = vec3(0.0, 1.0, 0.0); // Upward normal for flat pool surface
+    float foam = 0.0;
+    if (isOcean) {
+        // Foam where the choppy displacement squeezes the surface together
+        vec4 ocean = texture(oceanNormals, TexCoords);
+        norm = normalize(ocean.xyz);
+        foam = clamp(1.0 - ocean.w, 0.0, 1.0);
+    }
+    else if (isPool) {
+        // Simulated surface normal, or straight up for a flat pool
+        norm = hasWater ? normalize(texture(waterTexture, TexCoords).xyz) : vec3(0.0, 1.0, 0.0);
     }
     else {
         norm = vec3(0.0, 1.0, 0.0); // Adjust normal
     }
 
     // Diffuse lighting
-    vec3 lightDir = normalize(light.position - FragPos);
+    vec3 lightDir = normalize(light.position - WorldPos);
     float diff = max(dot(norm, lightDir), 0.0);
     vec3 diffuse = light.diffuseStrength * diff * light.color;
 
     // Specular lighting
-    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 viewDir = normalize(viewPos - WorldPos);
     vec3 reflectDir = reflect(-lightDir, norm);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 128);
     vec3 specular = light.specularStrength * spec * light.color;
 
     vec3 ambient = light.ambientStrength * light.color;
-    vec3 result = (ambient + diffuse + specular);
+    vec3 result = (ambient + (diffuse + specular) * ShadowVisibility(WorldPos, norm));
 
     // Spotlight calculations
-    vec3 spotlightDir = normalize(spotlight.position - FragPos);
+    vec3 spotlightDir = normalize(spotlight.position - WorldPos);
     float theta = dot(spotlightDir, normalize(-spotlight.direction));
     float epsilon = spotlight.cutOff - spotlight.outerCutOff;
     float intensity = clamp((theta - spotlight.outerCutOff) / epsilon, 0.0, 1.0);
     vec3 spotlightEffect = intensity * (spotlight.ambientStrength * ambient + spotlight.diffuseStrength * diffuse + spotlight.specularStrength * specular) * spotlight.color;
     result += spotlightEffect * intensity;
 
+    result += ClusteredLights(WorldPos, ViewDepth, norm, normalize(viewPos - WorldPos));
+
     if (isPool) {
         vec4 poolColor = vec4(0.0, 0.4, 0.7, 1.0);
-        vec4 rippleColor = texture(rippleTexture, TexCoords);
-        fragmentColor = vec4(result, 1.0) * mix(poolColor, rippleColor, 0.5);
+        vec4 rippleColor = texture(rippleTexture, TexCoords + norm.xz * 0.1); // waves bend the view of the ripples
+        fragmentColor = vec4(result, 1.0) * mix(mix(poolColor, rippleColor, 0.5), vec4(1.0), foam);
+        if (hasReflection && !isOcean) {
+            // More mirror at grazing angles (Schlick); the waves shift the reflected image
+            vec4 mirrored = reflectionViewProjection * vec4(WorldPos, 1.0);
+            vec2 reflectionUv = mirrored.xy / mirrored.w * 0.5 + 0.5 + norm.xz * 0.05;
+            float fresnel = 0.1 + 0.9 * pow(1.0 - max(dot(normalize(viewPos - WorldPos), norm), 0.0), 5.0);
+            fragmentColor.rgb = mix(fragmentColor.rgb, texture(reflectionTexture, reflectionUv).rgb, fresnel);
+        }
     }
     else {
         fragmentColor = vec4(result, 1.0) * texture(ourTexture, TexCoords);
@@ -157,8 +556,591 @@ void main() {
 );
 
 
+// LIGHTING LIBRARY (clustered lights and shadows, shared by the forward and deferred lighting shaders)
+const GLchar* lightingLibrarySource = GLSL_LIBRARY(
+uniform sampler2DShadow shadowMap;
+uniform mat4 lightSpace;
+
+// Fraction of the directional light reaching a point, 3x3 PCF over the shadow map
+float ShadowVisibility(vec3 worldPos, vec3 norm) {
+    vec4 clip = lightSpace * vec4(worldPos + norm * 0.01, 1.0);
+    vec3 coord = clip.xyz / clip.w * 0.5 + 0.5;
+    if (coord.z > 1.0)
+        return 1.0;
+
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0));
+    float lit = 0.0;
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x)
+            lit += texture(shadowMap, vec3(coord.xy + vec2(x, y) * texel, coord.z - 0.002));
+    }
+    return lit / 9.0;
+}
+
+// Clustered lights: a light table, an (offset, count) range per cluster and the
+// light indices those ranges point into
+struct ClusterLight {
+    vec4 positionRadius;
+    vec4 colorIntensity;
+    vec4 directionCosOuter;
+    vec4 spotParams;
+};
+
+layout(std430, binding = 0) readonly buffer ClusterLightBuffer { ClusterLight clusterLights[]; };
+layout(std430, binding = 1) readonly buffer ClusterRangeBuffer { uvec2 clusterRanges[]; };
+layout(std430, binding = 2) readonly buffer ClusterIndexBuffer { uint clusterIndices[]; };
+
+uniform uvec3 clusterGrid;
+uniform vec2 clusterTileSize;
+uniform float clusterZScale;
+uniform float clusterZBias;
+
+vec3 ClusteredLights(vec3 worldPos, float viewDepth, vec3 norm, vec3 viewDir) {
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterTileSize), clusterGrid.xy - uvec2(1u));
+    uint slice = uint(clamp(log(max(viewDepth, 1e-4)) * clusterZScale + clusterZBias, 0.0, float(clusterGrid.z - 1u)));
+    uvec2 range = clusterRanges[tile.x + clusterGrid.x * (tile.y + clusterGrid.y * slice)];
+
+    vec3 total = vec3(0.0);
+    for (uint i = 0u; i < range.y; ++i) {
+        ClusterLight clusterLight = clusterLights[clusterIndices[range.x + i]];
+        vec3 toLight = clusterLight.positionRadius.xyz - worldPos;
+        float dist = length(toLight);
+        if (dist >= clusterLight.positionRadius.w)
+            continue;
+
+        // Inverse-square falloff windowed to reach zero at the light's radius
+        vec3 dir = toLight / max(dist, 1e-4);
+        float window = clamp(1.0 - pow(dist / clusterLight.positionRadius.w, 4.0), 0.0, 1.0);
+        float attenuation = window * window / (dist * dist + 1.0);
+        if (clusterLight.directionCosOuter.w > -1.5)
+            attenuation *= smoothstep(clusterLight.directionCosOuter.w, clusterLight.spotParams.x, dot(-dir, clusterLight.directionCosOuter.xyz));
+
+        float diff = max(dot(norm, dir), 0.0);
+        float spec = pow(max(dot(viewDir, reflect(-dir, norm)), 0.0), 32.0);
+        total += (diff + 0.5 * spec) * attenuation * clusterLight.colorIntensity.rgb * clusterLight.colorIntensity.a;
+    }
+    return total;
+}
+);
+
+
+// SHADOW DEPTH SHADERS
+const GLchar* shadowVertexShaderSource = GLSL(440,
+    layout(location = 0) in vec3 position;
+
+uniform mat4 model;
+uniform mat4 lightSpace;
+
+void main() {
+    gl_Position = lightSpace * model * vec4(position, 1.0f);
+}
+);
+
+const GLchar* shadowFragmentShaderSource = GLSL(440,
+    void main() {
+}
+);
+
+
+// DEPTH PRE-PASS VERTEX SHADER (drawn with the empty shadow fragment shader)
+const GLchar* depthVertexShaderSource = GLSL_CAMERA(440,
+    layout(location = 0) in vec3 position;
+
+invariant gl_Position;
+
+uniform mat4 model;
+uniform bool isOcean;                   // displaced exactly as in the forward vertex shader
+uniform sampler2D oceanDisplacement;
+uniform float oceanPatchSize;
+
+void main() {
+    vec3 displaced = position;
+    if (isOcean)
+        displaced += textureLod(oceanDisplacement, position.xz / oceanPatchSize, 0.0).xyz;
+    gl_Position = projection * view * model * vec4(displaced, 1.0f);
+}
+);
+
+
+// G-BUFFER FRAGMENT SHADER (deferred path; uses the forward vertex shader)
+const GLchar* gbufferFragmentShaderSource = GLSL_CAMERA(440,
+    in vec2 TexCoords;
+in vec3 WorldPos;
+in float ViewDepth;
+
+layout(location = 0) out vec4 gAlbedoSpecOut;
+layout(location = 1) out vec2 gNormalOut;
+
+uniform sampler2D ourTexture;
+uniform sampler2D rippleTexture;
+uniform bool isPool;
+uniform sampler2D waterTexture;     // --water surface: normal in xyz, height in w
+uniform bool hasWater;
+uniform bool isOcean;
+uniform sampler2D oceanNormals;     // --ocean: unit normal in xyz, Jacobian in w
+uniform bool hasReflection;
+uniform sampler2D reflectionTexture;    // --reflections: the scene mirrored in the pool
+uniform mat4 reflectionViewProjection;
+
+// Octahedral encoding: a unit normal in two channels
+vec2 PackNormal(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signs;
+}
+
+void main() {
+    vec3 norm = vec3(0.0, 1.0, 0.0);
+    float foam = 0.0;
+    if (isOcean) {
+        vec4 ocean = texture(oceanNormals, TexCoords);
+        norm = normalize(ocean.xyz);
+        foam = clamp(1.0 - ocean.w, 0.0, 1.0);
+    }
+    else if (isPool && hasWater)
+        norm = normalize(texture(waterTexture, TexCoords).xyz);
+
+    vec3 albedo;
+    if (isPool) {
+        vec4 poolColor = vec4(0.0, 0.4, 0.7, 1.0);
+        albedo = mix(mix(poolColor, texture(rippleTexture, TexCoords + norm.xz * 0.1), 0.5).rgb, vec3(1.0), foam);
+        if (hasReflection && !isOcean) {
+            // The lighting pass shades it again, so the reflection comes out dimmer than forward
+            vec4 mirrored = reflectionViewProjection * vec4(WorldPos, 1.0);
+            vec2 reflectionUv = mirrored.xy / mirrored.w * 0.5 + 0.5 + norm.xz * 0.05;
+            float fresnel = 0.1 + 0.9 * pow(1.0 - max(dot(normalize(viewPos - WorldPos), norm), 0.0), 5.0);
+            albedo = mix(albedo, texture(reflectionTexture, reflectionUv).rgb, fresnel);
+        }
+    }
+    else {
+        albedo = texture(ourTexture, TexCoords).rgb;
+    }
+
+    gAlbedoSpecOut = vec4(albedo, 1.0);
+    gNormalOut = PackNormal(norm);
+}
+);
+
+
+// REFLECTION FRAGMENT SHADER (--reflections; uses the forward vertex shader). The
+// courtyard light only: no spotlight, clustered lights or shadows.
+const GLchar* reflectionFragmentShaderSource = GLSL(440,
+    in vec2 TexCoords;
+in vec3 WorldPos;
+in float ViewDepth;
+out vec4 fragmentColor;
+
+struct Light {
+    vec3 position;
+    vec3 color;
+    float ambientStrength;
+    float diffuseStrength;
+    float specularStrength;
+};
+
+layout(std140, binding = 1) uniform LightData {
+    Light light;
+};
+
+uniform sampler2D ourTexture;
+
+void main() {
+    // Every surface faces up, as in the forward shader
+    float diff = max(normalize(light.position - WorldPos).y, 0.0);
+    vec3 result = (light.ambientStrength + light.diffuseStrength * diff) * light.color;
+    fragmentColor = vec4(result, 1.0) * texture(ourTexture, TexCoords);
+}
+);
+
+
+// FULLSCREEN VERTEX SHADER (deferred lighting and temporal upscale passes)
+const GLchar* fullscreenVertexShaderSource = GLSL(440,
+    out vec2 ScreenUV;
+
+void main() {
+    // One oversized triangle: (0,0), (2,0), (0,2) in UV space
+    ScreenUV = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(ScreenUV * 2.0 - 1.0, 0.0, 1.0);
+}
+);
+
+
+// TEMPORAL UPSCALE FRAGMENT SHADER (dynamic resolution)
+const GLchar* temporalUpscaleShaderSource = GLSL(440,
+    in vec2 ScreenUV;
+
+layout(location = 0) out vec4 resolved;
+
+uniform sampler2D sceneColor;       // render resolution, jittered
+uniform sampler2D sceneDepth;
+uniform sampler2D history;          // output resolution, unjittered
+uniform mat4 inverseViewProjection; // this frame, unjittered
+uniform mat4 previousViewProjection;
+uniform vec2 jitterUV;
+uniform vec2 sceneTexel;
+uniform vec2 sceneScale;            // the drawn corner of the scene target
+uniform vec2 sceneMaxUV;            // its last texel centre
+uniform float historyWeight;
+
+// Scene UVs span the drawn corner; clamped to it as the edge of a texture would be
+vec2 SceneTexture(vec2 uv) {
+    return min(uv * sceneScale, sceneMaxUV);
+}
+
+void main() {
+    // The jittered scene shows this pixel's surface shifted by the jitter
+    vec2 sceneUV = ScreenUV + jitterUV;
+    vec3 current = texture(sceneColor, SceneTexture(sceneUV)).rgb;
+    vec3 low = current;
+    vec3 high = current;
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x) {
+            vec3 neighbour = texture(sceneColor, SceneTexture(sceneUV + vec2(x, y) * sceneTexel)).rgb;
+            low = min(low, neighbour);
+            high = max(high, neighbour);
+        }
+    }
+
+    // Where the surface was last frame
+    float depth = texture(sceneDepth, SceneTexture(sceneUV)).r;
+    vec4 world = inverseViewProjection * vec4(ScreenUV * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 previous = previousViewProjection * vec4(world.xyz / world.w, 1.0);
+    vec2 historyUV = previous.xy / previous.w * 0.5 + 0.5;
+
+    float weight = historyWeight;
+    if (any(lessThan(historyUV, vec2(0.0))) || any(greaterThan(historyUV, vec2(1.0))))
+        weight = 0.0;
+    vec3 past = clamp(texture(history, historyUV).rgb, low, high);
+    resolved = vec4(mix(current, past, weight), 1.0);
+}
+);
+
+
+// WATER COMPUTE SHADER (--water-gpu; the same rules as WaterSimulation, one pass per dispatch)
+const GLchar* waterComputeShaderSource = GLSL(440,
+    layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(r32f, binding = 0) uniform image2D current;
+layout(r32f, binding = 1) uniform image2D previous;     // overwritten with the next heights
+layout(rgba16f, binding = 2) uniform writeonly image2D surface;
+
+uniform int waterPass;          // 0 disturb, 1 step, 2 surface
+uniform int resolution;
+uniform float damping;
+uniform float cellSize;
+uniform float settleHeight;
+uniform vec4 disturbances[16];  // uv, radius, strength
+uniform int disturbanceCount;
+
+// Still water beyond the edges
+float Height(ivec2 cell) {
+    if (any(lessThan(cell, ivec2(0))) || any(greaterThanEqual(cell, ivec2(resolution))))
+        return 0.0;
+    return imageLoad(current, cell).r;
+}
+
+void main() {
+    ivec2 cell = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(cell, ivec2(resolution))))
+        return;
+
+    if (waterPass == 0) {
+        vec2 centre = vec2(cell) + 0.5;
+        float height = imageLoad(current, cell).r;
+        for (int i = 0; i < disturbanceCount; ++i) {
+            float radius = disturbances[i].z * float(resolution);
+            float distance = length(centre - disturbances[i].xy * float(resolution));
+            if (distance < radius)
+                height += disturbances[i].w * 0.5 * (1.0 + cos(3.14159265 * distance / radius));
+        }
+        imageStore(current, cell, vec4(height));
+    }
+    else if (waterPass == 1) {
+        float sum = Height(cell + ivec2(-1, 0)) + Height(cell + ivec2(1, 0)) + Height(cell + ivec2(0, -1)) + Height(cell + ivec2(0, 1));
+        float height = (sum * 0.5 - imageLoad(previous, cell).r) * damping;
+        imageStore(previous, cell, vec4(abs(height) < settleHeight ? 0.0 : height));
+    }
+    else {
+        vec3 normal = vec3(Height(cell + ivec2(-1, 0)) - Height(cell + ivec2(1, 0)), 2.0 * cellSize,
+            Height(cell + ivec2(0, -1)) - Height(cell + ivec2(0, 1)));
+        imageStore(surface, cell, vec4(normalize(normal), Height(cell)));
+    }
+}
+);
+
+
+// DEFERRED LIGHTING FRAGMENT SHADER
+const GLchar* deferredLightingShaderSource = GLSL_CAMERA(440,
+    in vec2 ScreenUV;
+out vec4 fragmentColor;
+
+struct Light {
+    vec3 position;
+    vec3 color;
+    float ambientStrength;
+    float diffuseStrength;
+    float specularStrength;
+};
+
+struct Spotlight {
+    vec3 position;
+    vec3 direction;
+    vec3 color;
+    float cutOff;
+    float outerCutOff;
+    float ambientStrength;
+    float diffuseStrength;
+    float specularStrength;
+};
+
+layout(std140, binding = 1) uniform LightData {
+    Light light;
+    Spotlight spotlight;
+};
+
+uniform sampler2D gAlbedoSpec;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform vec2 gBufferScale;          // render size over the G-buffer's
+
+vec3 ClusteredLights(vec3 worldPos, float viewDepth, vec3 norm, vec3 viewDir);
+float ShadowVisibility(vec3 worldPos, vec3 norm);
+
+vec3 UnpackNormal(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * signs;
+    }
+    return normalize(n);
+}
+
+void main() {
+    // The scene covers the lower-left corner of the G-buffer when drawn below its size
+    vec2 gBufferUV = ScreenUV * gBufferScale;
+    float depth = texture(gDepth, gBufferUV).r;
+    if (depth >= 1.0)
+        discard;   // nothing was drawn here; keep the clear colour
+
+    vec4 clip = vec4(ScreenUV * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 world = inverseViewProjection * clip;
+    vec3 worldPos = world.xyz / world.w;
+    float viewDepth = -(view * vec4(worldPos, 1.0)).z;
+
+    vec4 albedoSpec = texture(gAlbedoSpec, gBufferUV);
+    vec3 norm = UnpackNormal(texture(gNormal, gBufferUV).rg);
+
+    // Same terms as the forward shader, evaluated once per visible pixel
+    vec3 lightDir = normalize(light.position - worldPos);
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = light.diffuseStrength * diff * light.color;
+
+    vec3 viewDir = normalize(viewPos - worldPos);
+    vec3 reflectDir = reflect(-lightDir, norm);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 128);
+    vec3 specular = albedoSpec.a * light.specularStrength * spec * light.color;
+
+    vec3 ambient = light.ambientStrength * light.color;
+    vec3 result = (ambient + (diffuse + specular) * ShadowVisibility(worldPos, norm));
+
+    vec3 spotlightDir = normalize(spotlight.position - worldPos);
+    float theta = dot(spotlightDir, normalize(-spotlight.direction));
+    float epsilon = spotlight.cutOff - spotlight.outerCutOff;
+    float intensity = clamp((theta - spotlight.outerCutOff) / epsilon, 0.0, 1.0);
+    vec3 spotlightEffect = intensity * (spotlight.ambientStrength * ambient + spotlight.diffuseStrength * diffuse + spotlight.specularStrength * specular) * spotlight.color;
+    result += spotlightEffect * intensity;
+
+    result += ClusteredLights(worldPos, viewDepth, norm, viewDir);
+
+    fragmentColor = vec4(result * albedoSpec.rgb, 1.0);
+}
+);
+
+
 int main(int argc, char* argv[]) {
-    if (!UInitialize(argc, argv, &gWindow))
+    // Command-line benchmarks run without opening a window
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (strcmp(argv[i], "--bench") == 0)
+            return URunBenchmark(argv[i + 1]) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    size_t extraLights = 0;
+    bool comparePaths = false;
+    bool compareSoftware = false;
+    bool singleThread = false;
+    const char* timingsCsv = nullptr;
+    const char* gpuProfileOut = nullptr;
+    const char* cpuTraceOut = nullptr;
+    const char* cameraPathName = nullptr;
+    size_t benchmarkFrames = 0;
+    const char* benchmarkOut = nullptr;
+    const char* captureOut = nullptr;
+    int tiledWidth = 0, tiledHeight = 0, tileSize = 2048;
+    const char* tiledOut = nullptr;
+    ResolutionController::Settings resolutionSettings;
+    WaterSimulation::Settings waterSettings;
+    OceanSpectrum::Settings oceanSettings;
+    ReflectionSchedule::Settings reflectionSettings;
+    float reflectionScale = 0.5f;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+            extraLights = static_cast<size_t>(strtoul(argv[i + 1], NULL, 10));
+        else if (strcmp(argv[i], "--deferred") == 0)
+            gDeferred = true;
+        else if (strcmp(argv[i], "--depth-prepass") == 0)
+            gDepthPrepass = true;
+        else if (strcmp(argv[i], "--front-to-back") == 0)
+            gFrontToBack = true;
+        else if (strcmp(argv[i], "--pipeline-stats") == 0)
+            gPipelineStats = true;
+        else if (strcmp(argv[i], "--compare-paths") == 0)
+            comparePaths = true;
+        else if (strcmp(argv[i], "--software") == 0)
+            gSoftware = true;
+        else if (strcmp(argv[i], "--compare-software") == 0)
+            compareSoftware = true;
+        else if (strcmp(argv[i], "--single-thread") == 0)
+            singleThread = true;
+        else if (strcmp(argv[i], "--vsync") == 0)
+            gFramePacer.SetMode(FramePacer::MODE_VSYNC);
+        else if (strcmp(argv[i], "--uncapped") == 0)
+            gFramePacer.SetMode(FramePacer::MODE_UNCAPPED);
+        else if (strcmp(argv[i], "--fps-limit") == 0 && i + 1 < argc)
+            gFramePacer.SetMode(FramePacer::MODE_LIMITED, atof(argv[i + 1]));
+        else if (strcmp(argv[i], "--low-latency") == 0)
+            gLowLatency = true;
+        else if (strcmp(argv[i], "--timings-csv") == 0 && i + 1 < argc)
+            timingsCsv = argv[i + 1];
+        else if (strcmp(argv[i], "--gpu-profile") == 0 && i + 1 < argc) {
+            gGpuProfile = true;
+            gpuProfileOut = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "--gl-trace") == 0 && i + 1 < argc)
+            gGLTraceFrames = static_cast<size_t>(strtoul(argv[i + 1], NULL, 10));
+        else if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+            gHeadless = true;
+            gHeadlessFrames = static_cast<size_t>(strtoul(argv[i + 1], NULL, 10));
+        }
+        else if (strcmp(argv[i], "--frame-output") == 0 && i + 1 < argc)
+            gFrameOutput = argv[i + 1];
+        else if (strcmp(argv[i], "--cpu-trace") == 0 && i + 1 < argc)
+            cpuTraceOut = argv[i + 1];
+        else if (strcmp(argv[i], "--fixed-frame-time") == 0 && i + 1 < argc)
+            gFrameClock.SetFixedFrameTime(atof(argv[i + 1]) / 1000.0);
+        else if (strcmp(argv[i], "--benchmark") == 0 && i + 3 < argc) {
+            // --benchmark <path file | orbit> <frames> <output.json>
+            cameraPathName = argv[i + 1];
+            benchmarkFrames = static_cast<size_t>(strtoul(argv[i + 2], NULL, 10));
+            benchmarkOut = argv[i + 3];
+        }
+        else if (strcmp(argv[i], "--record-path") == 0 && i + 1 < argc)
+            gRecordPathOut = argv[i + 1];
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            gSceneSeed = static_cast<uint32_t>(strtoul(argv[i + 1], NULL, 10));
+        else if (strcmp(argv[i], "--tiled") == 0 && i + 3 < argc) {
+            // --tiled <width> <height> <output.png>
+            tiledWidth = atoi(argv[i + 1]);
+            tiledHeight = atoi(argv[i + 2]);
+            tiledOut = argv[i + 3];
+        }
+        else if (strcmp(argv[i], "--tile-size") == 0 && i + 1 < argc)
+            tileSize = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            captureOut = argv[i + 1];
+            // "-" streams the video to stdout, so the log moves to stderr
+            if (strcmp(captureOut, "-") == 0)
+                cout.rdbuf(cerr.rdbuf());
+        }
+        else if (strcmp(argv[i], "--dynamic-res") == 0 && i + 1 < argc) {
+            gDynamicResolution = true;
+            resolutionSettings.budgetMs = atof(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "--min-scale") == 0 && i + 1 < argc)
+            resolutionSettings.minScale = static_cast<float>(atof(argv[i + 1]));
+        else if (strcmp(argv[i], "--water") == 0)
+            gWater = true;
+        else if (strcmp(argv[i], "--water-gpu") == 0)
+            gWater = gWaterCompute = true;
+        else if (strcmp(argv[i], "--water-rain") == 0 && i + 1 < argc)
+            waterSettings.dropsPerSecond = static_cast<float>(atof(argv[i + 1]));
+        else if (strcmp(argv[i], "--ocean") == 0 && i + 1 < argc) {
+            gOcean = true;
+            oceanSettings.resolution = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "--reflections") == 0 && i + 1 < argc) {
+            gReflections = true;
+            reflectionSettings.interval = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "--reflection-threshold") == 0 && i + 1 < argc)
+            reflectionSettings.moveThreshold = static_cast<float>(atof(argv[i + 1]));
+        else if (strcmp(argv[i], "--reflection-scale") == 0 && i + 1 < argc)
+            reflectionScale = static_cast<float>(atof(argv[i + 1]));
+        else if (strcmp(argv[i], "--stress") == 0 && i + 1 < argc)
+            gStressSettings.objects = static_cast<size_t>(strtoull(argv[i + 1], NULL, 10));
+        else if (strcmp(argv[i], "--stress-meshes") == 0 && i + 1 < argc)
+            gStressSettings.uniqueMeshes = static_cast<size_t>(strtoul(argv[i + 1], NULL, 10));
+        else if (strcmp(argv[i], "--stress-textures") == 0 && i + 1 < argc)
+            gStressSettings.uniqueTextures = static_cast<size_t>(strtoul(argv[i + 1], NULL, 10));
+        else if (strcmp(argv[i], "--table-segments") == 0 && i + 1 < argc)
+            gTableSegments = min(max(atoi(argv[i + 1]), 1), 100);
+    }
+    gStressSettings.seed = gSceneSeed;
+    gKeepSoftTextures = gSoftware || compareSoftware;
+
+    if (cameraPathName != nullptr) {
+        if (strcmp(cameraPathName, "orbit") == 0)
+            gCameraPath = CameraPath::Orbit();
+        else if (!gCameraPath.Load(cameraPathName))
+            return EXIT_FAILURE;
+        if (benchmarkFrames == 0) {
+            cout << "--benchmark needs a frame count above zero" << endl;
+            return EXIT_FAILURE;
+        }
+
+        // Same simulated time every frame, and each frame's GPU time comes from the profiler's frame scope
+        gBenchmark = true;
+        gBenchmarkFramesLeft = BENCHMARK_WARMUP_FRAMES + benchmarkFrames;
+        gBenchmarkReport.Reserve(benchmarkFrames);
+        gFrameClock.SetFixedFrameTime(BENCHMARK_FRAME_SECONDS);
+        gGpuProfile = true;
+        if (gFramePacer.GetMode() == FramePacer::MODE_VSYNC)
+            gFramePacer.SetMode(FramePacer::MODE_UNCAPPED);
+    }
+
+    if (gReflections && gSoftware) {
+        cout << "--reflections has no effect with --software" << endl;
+        gReflections = false;
+    }
+    if (gReflections && reflectionSettings.interval <= 0) {
+        cout << "--reflections needs an update interval of at least one frame" << endl;
+        return EXIT_FAILURE;
+    }
+
+    if (gDynamicResolution) {
+        if (gSoftware) {
+            cout << "--dynamic-res has no effect with --software" << endl;
+            gDynamicResolution = false;
+        }
+        else if (resolutionSettings.budgetMs <= 0.0) {
+            cout << "--dynamic-res needs a frame budget above zero milliseconds" << endl;
+            return EXIT_FAILURE;
+        }
+        else {
+            // A new scale waits behind the queued packets, then its GPU time behind the profiler
+            resolutionSettings.minScale = max(0.1f, min(resolutionSettings.minScale, resolutionSettings.maxScale));
+            resolutionSettings.latencyFrames = GpuProfiler::FRAME_LATENCY + RenderThread::PACKET_COUNT;
+            gResolutionController.Configure(resolutionSettings);
+            gResolutionScale = gResolutionController.Scale();
+            gGpuProfile = true;
+        }
+    }
+
+    PROFILE_THREAD("main");
+    // Nothing to synchronize to without a display
+    if (gHeadless && gFramePacer.GetMode() == FramePacer::MODE_VSYNC)
+        gFramePacer.SetMode(FramePacer::MODE_UNCAPPED);
+
+    if (gHeadless ? !UInitializeHeadless() : !UInitialize(argc, argv, &gWindow))
         return EXIT_FAILURE;
 
     textureID = loadTexture("brick.jpg");
@@ -174,33 +1156,405 @@ int main(int argc, char* argv[]) {
         return EXIT_FAILURE;
     }
 
-    UCreatePool(gPool);
-    UCreateWalkway(gWalkway);
-    UCreateCube(gTable1);
-    UCreateCube(gTable2);
+    if (gStressSettings.objects > 0)
+        UCreateStressScene();
+    else
+        UCreateScene();
+    if (gOcean) {
+        oceanSettings.seed = gSceneSeed;
+        if (!gOceanSpectrum.Create(oceanSettings)) {
+            cout << "--ocean needs a power of two grid from " << OceanSpectrum::MIN_RESOLUTION << " to "
+                << OceanSpectrum::MAX_RESOLUTION << endl;
+            return EXIT_FAILURE;
+        }
+        UCreateOcean();
+    }
+    UCreateLights(extraLights);
+    if (extraLights > 0)
+        cout << "Created " << extraLights << " clustered lights" << endl;
 
-    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId))
+    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId, lightingLibrarySource))
+        return EXIT_FAILURE;
+    if (!UCreateShaderProgram(vertexShaderSource, gbufferFragmentShaderSource, gGBufferProgramId))
+        return EXIT_FAILURE;
+    if (!UCreateShaderProgram(fullscreenVertexShaderSource, deferredLightingShaderSource, gLightingProgramId, lightingLibrarySource))
+        return EXIT_FAILURE;
+    if (!UCreateShaderProgram(shadowVertexShaderSource, shadowFragmentShaderSource, gShadowProgramId))
         return EXIT_FAILURE;
+    if (!UCreateShaderProgram(depthVertexShaderSource, shadowFragmentShaderSource, gDepthProgramId))
+        return EXIT_FAILURE;
+    if (!gGBuffer.Create(WINDOW_WIDTH, WINDOW_HEIGHT))
+        return EXIT_FAILURE;
+    if (gDynamicResolution) {
+        if (!UCreateShaderProgram(fullscreenVertexShaderSource, temporalUpscaleShaderSource, gUpscaleProgramId))
+            return EXIT_FAILURE;
+        if (!gUpscaler.Create())
+            return EXIT_FAILURE;
+    }
+    if (!gShadowCache.Create(SHADOW_MAP_SIZE))
+        return EXIT_FAILURE;
+    if (!gRingBuffer.Create(RING_REGION_SIZE))
+        return EXIT_FAILURE;
+    if (gWater) {
+        waterSettings.seed = gSceneSeed;
+        waterSettings.simulate = !gWaterCompute;
+        gWaterSimulation.Create(waterSettings);
+        if (gWaterCompute && !UCreateComputeProgram(waterComputeShaderSource, gWaterComputeProgramId))
+            return EXIT_FAILURE;
+        if (!gWaterSurface.Create(gWaterSimulation.Resolution(), gWaterCompute))
+            return EXIT_FAILURE;
+    }
+    if (gOcean && !gOceanSurface.Create(gOceanSpectrum.Resolution(), gOceanSpectrum.GetSettings().patchSize))
+        return EXIT_FAILURE;
+    if (gReflections) {
+        gReflectionSchedule.Configure(reflectionSettings);
+        if (!UCreateShaderProgram(vertexShaderSource, reflectionFragmentShaderSource, gReflectionProgramId))
+            return EXIT_FAILURE;
+        if (!gPlanarReflection.Create(reflectionScale))
+            return EXIT_FAILURE;
+    }
+
+    // A failed check below still runs the shutdown, then exits with this
+    int exitCode = EXIT_SUCCESS;
+
+    // Timed run of both paths at several light counts, then exit
+    if (comparePaths) {
+        UComparePaths();
+        if (gHeadless)
+            gHeadlessFrames = 0;
+        else
+            glfwSetWindowShouldClose(gWindow, true);
+    }
+
+    // Software rasterizer against the GL path, then exit
+    if (compareSoftware) {
+        if (!UCompareSoftware())
+            exitCode = EXIT_FAILURE;
+        if (gHeadless)
+            gHeadlessFrames = 0;
+        else
+            glfwSetWindowShouldClose(gWindow, true);
+    }
+
+    // Offline render of one large image, then exit
+    if (tiledOut != nullptr) {
+        if (tiledWidth <= 0 || tiledHeight <= 0)
+            cout << "--tiled needs a width and height above zero" << endl;
+        else
+            URenderTiled(tiledWidth, tiledHeight, tileSize, tiledOut);
+        if (gHeadless)
+            gHeadlessFrames = 0;
+        else
+            glfwSetWindowShouldClose(gWindow, true);
+    }
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
-    while (!glfwWindowShouldClose(gWindow)) {
+    // Installed after setup so the reports cover frames only
+    if (gGLTraceFrames > 0 && !UInstallGLTrace())
+        cout << "GL trace unavailable: entry points not loaded" << endl;
+
+    // The context can only be current on one thread; the render thread takes it over
+    if (!singleThread)
+        UMakeContextCurrent(false);
+    gCaptureEveryFrame = captureOut != nullptr;
+    gRenderThread.Start(!singleThread,
+        [captureOut, singleThread] {
+            // With --single-thread this runs on the main thread, which keeps its name
+            if (!singleThread)
+                PROFILE_THREAD("render");
+            UMakeContextCurrent(true);
+            if (!gHeadless)
+                glfwSwapInterval(gFramePacer.SwapInterval());
+            gFrameTimeline.Create();
+            if (gGpuProfile)
+                gGpuProfiler.Create();
+            if (gPipelineStats && !gPipelineStatistics.Create())
+                cout << "Pipeline statistics unavailable: ARB_pipeline_statistics_query not supported" << endl;
+
+            int fps = gFramePacer.GetMode() == FramePacer::MODE_LIMITED ? static_cast<int>(gFramePacer.TargetFps() + 0.5) : 60;
+            if (captureOut != nullptr)
+                gCapture.Create(captureOut, fps);
+            else if (!gHeadless)
+                gCapture.Create("screenshot.png", fps);
+        },
+        URender,
+        [] {
+            gCapture.Destroy();
+            gGpuProfiler.Destroy();
+            gPipelineStatistics.Destroy();
+            gFrameTimeline.Destroy();
+            UMakeContextCurrent(false);
+        });
+    cout << "Frame pacing: " << FramePacer::ModeName(gFramePacer.GetMode());
+    if (gFramePacer.GetMode() == FramePacer::MODE_LIMITED)
+        cout << " at " << gFramePacer.TargetFps() << " fps";
+    cout << (gLowLatency ? ", low-latency input" : "") << endl;
+
+    while (gHeadless ? gHeadlessFrames > 0 : !glfwWindowShouldClose(gWindow)) {
+        if (gLowLatency) {
+            // Wait out the frame budget and the previous frame before touching input,
+            // so no queued frame sits between sampling it and presenting it
+            gFramePacer.Wait();
+            gRenderThread.WaitIdle();
+            UPollEvents();
+        }
+
+        FramePacket& packet = gRenderThread.Acquire();
+        int steps = gFrameClock.BeginFrame();
         UProcessInput(gWindow);
-        URender();
-        glfwPollEvents();
+        for (int i = 0; i < steps; ++i)
+            USimulate(gWindow, static_cast<float>(gFrameClock.StepSeconds()));
+        if (steps > 0)
+            UAnimateScene(static_cast<float>(gFrameClock.SimulatedSeconds()));
+        if (gWater)
+            gWaterSimulation.Advance(steps * gFrameClock.StepSeconds());
+        UInterpolateCamera(static_cast<float>(gFrameClock.Alpha()));
+        if (gBenchmark)
+            UFollowCameraPath(static_cast<float>(gFrameClock.SimulatedSeconds()));
+        if (gRecordPathOut != nullptr)
+            URecordCameraKey(static_cast<float>(gFrameClock.SimulatedSeconds()));
+
+        UBuildFramePacket(packet);
+        gRenderThread.Submit();
+        if (gHeadless)
+            --gHeadlessFrames;
+        if (gBenchmark && --gBenchmarkFramesLeft == 0) {
+            if (gHeadless)
+                gHeadlessFrames = 0;
+            else
+                glfwSetWindowShouldClose(gWindow, true);
+        }
+
+        if (!gLowLatency) {
+            UPollEvents();
+            gFramePacer.Wait();
+        }
+    }
+
+    gRenderThread.Stop();
+    UMakeContextCurrent(true);
+
+    RenderThread::Stats renderStats = gRenderThread.GetStats();
+    if (renderStats.frames > 0) {
+        // Overlap is the share of the shorter stage that ran while the other stage was busy
+        double overlapPercent = 100.0 * renderStats.overlapMs / max(1e-6, min(renderStats.buildMs, renderStats.renderMs));
+        cout << (gRenderThread.Threaded() ? "Render thread: " : "Single thread: ") << renderStats.frames << " frames, main "
+            << fixed << setprecision(2) << renderStats.buildMs / renderStats.frames << " ms/frame, render "
+            << renderStats.renderMs / renderStats.frames << " ms/frame, overlap " << renderStats.overlapMs << " ms ("
+            << setprecision(1) << overlapPercent << "%)" << endl;
+        cout << "Input to present latency: avg " << setprecision(2) << renderStats.averageLatencyMs << " ms, max "
+            << renderStats.maxLatencyMs << " ms, of which queued " << renderStats.averageQueueMs << " ms" << endl;
+    }
+
+    const FrameCapture::Stats& captureStats = gCapture.GetStats();
+    if (captureStats.captured > 0 || captureStats.dropped > 0) {
+        cout << "Capture: " << captureStats.captured << " frames read back, " << captureStats.written << " written, "
+            << captureStats.dropped << " dropped, " << captureStats.fenceWaits << " fence waits; render thread "
+            << fixed << setprecision(3) << captureStats.captureMs / max<size_t>(captureStats.captured + captureStats.dropped, 1)
+            << " ms/frame (max " << captureStats.maxCaptureMs << "), writer " << setprecision(2)
+            << captureStats.writeMs / max<size_t>(captureStats.written, 1) << " ms/frame" << endl;
+    }
+
+    FrameTimeline::Summary timeline = gFrameTimeline.Summarize();
+    if (timeline.frames > 0) {
+        cout << "Frame timeline over " << timeline.frames << " frames, from frame start: submit " << fixed << setprecision(2)
+            << timeline.averageSubmitMs << " ms, swap " << timeline.averageSwapMs << " ms, GPU complete "
+            << timeline.averageGpuCompleteMs << " ms (p99 " << timeline.p99GpuCompleteMs << " ms), "
+            << timeline.queryStalls << " query stalls" << endl;
+    }
+    if (timingsCsv != nullptr && !gFrameTimeline.WriteCsv(timingsCsv))
+        cout << "Failed to write frame timings to " << timingsCsv << endl;
+
+    if (cpuTraceOut != nullptr) {
+#ifdef ENABLE_PROFILING
+        if (UWriteChromeTrace(cpuTraceOut))
+            cout << "CPU trace: " << UProfilerZoneCount() << " zones written to " << cpuTraceOut << " ("
+                << UProfilerZonesDropped() << " overwritten)" << endl;
+        else
+            cout << "Failed to write the CPU trace to " << cpuTraceOut << endl;
+#else
+        cout << "CPU profiling zones are compiled out; rebuild with ENABLE_PROFILING defined for --cpu-trace" << endl;
+#endif
+    }
+
+    if (gpuProfileOut != nullptr) {
+        cout << "GPU time over the last " << GpuProfiler::HISTORY_SIZE << " frames (" << gGpuProfiler.FramesResolved()
+            << " frames read back, " << gGpuProfiler.FramesDropped() << " dropped):" << endl;
+        cout << "  " << left << setw(10) << "scope" << right << setw(10) << "min" << setw(10) << "avg" << setw(10) << "p99"
+            << setw(10) << "max" << " (ms)" << endl;
+        for (const GpuProfiler::ScopeStats& scope : gGpuProfiler.GetStats()) {
+            cout << "  " << left << setw(10) << scope.name << right << fixed << setprecision(3) << setw(10) << scope.minMs
+                << setw(10) << scope.averageMs << setw(10) << scope.p99Ms << setw(10) << scope.maxMs << endl;
+        }
+
+        string base(gpuProfileOut);
+        if (!gGpuProfiler.WriteCsv((base + ".csv").c_str()) || !gGpuProfiler.WriteJson((base + ".json").c_str()))
+            cout << "Failed to write the GPU profile to " << base << ".csv/.json" << endl;
+    }
+
+    if (gPipelineStatistics.FramesResolved() > 0) {
+        cout << "Pipeline statistics over " << gPipelineStatistics.FramesResolved() << " frames ("
+            << gPipelineStatistics.FramesDropped() << " dropped):" << endl;
+        cout << "  " << left << setw(10) << "pass" << right << setw(16) << "vertices/frame" << setw(18)
+            << "fragments/frame" << setw(18) << "fragments/pixel" << setw(16) << "samples/pixel" << endl;
+        for (const PipelineStatistics::PassStats& pass : gPipelineStatistics.GetStats()) {
+            cout << "  " << left << setw(10) << pass.name << right << fixed << setprecision(0) << setw(16)
+                << pass.vertexInvocations << setw(18) << pass.fragmentInvocations << setprecision(3) << setw(18)
+                << pass.fragmentsPerPixel << setw(16) << pass.samplesPerPixel << endl;
+        }
+    }
+
+    if (gDynamicResolution) {
+        ResolutionController::Stats resolution = gResolutionController.GetStats();
+        cout << "Dynamic resolution: budget " << fixed << setprecision(2) << gResolutionController.GetSettings().budgetMs
+            << " ms, scale avg " << resolution.averageScale << " (min " << resolution.minScale << ", max "
+            << resolution.maxScale << "), " << resolution.changes << " changes; GPU frame avg " << resolution.averageGpuMs
+            << " ms, max " << resolution.maxGpuMs << " ms, " << resolution.samplesOverBudget << " of "
+            << resolution.samples << " frames over budget" << endl;
+    }
+
+    if (gBenchmark) {
+        BenchmarkReport::Settings settings;
+        settings.cameraPath = cameraPathName;
+        settings.warmupFrames = BENCHMARK_WARMUP_FRAMES;
+        settings.seed = gSceneSeed;
+        settings.width = gFramebufferWidth;
+        settings.height = gFramebufferHeight;
+        settings.deferred = gDeferred;
+        settings.threaded = gRenderThread.Threaded();
+        settings.fixedFrameMs = BENCHMARK_FRAME_SECONDS * 1000.0;
+
+        BenchmarkReport::Distribution gpu = gBenchmarkReport.GpuTimes();
+        BenchmarkReport::Distribution frameTimes = gBenchmarkReport.FrameTimes();
+        cout << "Benchmark over " << gBenchmarkReport.FrameCount() << " frames: p50 " << fixed << setprecision(2)
+            << frameTimes.p50Ms << " ms, p90 " << frameTimes.p90Ms << " ms, p99 " << frameTimes.p99Ms << " ms, max "
+            << frameTimes.maxMs << " ms, GPU p50 " << gpu.p50Ms << " ms" << endl;
+        if (gBenchmarkReport.GpuOverflowFrames() > 0)
+            cout << "GPU times left out for " << gBenchmarkReport.GpuOverflowFrames() << " frames that needed more than "
+                << GpuProfiler::MAX_SCOPES_PER_FRAME << " profiler scopes" << endl;
+        if (!gBenchmarkReport.WriteJson(benchmarkOut, settings))
+            cout << "Failed to write the benchmark report to " << benchmarkOut << endl;
+    }
+
+    if (gRecordPathOut != nullptr) {
+        if (gRecordedPath.KeyCount() >= 2 && gRecordedPath.Save(gRecordPathOut))
+            cout << "Recorded " << gRecordedPath.KeyCount() << " camera keys to " << gRecordPathOut << endl;
+        else
+            cout << "Failed to record a camera path to " << gRecordPathOut << endl;
+    }
+
+    if (gWater) {
+        const WaterSimulation::Stats& water = gWaterSimulation.GetStats();
+        const WaterSurface::Stats& surface = gWaterSurface.GetStats();
+        cout << "Water: " << water.steps << " steps at " << fixed << setprecision(0)
+            << 1.0 / gWaterSimulation.GetSettings().stepSeconds << " Hz, " << water.disturbances << " disturbances; ";
+        if (gWaterCompute) {
+            cout << "GPU " << setprecision(3) << surface.gpuMs / max<size_t>(surface.timedSteps, 1) << " ms/step over "
+                << surface.timedSteps << " timed steps" << endl;
+        }
+        else {
+            cout << "CPU " << setprecision(3) << water.stepMs / max<size_t>(water.steps, 1) << " ms/step (max "
+                << water.maxStepMs << "), " << surface.uploads << " uploads of " << surface.texelsUploaded / max<size_t>(surface.uploads, 1)
+                << " texels on average" << endl;
+        }
+    }
+
+    if (gOcean) {
+        const OceanSpectrum::Stats& ocean = gOceanSpectrum.GetStats();
+        const OceanSurface::Stats& upload = gOceanSurface.GetStats();
+        double updates = static_cast<double>(max<size_t>(ocean.updates, 1));
+        cout << "Ocean: " << ocean.updates << " updates of a " << gOceanSpectrum.Resolution() << "^2 grid, "
+            << setprecision(2) << (ocean.spectrumMs + ocean.fftMs + ocean.assembleMs) / updates << " ms on average (spectrum "
+            << ocean.spectrumMs / updates << ", FFT " << ocean.fftMs / updates << ", maps " << ocean.assembleMs / updates
+            << "; max " << ocean.maxUpdateMs << "); " << upload.uploads << " uploads at "
+            << upload.uploadMs / max<size_t>(upload.uploads, 1) << " ms, " << upload.fenceWaits << " fence waits ("
+            << upload.fenceWaitMs << " ms)" << endl;
     }
 
-    UDestroyMesh(gPool);
-    UDestroyMesh(gWalkway);
+    if (gReflections) {
+        const ReflectionSchedule::Stats& schedule = gReflectionSchedule.GetStats();
+        const PlanarReflection::Stats& reflection = gPlanarReflection.GetStats();
+        double gpuPerRender = reflection.gpuMs / max<size_t>(reflection.timedRenders, 1);
+        cout << "Reflections: " << reflection.renders << " renders over " << schedule.frames << " frames with a pool in view ("
+            << schedule.intervalUpdates << " on the " << gReflectionSchedule.GetSettings().interval << "-frame interval, "
+            << schedule.motionUpdates << " after camera motion) into " << gPlanarReflection.Width() << "x" << gPlanarReflection.Height()
+            << "; GPU " << setprecision(3) << gpuPerRender << " ms per render, "
+            << gpuPerRender * reflection.renders / max<size_t>(schedule.frames, 1) << " ms per frame; CPU "
+            << reflection.cpuMs / max<size_t>(reflection.renders, 1) << " ms per render" << endl;
+    }
+
+    if (gDetailTrianglesFull > 0) {
+        cout << "Detail: " << gDetailTrianglesDrawn / max<size_t>(gDetailFrames, 1) << " of "
+            << gDetailTrianglesFull / max<size_t>(gDetailFrames, 1) << " triangles per frame drawn from meshes with LOD chains ("
+            << setprecision(1) << 100.0 * gDetailTrianglesDrawn / gDetailTrianglesFull << "%)" << endl;
+    }
+
+    if (gTransformFrames > 0) {
+        cout << "Transforms: " << gTransformNodesUpdated << " node updates over " << gTransformFrames << " frames (of "
+            << gSceneGraph.GetStats().nodeCount << " nodes; at most " << gTransformMaxNodes << " in a frame, "
+            << gTransformMaxLevels << " levels in parallel)" << endl;
+    }
+
+    const FramePacer::Stats& pacerStats = gFramePacer.GetStats();
+    if (pacerStats.waits > 0) {
+        cout << "Frame limiter: slept " << setprecision(1) << pacerStats.sleptMs << " ms, spun " << pacerStats.spunMs
+            << " ms, " << pacerStats.missedDeadlines << " late frames, worst overshoot " << pacerStats.maxOvershootUs << " us" << endl;
+    }
+
+    FrameClock::FrameStats frameStats = gFrameClock.ComputeStats();
+    if (frameStats.frames > 0) {
+        cout << "Frame time over the last " << frameStats.frames << " frames: avg " << fixed << setprecision(2)
+            << frameStats.averageMs << " ms, min " << frameStats.minMs << " ms, p99 " << frameStats.p99Ms
+            << " ms, max " << frameStats.maxMs << " ms (" << gFrameClock.SimulatedSeconds() << " s simulated)" << endl;
+    }
+
+    for (GLMesh& mesh : gMeshes)
+        UDestroyMesh(mesh);
+    if (gSoftwareFramebuffer != 0) {
+        glDeleteFramebuffers(1, &gSoftwareFramebuffer);
+        glDeleteTextures(1, &gSoftwareTexture);
+    }
+    gLightGrid.Destroy();
+    gGBuffer.Destroy();
+    gUpscaler.Destroy();
+    gWaterSurface.Destroy();
+    gOceanSurface.Destroy();
+    gPlanarReflection.Destroy();
+
+    const ShadowCache::Stats& shadowStats = gShadowCache.GetStats();
+    cout << "Shadow cache: " << shadowStats.cacheHits << " hits, " << shadowStats.staticRenders << " static renders, "
+        << shadowStats.dynamicComposites << " dynamic composites over " << shadowStats.frames << " frames" << endl;
+    gShadowCache.Destroy();
+
+    const PersistentRingBuffer::Stats& ringStats = gRingBuffer.GetStats();
+    cout << "Ring buffer: " << ringStats.frames << " frames, " << ringStats.fenceWaits << " fence waits ("
+        << setprecision(2) << ringStats.fenceWaitMs << " ms), peak " << ringStats.peakFrameBytes << " bytes per frame" << endl;
+    gRingBuffer.Destroy();
+    UDestroyShaderProgram(gShadowProgramId);
+    UDestroyShaderProgram(gDepthProgramId);
     UDestroyShaderProgram(gProgramId);
-    UDestroyMesh(gTable1);
-    UDestroyMesh(gTable2);
+    UDestroyShaderProgram(gGBufferProgramId);
+    UDestroyShaderProgram(gLightingProgramId);
+    if (gUpscaleProgramId != 0)
+        UDestroyShaderProgram(gUpscaleProgramId);
+    if (gWaterComputeProgramId != 0)
+        UDestroyShaderProgram(gWaterComputeProgramId);
+    if (gReflectionProgramId != 0)
+        UDestroyShaderProgram(gReflectionProgramId);
+    if (gHeadless) {
+        if (gFrameOutput != nullptr)
+            cout << "Wrote " << gFramesPresented << " frames to " << gFrameOutput << "*.png" << endl;
+        gHeadlessContext.Destroy();
+    }
+    UShutdownParallel();
 
 
-    exit(EXIT_SUCCESS);
+    exit(exitCode);
 }
 
 GLuint loadTexture(const char* texImagePath) {
+    PROFILE_FUNCTION();
     GLuint textureId;
     int imgWidth, imgHeight, imgChannels;
     stbi_set_flip_vertically_on_load(true);
@@ -210,6 +1564,8 @@ GLuint loadTexture(const char* texImagePath) {
         glBindTexture(GL_TEXTURE_2D, textureId);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, imgWidth, imgHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, img);
         glGenerateMipmap(GL_TEXTURE_2D);
+        if (gKeepSoftTextures)
+            gSoftTextures[textureId].Create(img, imgWidth, imgHeight, imgChannels);
 
         // Set the texture wrapping/filtering options
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -230,6 +1586,47 @@ GLuint loadTexture(const char* texImagePath) {
     return textureId;
 }
 
+// Loads an image once and uploads it count times, every copy after the first tinted a
+// different colour, so stress scenes can use many distinct textures from one file
+std::vector<GLuint> ULoadTextureVariants(const char* texImagePath, size_t count) {
+    PROFILE_FUNCTION();
+    std::vector<GLuint> textures;
+    int imgWidth, imgHeight, imgChannels;
+    stbi_set_flip_vertically_on_load(true);
+    unsigned char* img = stbi_load(texImagePath, &imgWidth, &imgHeight, &imgChannels, 3);
+    if (!img) {
+        std::cout << "Texture failed to load at path: " << texImagePath << std::endl;
+        return textures;
+    }
+
+    const size_t pixelBytes = static_cast<size_t>(imgWidth) * imgHeight * 3;
+    std::vector<unsigned char> tinted(pixelBytes);
+    for (size_t variant = 0; variant < max(count, size_t(1)); ++variant) {
+        // Hues a golden-ratio step apart stay distinct however many there are
+        float hue = fmod(0.618034f * variant, 1.0f) * 6.0f;
+        glm::vec3 tint = variant == 0 ? glm::vec3(1.0f)
+            : glm::vec3(0.6f) + 0.4f * glm::clamp(glm::vec3(fabs(hue - 3.0f) - 1.0f, 2.0f - fabs(hue - 2.0f),
+                2.0f - fabs(hue - 4.0f)), 0.0f, 1.0f);
+        for (size_t i = 0; i < pixelBytes; ++i)
+            tinted[i] = static_cast<unsigned char>(img[i] * tint[static_cast<int>(i % 3)]);
+
+        GLuint textureId;
+        glGenTextures(1, &textureId);
+        glBindTexture(GL_TEXTURE_2D, textureId);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, imgWidth, imgHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, tinted.data());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        if (gKeepSoftTextures)
+            gSoftTextures[textureId].Create(tinted.data(), imgWidth, imgHeight, 3);
+        textures.push_back(textureId);
+    }
+    stbi_image_free(img);
+    return textures;
+}
+
 
 
 // Initialize GLFW, GLEW, and create a window
@@ -241,6 +1638,9 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    // Benchmarks keep one resolution for the whole run
+    if (gBenchmark)
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
 
 
 #ifdef __APPLE__
@@ -282,44 +1682,196 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
     return true;
 }
 
+// Creates a context with no window and an offscreen framebuffer the size the window would be
+bool UInitializeHeadless()
+{
+    if (!gHeadlessContext.Create())
+        return false;
 
-void UProcessInput(GLFWwindow* window)
+    glewExperimental = GL_TRUE;
+    GLenum GlewInitResult = glewInit();
+    if (GLEW_OK != GlewInitResult)
+    {
+        std::cerr << glewGetErrorString(GlewInitResult) << std::endl;
+        return false;
+    }
+
+    if (!gHeadlessContext.CreateFramebuffer(WINDOW_WIDTH, WINDOW_HEIGHT))
+        return false;
+    gOutputFramebuffer = gHeadlessContext.Framebuffer();
+    // A context made current without a surface starts with an empty viewport
+    glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << " (headless, " << WINDOW_WIDTH << "x" << WINDOW_HEIGHT << ")" << endl;
+    return true;
+}
+
+// Binds the context to the calling thread, or releases it
+void UMakeContextCurrent(bool current)
 {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
+    if (gHeadless) {
+        if (current)
+            gHeadlessContext.MakeCurrent();
+        else
+            gHeadlessContext.ReleaseCurrent();
+    }
+    else {
+        glfwMakeContextCurrent(current ? gWindow : NULL);
+    }
+}
+
+void UPollEvents()
+{
+    if (!gHeadless)
+        glfwPollEvents();
+}
+
+// Shows the finished frame. Headless frames are written out when --frame-output is set.
+void UPresent()
+{
+    if (!gHeadless) {
+        glfwSwapBuffers(gWindow);
+        return;
+    }
+
+    if (gFrameOutput != nullptr) {
+        static std::vector<uint8_t> pixels;
+        gHeadlessContext.ReadPixels(pixels);
+
+        ostringstream path;
+        path << gFrameOutput << setw(4) << setfill('0') << gFramesPresented << ".png";
+        if (!UWritePng(path.str().c_str(), gHeadlessContext.Width(), gHeadlessContext.Height(), 3, pixels.data(),
+            gHeadlessContext.Width() * 3))
+            cout << "Failed to write " << path.str() << endl;
+    }
+    else {
+        glFlush();
+    }
+    ++gFramesPresented;
+}
+
+
+// Advances the camera by one fixed step of dt seconds from the held keys
+void USimulate(GLFWwindow* window, float dt)
+{
+    PROFILE_FUNCTION();
+    previousCameraPosition = cameraPosition;
+    previousYaw = yaw;
+
+    // Headless runs have no keyboard; the camera holds still
+    if (window == nullptr)
+        return;
 
     // Camera Movement
+    float distance = cameraSpeed * dt;
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        cameraPosition += cameraSpeed * cameraFront;
+        cameraPosition += distance * cameraFront;
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        cameraPosition -= cameraSpeed * cameraFront;
+        cameraPosition -= distance * cameraFront;
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        cameraPosition -= glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
+        cameraPosition -= glm::normalize(glm::cross(cameraFront, cameraUp)) * distance;
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        cameraPosition += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
+        cameraPosition += glm::normalize(glm::cross(cameraFront, cameraUp)) * distance;
     if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-        cameraPosition += cameraSpeed * cameraUp;
+        cameraPosition += distance * cameraUp;
     if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-        cameraPosition -= cameraSpeed * cameraUp;
+        cameraPosition -= distance * cameraUp;
 
     // Camera Rotation
-    float rotationSpeed = 1.0f;
     if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
-        yaw += rotationSpeed;
+        yaw += rotationSpeed * dt;
     if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
-        yaw -= rotationSpeed;
+        yaw -= rotationSpeed * dt;
+
+    cameraFront = UFrontFromAngles(yaw, pitch);
+}
+
+// Blends the last two simulated camera states; alpha is in [0, 1)
+void UInterpolateCamera(float alpha)
+{
+    renderCameraPosition = glm::mix(previousCameraPosition, cameraPosition, alpha);
+    renderCameraFront = UFrontFromAngles(previousYaw + (yaw - previousYaw) * alpha, pitch);
+}
+
+// Puts the camera where the benchmark path is at the given simulated time, overriding
+// anything the keys or mouse did this frame
+void UFollowCameraPath(float time)
+{
+    CameraPath::Key key = gCameraPath.Evaluate(time);
+    cameraPosition = previousCameraPosition = renderCameraPosition = key.position;
+    yaw = previousYaw = key.yaw;
+    pitch = key.pitch;
+    cameraFront = renderCameraFront = UFrontFromAngles(yaw, pitch);
+}
+
+// Moves the scene's animated nodes to where they are at the given simulated time. The
+// float circles the pool, spinning and bobbing through the water surface at y = -0.5.
+void UAnimateScene(float time)
+{
+    if (gFloatNode == SceneGraph::kNoParent)
+        return;
+    glm::vec3 position(0.55f * cos(0.8f * time), -0.5f + 0.15f * sin(2.3f * time), 0.55f * sin(0.8f * time));
+    glm::mat4 local = glm::translate(position);
+    local = glm::rotate(local, 1.5f * time, glm::vec3(0.0f, 1.0f, 0.0f));
+    gSceneGraph.SetLocal(gFloatNode, glm::scale(local, glm::vec3(0.15f, 0.15f, 0.15f)));
+}
+
+// Appends the simulated camera to the recorded path every RECORD_KEY_SECONDS
+void URecordCameraKey(float time)
+{
+    if (gRecordedPath.KeyCount() > 0 && time - gRecordedPath.LastKey().time < RECORD_KEY_SECONDS)
+        return;
+    CameraPath::Key key = { time, cameraPosition, yaw, pitch };
+    gRecordedPath.AddKey(key);
+}
 
-    // Update camera direction based on updated yaw
+glm::vec3 UFrontFromAngles(float yawDegrees, float pitchDegrees)
+{
     glm::vec3 front;
-    front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
-    front.y = sin(glm::radians(pitch));
-    front.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
-    cameraFront = glm::normalize(front);
+    front.x = cos(glm::radians(yawDegrees)) * cos(glm::radians(pitchDegrees));
+    front.y = sin(glm::radians(pitchDegrees));
+    front.z = sin(glm::radians(yawDegrees)) * cos(glm::radians(pitchDegrees));
+    return glm::normalize(front);
+}
+
+// Per-frame input: quitting and mode toggles. Movement is applied by USimulate.
+void UProcessInput(GLFWwindow* window)
+{
+    PROFILE_FUNCTION();
+    if (window == nullptr)
+        return;
+
+    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+        glfwSetWindowShouldClose(window, true);
 
     // Toggle projection mode when 'P' is pressed
     if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) {
         isPerspective = !isPerspective;
     }
+
+    // Switch between forward and deferred shading on each press of 'G'
+    static bool deferredKeyDown = false;
+    bool deferredKey = glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+    if (deferredKey && !deferredKeyDown) {
+        gDeferred = !gDeferred;
+        cout << (gDeferred ? "Deferred" : "Forward") << " shading" << endl;
+    }
+    deferredKeyDown = deferredKey;
+
+    // Depth pre-pass on and off with 'Z'
+    static bool prepassKeyDown = false;
+    bool prepassKey = glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS;
+    if (prepassKey && !prepassKeyDown) {
+        gDepthPrepass = !gDepthPrepass;
+        cout << "Depth pre-pass " << (gDepthPrepass ? "on" : "off") << endl;
+    }
+    prepassKeyDown = prepassKey;
+
+    static bool screenshotKeyDown = false;
+    bool screenshotKey = glfwGetKey(window, GLFW_KEY_F12) == GLFW_PRESS;
+    if (screenshotKey && !screenshotKeyDown)
+        gScreenshotRequested = true;
+    screenshotKeyDown = screenshotKey;
 }
 
 
@@ -342,7 +1894,9 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
     xoffset *= sensitivity;
     yoffset *= sensitivity;
 
+    // Mouse look applies immediately; shifting the previous step too keeps interpolation from lagging it
     yaw += xoffset;
+    previousYaw += xoffset;
     pitch += yoffset;
 
     if (pitch > 89.0f)
@@ -350,37 +1904,35 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
     if (pitch < -89.0f)
         pitch = -89.0f;
 
-    glm::vec3 front;
-    front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
-    front.y = sin(glm::radians(pitch));
-    front.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
-    cameraFront = glm::normalize(front);
+    cameraFront = UFrontFromAngles(yaw, pitch);
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
-    cameraSpeed += static_cast<float>(yoffset) * 0.01f;
-    if (cameraSpeed < 0.01f)
-        cameraSpeed = 0.01f;
+    cameraSpeed += static_cast<float>(yoffset) * 0.6f;
+    if (cameraSpeed < 0.6f)
+        cameraSpeed = 0.6f;
 }
 
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
+// Runs on the main thread, which no longer owns the context; the render thread picks
+// the new size up from the next frame packet.
 void UResizeWindow(GLFWwindow* window, int width, int height)
 {
-    glViewport(0, 0, width, height);
+    gFramebufferWidth = width;
+    gFramebufferHeight = height;
 }
 
 
-void URender() {
-    glEnable(GL_DEPTH_TEST);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    glm::mat4 model;
-    glm::mat4 view = glm::lookAt(cameraPosition, cameraPosition + cameraFront, cameraUp);
+// Main thread: advances the scene, culls it for the interpolated camera and copies
+// everything the render thread needs into the packet
+void UBuildFramePacket(FramePacket& packet) {
+    PROFILE_FUNCTION();
+    glm::mat4 view = glm::lookAt(renderCameraPosition, renderCameraPosition + renderCameraFront, cameraUp);
     // glm::mat4 projection = glm::perspective(glm::radians(55.0f), (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT, 0.1f, 200.0f);
     glm::mat4 projection;
     if (isPerspective) {
-        projection = glm::perspective(glm::radians(55.0f), (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT, 0.1f, 200.0f);
+        projection = glm::perspective(glm::radians(55.0f), gProjectionAspect, 0.1f, 200.0f);
     }
     else {
         // Set the orthographic projection parameters
@@ -390,114 +1942,1148 @@ void URender() {
         projection = glm::ortho(-orthoWidth / 2, orthoWidth / 2, -orthoHeight / 2, orthoHeight / 2, 0.1f, 200.0f);
     }
 
-    // Use the projection matrix in shader
-    GLint projLoc = glGetUniformLocation(gProgramId, "projection");
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    // Recompute world matrices for anything that moved since the last frame
+    gSceneGraph.Update();
+    const SceneGraph::Stats& graphStats = gSceneGraph.GetStats();
+    if (graphStats.nodesUpdated > 0) {
+        ++gTransformFrames;
+        gTransformNodesUpdated += graphStats.nodesUpdated;
+        gTransformMaxNodes = max(gTransformMaxNodes, graphStats.nodesUpdated);
+        gTransformMaxLevels = max(gTransformMaxLevels, graphStats.levelsParallel);
+    }
+    USyncEntityTransforms();
+
+    // Changes to the water since the last packet; disturbances found now apply next step
+    if (gWater) {
+        UDisturbWater();
+        packet.waterRect = gWaterSimulation.TakeDirty(packet.waterTexels);
+        packet.waterSteps = gWaterSimulation.TakeSteps(packet.waterDisturbances);
+    }
+
+    // The sea at this frame's simulated time, in a map set no queued packet still shows
+    packet.oceanMaps.reset();
+    if (gOcean) {
+        std::shared_ptr<OceanSpectrum::Maps> maps;
+        for (const std::shared_ptr<OceanSpectrum::Maps>& candidate : gOceanMaps) {
+            if (candidate.use_count() == 1) {
+                maps = candidate;
+                break;
+            }
+        }
+        if (!maps) {
+            maps = std::make_shared<OceanSpectrum::Maps>();
+            gOceanMaps.push_back(maps);
+        }
+        gOceanSpectrum.Update(gFrameClock.SimulatedSeconds(), *maps);
+        packet.oceanMaps = maps;
+    }
+
+    // Culling pass; survivors come back grouped by material and mesh
+    UCullEntities(gEntities, Frustum::FromMatrix(projection * view), renderCameraPosition, gVisible);
+
+    // Culled with the plain projection; the jitter moves the image by under a pixel
+    packet.renderWidth = 0;
+    packet.renderHeight = 0;
+    packet.jitter = glm::vec2(0.0f);
+    if (gDynamicResolution && gFramebufferWidth > 0 && gFramebufferHeight > 0) {
+        float scale = gResolutionScale;
+        packet.renderWidth = max(1, static_cast<int>(gFramebufferWidth * scale + 0.5f));
+        packet.renderHeight = max(1, static_cast<int>(gFramebufferHeight * scale + 0.5f));
+        packet.jitter = TemporalUpscaler::Jitter(packet.frame);
+        projection = TemporalUpscaler::JitterProjection(projection, packet.jitter, packet.renderWidth, packet.renderHeight);
+    }
+
+    packet.view = view;
+    packet.projection = projection;
+    packet.cameraPosition = renderCameraPosition;
+    packet.cameraFront = renderCameraFront;
+    packet.framebufferWidth = gFramebufferWidth;
+    packet.framebufferHeight = gFramebufferHeight;
+    packet.deferred = gDeferred;
+    packet.depthPrepass = gDepthPrepass;
+    packet.capture = gCaptureEveryFrame || gScreenshotRequested;
+    gScreenshotRequested = false;
+    packet.staticShadowVersion = gStaticShadowVersion;
+    packet.lights = gLights;
+
+    // Nearest first, by bounding-sphere centre; equal distances keep the material order
+    if (gFrontToBack) {
+        std::stable_sort(gVisible.begin(), gVisible.end(), [](const DrawItem& a, const DrawItem& b) {
+            return a.viewDepth < b.viewDepth;
+        });
+    }
+
+    // Matrices are copied; the entity store keeps changing while the packet is drawn.
+    // Meshes with detail get a level from their error in pixels, and at full detail drop
+    // the meshlets outside the frustum or facing away. Perspective only: an orthographic
+    // view's error does not shrink with distance.
+    packet.draws.clear();
+    packet.meshletCounts.clear();
+    packet.meshletOffsets.clear();
+    packet.triangles = 0;
+    const float lodProjectionScale = 0.5f * gFramebufferHeight * projection[1][1];    // pixels per world unit at distance 1
+    const glm::mat4 viewProjection = projection * view;
+    for (const DrawItem& item : gVisible) {
+        const GLMesh& mesh = gMeshes[item.mesh];
+        FramePacket::Draw draw = { *item.model, item.mesh, item.material, 0, FramePacket::ALL_MESHLETS, 0 };
+        size_t triangles = mesh.nIndices / 3;
+        if (isPerspective && mesh.lods.size() > 1) {
+            LodState unused;
+            LodState& state = item.lodState != nullptr ? *item.lodState : unused;
+            draw.lod = USelectLod(mesh.lods, UMaxAxisScale(*item.model), item.viewDepth, lodProjectionScale, state);
+            triangles = mesh.lods[draw.lod].indexCount / 3;
+        }
+        if (isPerspective && draw.lod == 0 && !mesh.meshlets.empty()) {
+            UCullMeshlets(mesh.meshlets, viewProjection, *item.model, renderCameraPosition, gMeshletScratch, sizeof(GLushort));
+            draw.firstMeshletRange = static_cast<uint32_t>(packet.meshletCounts.size());
+            draw.meshletRanges = static_cast<uint32_t>(gMeshletScratch.counts.size());
+            packet.meshletCounts.insert(packet.meshletCounts.end(), gMeshletScratch.counts.begin(), gMeshletScratch.counts.end());
+            packet.meshletOffsets.insert(packet.meshletOffsets.end(), gMeshletScratch.offsets.begin(), gMeshletScratch.offsets.end());
+            triangles = gMeshletScratch.trianglesVisible;
+        }
+        if (!mesh.lods.empty()) {
+            gDetailTrianglesFull += mesh.nIndices / 3;
+            gDetailTrianglesDrawn += triangles;
+        }
+        packet.triangles += triangles;
+        packet.draws.push_back(draw);
+    }
+    ++gDetailFrames;
+
+    // Mirror in the first visible pool's surface while the camera is above it. The plane's
+    // clip-space twin becomes the mirrored camera's near plane.
+    packet.reflection = false;
+    packet.reflectionUpdate = false;
+    if (gReflections) {
+        for (const DrawItem& item : gVisible) {
+            const Material& material = gMaterials[item.material];
+            if (!material.isPool || material.isOcean)
+                continue;
+            glm::vec3 normal = glm::normalize(glm::vec3(glm::transpose(glm::inverse(*item.model)) * glm::vec4(0.0f, 1.0f, 0.0f, 0.0f)));
+            glm::vec4 plane(normal, -glm::dot(normal, glm::vec3((*item.model)[3])));
+            if (glm::dot(normal, renderCameraPosition) + plane.w <= 0.0f)
+                break;
+
+            packet.reflection = true;
+            packet.reflectionView = PlanarReflection::MirrorView(view, plane);
+            glm::vec4 clipPlane = glm::transpose(glm::inverse(packet.reflectionView)) * plane;
+            packet.reflectionProjection = PlanarReflection::ObliqueProjection(projection, clipPlane);
+            packet.reflectionUpdate = gReflectionSchedule.ShouldUpdate(renderCameraPosition, renderCameraFront);
+            packet.reflectionWidth = gFramebufferWidth;
+            packet.reflectionHeight = gFramebufferHeight;
+            break;
+        }
+    }
+
+    packet.depthOrder.clear();
+    if (gDepthPrepass && !gFrontToBack) {
+        packet.depthOrder.resize(gVisible.size());
+        for (size_t i = 0; i < gVisible.size(); ++i)
+            packet.depthOrder[i] = static_cast<uint32_t>(i);
+        std::stable_sort(packet.depthOrder.begin(), packet.depthOrder.end(), [](uint32_t a, uint32_t b) {
+            return gVisible[a].viewDepth < gVisible[b].viewDepth;
+        });
+    }
+
+    auto appendCasters = [](const EntityColumns& columns, std::vector<FramePacket::ShadowCaster>& casters) {
+        for (size_t row = columns.begin; row < columns.end; ++row) {
+            // The sea lies below everything else, and its shadow map depth would be flat
+            if (columns.meshes[row] == gOceanMesh)
+                continue;
+            FramePacket::ShadowCaster caster = { columns.transforms[row], columns.meshes[row] };
+            casters.push_back(caster);
+        }
+    };
+
+    // Static casters are only gathered again once one of them has moved
+    if (!gStaticCasters || gStaticCastersVersion != gStaticShadowVersion) {
+        std::vector<FramePacket::ShadowCaster> casters;
+        gEntities.ForEach(COMPONENT_TRANSFORM | COMPONENT_MESH, [&](const EntityColumns& columns) {
+            if ((columns.mask & COMPONENT_DYNAMIC) == 0)
+                appendCasters(columns, casters);
+        });
+        gStaticCasters = std::make_shared<const std::vector<FramePacket::ShadowCaster> >(std::move(casters));
+        gStaticCastersVersion = gStaticShadowVersion;
+    }
+    packet.staticCasters = gStaticCasters;
+
+    packet.dynamicCasters.clear();
+    gEntities.ForEach(COMPONENT_TRANSFORM | COMPONENT_MESH | COMPONENT_DYNAMIC, [&](const EntityColumns& columns) {
+        appendCasters(columns, packet.dynamicCasters);
+    });
+}
+
+// Draws one packet into gOutputFramebuffer without presenting it
+void URenderFrame(const FramePacket& packet) {
+    // The G-buffer stays at the output size and the scene is drawn into its lower-left
+    // corner, so a new render scale reallocates nothing; skip while minimized
+    const bool upscale = packet.renderWidth > 0 && packet.renderHeight > 0;
+    const int width = upscale ? packet.renderWidth : packet.framebufferWidth;
+    const int height = upscale ? packet.renderHeight : packet.framebufferHeight;
+    if (width > 0 && height > 0) {
+        if (packet.framebufferWidth != gGBuffer.Width() || packet.framebufferHeight != gGBuffer.Height())
+            gGBuffer.Create(packet.framebufferWidth, packet.framebufferHeight);
+        gGBuffer.SetRenderSize(width, height);
+        glViewport(0, 0, width, height);
+    }
+
+    // The CPU rasterizer has a forward path only
+    if (gSoftware) {
+        URenderSoftware(packet);
+        UBlitSoftware();
+        return;
+    }
+
+    // Assign the extra lights to view clusters; both paths read the same lists
+    gLightGrid.Build(*packet.lights, packet.view, packet.projection, 0.1f, 200.0f, gGBuffer.RenderWidth(), gGBuffer.RenderHeight());
+    gLightGrid.Upload(*packet.lights);
+
+    gGpuProfiler.BeginFrame(packet.frame);
+    gPipelineStatistics.BeginFrame(static_cast<size_t>(width) * height);
+    gRingBuffer.BeginFrame();
+    UUploadFrameData(packet);
+
+    // The passes draw into the upscaler's scene target, which the resolve reads
+    GLuint outputFramebuffer = gOutputFramebuffer;
+    if (upscale) {
+        gUpscaler.Resize(width, height, packet.framebufferWidth, packet.framebufferHeight);
+        gOutputFramebuffer = gUpscaler.SceneFramebuffer();
+    }
+
+    {
+        GpuProfiler::Scope frameScope(gGpuProfiler, "frame");
+        if (gWaterSurface.Created()) {
+            GpuProfiler::Scope scope(gGpuProfiler, "water");
+            const WaterSimulation::Settings& water = gWaterSimulation.GetSettings();
+            gWaterSurface.Upload(packet.waterRect, packet.waterTexels);
+            gWaterSurface.Simulate(gWaterComputeProgramId, packet.waterSteps, packet.waterDisturbances, water.damping,
+                gWaterSimulation.CellSize());
+        }
+        if (packet.oceanMaps && gOceanSurface.Created()) {
+            GpuProfiler::Scope scope(gGpuProfiler, "ocean");
+            gOceanSurface.Upload(*packet.oceanMaps);
+        }
+        glEnable(GL_DEPTH_TEST);
+        URenderShadows(packet);
+        if (packet.reflection && gReflectionProgramId != 0)
+            URenderReflection(packet);
+        if (packet.deferred)
+            URenderDeferred(packet);
+        else
+            URenderForward(packet);
+
+        if (upscale) {
+            GpuProfiler::Scope scope(gGpuProfiler, "upscale");
+            gOutputFramebuffer = outputFramebuffer;
+            gUpscaler.Resolve(gUpscaleProgramId, packet.deferred ? gGBuffer.DepthTexture() : gUpscaler.SceneDepth(),
+                packet.view, packet.projection, packet.jitter, gOutputFramebuffer);
+        }
+    }
+    gRingBuffer.EndFrame();
+}
+
+// Renders one image of width x height pixels tile by tile, each tile through an
+// off-centre slice of the full projection, and streams it to a PNG. Only one row of
+// tiles is held in memory, so the size is limited by the PNG format, not by GL or RAM.
+bool URenderTiled(int width, int height, int tileSize, const char* path) {
+    PROFILE_FUNCTION();
+    GLint maxRenderbuffer = 0, maxViewport[2] = { 0, 0 };
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbuffer);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+    tileSize = max(1, min(tileSize, min(maxRenderbuffer, min(maxViewport[0], maxViewport[1]))));
+    const int tileWidth = min(tileSize, width);
+    const int tileHeight = min(tileSize, height);
+
+    GLuint renderbuffers[2];
+    GLuint framebuffer;
+    glGenRenderbuffers(2, renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, tileWidth, tileHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, tileWidth, tileHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    PngStreamWriter png;
+    bool ok = complete && png.Begin(path, width, height, 3);
+    if (!ok)
+        cout << (complete ? "Failed to open " : "Tile framebuffer incomplete for ") << path << endl;
+
+    // Culls against the whole image; tiles only narrow the projection
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    float savedAspect = gProjectionAspect;
+    GLuint savedOutput = gOutputFramebuffer;
+    bool savedDynamicResolution = gDynamicResolution;
+    gProjectionAspect = static_cast<float>(width) / height;
+    gOutputFramebuffer = framebuffer;
+    gDynamicResolution = false;
+    FramePacket packet;
+    const int savedWidth = gFramebufferWidth;
+    const int savedHeight = gFramebufferHeight;
+    gFramebufferWidth = width;      // detail and the reflection follow the whole image
+    gFramebufferHeight = height;
+    UBuildFramePacket(packet);
+    gFramebufferWidth = savedWidth;
+    gFramebufferHeight = savedHeight;
+    const glm::mat4 fullProjection = packet.projection;
+    packet.framebufferWidth = tileWidth;
+    packet.framebufferHeight = tileHeight;
+
+    // One row of tiles, bottom row first as GL reads it
+    std::vector<uint8_t> strip(ok ? static_cast<size_t>(width) * tileHeight * 3 : 0);
+    size_t tiles = 0;
+    for (int top = 0; ok && top < height; top += tileHeight) {
+        const int rows = min(tileHeight, height - top);
+        for (int left = 0; left < width; left += tileWidth) {
+            const int columns = min(tileWidth, width - left);
+
+            // Scales and shifts clip space so the tile's slice of the image fills the viewport.
+            // Edge tiles keep the full tile size and only their part inside the image is read.
+            float sx = static_cast<float>(width) / tileWidth;
+            float sy = static_cast<float>(height) / tileHeight;
+            float centerX = -1.0f + (2.0f * left + tileWidth) / width;
+            float centerY = 1.0f - (2.0f * top + tileHeight) / height;
+            glm::mat4 tile(1.0f);
+            tile[0][0] = sx;
+            tile[1][1] = sy;
+            tile[3][0] = -centerX * sx;
+            tile[3][1] = -centerY * sy;
+            packet.projection = tile * fullProjection;
+            URenderFrame(packet);
+
+            // The water steps, changed texels and reflection apply once per packet; later
+            // tiles reuse them
+            packet.waterRect = WaterRect();
+            packet.waterTexels.clear();
+            packet.waterSteps = 0;
+            packet.waterDisturbances.clear();
+            packet.reflectionUpdate = false;
+
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glPixelStorei(GL_PACK_ROW_LENGTH, width);
+            glReadPixels(0, tileHeight - rows, columns, rows, GL_RGB, GL_UNSIGNED_BYTE, strip.data() + static_cast<size_t>(left) * 3);
+            glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+            ++tiles;
+        }
+
+        for (int row = rows - 1; row >= 0 && ok; --row)
+            ok = png.WriteRow(strip.data() + static_cast<size_t>(row) * width * 3);
+    }
+    ok = ok && png.Finish();
+
+    gProjectionAspect = savedAspect;
+    gOutputFramebuffer = savedOutput;
+    gDynamicResolution = savedDynamicResolution;
+    glBindFramebuffer(GL_FRAMEBUFFER, gOutputFramebuffer);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(2, renderbuffers);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (ok)
+        cout << "Tiled render: " << width << "x" << height << " in " << tiles << " tiles of " << tileWidth << "x" << tileHeight
+            << ", " << fixed << setprecision(1) << seconds << " s, written to " << path << endl;
+    else if (complete)
+        cout << "Failed to write the tiled render to " << path << endl;
+    return ok;
+}
+
+// Render thread: draws one packet and presents it
+void URender(const FramePacket& packet) {
+    PROFILE_FUNCTION();
+    FramePacket::Clock::time_point renderStart = FramePacket::Clock::now();
+    URenderFrame(packet);
+
+    // Each GPU frame time reaches the controller once, FRAME_LATENCY frames after it was
+    // drawn; frames that ran out of profiler queries are skipped
+    if (packet.renderWidth > 0 && gGpuProfiler.FramesResolved() != gResolutionSamplesSeen) {
+        gResolutionSamplesSeen = gGpuProfiler.FramesResolved();
+        double gpuMs = gGpuProfiler.LatestMs("frame");
+        if (gpuMs >= 0.0 && !gGpuProfiler.LatestOverflowed())
+            gResolutionScale = gResolutionController.Update(gpuMs);
+    }
+
+    if (packet.capture)
+        gCapture.Capture(gOutputFramebuffer, gHeadless ? GL_COLOR_ATTACHMENT0 : GL_BACK, packet.framebufferWidth,
+            packet.framebufferHeight);
+
+    gFrameTimeline.MarkSubmitted(packet.frame, packet.buildStart);
+    UPresent();
+    gFrameTimeline.MarkSwapped();
+
+    if (gBenchmark) {
+        FramePacket::Clock::time_point presented = FramePacket::Clock::now();
+        if (packet.frame >= BENCHMARK_WARMUP_FRAMES) {
+            BenchmarkReport::Frame frame;
+            frame.frame = packet.frame;
+            frame.frameMs = chrono::duration<double, milli>(presented - gLastPresent).count();
+            frame.mainMs = chrono::duration<double, milli>(packet.submitted - packet.buildStart).count();
+            frame.renderMs = chrono::duration<double, milli>(presented - renderStart).count();
+            frame.draws = packet.draws.size();
+            frame.renderScale = packet.renderWidth > 0 ? static_cast<double>(packet.renderWidth) / packet.framebufferWidth : 1.0;
+            frame.triangles = packet.triangles;
+            frame.gpuMs = -1.0;
+            frame.gpuOverflowed = false;
+            gBenchmarkReport.Record(frame);
+        }
+        gLastPresent = presented;
+
+        // The frame read back this time was recorded a few frames ago, unless it was a warm-up frame
+        if (gGpuProfiler.FramesResolved() != gBenchmarkGpuSeen) {
+            gBenchmarkGpuSeen = gGpuProfiler.FramesResolved();
+            gBenchmarkReport.RecordGpu(gGpuProfiler.LatestFrame(), gGpuProfiler.LatestMs("frame"), gGpuProfiler.LatestOverflowed());
+        }
+    }
+
+    // Keep the driver from queueing frames ahead; the next frame starts from an idle GPU
+    if (gLowLatency)
+        glFinish();
+
+    if (UGLTraceActive()) {
+        UGLTraceEndFrame();
+        if (--gGLTraceFrames == 0)
+            URemoveGLTrace();
+    }
+}
+
+// Lights and shades every rasterized fragment in one pass. With the depth pre-pass,
+// only the fragments that end up visible are shaded.
+void URenderForward(const FramePacket& packet) {
+    glBindFramebuffer(GL_FRAMEBUFFER, gOutputFramebuffer);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    if (packet.depthPrepass) {
+        GpuProfiler::Scope scope(gGpuProfiler, "prepass");
+        PipelineStatistics::Scope statistics(gPipelineStatistics, "prepass");
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glUseProgram(gDepthProgramId);
+        UDrawDepthPrepass(packet);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
+
+    {
+        GpuProfiler::Scope scope(gGpuProfiler, "forward");
+        PipelineStatistics::Scope statistics(gPipelineStatistics, "forward");
+        glUseProgram(gProgramId);
+        gLightGrid.Bind(gProgramId);
+        gShadowCache.Bind(gProgramId);
+        UDrawVisible(gProgramId, packet);
+    }
+
+    if (packet.depthPrepass) {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+}
+
+// Writes surface attributes to the G-buffer, then lights each visible pixel once
+void URenderDeferred(const FramePacket& packet) {
+    {
+        GpuProfiler::Scope scope(gGpuProfiler, "gbuffer");
+        PipelineStatistics::Scope statistics(gPipelineStatistics, "gbuffer");
+        gGBuffer.BeginGeometryPass();
+        glUseProgram(gGBufferProgramId);
+        UDrawVisible(gGBufferProgramId, packet);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, gOutputFramebuffer);
+    glViewport(0, 0, gGBuffer.RenderWidth(), gGBuffer.RenderHeight());
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_DEPTH_TEST);
+
+    GpuProfiler::Scope scope(gGpuProfiler, "lighting");
+    PipelineStatistics::Scope statistics(gPipelineStatistics, "lighting");
+    glUseProgram(gLightingProgramId);
+    gLightGrid.Bind(gLightingProgramId);
+    gGBuffer.BindTextures(gLightingProgramId);
+    gShadowCache.Bind(gLightingProgramId);
+    gGBuffer.DrawFullscreen();
+
+    glEnable(GL_DEPTH_TEST);
+}
+
+// Updates the directional light's shadow map. Static casters are only redrawn when the
+// cache is stale; dynamic casters are drawn over a copy of it every frame they exist.
+void URenderShadows(const FramePacket& packet) {
+    glm::mat4 lightSpace = ULightSpace();
+
+    // Saved before BeginStatic, which switches to the shadow map's viewport
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    bool drawStatic = gShadowCache.BeginStatic(lightSpace, packet.staticShadowVersion);
+    if (!drawStatic && packet.dynamicCasters.empty())
+        return;
+
+    GpuProfiler::Scope scope(gGpuProfiler, "shadows");
+    glUseProgram(gShadowProgramId);
+    glUniformMatrix4fv(glGetUniformLocation(gShadowProgramId, "lightSpace"), 1, GL_FALSE, glm::value_ptr(lightSpace));
+
+    if (drawStatic)
+        UDrawShadowCasters(*packet.staticCasters);
+    if (!packet.dynamicCasters.empty()) {
+        gShadowCache.BeginDynamic();
+        UDrawShadowCasters(packet.dynamicCasters);
+    }
+
+    gShadowCache.End();
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+// The directional light's view and projection, framing the courtyard
+glm::mat4 ULightSpace() {
+    glm::mat4 lightView = glm::lookAt(LIGHT_POSITION, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 lightProjection = glm::ortho(-3.0f, 3.0f, -3.0f, 3.0f, 1.0f, 15.0f);
+    return lightProjection * lightView;
+}
+
+// Depth only, through the position streams, nearest first so later draws fail early-z
+void UDrawDepthPrepass(const FramePacket& packet) {
+    GLint modelLoc = glGetUniformLocation(gDepthProgramId, "model");
+    GLint oceanLoc = glGetUniformLocation(gDepthProgramId, "isOcean");
+    if (gOceanSurface.Created())
+        gOceanSurface.Bind(gDepthProgramId);
+    MeshHandle boundMesh = ~0u;
+    const size_t count = packet.draws.size();
+    for (size_t i = 0; i < count; ++i) {
+        const FramePacket::Draw& item = packet.draws[packet.depthOrder.empty() ? i : packet.depthOrder[i]];
+        const GLMesh& mesh = gMeshes[item.mesh];
+        if (item.mesh != boundMesh) {
+            glBindVertexArray(mesh.positionVao);
+            boundMesh = item.mesh;
+        }
+
+        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(item.model));
+        if (gOceanSurface.Created())
+            glUniform1i(oceanLoc, gMaterials[item.material].isOcean ? GL_TRUE : GL_FALSE);
+        UDrawMesh(mesh, item, &packet);
+    }
+    glBindVertexArray(0);
+}
+
+// Draws depth for either the static or the dynamic shadow casters
+void UDrawShadowCasters(const std::vector<FramePacket::ShadowCaster>& casters) {
+    GLint modelLoc = glGetUniformLocation(gShadowProgramId, "model");
+    for (const FramePacket::ShadowCaster& caster : casters) {
+        const GLMesh& mesh = gMeshes[caster.mesh];
+        glBindVertexArray(mesh.vao);
+        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(caster.model));
+        if (mesh.indexed)
+            glDrawElements(GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_SHORT, NULL);
+        else
+            glDrawArrays(GL_TRIANGLES, 0, mesh.nIndices);
+    }
+    glBindVertexArray(0);
+}
+
+// Writes the camera and the courtyard light and camera spotlight for this frame into
+// the ring buffer and binds them as uniform blocks for every program
+void UUploadFrameData(const FramePacket& packet) {
+    PersistentRingBuffer::Allocation lightRange;
+    if (!gRingBuffer.AllocateUniform(sizeof(LightData), lightRange))
+        return;
+
+    LightData lights = UFrameLights(packet);
+    memcpy(lightRange.cpu, &lights, sizeof(lights));
+    gRingBuffer.BindUniform(LIGHT_BLOCK_BINDING, lightRange);
+    UBindCamera(packet.view, packet.projection, packet.cameraPosition);
+}
+
+// Streams a camera into the ring buffer and binds it as the CameraData block
+void UBindCamera(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& position) {
+    PersistentRingBuffer::Allocation cameraRange;
+    if (!gRingBuffer.AllocateUniform(sizeof(CameraData), cameraRange))
+        return;
+
+    CameraData camera;
+    camera.view = view;
+    camera.projection = projection;
+    camera.inverseViewProjection = glm::inverse(projection * view);
+    camera.viewPos = position;
+    camera.padding = 0.0f;
+    memcpy(cameraRange.cpu, &camera, sizeof(camera));
+    gRingBuffer.BindUniform(CAMERA_BLOCK_BINDING, cameraRange);
+}
+
+// Redraws the packet's visible list from the mirrored camera, leaving out the mirror
+// surfaces themselves. Frames the schedule holds over keep the last reflection, unless
+// the target was just resized and holds none.
+void URenderReflection(const FramePacket& packet) {
+    bool resized = gPlanarReflection.Resize(packet.reflectionWidth, packet.reflectionHeight);
+    if (!packet.reflectionUpdate && !resized)
+        return;
+
+    GpuProfiler::Scope scope(gGpuProfiler, "reflection");
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    gPlanarReflection.Begin();
+    UBindCamera(packet.reflectionView, packet.reflectionProjection, packet.cameraPosition);
+    glUseProgram(gReflectionProgramId);
+
+    GLint modelLoc = glGetUniformLocation(gReflectionProgramId, "model");
+    MaterialHandle boundMaterial = ~0u;
+    MeshHandle boundMesh = ~0u;
+    for (const FramePacket::Draw& item : packet.draws) {
+        const Material& material = gMaterials[item.material];
+        if (material.isPool)
+            continue;
+        if (item.material != boundMaterial) {
+            UBindMaterial(gReflectionProgramId, material, false);
+            boundMaterial = item.material;
+        }
+
+        const GLMesh& mesh = gMeshes[item.mesh];
+        if (item.mesh != boundMesh) {
+            glBindVertexArray(mesh.vao);
+            boundMesh = item.mesh;
+        }
+        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(item.model));
+        UDrawMesh(mesh, item, nullptr);
+    }
+    glBindVertexArray(0);
 
-    glUseProgram(gProgramId);
+    gPlanarReflection.End(packet.reflectionProjection * packet.reflectionView);
+    UBindCamera(packet.view, packet.projection, packet.cameraPosition);
+    glBindFramebuffer(GL_FRAMEBUFFER, gOutputFramebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
 
+// The courtyard light and the camera spotlight for one frame
+LightData UFrameLights(const FramePacket& packet) {
     // Set up the light propertiesd
-    glm::vec3 lightPos(2.0f, 6.0f, 3.0f); // Position of the light
-    glm::vec3 lightColor(1.0f, 0.95f, 0.8f); // Color of the light
-    glUniform3f(glGetUniformLocation(gProgramId, "light.position"), lightPos.x, lightPos.y, lightPos.z);
-    glUniform3f(glGetUniformLocation(gProgramId, "light.color"), lightColor.r, lightColor.g, lightColor.b);
-    glUniform1f(glGetUniformLocation(gProgramId, "light.ambientStrength"), 0.3f);
-    glUniform1f(glGetUniformLocation(gProgramId, "light.diffuseStrength"), 1.0f);
-    glUniform3f(glGetUniformLocation(gProgramId, "viewPos"), cameraPosition.x, cameraPosition.y, cameraPosition.z);
+    LightData lights = {};
+    lights.lightPosition = LIGHT_POSITION; // Position of the light
+    lights.lightColor = glm::vec3(1.0f, 0.95f, 0.8f); // Color of the light
+    lights.lightAmbientStrength = 0.3f;
+    lights.lightDiffuseStrength = 1.0f;
 
     // Set up the spotlight properties
-    glm::vec3 spotlightPos = cameraPosition - glm::vec3(0.0f, 0.0f, 0.5f); // Adjust the offset as needed
-    glm::vec3 spotlightDir = glm::normalize(cameraFront); // Direction the camera is facing
-    glm::vec3 spotlightColor = glm::vec3(1.0f, 0.9f, 0.6f); // Warm sunlight color
-    float spotlightCutOff = glm::cos(glm::radians(25.5f));
-    float spotlightOuterCutOff = glm::cos(glm::radians(25.5f));
-
-    glUniform3f(glGetUniformLocation(gProgramId, "spotlight.position"), spotlightPos.x, spotlightPos.y, spotlightPos.z);
-    glUniform3f(glGetUniformLocation(gProgramId, "spotlight.direction"), spotlightDir.x, spotlightDir.y, spotlightDir.z);
-    glUniform3f(glGetUniformLocation(gProgramId, "spotlight.color"), spotlightColor.r, spotlightColor.g, spotlightColor.b);
-    glUniform1f(glGetUniformLocation(gProgramId, "spotlight.cutOff"), spotlightCutOff);
-    glUniform1f(glGetUniformLocation(gProgramId, "spotlight.outerCutOff"), spotlightOuterCutOff);
-    glUniform1f(glGetUniformLocation(gProgramId, "spotlight.ambientStrength"), 0.05f);
-    glUniform1f(glGetUniformLocation(gProgramId, "spotlight.diffuseStrength"), 0.15f);
-
-    // Set the shader uniforms
-    GLint modelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint viewLoc = glGetUniformLocation(gProgramId, "view");
-    // GLint projLoc = glGetUniformLocation(gProgramId, "projection");
-
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Activate the brick texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glUniform1i(glGetUniformLocation(gProgramId, "ourTexture"), 0);
-
-    // Render first table
-    model = glm::translate(glm::vec3(1.4f, -0.4f, 0.0f)); // Adjust position for first table
-    model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f)); // Scale the table
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glBindVertexArray(gTable1.vao);
-    glDrawArrays(GL_TRIANGLES, 0, gTable1.nIndices);
-
-    // Render second table
-    model = glm::translate(glm::vec3(1.4f, -0.4f, 0.7f)); // Adjust position for second table
-    model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f)); // Scale the table
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glBindVertexArray(gTable2.vao);
-    glDrawArrays(GL_TRIANGLES, 0, gTable2.nIndices);
-
-    // Render third table
-    model = glm::translate(glm::vec3(1.4f, -0.4f, -0.5f)); // Adjust position for second table
-    model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f)); // Scale the table
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glBindVertexArray(gTable2.vao);
-    glDrawArrays(GL_TRIANGLES, 0, gTable2.nIndices);
-
-    // Render fourth table (mirror position of the first table)
-    model = glm::translate(glm::vec3(-1.4f, -0.4f, 0.0f)); // Adjust position for fourth table
-    model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f)); // Scale the table
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glBindVertexArray(gTable1.vao); // Assuming the same mesh for all tables
-    glDrawArrays(GL_TRIANGLES, 0, gTable1.nIndices);
-
-    // Render fifth table (mirror position of the second table)
-    model = glm::translate(glm::vec3(-1.4f, -0.4f, 0.7f)); // Adjust position for fifth table
-    model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f)); // Scale the table
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glBindVertexArray(gTable2.vao); // Assuming the same mesh for all tables
-    glDrawArrays(GL_TRIANGLES, 0, gTable2.nIndices);
-
-    // Render sixth table (mirror position of the third table)
-    model = glm::translate(glm::vec3(-1.4f, -0.4f, -0.5f)); // Adjust position for sixth table
-    model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f)); // Scale the table
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glBindVertexArray(gTable2.vao); // Assuming the same mesh for all tables
-    glDrawArrays(GL_TRIANGLES, 0, gTable2.nIndices);
-
-
-    // Activate the ripple texture
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, rippleTextureID);
-    glUniform1i(glGetUniformLocation(gProgramId, "rippleTexture"), 1);
-
-    // Render Pool
-    model = glm::translate(glm::vec3(0.0f, -0.5f, 0.0f));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniform1i(glGetUniformLocation(gProgramId, "isPool"), GL_TRUE); // Indicate pool rendering
-    glBindVertexArray(gPool.vao);
-    glDrawElements(GL_TRIANGLES, gPool.nIndices, GL_UNSIGNED_SHORT, NULL);
-    glBindVertexArray(0);
+    lights.spotlightPosition = packet.cameraPosition - glm::vec3(0.0f, 0.0f, 0.5f); // Adjust the offset as needed
+    lights.spotlightDirection = glm::normalize(packet.cameraFront); // Direction the camera is facing
+    lights.spotlightColor = glm::vec3(1.0f, 0.9f, 0.6f); // Warm sunlight color
+    lights.spotlightCutOff = glm::cos(glm::radians(25.5f));
+    lights.spotlightOuterCutOff = glm::cos(glm::radians(25.5f));
+    lights.spotlightAmbientStrength = 0.05f;
+    lights.spotlightDiffuseStrength = 0.15f;
+    return lights;
+}
 
-    // Render Walkway
-    model = glm::translate(glm::vec3(0.0f, -0.5f, 0.0f));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniform1i(glGetUniformLocation(gProgramId, "isPool"), GL_FALSE); // Indicate walkway rendering
-    glBindVertexArray(gWalkway.vao);
-    glDrawElements(GL_TRIANGLES, gWalkway.nIndices, GL_UNSIGNED_SHORT, NULL);
+// Draws the packet with the CPU rasterizer, from the same scene data and lights
+void URenderSoftware(const FramePacket& packet) {
+    PROFILE_FUNCTION();
+    LightData frameLights = UFrameLights(packet);
+    SoftLighting lighting;
+    lighting.lightPosition = frameLights.lightPosition;
+    lighting.lightColor = frameLights.lightColor;
+    lighting.lightAmbientStrength = frameLights.lightAmbientStrength;
+    lighting.lightDiffuseStrength = frameLights.lightDiffuseStrength;
+    lighting.lightSpecularStrength = frameLights.lightSpecularStrength;
+    lighting.spotlightPosition = frameLights.spotlightPosition;
+    lighting.spotlightDirection = frameLights.spotlightDirection;
+    lighting.spotlightColor = frameLights.spotlightColor;
+    lighting.spotlightCutOff = frameLights.spotlightCutOff;
+    lighting.spotlightOuterCutOff = frameLights.spotlightOuterCutOff;
+    lighting.spotlightAmbientStrength = frameLights.spotlightAmbientStrength;
+    lighting.spotlightDiffuseStrength = frameLights.spotlightDiffuseStrength;
+    lighting.spotlightSpecularStrength = frameLights.spotlightSpecularStrength;
+    lighting.lightSpace = ULightSpace();
+    lighting.lights = packet.lights.get();
+
+    gSoftRasterizer.Resize(max(packet.framebufferWidth, 1), max(packet.framebufferHeight, 1));
+    gSoftRasterizer.BeginFrame(packet.view, packet.projection, packet.cameraPosition, lighting);
+    for (const FramePacket::Draw& draw : packet.draws) {
+        const Material& material = gMaterials[draw.material];
+        gSoftRasterizer.AddDraw(gMeshes[draw.mesh].soft, draw.model, material.softTexture, material.isPool);
+    }
+
+    // Casters only matter when the cached shadow map is stale
+    gSoftRasterizer.SetShadowVersion(packet.staticShadowVersion);
+    if (!packet.dynamicCasters.empty())
+        gSoftRasterizer.InvalidateShadows();
+    if (gSoftRasterizer.ShadowsStale()) {
+        for (const FramePacket::ShadowCaster& caster : *packet.staticCasters)
+            gSoftRasterizer.AddShadowCaster(gMeshes[caster.mesh].soft, caster.model);
+        for (const FramePacket::ShadowCaster& caster : packet.dynamicCasters)
+            gSoftRasterizer.AddShadowCaster(gMeshes[caster.mesh].soft, caster.model);
+    }
+    gSoftRasterizer.Render();
+}
+
+// Uploads the CPU image and copies it into the output framebuffer
+void UBlitSoftware() {
+    const int width = gSoftRasterizer.Width();
+    const int height = gSoftRasterizer.Height();
+    static int textureWidth = 0, textureHeight = 0;
+    if (gSoftwareFramebuffer == 0 || width != textureWidth || height != textureHeight) {
+        if (gSoftwareFramebuffer == 0) {
+            glGenTextures(1, &gSoftwareTexture);
+            glGenFramebuffers(1, &gSoftwareFramebuffer);
+        }
+        glBindTexture(GL_TEXTURE_2D, gSoftwareTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, gSoftwareFramebuffer);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gSoftwareTexture, 0);
+        textureWidth = width;
+        textureHeight = height;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, gSoftwareTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, gSoftRasterizer.Color().data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, gSoftwareFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, gOutputFramebuffer);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, gOutputFramebuffer);
+}
+
+// Draws the culled entities with the given program, switching material and mesh only on change
+void UDrawVisible(GLuint programId, const FramePacket& packet) {
+    GLint modelLoc = glGetUniformLocation(programId, "model");
+    MaterialHandle boundMaterial = ~0u;
+    MeshHandle boundMesh = ~0u;
+    const char* scopeName = nullptr;
+    int scope = -1;
+    for (const FramePacket::Draw& item : packet.draws) {
+        if (item.material != boundMaterial) {
+            UBindMaterial(programId, gMaterials[item.material], packet.reflection);
+            boundMaterial = item.material;
+        }
+
+        const GLMesh& mesh = gMeshes[item.mesh];
+        if (item.mesh != boundMesh) {
+            // One GPU scope per run of draws from the same group; the profiler sums repeats
+            if (mesh.name != scopeName) {
+                gGpuProfiler.EndScope(scope);
+                scope = gGpuProfiler.BeginScope(mesh.name);
+                scopeName = mesh.name;
+            }
+            glBindVertexArray(mesh.vao);
+            boundMesh = item.mesh;
+        }
+
+        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(item.model));
+        UDrawMesh(mesh, item, &packet);
+    }
+    gGpuProfiler.EndScope(scope);
     glBindVertexArray(0);
+}
+
+// Submits one draw at the level the packet picked for it. Passes seen from the packet's
+// camera pass it as culled to skip the meshlets it dropped; other views draw whole levels.
+void UDrawMesh(const GLMesh& mesh, const FramePacket::Draw& item, const FramePacket* culled) {
+    if (!mesh.indexed) {
+        glDrawArrays(GL_TRIANGLES, 0, mesh.nIndices);
+        return;
+    }
+    if (culled != nullptr && item.firstMeshletRange != FramePacket::ALL_MESHLETS) {
+        if (item.meshletRanges > 0) {
+            glMultiDrawElements(GL_TRIANGLES, &culled->meshletCounts[item.firstMeshletRange], GL_UNSIGNED_SHORT,
+                &culled->meshletOffsets[item.firstMeshletRange], static_cast<GLsizei>(item.meshletRanges));
+        }
+        return;
+    }
+
+    size_t first = 0, count = mesh.nIndices;
+    if (!mesh.lods.empty()) {
+        first = mesh.lods[item.lod].indexOffset;
+        count = mesh.lods[item.lod].indexCount;
+    }
+    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(count), GL_UNSIGNED_SHORT, reinterpret_cast<const void*>(first * sizeof(GLushort)));
+}
+
+// Times both render paths at increasing light counts from a fixed viewpoint.
+// Runs on the main thread before the render thread starts, one packet at a time.
+// Run under Mesa llvmpipe with LIBGL_ALWAYS_SOFTWARE=1 to test without a GPU.
+void UComparePaths() {
+    const size_t lightCounts[] = { 0, 64, 256, 1024, 4096 };
+    const int WARMUP_FRAMES = 5;
+    const int TIMED_FRAMES = 30;
+
+    if (!gHeadless)
+        glfwSwapInterval(0);
+    bool wasDeferred = gDeferred;
+    FramePacket packet;
+    auto renderFrame = [&packet]() {
+        UBuildFramePacket(packet);
+        URender(packet);
+    };
+    renderFrame();   // settle one-time transform updates before timing
+    cout << "Frame time (ms), " << TIMED_FRAMES << " frames per sample:" << endl;
+    cout << "  lights   forward  deferred" << endl;
+
+    for (size_t count : lightCounts) {
+        UCreateLights(count);
+        double ms[2];
+        for (int path = 0; path < 2; ++path) {
+            gDeferred = path == 1;
+            for (int i = 0; i < WARMUP_FRAMES; ++i)
+                renderFrame();
+            glFinish();
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (int i = 0; i < TIMED_FRAMES; ++i)
+                renderFrame();
+            glFinish();
+            ms[path] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / TIMED_FRAMES;
+        }
+        cout << "  " << setw(6) << count << fixed << setprecision(2) << setw(10) << ms[0] << setw(10) << ms[1] << endl;
+    }
+
+    gDeferred = wasDeferred;
+}
+
+// Renders one frame with GL (forward) and with the CPU rasterizer and reports how far
+// apart they are, then times the rasterizer at doubling thread counts. Runs on the main
+// thread before the render thread starts, like UComparePaths. False when more than
+// SOFTWARE_MAX_MISMATCH_PERCENT of the pixels differ.
+bool UCompareSoftware() {
+    const int TIMED_FRAMES = 10;
+    FramePacket packet;
+    bool savedDynamicResolution = gDynamicResolution;
+    gDynamicResolution = false;
+    UBuildFramePacket(packet);
+    gDynamicResolution = savedDynamicResolution;
+    packet.deferred = false;
+    const int width = packet.framebufferWidth;
+    const int height = packet.framebufferHeight;
+
+    URenderFrame(packet);
+    std::vector<uint8_t> gpu(static_cast<size_t>(width) * height * 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, gOutputFramebuffer);
+    glReadBuffer(gHeadless ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, gpu.data());
+
+    URenderSoftware(packet);
+    const SoftRasterizer::Stats shadowStats = gSoftRasterizer.GetStats();
+    const std::vector<uint8_t>& cpu = gSoftRasterizer.Color();
+    size_t total = 0, mismatched = 0;
+    int worst = 0;
+    for (size_t pixel = 0; pixel < static_cast<size_t>(width) * height; ++pixel) {
+        int difference = 0;
+        for (int c = 0; c < 3; ++c) {
+            int d = abs(static_cast<int>(gpu[pixel * 4 + c]) - cpu[pixel * 4 + c]);
+            total += d;
+            difference = max(difference, d);
+        }
+        worst = max(worst, difference);
+        mismatched += difference > SOFTWARE_MATCH_LEVELS;
+    }
+    double mismatchPercent = 100.0 * mismatched / max<size_t>(static_cast<size_t>(width) * height, 1);
+    cout << "Software vs GL at " << width << "x" << height << ": mean difference " << fixed << setprecision(3)
+        << static_cast<double>(total) / (3.0 * width * height) << " levels, max " << worst << ", " << setprecision(2)
+        << mismatchPercent << "% of pixels differ by more than " << SOFTWARE_MATCH_LEVELS << endl;
+    if (mismatchPercent > SOFTWARE_MAX_MISMATCH_PERCENT) {
+        cout << "Software vs GL mismatch above the " << SOFTWARE_MAX_MISMATCH_PERCENT << "% tolerance" << endl;
+        return false;
+    }
+    cout << "Software shadow map: " << shadowStats.shadowTriangles << " triangles in " << setprecision(2)
+        << shadowStats.shadowMs << " ms" << endl;
+
+    // The shadow map stays cached, so the timings cover the colour pass
+    cout << "Software rasterizer, " << TIMED_FRAMES << " frames per sample:" << endl;
+    cout << "  threads  ms/frame   Mtri/s   Mpix/s  speedup" << endl;
+    double singleMs = 0.0;
+    unsigned poolThreads = UParallelThreadCount();
+    for (unsigned threads = 1; ; threads = min(threads * 2, poolThreads)) {
+        gSoftRasterizer.SetThreadCount(threads);
+        URenderSoftware(packet);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < TIMED_FRAMES; ++i)
+            URenderSoftware(packet);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / TIMED_FRAMES;
+        if (threads == 1)
+            singleMs = ms;
+
+        const SoftRasterizer::Stats& stats = gSoftRasterizer.GetStats();
+        cout << "  " << setw(7) << threads << fixed << setprecision(2) << setw(10) << ms << setw(9)
+            << stats.triangles / (ms * 1000.0) << setw(9) << stats.pixelsShaded / (ms * 1000.0) << setw(8)
+            << singleMs / ms << "x" << endl;
+        if (threads == poolThreads)
+            break;
+    }
+    gSoftRasterizer.SetThreadCount(0);
+    return true;
+}
+
+// Binds a material's texture to the unit its sampler reads from
+// reflection says whether the packet has a reflection for the pools to show
+void UBindMaterial(GLuint programId, const Material& material, bool reflection) {
+    if (material.isPool) {
+        // Activate the ripple texture
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, material.textureId);
+        glUniform1i(glGetUniformLocation(programId, "rippleTexture"), 1);
+        if (gWaterSurface.Created())
+            gWaterSurface.Bind(programId);
+        // A reflection left from earlier frames is stale once the packet has none
+        if (reflection && gPlanarReflection.Ready() && !material.isOcean)
+            gPlanarReflection.Bind(programId);
+        else
+            glUniform1i(glGetUniformLocation(programId, "hasReflection"), GL_FALSE);
+    }
+    else {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, material.textureId);
+        glUniform1i(glGetUniformLocation(programId, "ourTexture"), 0);
+    }
+    glUniform1i(glGetUniformLocation(programId, "isPool"), material.isPool ? GL_TRUE : GL_FALSE);
+    if (gOceanSurface.Created()) {
+        if (material.isOcean)
+            gOceanSurface.Bind(programId);
+        glUniform1i(glGetUniformLocation(programId, "isOcean"), material.isOcean ? GL_TRUE : GL_FALSE);
+    }
+}
+
+// simplify is false for meshes whose shape comes from the vertex shader, like the sea
+MeshHandle UAddMesh(void (*createMesh)(GLMesh&), const char* name, bool simplify) {
+    PROFILE_ZONE("UAddMesh");
+    GLMesh mesh = {};
+    createMesh(mesh);
+    if (simplify)
+        UBuildMeshDetail(mesh);
+    UCreatePositionStream(mesh);
+    mesh.name = name;
+    gMeshes.push_back(mesh);
+    return static_cast<MeshHandle>(gMeshes.size() - 1);
+}
+
+MaterialHandle UAddMaterial(GLuint textureId, bool isPool) {
+    std::map<GLuint, SoftTexture>::const_iterator soft = gSoftTextures.find(textureId);
+    Material material = { textureId, isPool, soft != gSoftTextures.end() ? &soft->second : nullptr, false };
+    gMaterials.push_back(material);
+    return static_cast<MaterialHandle>(gMaterials.size() - 1);
+}
+
+// Creates a drawable entity whose transform follows a new scene graph node; tags adds
+// column-less components such as COMPONENT_DYNAMIC
+Entity UCreateEntity(SceneGraph::NodeId parent, const glm::mat4& local, MeshHandle mesh, MaterialHandle material, ComponentMask tags) {
+    Entity entity = gEntities.Create(COMPONENT_TRANSFORM | COMPONENT_BOUNDS | COMPONENT_MESH | COMPONENT_MATERIAL | COMPONENT_SCENE_NODE | COMPONENT_LOD | tags);
+    gEntities.Node(entity) = gSceneGraph.CreateNode(parent, local);
+    gEntities.Mesh(entity) = mesh;
+    gEntities.Material(entity) = material;
+    if (gMaterials[material].isPool && !gMaterials[material].isOcean) {
+        WaterPool pool = { entity, glm::mat4(1.0f), false };
+        gWaterPools.push_back(pool);
+    }
+    return entity;
+}
+
+// Builds the courtyard: the pool, walkway, tables and the float hang off one root node
+void UCreateScene() {
+    MeshHandle poolMesh = UAddMesh(UCreatePool, "pool");
+    MeshHandle walkwayMesh = UAddMesh(UCreateWalkway, "walkway");
+    void (*createTable)(GLMesh&) = gTableSegments > 1 ? UCreateRoundedCube : UCreateCube;
+    MeshHandle tableMeshes[2] = { UAddMesh(createTable, "tables"), UAddMesh(createTable, "tables") };
+
+    MaterialHandle brick = UAddMaterial(textureID, false);
+    MaterialHandle water = UAddMaterial(rippleTextureID, true);
+
+    const glm::vec3 tablePositions[NUM_TABLES] = {
+        glm::vec3(1.4f, -0.4f, 0.0f),
+        glm::vec3(1.4f, -0.4f, 0.7f),
+        glm::vec3(1.4f, -0.4f, -0.5f),
+        glm::vec3(-1.4f, -0.4f, 0.0f),   // mirror of the first table
+        glm::vec3(-1.4f, -0.4f, 0.7f),   // mirror of the second table
+        glm::vec3(-1.4f, -0.4f, -0.5f)   // mirror of the third table
+    };
+
+    gCourtyardNode = gSceneGraph.CreateNode(SceneGraph::kNoParent, glm::mat4(1.0f));
+    UCreateEntity(gCourtyardNode, glm::translate(glm::vec3(0.0f, -0.5f, 0.0f)), poolMesh, water);
+    UCreateEntity(gCourtyardNode, glm::translate(glm::vec3(0.0f, -0.5f, 0.0f)), walkwayMesh, brick);
+
+    for (int i = 0; i < NUM_TABLES; ++i) {
+        glm::mat4 local = glm::translate(tablePositions[i]);
+        local = glm::scale(local, glm::vec3(0.2f, 0.2f, 0.2f)); // Scale the table
+        UCreateEntity(gCourtyardNode, local, tableMeshes[i % 3 == 0 ? 0 : 1], brick);
+    }
 
-    glfwSwapBuffers(gWindow);
+    // Dynamic: it moves every frame, so it is composited over the cached shadow map
+    Entity floatEntity = UCreateEntity(gCourtyardNode, glm::mat4(1.0f), UAddMesh(createTable, "float"), brick, COMPONENT_DYNAMIC);
+    gFloatNode = gEntities.Node(floatEntity);
+    UAnimateScene(0.0f);
+}
+
+// Adds the sea around the courtyard, a little below the walkway. It hangs off no other
+// node, shares the ripple texture with the pools and is displaced by the ocean maps.
+void UCreateOcean() {
+    gOceanMesh = UAddMesh(UCreateOceanGrid, "ocean", false);
+    MaterialHandle sea = UAddMaterial(rippleTextureID, true);
+    gMaterials[sea].isOcean = true;
+    UCreateEntity(SceneGraph::kNoParent, glm::translate(glm::vec3(0.0f, -0.8f, 0.0f)), gOceanMesh, sea);
+}
+
+// Builds a generated grid of courtyards in place of the hand-built one
+void UCreateStressScene() {
+    PROFILE_FUNCTION();
+    // Variants are separate copies of the geometry and texture, so each one is its own
+    // vertex array or texture binding in the draw loop
+    std::vector<MeshHandle> meshes;
+    const size_t meshCount = max(gStressSettings.uniqueMeshes, static_cast<size_t>(STRESS_KIND_COUNT));
+    for (size_t variant = 0; variant < meshCount; ++variant) {
+        switch (variant % STRESS_KIND_COUNT) {
+        case STRESS_POOL: meshes.push_back(UAddMesh(UCreatePool, "pool")); break;
+        case STRESS_WALKWAY: meshes.push_back(UAddMesh(UCreateWalkway, "walkway")); break;
+        default: meshes.push_back(UAddMesh(gTableSegments > 1 ? UCreateRoundedCube : UCreateCube, "tables")); break;
+        }
+    }
+
+    std::vector<MaterialHandle> materials;
+    for (GLuint texture : ULoadTextureVariants("brick.jpg", gStressSettings.uniqueTextures))
+        materials.push_back(UAddMaterial(texture, false));
+    MaterialHandle water = UAddMaterial(rippleTextureID, true);
+
+    const ComponentMask mask = COMPONENT_TRANSFORM | COMPONENT_BOUNDS | COMPONENT_MESH | COMPONENT_MATERIAL | COMPONENT_LOD;
+    gEntities.Reserve(mask, gStressSettings.objects);
+    StressSceneInfo info = UGenerateStressScene(gStressSettings, [&](const StressObject& object) {
+        Entity entity = gEntities.Create(mask);
+        MeshHandle mesh = meshes[object.meshVariant];
+        gEntities.Transform(entity) = object.model;
+        gEntities.BoundsOf(entity) = UWorldBounds(gMeshes[mesh], object.model);
+        gEntities.Mesh(entity) = mesh;
+        gEntities.Material(entity) = object.kind == STRESS_POOL ? water : materials[object.textureVariant];
+    });
+
+    // Spread the lights over the whole grid
+    gLightAreaMin = glm::vec3(info.boundsMin.x, gLightAreaMin.y, info.boundsMin.z);
+    gLightAreaMax = glm::vec3(info.boundsMax.x, gLightAreaMax.y, info.boundsMax.z);
+
+    cout << "Stress scene: " << info.objects << " objects in " << info.courtyards << " courtyards, "
+        << meshes.size() << " meshes, " << materials.size() << " textures" << endl;
+}
+
+// Scatters a deterministic set of coloured point and spot lights over the courtyard
+void UCreateLights(size_t count) {
+    uint32_t seed = gSceneSeed;
+    auto random01 = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return static_cast<float>(seed >> 8) / 16777216.0f;
+    };
+
+    // Built aside and swapped in, so packets still in flight keep the previous set
+    std::vector<ClusterLight> lights;
+    lights.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        glm::vec3 position = gLightAreaMin + (gLightAreaMax - gLightAreaMin) * glm::vec3(random01(), random01(), random01());
+        glm::vec3 color(0.3f + 0.7f * random01(), 0.3f + 0.7f * random01(), 0.3f + 0.7f * random01());
+        float radius = 0.4f + 0.8f * random01();
+        if (i % 4 == 3)
+            lights.push_back(UMakeSpotLight(position, radius * 2.0f, glm::vec3(0.0f, -1.0f, 0.0f), 20.0f, 35.0f, color, 1.5f));
+        else
+            lights.push_back(UMakePointLight(position, radius, color, 1.0f));
+    }
+    gLights = std::make_shared<const std::vector<ClusterLight> >(std::move(lights));
+}
+
+// Copies world matrices of moved scene nodes into their entities and refreshes bounds.
+// Any static entity moving invalidates the cached shadow map.
+void USyncEntityTransforms() {
+    const ComponentMask required = COMPONENT_TRANSFORM | COMPONENT_BOUNDS | COMPONENT_MESH | COMPONENT_SCENE_NODE;
+    std::atomic<bool> staticMoved(false);
+    gEntities.ParallelForEach(required, [&staticMoved](const EntityColumns& columns) {
+        for (size_t row = columns.begin; row < columns.end; ++row) {
+            SceneGraph::NodeId node = columns.nodes[row];
+            if (!gSceneGraph.ChangedLastUpdate(node))
+                continue;
+            if ((columns.mask & COMPONENT_DYNAMIC) == 0)
+                staticMoved.store(true, std::memory_order_relaxed);
+
+            const glm::mat4& world = gSceneGraph.GetWorld(node);
+            columns.transforms[row] = world;
+            columns.bounds[row] = UWorldBounds(gMeshes[columns.meshes[row]], world);
+        }
+    });
+
+    if (staticMoved.load())
+        ++gStaticShadowVersion;
+}
+
+// Objects that moved with their bounds through a pool's surface push the water down
+// there. Every pool shares the one simulated surface, each in its own texture
+// coordinates: the top face spans -1..1 in x and z at local y = 0.
+void UDisturbWater() {
+    for (WaterPool& pool : gWaterPools) {
+        if (!pool.current || gSceneGraph.ChangedLastUpdate(gEntities.Node(pool.entity))) {
+            pool.toPool = glm::inverse(gEntities.Transform(pool.entity));
+            pool.current = true;
+        }
+    }
+
+    gWaterMoved.clear();
+    const ComponentMask required = COMPONENT_TRANSFORM | COMPONENT_BOUNDS | COMPONENT_MATERIAL | COMPONENT_SCENE_NODE;
+    gEntities.ForEach(required, [](const EntityColumns& columns) {
+        for (size_t row = columns.begin; row < columns.end; ++row) {
+            if (!gMaterials[columns.materials[row]].isPool && gSceneGraph.ChangedLastUpdate(columns.nodes[row])
+                && columns.bounds[row].radius <= WATER_MAX_OBJECT_RADIUS)
+                gWaterMoved.push_back(columns.bounds[row]);
+        }
+    });
+
+    for (const Bounds& bounds : gWaterMoved) {
+        for (const WaterPool& pool : gWaterPools) {
+            glm::vec3 local = glm::vec3(pool.toPool * glm::vec4(bounds.center, 1.0f));
+            if (abs(local.y) >= bounds.radius || abs(local.x) > 1.0f || abs(local.z) > 1.0f)
+                continue;
+
+            // The sphere's cross-section with the surface; the face is two units across
+            WaterDisturbance disturbance;
+            disturbance.uv = (glm::vec2(local.x, local.z) + 1.0f) * 0.5f;
+            disturbance.radius = 0.5f * sqrt(bounds.radius * bounds.radius - local.y * local.y);
+            disturbance.strength = -WATER_OBJECT_STRENGTH;
+            disturbance.step = 0;
+            gWaterSimulation.Disturb(disturbance);
+        }
+    }
+}
+
+// The mesh's bounding sphere, moved into world space; non-uniform scales take the largest axis
+Bounds UWorldBounds(const GLMesh& mesh, const glm::mat4& world) {
+    Bounds bounds = { glm::vec3(world * glm::vec4(mesh.boundsCenter, 1.0f)), mesh.boundsRadius * UMaxAxisScale(world) };
+    return bounds;
+}
+
+// Longest of the matrix's axes, the most it can stretch a model-space distance
+float UMaxAxisScale(const glm::mat4& world) {
+    return glm::max(glm::length(glm::vec3(world[0])),
+        glm::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+}
+
+// Fits a bounding sphere around interleaved vertices whose first three floats are the position
+void UComputeMeshBounds(const GLfloat* verts, size_t vertexCount, size_t floatsPerVertex, GLMesh& mesh) {
+    glm::vec3 lo(verts[0], verts[1], verts[2]);
+    glm::vec3 hi = lo;
+    for (size_t i = 0; i < vertexCount; ++i) {
+        glm::vec3 p(verts[i * floatsPerVertex], verts[i * floatsPerVertex + 1], verts[i * floatsPerVertex + 2]);
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    mesh.boundsCenter = (lo + hi) * 0.5f;
+    mesh.boundsRadius = glm::length(hi - lo) * 0.5f;
+}
+
+// Keeps the positions and texture coordinates of interleaved 5-float vertices for the
+// CPU rasterizer; without indices the vertices are taken three at a time
+void UKeepSoftMesh(const GLfloat* verts, size_t vertexCount, const GLushort* indices, size_t indexCount, GLMesh& mesh) {
+    mesh.soft.positions.resize(vertexCount);
+    mesh.soft.texCoords.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i) {
+        mesh.soft.positions[i] = glm::vec3(verts[i * 5], verts[i * 5 + 1], verts[i * 5 + 2]);
+        mesh.soft.texCoords[i] = glm::vec2(verts[i * 5 + 3], verts[i * 5 + 4]);
+    }
+    mesh.soft.indices.resize(indices != nullptr ? indexCount : vertexCount);
+    for (size_t i = 0; i < mesh.soft.indices.size(); ++i)
+        mesh.soft.indices[i] = indices != nullptr ? indices[i] : static_cast<uint32_t>(i);
 }
 
 // Create Tables
@@ -562,8 +3148,73 @@ void UCreateCube(GLMesh& mesh) {
     glEnableVertexAttribArray(1);
 
     mesh.nIndices = sizeof(vertices) / (5 * sizeof(GLfloat)); // Number of vertices
+    mesh.indexed = false;
+    UComputeMeshBounds(vertices, mesh.nIndices, 5, mesh);
+    UKeepSoftMesh(vertices, mesh.nIndices, nullptr, 0, mesh);
 }
 
+// Table with rounded edges: each face of the unit cube is a gTableSegments x gTableSegments
+// grid, and points within the rounding radius of an edge are pulled onto the rounded edge
+void UCreateRoundedCube(GLMesh& mesh) {
+    const int segments = gTableSegments;
+    const float radius = 0.1f;
+    const glm::vec3 faces[6][3] = {
+        // normal, then the u and v axes, with u x v = normal for counter-clockwise winding
+        { glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f) },
+        { glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f) },
+        { glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f) },
+        { glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f) },
+        { glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f) },
+        { glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f) }
+    };
+
+    std::vector<GLfloat> verts;
+    std::vector<GLushort> indices;
+    for (const glm::vec3* face : faces) {
+        GLushort base = static_cast<GLushort>(verts.size() / 5);
+        for (int j = 0; j <= segments; ++j) {
+            for (int i = 0; i <= segments; ++i) {
+                float s = static_cast<float>(i) / segments;
+                float t = static_cast<float>(j) / segments;
+                glm::vec3 p = 0.5f * face[0] + (s - 0.5f) * face[1] + (t - 0.5f) * face[2];
+                glm::vec3 inner = glm::clamp(p, glm::vec3(radius - 0.5f), glm::vec3(0.5f - radius));
+                p = inner + glm::normalize(p - inner) * radius;
+                GLfloat vertex[5] = { p.x, p.y, p.z, s, t };
+                verts.insert(verts.end(), vertex, vertex + 5);
+            }
+        }
+        for (int j = 0; j < segments; ++j) {
+            for (int i = 0; i < segments; ++i) {
+                GLushort corner = static_cast<GLushort>(base + j * (segments + 1) + i);
+                GLushort quad[6] = {
+                    corner, static_cast<GLushort>(corner + 1), static_cast<GLushort>(corner + segments + 2),
+                    static_cast<GLushort>(corner + segments + 2), static_cast<GLushort>(corner + segments + 1), corner
+                };
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        }
+    }
+
+    glGenVertexArrays(1, &mesh.vao);
+    glBindVertexArray(mesh.vao);
+
+    glGenBuffers(2, mesh.vbos);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]);
+    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(GLfloat), verts.data(), GL_STATIC_DRAW);
+
+    mesh.nIndices = static_cast<GLuint>(indices.size());
+    mesh.indexed = true;
+    UComputeMeshBounds(verts.data(), verts.size() / 5, 5, mesh);
+    UKeepSoftMesh(verts.data(), verts.size() / 5, indices.data(), indices.size(), mesh);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+
+    GLint stride = sizeof(float) * 5;
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * 3));
+    glEnableVertexAttribArray(1);
+}
 
 // Function to create a 3D pool
 void UCreatePool(GLMesh& mesh) {
@@ -616,6 +3267,9 @@ void UCreatePool(GLMesh& mesh) {
     glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
 
     mesh.nIndices = sizeof(indices) / sizeof(indices[0]);
+    mesh.indexed = true;
+    UComputeMeshBounds(verts, sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerTexture)), floatsPerVertex + floatsPerTexture, mesh);
+    UKeepSoftMesh(verts, sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerTexture)), indices, mesh.nIndices, mesh);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
@@ -669,6 +3323,9 @@ void UCreateWalkway(GLMesh& mesh) {
     glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
 
     mesh.nIndices = sizeof(indices) / sizeof(indices[0]);
+    mesh.indexed = true;
+    UComputeMeshBounds(verts, sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerTexture)), floatsPerVertex + floatsPerTexture, mesh);
+    UKeepSoftMesh(verts, sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerTexture)), indices, mesh.nIndices, mesh);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
@@ -681,16 +3338,110 @@ void UCreateWalkway(GLMesh& mesh) {
     glEnableVertexAttribArray(1);
 }
 
+// Flat grid for the sea, OCEAN_EXTENT either side of the origin. Texture coordinates
+// count ocean patches, so the normal map lines up with the vertex shader's displacement.
+void UCreateOceanGrid(GLMesh& mesh) {
+    const int side = OCEAN_GRID_VERTICES;
+    const float patchSize = gOceanSpectrum.GetSettings().patchSize;
+    std::vector<GLfloat> verts;
+    verts.reserve(static_cast<size_t>(side) * side * 5);
+    for (int z = 0; z < side; ++z) {
+        for (int x = 0; x < side; ++x) {
+            float px = OCEAN_EXTENT * (2.0f * x / (side - 1) - 1.0f);
+            float pz = OCEAN_EXTENT * (2.0f * z / (side - 1) - 1.0f);
+            GLfloat vertex[5] = { px, 0.0f, pz, px / patchSize, pz / patchSize };
+            verts.insert(verts.end(), vertex, vertex + 5);
+        }
+    }
+
+    std::vector<GLushort> indices;
+    indices.reserve(static_cast<size_t>(side - 1) * (side - 1) * 6);
+    for (int z = 0; z + 1 < side; ++z) {
+        for (int x = 0; x + 1 < side; ++x) {
+            GLushort corner = static_cast<GLushort>(z * side + x);
+            GLushort quad[6] = {
+                corner, static_cast<GLushort>(corner + side), static_cast<GLushort>(corner + 1),
+                static_cast<GLushort>(corner + 1), static_cast<GLushort>(corner + side), static_cast<GLushort>(corner + side + 1)
+            };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+
+    glGenVertexArrays(1, &mesh.vao);
+    glBindVertexArray(mesh.vao);
+
+    glGenBuffers(2, mesh.vbos);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]);
+    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(GLfloat), verts.data(), GL_STATIC_DRAW);
+
+    mesh.nIndices = static_cast<GLuint>(indices.size());
+    mesh.indexed = true;
+    UComputeMeshBounds(verts.data(), verts.size() / 5, 5, mesh);
+    UKeepSoftMesh(verts.data(), verts.size() / 5, indices.data(), indices.size(), mesh);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+
+    GLint stride = sizeof(float) * 5;
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * 3));
+    glEnableVertexAttribArray(1);
+}
+
+// Splits an indexed mesh into meshlets, stores level 0 in meshlet order and appends its
+// simplified levels after it in the same index buffer. The CPU copy keeps the original
+// order. Meshes too small to simplify are left as they are.
+void UBuildMeshDetail(GLMesh& mesh) {
+    if (!mesh.indexed || mesh.nIndices / 3 < 2 * LodSettings().minTriangles)
+        return;
+
+    const float* positions = &mesh.soft.positions[0].x;
+    const size_t vertexCount = mesh.soft.positions.size();
+    std::vector<unsigned int> indices(mesh.soft.indices.begin(), mesh.soft.indices.end());
+    std::vector<unsigned int> clustered, combined;
+    UBuildMeshlets(positions, vertexCount, sizeof(glm::vec3), indices, mesh.meshlets, clustered);
+    mesh.lods = UBuildLodChain(positions, vertexCount, sizeof(glm::vec3), clustered, combined);
+
+    // Vertex counts already fit the 16-bit indices the mesh was created with
+    std::vector<GLushort> elements(combined.begin(), combined.end());
+    glBindVertexArray(mesh.vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, elements.size() * sizeof(GLushort), elements.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    mesh.nIndices = static_cast<GLuint>(mesh.lods[0].indexCount);
+}
+
+// Packs the mesh's positions into a buffer of their own, so the depth pre-pass fetches
+// 12 bytes per vertex instead of 20. Indexed meshes share their index buffer.
+void UCreatePositionStream(GLMesh& mesh) {
+    glGenVertexArrays(1, &mesh.positionVao);
+    glBindVertexArray(mesh.positionVao);
+
+    glGenBuffers(1, &mesh.positionVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.positionVbo);
+    glBufferData(GL_ARRAY_BUFFER, mesh.soft.positions.size() * sizeof(glm::vec3), mesh.soft.positions.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+    glEnableVertexAttribArray(0);
+    if (mesh.indexed)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]);
+
+    glBindVertexArray(0);
+}
+
 void UDestroyMesh(GLMesh& mesh)
 {
     glDeleteVertexArrays(1, &mesh.vao);
     glDeleteBuffers(2, mesh.vbos);
+    glDeleteVertexArrays(1, &mesh.positionVao);
+    glDeleteBuffers(1, &mesh.positionVbo);
 }
 
 
 // Implements the UCreateShaders function
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId,
+    const char* fragLibrarySource)
 {
+    PROFILE_FUNCTION();
     // Compilation and linkage error reporting
     int success = 0;
     char infoLog[512];
@@ -702,9 +3453,10 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
     GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
     GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
 
-    // Retrive the shader source
+    // Retrive the shader source; a library is appended after the main fragment source
+    const char* fragSources[2] = { fragShaderSource, fragLibrarySource };
     glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);
-    glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);
+    glShaderSource(fragmentShaderId, fragLibrarySource ? 2 : 1, fragSources, NULL);
 
     // Link and use the program
     glLinkProgram(programId);
@@ -757,6 +3509,42 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
 }
 
 
+// Compiles and links a program with a compute shader only
+bool UCreateComputeProgram(const char* computeShaderSource, GLuint& programId)
+{
+    PROFILE_FUNCTION();
+    int success = 0;
+    char infoLog[512];
+
+    programId = glCreateProgram();
+    GLuint computeShaderId = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(computeShaderId, 1, &computeShaderSource, NULL);
+    glCompileShader(computeShaderId);
+
+    glGetShaderiv(computeShaderId, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(computeShaderId, sizeof(infoLog), NULL, infoLog);
+        std::cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
+
+        return false;
+    }
+
+    glAttachShader(programId, computeShaderId);
+    glLinkProgram(programId);
+    glGetProgramiv(programId, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+
+        return false;
+    }
+
+    return true;
+}
+
+
 void UDestroyShaderProgram(GLuint programId)
 {
     glDeleteProgram(programId);
@@ -0,0 +1,121 @@
+#include "benchmark_report.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+using namespace std;
+
+namespace {
+    void WriteDistribution(ofstream& out, const char* name, const BenchmarkReport::Distribution& d) {
+        out << "  \"" << name << "\": { \"avg\": " << d.averageMs << ", \"p50\": " << d.p50Ms << ", \"p90\": " << d.p90Ms
+            << ", \"p99\": " << d.p99Ms << ", \"max\": " << d.maxMs << " },\n";
+    }
+}
+
+BenchmarkReport::Distribution BenchmarkReport::Summarize(vector<double> samples) {
+    Distribution d;
+    if (samples.empty())
+        return d;
+
+    sort(samples.begin(), samples.end());
+    double total = 0.0;
+    for (double ms : samples)
+        total += ms;
+
+    const size_t n = samples.size();
+    d.averageMs = total / n;
+    d.p50Ms = samples[min(n - 1, n * 50 / 100)];
+    d.p90Ms = samples[min(n - 1, n * 90 / 100)];
+    d.p99Ms = samples[min(n - 1, n * 99 / 100)];
+    d.maxMs = samples.back();
+    return d;
+}
+
+void BenchmarkReport::RecordGpu(uint64_t frame, double ms, bool overflowed) {
+    // Frames are recorded in packet order
+    vector<Frame>::iterator found = lower_bound(mFrames.begin(), mFrames.end(), frame,
+        [](const Frame& recorded, uint64_t number) { return recorded.frame < number; });
+    if (found == mFrames.end() || found->frame != frame)
+        return;
+    found->gpuMs = overflowed ? -1.0 : ms;
+    found->gpuOverflowed = overflowed;
+}
+
+size_t BenchmarkReport::GpuOverflowFrames() const {
+    size_t overflowed = 0;
+    for (const Frame& frame : mFrames)
+        overflowed += frame.gpuOverflowed;
+    return overflowed;
+}
+
+BenchmarkReport::Distribution BenchmarkReport::FrameTimes() const {
+    vector<double> samples;
+    samples.reserve(mFrames.size());
+    for (const Frame& frame : mFrames)
+        samples.push_back(frame.frameMs);
+    return Summarize(samples);
+}
+
+BenchmarkReport::Distribution BenchmarkReport::GpuTimes(size_t* samples) const {
+    vector<double> gpuMs;
+    for (const Frame& frame : mFrames) {
+        if (frame.gpuMs >= 0.0)
+            gpuMs.push_back(frame.gpuMs);
+    }
+    if (samples != nullptr)
+        *samples = gpuMs.size();
+    return Summarize(gpuMs);
+}
+
+bool BenchmarkReport::WriteJson(const char* path, const Settings& settings) const {
+    ofstream out(path);
+    if (!out)
+        return false;
+
+    vector<double> mainMs, renderMs;
+    size_t totalDraws = 0, maxDraws = 0, totalTriangles = 0, maxTriangles = 0;
+    double totalScale = 0.0, minScale = mFrames.empty() ? 0.0 : mFrames.front().renderScale;
+    for (const Frame& frame : mFrames) {
+        mainMs.push_back(frame.mainMs);
+        renderMs.push_back(frame.renderMs);
+        totalDraws += frame.draws;
+        maxDraws = max(maxDraws, frame.draws);
+        totalTriangles += frame.triangles;
+        maxTriangles = max(maxTriangles, frame.triangles);
+        totalScale += frame.renderScale;
+        minScale = min(minScale, frame.renderScale);
+    }
+    const size_t frames = max(mFrames.size(), size_t(1));
+
+    // The path is a file name or "orbit"; backslashes from Windows paths are the only escapes needed
+    string cameraPath;
+    for (char c : settings.cameraPath) {
+        if (c == '\\' || c == '"')
+            cameraPath += '\\';
+        cameraPath += c;
+    }
+
+    out << "{\n" << fixed << setprecision(4)
+        << "  \"cameraPath\": \"" << cameraPath << "\",\n"
+        << "  \"frames\": " << mFrames.size() << ",\n"
+        << "  \"warmupFrames\": " << settings.warmupFrames << ",\n"
+        << "  \"seed\": " << settings.seed << ",\n"
+        << "  \"width\": " << settings.width << ",\n"
+        << "  \"height\": " << settings.height << ",\n"
+        << "  \"shading\": \"" << (settings.deferred ? "deferred" : "forward") << "\",\n"
+        << "  \"renderThread\": " << (settings.threaded ? "true" : "false") << ",\n"
+        << "  \"simulatedFrameMs\": " << settings.fixedFrameMs << ",\n";
+    WriteDistribution(out, "frameMs", FrameTimes());
+    WriteDistribution(out, "cpuMainMs", Summarize(mainMs));
+    WriteDistribution(out, "cpuRenderMs", Summarize(renderMs));
+    size_t gpuSamples = 0;
+    WriteDistribution(out, "gpuMs", GpuTimes(&gpuSamples));
+    out << "  \"gpuSamples\": " << gpuSamples << ",\n"
+        << "  \"gpuOverflowFrames\": " << GpuOverflowFrames() << ",\n"
+        << "  \"renderScale\": { \"avg\": " << totalScale / frames << ", \"min\": " << minScale << " },\n"
+        << "  \"draws\": { \"avg\": " << static_cast<double>(totalDraws) / frames << ", \"max\": " << maxDraws << " },\n"
+        << "  \"triangles\": { \"avg\": " << static_cast<double>(totalTriangles) / frames << ", \"max\": " << maxTriangles << " }\n"
+        << "}\n";
+    return static_cast<bool>(out);
+}
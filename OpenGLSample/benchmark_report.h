@@ -0,0 +1,67 @@
+#ifndef BENCHMARK_REPORT_H
+#define BENCHMARK_REPORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Per-frame measurements from a camera-path benchmark run, reduced to percentiles and
+// written as JSON. Frames are recorded on the render thread; the report is read once
+// the render thread has stopped. GPU times are read back a few frames after the frame
+// was recorded and added to it then; the last frames of a run never receive one.
+class BenchmarkReport {
+public:
+    struct Frame {
+        uint64_t frame;         // packet number
+        double frameMs;         // present to present
+        double mainMs;          // main thread: input, simulation, culling, packet build
+        double renderMs;        // render thread: GL submission and present
+        size_t draws;           // main-pass draw calls
+        size_t triangles;       // main-pass triangles
+        double renderScale;     // render resolution over window resolution, 1 without --dynamic-res
+        double gpuMs;           // the GPU profiler's frame scope, -1 until read back or when it overflowed
+        bool gpuOverflowed;     // the profiler ran out of queries in this frame
+    };
+
+    struct Distribution {
+        double averageMs = 0.0;
+        double p50Ms = 0.0;
+        double p90Ms = 0.0;
+        double p99Ms = 0.0;
+        double maxMs = 0.0;
+    };
+
+    // Describes the run; copied into the report unchanged
+    struct Settings {
+        std::string cameraPath;
+        size_t warmupFrames = 0;
+        unsigned seed = 0;
+        int width = 0;
+        int height = 0;
+        bool deferred = false;
+        bool threaded = false;
+        double fixedFrameMs = 0.0;
+    };
+
+    void Reserve(size_t frames) { mFrames.reserve(frames); }
+    void Record(const Frame& frame) { mFrames.push_back(frame); }
+    // Adds the GPU time of a recorded frame; frames not in the report are ignored. A frame
+    // whose profiler scopes overflowed is counted as such instead of timed.
+    void RecordGpu(uint64_t frame, double ms, bool overflowed);
+    size_t FrameCount() const { return mFrames.size(); }
+
+    static Distribution Summarize(std::vector<double> samples);
+
+    Distribution FrameTimes() const;
+    // Over the frames whose GPU time was read back; samples says how many
+    Distribution GpuTimes(size_t* samples = nullptr) const;
+    size_t GpuOverflowFrames() const;
+
+    bool WriteJson(const char* path, const Settings& settings) const;
+
+private:
+    std::vector<Frame> mFrames;
+};
+
+#endif
@@ -0,0 +1,495 @@
+#include "benchmarks.h"
+#include "cpu_profiler.h"
+#include "culling.h"
+#include "entity_store.h"
+#include "light_clusters.h"
+#include "mesh_lod.h"
+#include "meshlet.h"
+#include "ocean_spectrum.h"
+#include "parallel.h"
+#include "scene_graph.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace std;
+
+namespace {
+    typedef std::chrono::steady_clock BenchClock;
+
+    double MillisecondsSince(BenchClock::time_point start) {
+        return std::chrono::duration<double, std::milli>(BenchClock::now() - start).count();
+    }
+
+    void PrintTiming(const char* label, double ms, size_t items) {
+        cout << "  " << left << setw(28) << label << right << fixed << setprecision(3)
+            << setw(10) << ms << " ms  " << setw(8) << setprecision(2)
+            << (ms * 1.0e6 / static_cast<double>(items)) << " ns/entity" << endl;
+    }
+
+    // Creation, iteration and destruction cost for a million renderable entities
+    bool BenchEntities() {
+        const size_t COUNT = 1000000;
+        const ComponentMask mask = COMPONENT_TRANSFORM | COMPONENT_BOUNDS | COMPONENT_MESH | COMPONENT_MATERIAL;
+
+        cout << "Entity store: " << COUNT << " entities, " << UParallelThreadCount() << " threads" << endl;
+
+        EntityStore store;
+        std::vector<Entity> entities;
+        entities.reserve(COUNT);
+
+        BenchClock::time_point start = BenchClock::now();
+        store.Reserve(mask, COUNT);
+        for (size_t i = 0; i < COUNT; ++i) {
+            Entity entity = store.Create(mask);
+            float x = static_cast<float>(i % 1000);
+            float z = static_cast<float>(i / 1000);
+            store.Transform(entity) = glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z));
+            store.BoundsOf(entity) = Bounds{ glm::vec3(x, 0.0f, z), 0.9f };
+            store.Mesh(entity) = static_cast<MeshHandle>(i % 4);
+            store.Material(entity) = static_cast<MaterialHandle>(i % 2);
+            entities.push_back(entity);
+        }
+        PrintTiming("create", MillisecondsSince(start), COUNT);
+
+        // Sequential read of one column, the pattern a render pass uses
+        start = BenchClock::now();
+        uint64_t meshSum = 0;
+        store.ForEach(COMPONENT_MESH, [&](const EntityColumns& columns) {
+            for (size_t row = columns.begin; row < columns.end; ++row)
+                meshSum += columns.meshes[row];
+        });
+        PrintTiming("iterate mesh column", MillisecondsSince(start), COUNT);
+
+        // Read-modify-write of two columns on the worker pool, like an animation pass
+        start = BenchClock::now();
+        store.ParallelForEach(COMPONENT_TRANSFORM | COMPONENT_BOUNDS, [](const EntityColumns& columns) {
+            for (size_t row = columns.begin; row < columns.end; ++row) {
+                columns.transforms[row][3].y += 0.01f;
+                columns.bounds[row].center = glm::vec3(columns.transforms[row][3]);
+            }
+        });
+        PrintTiming("animate (parallel)", MillisecondsSince(start), COUNT);
+
+        // Culling pass over the bounds column
+        std::vector<DrawItem> visible;
+        glm::mat4 viewProjection = glm::perspective(glm::radians(55.0f), 1800.0f / 1600.0f, 0.1f, 200.0f)
+            * glm::lookAt(glm::vec3(500.0f, 20.0f, -10.0f), glm::vec3(500.0f, 0.0f, 100.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        start = BenchClock::now();
+        UCullEntities(store, Frustum::FromMatrix(viewProjection), glm::vec3(500.0f, 20.0f, -10.0f), visible);
+        PrintTiming("cull", MillisecondsSince(start), COUNT);
+        cout << "  visible after culling: " << visible.size() << endl;
+
+        // Destroy every other entity first so swap-removal moves rows around
+        start = BenchClock::now();
+        for (size_t i = 0; i < COUNT; i += 2)
+            store.Destroy(entities[i]);
+        for (size_t i = 1; i < COUNT; i += 2)
+            store.Destroy(entities[i]);
+        PrintTiming("destroy", MillisecondsSince(start), COUNT);
+
+        cout << "  (checksum " << meshSum << ", remaining " << store.Count() << ")" << endl;
+        return true;
+    }
+
+    // Lumpy sphere with a duplicated seam column, standing in for an imported model
+    void BuildTestSphere(int rings, int segments, std::vector<float>& positions, std::vector<unsigned int>& indices) {
+        const float PI = 3.14159265358979f;
+        for (int r = 0; r <= rings; ++r) {
+            float theta = PI * r / rings;
+            for (int s = 0; s <= segments; ++s) {
+                float phi = 2.0f * PI * s / segments;
+                float bump = 1.0f + 0.05f * std::sin(6.0f * theta) * std::cos(5.0f * phi);
+                positions.push_back(bump * std::sin(theta) * std::cos(phi));
+                positions.push_back(bump * std::cos(theta));
+                positions.push_back(bump * std::sin(theta) * std::sin(phi));
+            }
+        }
+        for (int r = 0; r < rings; ++r) {
+            for (int s = 0; s < segments; ++s) {
+                unsigned int a = r * (segments + 1) + s;
+                unsigned int b = a + segments + 1;
+                indices.push_back(a); indices.push_back(b); indices.push_back(a + 1);
+                indices.push_back(a + 1); indices.push_back(b); indices.push_back(b + 1);
+            }
+        }
+    }
+
+    // Triangles submitted for a field of 10,000 detailed models with and without LOD
+    bool BenchLod() {
+        std::vector<float> positions;
+        std::vector<unsigned int> indices;
+        BuildTestSphere(128, 256, positions, indices);
+
+        BenchClock::time_point start = BenchClock::now();
+        std::vector<unsigned int> combined;
+        std::vector<LodLevel> levels = UBuildLodChain(positions.data(), positions.size() / 3, 3 * sizeof(float), indices, combined);
+        double buildMs = MillisecondsSince(start);
+
+        cout << "LOD chain for " << indices.size() / 3 << " triangles built in " << fixed << setprecision(1) << buildMs << " ms" << endl;
+        for (size_t i = 0; i < levels.size(); ++i) {
+            cout << "  LOD " << i << ": " << setw(7) << levels[i].indexCount / 3 << " triangles, error "
+                << setprecision(5) << levels[i].geometricError << endl;
+        }
+
+        const int GRID = 100;
+        const float SPACING = 6.0f;
+        const float FOVY = glm::radians(55.0f);
+        const float WIDTH = 1800.0f, HEIGHT = 1600.0f;
+        float projectionScale = ULodProjectionScale(FOVY, HEIGHT);
+        glm::mat4 projection = glm::perspective(FOVY, WIDTH / HEIGHT, 0.1f, 1000.0f);
+
+        std::vector<LodState> states(GRID * GRID);
+        std::vector<size_t> levelUse(levels.size(), 0);
+        size_t frames = 0, withLod = 0, withoutLod = 0, switches = 0;
+
+        // Fly low over the field so near, mid and far models are all on screen
+        for (int frame = 0; frame < 120; ++frame, ++frames) {
+            float t = frame / 119.0f;
+            glm::vec3 eye(-20.0f + t * 340.0f, 4.0f, -20.0f + t * 200.0f);
+            glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(1.0f, -0.1f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            Frustum frustum = Frustum::FromMatrix(projection * view);
+
+            for (int z = 0; z < GRID; ++z) {
+                for (int x = 0; x < GRID; ++x) {
+                    glm::vec3 center(x * SPACING, 0.0f, z * SPACING);
+                    if (!frustum.IntersectsSphere(center, 1.05f))
+                        continue;
+
+                    LodState& state = states[z * GRID + x];
+                    unsigned int before = state.level;
+                    unsigned int level = USelectLod(levels, 1.0f, glm::distance(eye, center), projectionScale, state);
+                    switches += level != before ? 1 : 0;
+                    ++levelUse[level];
+                    withLod += levels[level].indexCount / 3;
+                    withoutLod += levels[0].indexCount / 3;
+                }
+            }
+        }
+
+        cout << "Triangles per frame over " << frames << " frames (1 px error budget):" << endl;
+        cout << "  without LOD: " << withoutLod / frames << endl;
+        cout << "  with LOD:    " << withLod / frames << "  ("
+            << setprecision(1) << (100.0 * withLod / std::max<size_t>(withoutLod, 1)) << "%)" << endl;
+        cout << "  LOD switches per frame: " << setprecision(2) << static_cast<double>(switches) / frames << endl;
+        for (size_t i = 0; i < levels.size(); ++i)
+            cout << "  LOD " << i << " selected " << levelUse[i] << " times" << endl;
+        return true;
+    }
+
+    // Triangles surviving meshlet culling for a large model seen from several angles
+    bool BenchMeshlets() {
+        std::vector<float> positions;
+        std::vector<unsigned int> indices;
+        BuildTestSphere(512, 1024, positions, indices);
+
+        BenchClock::time_point start = BenchClock::now();
+        std::vector<Meshlet> meshlets;
+        std::vector<unsigned int> clustered;
+        UBuildMeshlets(positions.data(), positions.size() / 3, 3 * sizeof(float), indices, meshlets, clustered);
+        double buildMs = MillisecondsSince(start);
+
+        size_t totalTriangles = clustered.size() / 3;
+        size_t maxVertices = 0;
+        for (const Meshlet& meshlet : meshlets)
+            maxVertices = std::max<size_t>(maxVertices, meshlet.vertexCount);
+        cout << totalTriangles << " triangles -> " << meshlets.size() << " meshlets in " << fixed << setprecision(1)
+            << buildMs << " ms (avg " << setprecision(1) << static_cast<double>(totalTriangles) / meshlets.size()
+            << " triangles, max " << maxVertices << " vertices)" << endl;
+
+        struct View {
+            const char* name;
+            glm::vec3 eye;
+            glm::vec3 target;
+        };
+        const View views[] = {
+            { "whole model in view", glm::vec3(0.0f, 0.0f, 4.0f), glm::vec3(0.0f) },
+            { "model half off-screen", glm::vec3(1.2f, 0.0f, 3.0f), glm::vec3(2.2f, 0.0f, 0.0f) },
+            { "close-up of the surface", glm::vec3(0.0f, 0.0f, 1.3f), glm::vec3(0.0f) },
+            { "behind the camera", glm::vec3(0.0f, 0.0f, 4.0f), glm::vec3(0.0f, 0.0f, 8.0f) }
+        };
+
+        glm::mat4 projection = glm::perspective(glm::radians(55.0f), 1800.0f / 1600.0f, 0.1f, 200.0f);
+        MeshletDrawList drawList;
+        for (const View& view : views) {
+            glm::mat4 viewProjection = projection * glm::lookAt(view.eye, view.target, glm::vec3(0.0f, 1.0f, 0.0f));
+
+            const int REPEATS = 20;
+            start = BenchClock::now();
+            for (int i = 0; i < REPEATS; ++i)
+                UCullMeshlets(meshlets, viewProjection, glm::mat4(1.0f), view.eye, drawList);
+            double cullMs = MillisecondsSince(start) / REPEATS;
+
+            cout << "  " << left << setw(26) << view.name << right << setw(9) << drawList.trianglesVisible << " triangles ("
+                << setw(5) << setprecision(1) << (100.0 * drawList.trianglesVisible / totalTriangles) << "%), "
+                << setw(5) << drawList.counts.size() << " draw ranges, cull " << setprecision(3) << cullMs << " ms" << endl;
+        }
+        return true;
+    }
+
+    // Cluster assignment cost and occupancy for 10,000 lights scattered over a large courtyard
+    bool BenchLights() {
+        const size_t COUNT = 10000;
+        std::vector<ClusterLight> lights;
+        lights.reserve(COUNT);
+
+        uint32_t seed = 12345u;
+        auto random01 = [&seed]() {
+            seed = seed * 1664525u + 1013904223u;
+            return static_cast<float>(seed >> 8) / 16777216.0f;
+        };
+        for (size_t i = 0; i < COUNT; ++i) {
+            glm::vec3 position(-100.0f + 200.0f * random01(), 0.5f + 4.0f * random01(), -100.0f + 200.0f * random01());
+            glm::vec3 color(0.5f + 0.5f * random01(), 0.5f + 0.5f * random01(), 0.5f + 0.5f * random01());
+            float radius = 1.5f + 3.0f * random01();
+            if (i % 4 == 0)
+                lights.push_back(UMakeSpotLight(position, radius * 2.0f, glm::vec3(0.0f, -1.0f, 0.0f), 20.0f, 30.0f, color, 2.0f));
+            else
+                lights.push_back(UMakePointLight(position, radius, color, 1.0f));
+        }
+
+        const float WIDTH = 1800.0f, HEIGHT = 1600.0f;
+        glm::mat4 projection = glm::perspective(glm::radians(55.0f), WIDTH / HEIGHT, 0.1f, 200.0f);
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 6.0f, -90.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+        cout << "Light clusters: " << COUNT << " lights, " << LightClusterGrid::TILES_X << "x" << LightClusterGrid::TILES_Y
+            << "x" << LightClusterGrid::SLICES << " clusters, " << UParallelThreadCount() << " threads" << endl;
+
+        LightClusterGrid grid;
+        const int REPEATS = 20;
+        double totalMs = 0.0;
+        for (int i = 0; i < REPEATS; ++i) {
+            grid.Build(lights, view, projection, 0.1f, 200.0f, static_cast<int>(WIDTH), static_cast<int>(HEIGHT));
+            totalMs += grid.GetStats().buildMs;
+        }
+
+        const LightClusterGrid::Stats& stats = grid.GetStats();
+        cout << "  build: " << fixed << setprecision(3) << totalMs / REPEATS << " ms" << endl;
+        cout << "  lights in view: " << stats.lightsInView << endl;
+        cout << "  occupied clusters: " << stats.occupiedClusters << " of " << LightClusterGrid::CLUSTER_COUNT << endl;
+        cout << "  lights per occupied cluster: avg " << setprecision(2)
+            << static_cast<double>(stats.indexCount) / std::max<size_t>(stats.occupiedClusters, 1)
+            << ", max " << stats.maxLightsPerCluster << endl;
+        cout << "  shading work vs. every light per pixel: " << setprecision(3)
+            << (100.0 * stats.maxLightsPerCluster / COUNT) << "% worst case" << endl;
+        // Benchmarks run before any GL context exists, so shading is not timed here
+        cout << "  (CPU cluster build only; the GPU cost of shading with these lists is timed by --compare-paths)" << endl;
+        return true;
+    }
+
+    // Cost of one CPU profiling zone: two timestamp reads and a ring buffer write. Uses the
+    // zone class directly, so it measures the same code whether or not ENABLE_PROFILING is set.
+    // Each loop is timed several times and the fastest pass kept, so a preempted pass does
+    // not count against the budget.
+    bool BenchProfiler() {
+        const size_t COUNT = 10000000;
+        const int PASSES = 5;
+        const double BUDGET_NS = 50.0;
+
+        cout << "Profiler zones: " << COUNT << " zones, best of " << PASSES << " passes" << endl;
+
+        uint64_t sink = 0;
+        double baselineMs = 1.0e30, zonesMs = 1.0e30, clockMs = 1.0e30, recordMs = 1.0e30;
+        for (int pass = 0; pass < PASSES; ++pass) {
+            // The same cheap loop body with and without a zone, so only the zone is measured
+            BenchClock::time_point start = BenchClock::now();
+            for (size_t i = 0; i < COUNT; ++i)
+                sink = sink * 31 + i;
+            baselineMs = std::min(baselineMs, MillisecondsSince(start));
+
+            start = BenchClock::now();
+            for (size_t i = 0; i < COUNT; ++i) {
+                CpuProfileZone zone("bench");
+                sink = sink * 31 + i;
+            }
+            zonesMs = std::min(zonesMs, MillisecondsSince(start));
+
+            start = BenchClock::now();
+            for (size_t i = 0; i < COUNT; ++i)
+                sink += static_cast<uint64_t>(UProfilerTicks());
+            clockMs = std::min(clockMs, MillisecondsSince(start));
+
+            // Recording alone, with made-up timestamps instead of clock reads
+            start = BenchClock::now();
+            for (size_t i = 0; i < COUNT; ++i)
+                URecordZone("bench", static_cast<int64_t>(i), static_cast<int64_t>(i + 1));
+            recordMs = std::min(recordMs, MillisecondsSince(start));
+        }
+
+        double zoneNs = (zonesMs - baselineMs) * 1.0e6 / COUNT;
+        cout << "  timestamp read: " << fixed << setprecision(2) << clockMs * 1.0e6 / COUNT << " ns" << endl;
+        cout << "  recording: " << recordMs * 1.0e6 / COUNT << " ns" << endl;
+        cout << "  zone overhead: " << zoneNs << " ns (budget " << BUDGET_NS << " ns) "
+            << (zoneNs <= BUDGET_NS ? "OK" : "OVER BUDGET") << endl;
+        cout << "  zones buffered: " << UProfilerZoneCount() << ", overwritten: " << UProfilerZonesDropped()
+            << " (checksum " << (sink & 0xff) << ")" << endl;
+        return zoneNs <= BUDGET_NS;
+    }
+
+    // Transform propagation through a 100,000 node hierarchy, six levels deep, with the
+    // lower levels wide enough to be split across the worker pool. Each frame moves a
+    // different random subset of nodes; a moved node drags its whole subtree along.
+    bool BenchSceneGraph() {
+        const size_t FANOUT[] = { 16, 8, 8, 8, 4, 2 };     // children per node, level by level
+        const int FRAMES = 100;
+
+        SceneGraph graph;
+        std::vector<SceneGraph::NodeId> nodes;
+        std::vector<SceneGraph::NodeId> parentOf;     // indexed by NodeId, which counts up from 0
+        std::vector<SceneGraph::NodeId> parents(1, SceneGraph::kNoParent);
+        for (size_t count : FANOUT) {
+            std::vector<SceneGraph::NodeId> level;
+            for (SceneGraph::NodeId parent : parents) {
+                for (size_t i = 0; i < count; ++i) {
+                    level.push_back(graph.CreateNode(parent, glm::translate(glm::mat4(1.0f), glm::vec3(0.1f * i, 1.0f, 0.0f))));
+                    parentOf.push_back(parent);
+                }
+            }
+            nodes.insert(nodes.end(), level.begin(), level.end());
+            parents.swap(level);
+        }
+        graph.Update();     // first update sorts the layout and computes every world matrix
+
+        cout << "Scene graph: " << graph.NodeCount() << " nodes in " << sizeof(FANOUT) / sizeof(FANOUT[0]) << " levels, "
+            << FRAMES << " frames, " << UParallelThreadCount() << " threads (levels of "
+            << SceneGraph::kParallelLevelSize << "+ nodes run in parallel)" << endl;
+        cout << "  " << left << setw(16) << "moved per frame" << right << setw(12) << "updated" << setw(10) << "parallel"
+            << setw(12) << "ms/frame" << setw(12) << "ns/update" << endl;
+
+        uint32_t seed = 12345u;
+        const size_t MOVED[] = { 0, 16, 256, 1024 };
+        for (size_t moved : MOVED) {
+            size_t updated = 0, parallelLevels = 0;
+            double totalMs = 0.0;
+            for (int frame = 0; frame < FRAMES; ++frame) {
+                // Picking the nodes stays out of the timing; SetLocal only marks them dirty
+                for (size_t i = 0; i < moved; ++i) {
+                    seed = seed * 1664525u + 1013904223u;
+                    SceneGraph::NodeId node = nodes[(seed >> 8) % nodes.size()];
+                    graph.SetLocal(node, glm::translate(graph.GetLocal(node), glm::vec3(0.0f, 0.001f, 0.0f)));
+                }
+                BenchClock::time_point start = BenchClock::now();
+                graph.Update();
+                totalMs += MillisecondsSince(start);
+                updated += graph.GetStats().nodesUpdated;
+                parallelLevels += graph.GetStats().levelsParallel;
+            }
+            cout << "  " << left << setw(16) << moved << right << setw(12) << updated / FRAMES << setw(10) << fixed
+                << setprecision(1) << static_cast<double>(parallelLevels) / FRAMES << setw(12) << setprecision(3)
+                << totalMs / FRAMES << setw(12) << setprecision(2)
+                << (updated > 0 ? totalMs * 1.0e6 / updated : 0.0) << endl;
+        }
+
+        // Sampled leaves must match their chain of locals multiplied out by hand
+        bool ok = true;
+        for (size_t i = nodes.size() - parents.size(); i < nodes.size(); i += 997) {
+            glm::mat4 expected(1.0f);
+            for (SceneGraph::NodeId node = nodes[i]; node != SceneGraph::kNoParent; node = parentOf[node])
+                expected = graph.GetLocal(node) * expected;
+            const glm::mat4& world = graph.GetWorld(nodes[i]);
+            for (int c = 0; c < 4; ++c)
+                ok = ok && glm::length(world[c] - expected[c]) < 1.0e-3f;
+        }
+        if (!ok)
+            cout << "  world matrices do not match their parents" << endl;
+        return ok;
+    }
+
+    // Ocean spectrum updates from 128^2 to 1024^2, with SSE2 butterflies and scalar ones.
+    // Fails unless a fresh instance with the same seed reproduces the maps bit for bit and
+    // both butterfly paths agree.
+    bool BenchOcean() {
+        const int REPEATS = 10;
+        const double TIME_STEP = 1.0 / 60.0;
+
+        cout << "Ocean spectrum: " << REPEATS << " updates per grid, " << UParallelThreadCount() << " threads" << endl;
+        cout << "  " << setw(6) << "grid" << setw(6) << "simd" << setw(11) << "update ms" << setw(11) << "spectrum"
+            << setw(9) << "fft" << setw(9) << "maps" << setw(9) << "fft x" << "  checksum" << endl;
+
+        bool ok = true;
+        for (int resolution = 128; resolution <= 1024; resolution *= 2) {
+            uint64_t checksums[2] = { 0, 0 };
+            double fftMs[2] = { 0.0, 0.0 };
+            for (int simd = 0; simd < 2; ++simd) {
+                OceanSpectrum::Settings settings;
+                settings.resolution = resolution;
+                settings.simd = simd != 0;
+                OceanSpectrum ocean;
+                ocean.Create(settings);
+
+                OceanSpectrum::Maps maps;
+                ocean.Update(0.0, maps);    // first touch of the work buffers stays out of the timing
+                BenchClock::time_point start = BenchClock::now();
+                for (int i = 1; i <= REPEATS; ++i)
+                    ocean.Update(i * TIME_STEP, maps);
+                double updateMs = MillisecondsSince(start) / REPEATS;
+                checksums[simd] = OceanSpectrum::Checksum(maps);
+
+                // A second instance drawing the same spectrum must land on the same bits
+                OceanSpectrum replay;
+                replay.Create(settings);
+                OceanSpectrum::Maps replayMaps;
+                replay.Update(REPEATS * TIME_STEP, replayMaps);
+                bool reproduced = OceanSpectrum::Checksum(replayMaps) == checksums[simd];
+                ok = ok && reproduced;
+
+                const OceanSpectrum::Stats& stats = ocean.GetStats();
+                double updates = static_cast<double>(stats.updates);
+                fftMs[simd] = stats.fftMs / updates;
+                cout << "  " << setw(6) << resolution << setw(6) << (simd ? "sse2" : "off") << fixed << setprecision(2)
+                    << setw(11) << updateMs << setw(11) << stats.spectrumMs / updates << setw(9) << fftMs[simd]
+                    << setw(9) << stats.assembleMs / updates << setw(9);
+                if (simd)
+                    cout << fftMs[0] / fftMs[1];
+                else
+                    cout << "";
+                cout << "  " << hex << checksums[simd] << dec << (reproduced ? "" : " NOT REPRODUCED") << endl;
+            }
+            if (checksums[0] != checksums[1]) {
+                cout << "  " << resolution << "^2: SIMD and scalar maps differ" << endl;
+                ok = false;
+            }
+        }
+        return ok;
+    }
+}
+
+bool URunBenchmark(const std::string& name) {
+    bool ok;
+    if (name == "entities") {
+        ok = BenchEntities();
+    }
+    else if (name == "lod") {
+        ok = BenchLod();
+    }
+    else if (name == "meshlets") {
+        ok = BenchMeshlets();
+    }
+    else if (name == "lights") {
+        ok = BenchLights();
+    }
+    else if (name == "profiler") {
+        ok = BenchProfiler();
+    }
+    else if (name == "ocean") {
+        ok = BenchOcean();
+    }
+    else if (name == "scenegraph") {
+        ok = BenchSceneGraph();
+    }
+    else {
+        cout << "Unknown benchmark: " << name << endl;
+        cout << "Available: entities, lod, meshlets, lights, profiler, ocean, scenegraph" << endl;
+        ok = false;
+    }
+
+    UShutdownParallel();
+    return ok;
+}
@@ -0,0 +1,10 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <string>
+
+// Runs a CPU benchmark selected with "--bench <name>" and prints its timings.
+// These need no window or GL context. Returns false if the name is unknown.
+bool URunBenchmark(const std::string& name);
+
+#endif
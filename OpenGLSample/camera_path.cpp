@@ -0,0 +1,122 @@
+#include "camera_path.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+namespace {
+    template <typename T>
+    T CatmullRom(const T& p0, const T& p1, const T& p2, const T& p3, float t) {
+        float t2 = t * t;
+        float t3 = t2 * t;
+        return 0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2
+            + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+    }
+}
+
+CameraPath CameraPath::Orbit() {
+    // The courtyard spans roughly -3..3 on x and z; the pool sits at the centre
+    const Key keys[] = {
+        {  0.0f, glm::vec3( 0.0f, 0.5f,  3.0f),  -90.0f,   0.0f },
+        {  2.0f, glm::vec3( 2.2f, 0.9f,  2.2f), -135.0f, -12.0f },
+        {  4.0f, glm::vec3( 3.0f, 1.4f,  0.0f), -180.0f, -20.0f },
+        {  6.0f, glm::vec3( 2.2f, 0.6f, -2.2f), -225.0f,  -5.0f },
+        {  8.0f, glm::vec3( 0.0f, 0.3f, -3.0f), -270.0f,   5.0f },
+        { 10.0f, glm::vec3(-2.2f, 1.8f, -2.2f), -315.0f, -35.0f },
+        { 12.0f, glm::vec3(-3.0f, 0.5f,  0.0f), -360.0f,   0.0f },
+        { 14.0f, glm::vec3(-1.0f, 0.2f,  1.0f), -380.0f,  10.0f },
+        { 16.0f, glm::vec3( 0.0f, 0.5f,  3.0f), -450.0f,   0.0f },
+    };
+
+    CameraPath path;
+    for (const Key& key : keys)
+        path.AddKey(key);
+    return path;
+}
+
+bool CameraPath::Load(const char* path) {
+    ifstream in(path);
+    if (!in) {
+        cout << "Failed to open camera path " << path << endl;
+        return false;
+    }
+
+    mKeys.clear();
+    string line;
+    for (size_t lineNumber = 1; getline(in, line); ++lineNumber) {
+        size_t comment = line.find('#');
+        if (comment != string::npos)
+            line.erase(comment);
+        if (line.find_first_not_of(" \t\r") == string::npos)
+            continue;
+
+        istringstream fields(line);
+        Key key;
+        if (!(fields >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch)) {
+            cout << path << ":" << lineNumber << ": expected \"time x y z yaw pitch\"" << endl;
+            return false;
+        }
+        if (!mKeys.empty() && key.time <= mKeys.back().time) {
+            cout << path << ":" << lineNumber << ": key times must increase" << endl;
+            return false;
+        }
+        mKeys.push_back(key);
+    }
+
+    if (mKeys.size() < 2) {
+        cout << "Camera path " << path << " needs at least two keys" << endl;
+        return false;
+    }
+    return true;
+}
+
+bool CameraPath::Save(const char* path) const {
+    ofstream out(path);
+    if (!out)
+        return false;
+
+    out << "# time x y z yaw pitch\n" << fixed << setprecision(4);
+    for (const Key& key : mKeys) {
+        out << key.time << " " << key.position.x << " " << key.position.y << " " << key.position.z << " "
+            << key.yaw << " " << key.pitch << "\n";
+    }
+    return static_cast<bool>(out);
+}
+
+void CameraPath::AddKey(const Key& key) {
+    mKeys.push_back(key);
+}
+
+CameraPath::Key CameraPath::Evaluate(float time) const {
+    if (mKeys.size() < 2)
+        return mKeys.empty() ? Key{ 0.0f, glm::vec3(0.0f), -90.0f, 0.0f } : mKeys.front();
+
+    // Keys may start after zero; time is measured from the first one
+    float start = mKeys.front().time;
+    float length = mKeys.back().time - start;
+    float local = fmod(max(time, 0.0f), length) + start;
+
+    size_t segment = upper_bound(mKeys.begin(), mKeys.end(), local,
+        [](float t, const Key& key) { return t < key.time; }) - mKeys.begin();
+    segment = min(max(segment, size_t(1)), mKeys.size() - 1) - 1;
+
+    // End segments repeat their outer key in place of the missing neighbour
+    const Key& k0 = mKeys[segment > 0 ? segment - 1 : segment];
+    const Key& k1 = mKeys[segment];
+    const Key& k2 = mKeys[segment + 1];
+    const Key& k3 = mKeys[min(segment + 2, mKeys.size() - 1)];
+    float t = (local - k1.time) / (k2.time - k1.time);
+
+    Key key;
+    key.time = time;
+    key.position = CatmullRom(k0.position, k1.position, k2.position, k3.position, t);
+    key.yaw = CatmullRom(k0.yaw, k1.yaw, k2.yaw, k3.yaw, t);
+    key.pitch = glm::clamp(CatmullRom(k0.pitch, k1.pitch, k2.pitch, k3.pitch, t), -89.0f, 89.0f);
+    return key;
+}
@@ -0,0 +1,45 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// A camera flight through timed keys, for runs that must see the same frames every
+// time. Positions and angles are Catmull-Rom splines through the keys, so the camera
+// passes through every key with no kinks between them. Paths are plain text, one key
+// per line: "time x y z yaw pitch", times in seconds and angles in degrees, '#' starts
+// a comment. Save() writes the same format, so a recorded flight can be replayed.
+class CameraPath {
+public:
+    struct Key {
+        float time;
+        glm::vec3 position;
+        float yaw;
+        float pitch;
+    };
+
+    // A loop around the pool and under the table canopy, starting and ending at the
+    // default camera position
+    static CameraPath Orbit();
+
+    bool Load(const char* path);
+    bool Save(const char* path) const;
+
+    // Keys must be added in increasing time order
+    void AddKey(const Key& key);
+    void Clear() { mKeys.clear(); }
+
+    size_t KeyCount() const { return mKeys.size(); }
+    const Key& LastKey() const { return mKeys.back(); }
+    float Duration() const { return mKeys.empty() ? 0.0f : mKeys.back().time; }
+
+    // Samples the path; times past the end wrap around to the start
+    Key Evaluate(float time) const;
+
+private:
+    std::vector<Key> mKeys;
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include "cpu_profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    // The recording fields live in the header; zones points into storage
+    struct ThreadBuffer : ProfilerThreadBuffer {
+        vector<ProfilerZoneRecord> storage;
+        string name;
+        unsigned id;
+    };
+
+    // Buffers outlive their threads so zones from a stopped thread can still be exported
+    mutex gRegistryMutex;
+    vector<unique_ptr<ThreadBuffer>> gBuffers;
+
+    // Reference point for converting ticks to time, taken at static initialization
+    const chrono::steady_clock::time_point gCalibrationTime = chrono::steady_clock::now();
+    const int64_t gCalibrationTicks = UProfilerTicks();
+
+    ThreadBuffer& LocalBuffer() {
+        if (tProfilerBuffer == nullptr)
+            UProfilerCreateThreadBuffer();
+        return static_cast<ThreadBuffer&>(*tProfilerBuffer);
+    }
+
+    // Trace names are code identifiers and literals; escape the two characters JSON cares about
+    void WriteJsonString(ofstream& out, const char* text) {
+        out << '"';
+        for (const char* c = text; *c != '\0'; ++c) {
+            if (*c == '"' || *c == '\\')
+                out << '\\';
+            out << *c;
+        }
+        out << '"';
+    }
+}
+
+thread_local ProfilerThreadBuffer* tProfilerBuffer = nullptr;
+
+ProfilerThreadBuffer& UProfilerCreateThreadBuffer() {
+    unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+    buffer->storage.resize(PROFILER_ZONES_PER_THREAD);
+    buffer->zones = buffer->storage.data();
+    buffer->next = 0;
+
+    lock_guard<mutex> lock(gRegistryMutex);
+    buffer->id = static_cast<unsigned>(gBuffers.size() + 1);
+    buffer->name = "thread " + to_string(buffer->id);
+    tProfilerBuffer = buffer.get();
+    gBuffers.push_back(move(buffer));
+    return *tProfilerBuffer;
+}
+
+double UProfilerNanosecondsPerTick() {
+#ifdef PROFILER_USE_TSC
+    // A few milliseconds of reference keeps the rate error well under 0.1%
+    chrono::steady_clock::time_point now;
+    int64_t ticks;
+    do {
+        now = chrono::steady_clock::now();
+        ticks = UProfilerTicks();
+    } while (now - gCalibrationTime < chrono::milliseconds(10));
+    return chrono::duration<double, nano>(now - gCalibrationTime).count() / static_cast<double>(ticks - gCalibrationTicks);
+#else
+    return 1.0;
+#endif
+}
+
+void UProfilerSetThreadName(const char* name) {
+    ThreadBuffer& buffer = LocalBuffer();
+    lock_guard<mutex> lock(gRegistryMutex);
+    buffer.name = name;
+}
+
+bool UWriteChromeTrace(const char* path) {
+    ofstream out(path);
+    if (!out)
+        return false;
+
+    double usPerTick = UProfilerNanosecondsPerTick() / 1000.0;
+    lock_guard<mutex> lock(gRegistryMutex);
+
+    // Timestamps are written relative to the earliest buffered zone
+    int64_t origin = INT64_MAX;
+    for (const unique_ptr<ThreadBuffer>& buffer : gBuffers) {
+        size_t count = min(buffer->next.load(memory_order_acquire), PROFILER_ZONES_PER_THREAD);
+        for (size_t i = 0; i < count; ++i)
+            origin = min(origin, buffer->zones[i].beginTicks);
+    }
+
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" << fixed << setprecision(3);
+    bool first = true;
+    for (const unique_ptr<ThreadBuffer>& buffer : gBuffers) {
+        out << (first ? "\n" : ",\n") << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id
+            << ",\"name\":\"thread_name\",\"args\":{\"name\":";
+        WriteJsonString(out, buffer->name.c_str());
+        out << "}}";
+        first = false;
+
+        // Oldest first, so the file reads in time order within a thread
+        size_t next = buffer->next.load(memory_order_acquire);
+        size_t count = min(next, PROFILER_ZONES_PER_THREAD);
+        for (size_t i = next - count; i < next; ++i) {
+            const ProfilerZoneRecord& zone = buffer->zones[i & (PROFILER_ZONES_PER_THREAD - 1)];
+            out << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id << ",\"name\":";
+            WriteJsonString(out, zone.name);
+            out << ",\"ts\":" << (zone.beginTicks - origin) * usPerTick << ",\"dur\":" << (zone.endTicks - zone.beginTicks) * usPerTick << "}";
+        }
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
+
+size_t UProfilerZoneCount() {
+    lock_guard<mutex> lock(gRegistryMutex);
+    size_t total = 0;
+    for (const unique_ptr<ThreadBuffer>& buffer : gBuffers)
+        total += min(buffer->next.load(memory_order_acquire), PROFILER_ZONES_PER_THREAD);
+    return total;
+}
+
+size_t UProfilerZonesDropped() {
+    lock_guard<mutex> lock(gRegistryMutex);
+    size_t total = 0;
+    for (const unique_ptr<ThreadBuffer>& buffer : gBuffers) {
+        size_t next = buffer->next.load(memory_order_acquire);
+        total += next - min(next, PROFILER_ZONES_PER_THREAD);
+    }
+    return total;
+}
@@ -0,0 +1,111 @@
+#ifndef CPU_PROFILER_H
+#define CPU_PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define PROFILER_USE_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILER_USE_TSC
+#endif
+
+// CPU profiling zones. PROFILE_ZONE("name") times the rest of the enclosing block and
+// records it into a ring buffer owned by the calling thread, so recording takes no
+// lock. The macros compile to nothing unless ENABLE_PROFILING is defined (add it to
+// the C/C++ preprocessor definitions). Zone names must be string literals.
+// The capture can be written as Chrome trace JSON, which chrome://tracing and
+// ui.perfetto.dev both open.
+
+#ifdef ENABLE_PROFILING
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) CpuProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__FUNCTION__)
+#define PROFILE_THREAD(name) UProfilerSetThreadName(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_FUNCTION() ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
+
+// Zones kept per thread; older ones are overwritten once a thread records more
+const size_t PROFILER_ZONES_PER_THREAD = 1 << 16;
+
+// Raw zone timestamp. On x86 this is the time stamp counter, which reads in a few
+// nanoseconds where a system clock call can cost tens; it runs at a constant rate on
+// any CPU this targets and is converted to nanoseconds only when a trace is written.
+inline int64_t UProfilerTicks() {
+#ifdef PROFILER_USE_TSC
+    return static_cast<int64_t>(__rdtsc());
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Nanoseconds per tick, measured against steady_clock since the program started
+double UProfilerNanosecondsPerTick();
+
+struct ProfilerZoneRecord {
+    const char* name;
+    int64_t beginTicks;
+    int64_t endTicks;
+};
+
+// A thread's ring buffer, written only by that thread. next counts every zone ever
+// recorded; the release store publishes the slot to the exporter.
+struct ProfilerThreadBuffer {
+    ProfilerZoneRecord* zones;
+    std::atomic<size_t> next;
+};
+
+// The calling thread's buffer, null until the thread records its first zone
+extern thread_local ProfilerThreadBuffer* tProfilerBuffer;
+
+// Creates and registers the calling thread's buffer
+ProfilerThreadBuffer& UProfilerCreateThreadBuffer();
+
+// Appends a finished zone to the calling thread's ring buffer. Inline so that, past a
+// thread's first zone, recording is a few stores and no call.
+inline void URecordZone(const char* name, int64_t beginTicks, int64_t endTicks) {
+    ProfilerThreadBuffer* buffer = tProfilerBuffer;
+    if (buffer == nullptr)
+        buffer = &UProfilerCreateThreadBuffer();
+    size_t index = buffer->next.load(std::memory_order_relaxed);
+    ProfilerZoneRecord& zone = buffer->zones[index & (PROFILER_ZONES_PER_THREAD - 1)];
+    zone.name = name;
+    zone.beginTicks = beginTicks;
+    zone.endTicks = endTicks;
+    buffer->next.store(index + 1, std::memory_order_release);
+}
+
+// Labels the calling thread in the exported trace
+void UProfilerSetThreadName(const char* name);
+
+// Writes every thread's buffered zones as Chrome trace events. Call while no other
+// thread is recording, e.g. after the render thread has stopped.
+bool UWriteChromeTrace(const char* path);
+
+// Zones currently buffered, and zones lost to ring buffer wrap-around
+size_t UProfilerZoneCount();
+size_t UProfilerZonesDropped();
+
+class CpuProfileZone {
+public:
+    explicit CpuProfileZone(const char* name) : mName(name), mBegin(UProfilerTicks()) {}
+    ~CpuProfileZone() { URecordZone(mName, mBegin, UProfilerTicks()); }
+
+    CpuProfileZone(const CpuProfileZone&) = delete;
+    CpuProfileZone& operator=(const CpuProfileZone&) = delete;
+
+private:
+    const char* mName;
+    int64_t mBegin;
+};
+
+#endif
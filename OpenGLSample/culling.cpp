@@ -0,0 +1,68 @@
+#include "culling.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cstdint>
+
+Frustum Frustum::FromMatrix(const glm::mat4& m) {
+    // Gribb/Hartmann plane extraction; glm matrices are column-major so m[c][r]
+    glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    Frustum frustum;
+    frustum.planes[0] = row3 + row0;   // left
+    frustum.planes[1] = row3 - row0;   // right
+    frustum.planes[2] = row3 + row1;   // bottom
+    frustum.planes[3] = row3 - row1;   // top
+    frustum.planes[4] = row3 + row2;   // near
+    frustum.planes[5] = row3 - row2;   // far
+
+    for (glm::vec4& plane : frustum.planes)
+        plane /= glm::length(glm::vec3(plane));
+    return frustum;
+}
+
+bool Frustum::IntersectsSphere(const glm::vec3& center, float radius) const {
+    for (const glm::vec4& plane : planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+            return false;
+    }
+    return true;
+}
+
+void UCullEntities(EntityStore& store, const Frustum& frustum, const glm::vec3& viewPos, std::vector<DrawItem>& visible) {
+    visible.clear();
+
+    const ComponentMask required = COMPONENT_TRANSFORM | COMPONENT_BOUNDS | COMPONENT_MESH | COMPONENT_MATERIAL;
+    std::vector<uint8_t> inside;
+
+    store.ForEach(required, [&](const EntityColumns& columns) {
+        // Test in parallel into a flag array, then compact in order so the result is deterministic
+        inside.resize(columns.end);
+        const Bounds* bounds = columns.bounds;
+        UParallelFor(columns.end, 16384, [&](size_t begin, size_t end) {
+            for (size_t row = begin; row < end; ++row)
+                inside[row] = frustum.IntersectsSphere(bounds[row].center, bounds[row].radius) ? 1 : 0;
+        });
+
+        for (size_t row = 0; row < columns.end; ++row) {
+            if (!inside[row])
+                continue;
+            DrawItem item;
+            item.model = &columns.transforms[row];
+            item.mesh = columns.meshes[row];
+            item.material = columns.materials[row];
+            item.viewDepth = glm::distance(viewPos, bounds[row].center);
+            item.lodState = columns.lods != nullptr ? &columns.lods[row] : nullptr;
+            visible.push_back(item);
+        }
+    });
+
+    std::sort(visible.begin(), visible.end(), [](const DrawItem& a, const DrawItem& b) {
+        if (a.material != b.material)
+            return a.material < b.material;
+        return a.mesh < b.mesh;
+    });
+}
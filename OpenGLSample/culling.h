@@ -0,0 +1,35 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "entity_store.h"
+
+// View frustum as six inward-facing planes (xyz = normal, w = distance)
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // Extracts the planes from a projection * view matrix
+    static Frustum FromMatrix(const glm::mat4& viewProjection);
+
+    bool IntersectsSphere(const glm::vec3& center, float radius) const;
+};
+
+// A visible entity as seen by the render pass. The transform pointer stays valid
+// until the entity store is next modified structurally (create or destroy).
+struct DrawItem {
+    const glm::mat4* model;
+    MeshHandle mesh;
+    MaterialHandle material;
+    float viewDepth;
+    LodState* lodState;         // null for entities without COMPONENT_LOD
+};
+
+// Culling pass: tests every entity with bounds, a mesh and a material against the
+// frustum and returns the survivors sorted by material, then mesh, to keep state
+// changes in the render pass low
+void UCullEntities(EntityStore& store, const Frustum& frustum, const glm::vec3& viewPos, std::vector<DrawItem>& visible);
+
+#endif
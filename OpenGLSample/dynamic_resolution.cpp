@@ -0,0 +1,270 @@
+#include "dynamic_resolution.h"
+#include "gl_trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace std;
+
+const uint64_t TemporalUpscaler::JITTER_PHASES;
+const float TemporalUpscaler::HISTORY_WEIGHT = 0.9f;
+
+namespace {
+    // Weight of a new sample in the smoothed GPU time
+    const double SMOOTHING = 0.2;
+
+    GLuint CreateTexture(GLenum internalFormat, GLint filter, int width, int height) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+
+    bool CheckFramebuffer(const char* name) {
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (status == GL_FRAMEBUFFER_COMPLETE)
+            return true;
+        cout << name << " framebuffer incomplete: 0x" << hex << status << dec << endl;
+        return false;
+    }
+
+    float Halton(uint64_t index, uint64_t base) {
+        float result = 0.0f;
+        float fraction = 1.0f;
+        while (index > 0) {
+            fraction /= base;
+            result += fraction * (index % base);
+            index /= base;
+        }
+        return result;
+    }
+}
+
+void ResolutionController::Configure(const Settings& settings) {
+    mSettings = settings;
+    mScale = settings.maxScale;
+    mSmoothedSamples = 0;
+    mIgnore = 0;
+}
+
+float ResolutionController::Update(double gpuMs) {
+    ++mSamples;
+    mTotalScale += mScale;
+    mMinScale = min(mMinScale, mScale);
+    mMaxScale = max(mMaxScale, mScale);
+    mTotalGpuMs += gpuMs;
+    mMaxGpuMs = max(mMaxGpuMs, gpuMs);
+    if (gpuMs > mSettings.budgetMs)
+        ++mSamplesOverBudget;
+
+    // Still drawn at the previous scale
+    if (mIgnore > 0) {
+        --mIgnore;
+        return mScale;
+    }
+
+    mSmoothedMs = mSmoothedSamples == 0 ? gpuMs : mSmoothedMs + SMOOTHING * (gpuMs - mSmoothedMs);
+    ++mSmoothedSamples;
+
+    // A frame over budget is acted on at once; otherwise the smoothed time decides
+    double costMs = gpuMs > mSettings.budgetMs ? max(gpuMs, mSmoothedMs) : mSmoothedMs;
+    double target = mScale * sqrt(mSettings.budgetMs * mSettings.headroom / max(costMs, 1e-3));
+    target = floor(target / mSettings.step + 1e-3) * mSettings.step;
+    float scale = static_cast<float>(min<double>(mSettings.maxScale, max<double>(mSettings.minScale, target)));
+
+    bool lower = scale < mScale;
+    bool raise = scale > mScale && mSmoothedSamples >= mSettings.cooldownFrames;
+    if (lower || raise) {
+        mScale = scale;
+        mSmoothedSamples = 0;
+        mIgnore = mSettings.latencyFrames;
+        ++mChanges;
+    }
+    return mScale;
+}
+
+ResolutionController::Stats ResolutionController::GetStats() const {
+    Stats stats;
+    stats.samples = mSamples;
+    stats.changes = mChanges;
+    stats.samplesOverBudget = mSamplesOverBudget;
+    if (mSamples > 0) {
+        stats.averageScale = mTotalScale / mSamples;
+        stats.minScale = mMinScale;
+        stats.maxScale = mMaxScale;
+        stats.averageGpuMs = mTotalGpuMs / mSamples;
+        stats.maxGpuMs = mMaxGpuMs;
+    }
+    return stats;
+}
+
+bool TemporalUpscaler::Create() {
+    Destroy();
+
+    // Core profile refuses to draw without a bound VAO, even with no attributes
+    glGenVertexArrays(1, &mFullscreenVao);
+    return glGetError() == GL_NO_ERROR;
+}
+
+void TemporalUpscaler::Destroy() {
+    DestroyScene();
+    DestroyHistory();
+    if (mFullscreenVao != 0)
+        glDeleteVertexArrays(1, &mFullscreenVao);
+    mFullscreenVao = 0;
+}
+
+bool TemporalUpscaler::Resize(int renderWidth, int renderHeight, int outputWidth, int outputHeight) {
+    // The output size bounds the render size, so the scene target is allocated at it
+    bool ok = true;
+    int sceneWidth = max(renderWidth, outputWidth);
+    int sceneHeight = max(renderHeight, outputHeight);
+    if (sceneWidth != mSceneWidth || sceneHeight != mSceneHeight)
+        ok = CreateScene(sceneWidth, sceneHeight);
+    if (outputWidth != mOutputWidth || outputHeight != mOutputHeight)
+        ok = CreateHistory(outputWidth, outputHeight) && ok;
+    mRenderWidth = renderWidth;
+    mRenderHeight = renderHeight;
+    return ok;
+}
+
+bool TemporalUpscaler::CreateScene(int width, int height) {
+    DestroyScene();
+    mSceneWidth = width;
+    mSceneHeight = height;
+
+    mSceneColor = CreateTexture(GL_RGBA8, GL_LINEAR, width, height);
+    mSceneDepth = CreateTexture(GL_DEPTH_COMPONENT24, GL_NEAREST, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &mSceneFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, mSceneFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mSceneColor, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, mSceneDepth, 0);
+    bool complete = CheckFramebuffer("Upscaler scene");
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!complete)
+        DestroyScene();
+    return complete;
+}
+
+bool TemporalUpscaler::CreateHistory(int width, int height) {
+    DestroyHistory();
+    mOutputWidth = width;
+    mOutputHeight = height;
+
+    bool complete = true;
+    glGenFramebuffers(2, mHistoryFramebuffers);
+    for (int i = 0; i < 2; ++i) {
+        mHistory[i] = CreateTexture(GL_RGBA16F, GL_LINEAR, width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, mHistoryFramebuffers[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mHistory[i], 0);
+        complete = CheckFramebuffer("Upscaler history") && complete;
+
+        // Never blended in before the first resolve, but a NaN would survive the zero weight
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!complete)
+        DestroyHistory();
+    return complete;
+}
+
+void TemporalUpscaler::DestroyScene() {
+    if (mSceneFramebuffer != 0)
+        glDeleteFramebuffers(1, &mSceneFramebuffer);
+    GLuint textures[2] = { mSceneColor, mSceneDepth };
+    for (GLuint texture : textures) {
+        if (texture != 0)
+            glDeleteTextures(1, &texture);
+    }
+
+    mSceneFramebuffer = mSceneColor = mSceneDepth = 0;
+    mSceneWidth = mSceneHeight = 0;
+}
+
+void TemporalUpscaler::DestroyHistory() {
+    if (mHistoryFramebuffers[0] != 0)
+        glDeleteFramebuffers(2, mHistoryFramebuffers);
+    if (mHistory[0] != 0)
+        glDeleteTextures(2, mHistory);
+
+    mHistoryFramebuffers[0] = mHistoryFramebuffers[1] = mHistory[0] = mHistory[1] = 0;
+    mOutputWidth = mOutputHeight = 0;
+    mHistoryValid = false;
+}
+
+glm::vec2 TemporalUpscaler::Jitter(uint64_t frame) {
+    // Index 0 of both sequences is 0; start at 1 so every phase is off-centre
+    uint64_t index = frame % JITTER_PHASES + 1;
+    return glm::vec2(Halton(index, 2) - 0.5f, Halton(index, 3) - 0.5f);
+}
+
+glm::mat4 TemporalUpscaler::JitterProjection(const glm::mat4& projection, const glm::vec2& jitter, int width, int height) {
+    // A clip-space translation, so it works for perspective and orthographic projections alike
+    glm::mat4 shift(1.0f);
+    shift[3][0] = 2.0f * jitter.x / width;
+    shift[3][1] = 2.0f * jitter.y / height;
+    return shift * projection;
+}
+
+void TemporalUpscaler::Resolve(GLuint programId, GLuint depthTexture, const glm::mat4& view, const glm::mat4& projection,
+    const glm::vec2& jitter, GLuint outputFramebuffer) {
+    // History is kept unjittered, so reprojection uses the camera without the offset
+    glm::mat4 viewProjection = JitterProjection(projection, -jitter, mRenderWidth, mRenderHeight) * view;
+    glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+    glm::vec2 jitterUV(jitter.x / mRenderWidth, jitter.y / mRenderHeight);
+    glm::vec2 sceneTexel(1.0f / mRenderWidth, 1.0f / mRenderHeight);
+    glm::vec2 sceneScale(static_cast<float>(mRenderWidth) / mSceneWidth, static_cast<float>(mRenderHeight) / mSceneHeight);
+    glm::vec2 sceneMaxUV((mRenderWidth - 0.5f) / mSceneWidth, (mRenderHeight - 0.5f) / mSceneHeight);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, mHistoryFramebuffers[mCurrent]);
+    glViewport(0, 0, mOutputWidth, mOutputHeight);
+    glDisable(GL_DEPTH_TEST);
+
+    glUseProgram(programId);
+    glActiveTexture(GL_TEXTURE0 + UNIT_SCENE_COLOR);
+    glBindTexture(GL_TEXTURE_2D, mSceneColor);
+    glActiveTexture(GL_TEXTURE0 + UNIT_SCENE_DEPTH);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glActiveTexture(GL_TEXTURE0 + UNIT_HISTORY);
+    glBindTexture(GL_TEXTURE_2D, mHistory[1 - mCurrent]);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform1i(glGetUniformLocation(programId, "sceneColor"), UNIT_SCENE_COLOR);
+    glUniform1i(glGetUniformLocation(programId, "sceneDepth"), UNIT_SCENE_DEPTH);
+    glUniform1i(glGetUniformLocation(programId, "history"), UNIT_HISTORY);
+    glUniformMatrix4fv(glGetUniformLocation(programId, "inverseViewProjection"), 1, GL_FALSE,
+        glm::value_ptr(inverseViewProjection));
+    glUniformMatrix4fv(glGetUniformLocation(programId, "previousViewProjection"), 1, GL_FALSE,
+        glm::value_ptr(mPreviousViewProjection));
+    glUniform2fv(glGetUniformLocation(programId, "jitterUV"), 1, glm::value_ptr(jitterUV));
+    glUniform2fv(glGetUniformLocation(programId, "sceneTexel"), 1, glm::value_ptr(sceneTexel));
+    glUniform2fv(glGetUniformLocation(programId, "sceneScale"), 1, glm::value_ptr(sceneScale));
+    glUniform2fv(glGetUniformLocation(programId, "sceneMaxUV"), 1, glm::value_ptr(sceneMaxUV));
+    glUniform1f(glGetUniformLocation(programId, "historyWeight"), mHistoryValid ? HISTORY_WEIGHT : 0.0f);
+
+    glBindVertexArray(mFullscreenVao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, mHistoryFramebuffers[mCurrent]);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, outputFramebuffer);
+    glBlitFramebuffer(0, 0, mOutputWidth, mOutputHeight, 0, 0, mOutputWidth, mOutputHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+
+    mPreviousViewProjection = viewProjection;
+    mHistoryValid = true;
+    mCurrent = 1 - mCurrent;
+}
@@ -0,0 +1,136 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Picks the render resolution scale from measured GPU frame times so the frame stays
+// within a budget. Pixel cost grows with the square of the scale, so the next scale is
+// the current one times the square root of budget over cost, rounded down to a whole
+// step. Over budget it drops at once; it only rises again after cooldownFrames samples
+// in a row have left room. Samples drawn before a change reach the controller
+// latencyFrames late, so that many are ignored after every change.
+class ResolutionController {
+public:
+    struct Settings {
+        double budgetMs = 16.0;
+        double headroom = 0.9;          // share of the budget to aim for
+        float minScale = 0.5f;
+        float maxScale = 1.0f;
+        float step = 0.05f;
+        size_t cooldownFrames = 30;
+        size_t latencyFrames = 5;
+    };
+
+    struct Stats {
+        size_t samples = 0;
+        size_t changes = 0;
+        size_t samplesOverBudget = 0;
+        double averageScale = 0.0;
+        float minScale = 0.0f;
+        float maxScale = 0.0f;
+        double averageGpuMs = 0.0;
+        double maxGpuMs = 0.0;
+    };
+
+    void Configure(const Settings& settings);
+
+    // Takes the GPU time of one frame and returns the scale to render the next one at
+    float Update(double gpuMs);
+
+    float Scale() const { return mScale; }
+    const Settings& GetSettings() const { return mSettings; }
+    Stats GetStats() const;
+
+private:
+    Settings mSettings;
+    float mScale = 1.0f;
+    double mSmoothedMs = 0.0;
+    size_t mSmoothedSamples = 0;
+    size_t mIgnore = 0;
+
+    size_t mSamples = 0;
+    size_t mChanges = 0;
+    size_t mSamplesOverBudget = 0;
+    double mTotalScale = 0.0;
+    float mMinScale = 1.0f;
+    float mMaxScale = 0.0f;
+    double mTotalGpuMs = 0.0;
+    double mMaxGpuMs = 0.0;
+};
+
+// Upsamples a scene drawn below the output resolution back up to it. The scene is drawn
+// into the lower-left corner of a colour and depth target kept at the output size, so a
+// new scale reallocates nothing, through a projection shifted by a different sub-pixel
+// offset every frame (Halton 2,3 over JITTER_PHASES frames).
+// Resolve() finds where each output pixel was in the previous frame from the scene
+// depth and both frames' camera matrices, and blends the current sample into the
+// history found there. The history is clamped to the colour range of the sample's
+// neighbourhood, so disoccluded and moving surfaces do not leave trails. With the
+// jitter, the history gathers detail at the output resolution over a few frames.
+class TemporalUpscaler {
+public:
+    static const uint64_t JITTER_PHASES = 8;
+    static const float HISTORY_WEIGHT;
+
+    // Texture units Resolve() uses
+    enum TextureUnit {
+        UNIT_SCENE_COLOR = 2,
+        UNIT_SCENE_DEPTH = 3,
+        UNIT_HISTORY = 4
+    };
+
+    bool Create();
+    void Destroy();
+
+    // Sets the render size; reallocates the scene target or the history only when the
+    // output size changes, which starts the accumulation over
+    bool Resize(int renderWidth, int renderHeight, int outputWidth, int outputHeight);
+
+    // Scene target; forward shading draws its depth here, deferred into the G-buffer
+    GLuint SceneFramebuffer() const { return mSceneFramebuffer; }
+    GLuint SceneDepth() const { return mSceneDepth; }
+
+    // Offset in render pixels for a frame, each component in [-0.5, 0.5)
+    static glm::vec2 Jitter(uint64_t frame);
+
+    // Moves the image by jitter pixels of a width x height target
+    static glm::mat4 JitterProjection(const glm::mat4& projection, const glm::vec2& jitter, int width, int height);
+
+    // Blends the scene into the history and copies the result to outputFramebuffer.
+    // projection is the jittered one the scene was drawn with; depthTexture has the scene
+    // target's size, like the G-buffer's. Leaves the viewport at the output size.
+    void Resolve(GLuint programId, GLuint depthTexture, const glm::mat4& view, const glm::mat4& projection,
+        const glm::vec2& jitter, GLuint outputFramebuffer);
+
+    int RenderWidth() const { return mRenderWidth; }
+    int RenderHeight() const { return mRenderHeight; }
+
+private:
+    bool CreateScene(int width, int height);
+    bool CreateHistory(int width, int height);
+    void DestroyScene();
+    void DestroyHistory();
+
+    GLuint mSceneFramebuffer = 0;
+    GLuint mSceneColor = 0;
+    GLuint mSceneDepth = 0;
+    GLuint mHistoryFramebuffers[2] = { 0, 0 };
+    GLuint mHistory[2] = { 0, 0 };
+    GLuint mFullscreenVao = 0;
+    int mSceneWidth = 0;                // allocated; the scene covers RenderWidth() x RenderHeight() of it
+    int mSceneHeight = 0;
+    int mRenderWidth = 0;
+    int mRenderHeight = 0;
+    int mOutputWidth = 0;
+    int mOutputHeight = 0;
+
+    int mCurrent = 0;                   // history written by the next Resolve()
+    bool mHistoryValid = false;
+    glm::mat4 mPreviousViewProjection = glm::mat4(1.0f);
+};
+
+#endif
@@ -0,0 +1,189 @@
+#include "entity_store.h"
+#include "parallel.h"
+
+#include <cassert>
+
+namespace {
+    // Rows per task when an archetype is split across the worker pool
+    const size_t PARALLEL_ROWS = 16384;
+
+    template <typename T>
+    void SwapRemove(std::vector<T>& column, size_t row) {
+        if (column.empty())
+            return;
+        column[row] = column.back();
+        column.pop_back();
+    }
+}
+
+uint32_t EntityStore::FindOrCreateArchetype(ComponentMask mask) {
+    for (size_t i = 0; i < mArchetypes.size(); ++i) {
+        if (mArchetypes[i].mask == mask)
+            return static_cast<uint32_t>(i);
+    }
+
+    Archetype archetype;
+    archetype.mask = mask;
+    mArchetypes.push_back(archetype);
+    return static_cast<uint32_t>(mArchetypes.size() - 1);
+}
+
+void EntityStore::Reserve(ComponentMask mask, size_t count) {
+    Archetype& archetype = mArchetypes[FindOrCreateArchetype(mask)];
+    size_t total = archetype.entities.size() + count;
+
+    archetype.entities.reserve(total);
+    if (mask & COMPONENT_TRANSFORM)
+        archetype.transforms.reserve(total);
+    if (mask & COMPONENT_BOUNDS)
+        archetype.bounds.reserve(total);
+    if (mask & COMPONENT_MESH)
+        archetype.meshes.reserve(total);
+    if (mask & COMPONENT_MATERIAL)
+        archetype.materials.reserve(total);
+    if (mask & COMPONENT_SCENE_NODE)
+        archetype.nodes.reserve(total);
+    if (mask & COMPONENT_LOD)
+        archetype.lods.reserve(total);
+
+    mRecords.reserve(mRecords.size() + count);
+}
+
+Entity EntityStore::Create(ComponentMask mask) {
+    uint32_t archetypeIndex = FindOrCreateArchetype(mask);
+    Archetype& archetype = mArchetypes[archetypeIndex];
+
+    uint32_t index;
+    if (!mFreeIndices.empty()) {
+        index = mFreeIndices.back();
+        mFreeIndices.pop_back();
+    }
+    else {
+        index = static_cast<uint32_t>(mRecords.size());
+        Record record = { 0, 0, 0, false };
+        mRecords.push_back(record);
+    }
+
+    Record& record = mRecords[index];
+    record.archetype = archetypeIndex;
+    record.row = static_cast<uint32_t>(archetype.entities.size());
+    record.alive = true;
+
+    Entity entity = { index, record.generation };
+    archetype.entities.push_back(entity);
+    if (mask & COMPONENT_TRANSFORM)
+        archetype.transforms.push_back(glm::mat4(1.0f));
+    if (mask & COMPONENT_BOUNDS)
+        archetype.bounds.push_back(Bounds{ glm::vec3(0.0f), 0.0f });
+    if (mask & COMPONENT_MESH)
+        archetype.meshes.push_back(0);
+    if (mask & COMPONENT_MATERIAL)
+        archetype.materials.push_back(0);
+    if (mask & COMPONENT_SCENE_NODE)
+        archetype.nodes.push_back(SceneGraph::kNoParent);
+    if (mask & COMPONENT_LOD)
+        archetype.lods.push_back(LodState());
+
+    ++mAliveCount;
+    return entity;
+}
+
+void EntityStore::Destroy(Entity entity) {
+    if (!IsAlive(entity))
+        return;
+
+    Record& record = mRecords[entity.index];
+    Archetype& archetype = mArchetypes[record.archetype];
+    size_t row = record.row;
+
+    // Move the last row into the hole so columns stay dense
+    Entity moved = archetype.entities.back();
+    SwapRemove(archetype.entities, row);
+    SwapRemove(archetype.transforms, row);
+    SwapRemove(archetype.bounds, row);
+    SwapRemove(archetype.meshes, row);
+    SwapRemove(archetype.materials, row);
+    SwapRemove(archetype.nodes, row);
+    SwapRemove(archetype.lods, row);
+    if (moved.index != entity.index)
+        mRecords[moved.index].row = static_cast<uint32_t>(row);
+
+    record.alive = false;
+    ++record.generation;
+    mFreeIndices.push_back(entity.index);
+    --mAliveCount;
+}
+
+bool EntityStore::IsAlive(Entity entity) const {
+    return entity.index < mRecords.size()
+        && mRecords[entity.index].alive
+        && mRecords[entity.index].generation == entity.generation;
+}
+
+const EntityStore::Record& EntityStore::RecordOf(Entity entity) const {
+    assert(IsAlive(entity));
+    return mRecords[entity.index];
+}
+
+ComponentMask EntityStore::MaskOf(Entity entity) const {
+    return mArchetypes[RecordOf(entity).archetype].mask;
+}
+
+glm::mat4& EntityStore::Transform(Entity entity) {
+    const Record& record = RecordOf(entity);
+    return mArchetypes[record.archetype].transforms[record.row];
+}
+
+Bounds& EntityStore::BoundsOf(Entity entity) {
+    const Record& record = RecordOf(entity);
+    return mArchetypes[record.archetype].bounds[record.row];
+}
+
+MeshHandle& EntityStore::Mesh(Entity entity) {
+    const Record& record = RecordOf(entity);
+    return mArchetypes[record.archetype].meshes[record.row];
+}
+
+MaterialHandle& EntityStore::Material(Entity entity) {
+    const Record& record = RecordOf(entity);
+    return mArchetypes[record.archetype].materials[record.row];
+}
+
+SceneGraph::NodeId& EntityStore::Node(Entity entity) {
+    const Record& record = RecordOf(entity);
+    return mArchetypes[record.archetype].nodes[record.row];
+}
+
+EntityColumns EntityStore::ColumnsOf(Archetype& archetype, size_t begin, size_t end) {
+    EntityColumns columns;
+    columns.mask = archetype.mask;
+    columns.begin = begin;
+    columns.end = end;
+    columns.entities = archetype.entities.data();
+    columns.transforms = archetype.transforms.empty() ? nullptr : archetype.transforms.data();
+    columns.bounds = archetype.bounds.empty() ? nullptr : archetype.bounds.data();
+    columns.meshes = archetype.meshes.empty() ? nullptr : archetype.meshes.data();
+    columns.materials = archetype.materials.empty() ? nullptr : archetype.materials.data();
+    columns.nodes = archetype.nodes.empty() ? nullptr : archetype.nodes.data();
+    columns.lods = archetype.lods.empty() ? nullptr : archetype.lods.data();
+    return columns;
+}
+
+void EntityStore::ForEach(ComponentMask required, const std::function<void(const EntityColumns&)>& fn) {
+    for (Archetype& archetype : mArchetypes) {
+        if ((archetype.mask & required) != required || archetype.entities.empty())
+            continue;
+        fn(ColumnsOf(archetype, 0, archetype.entities.size()));
+    }
+}
+
+void EntityStore::ParallelForEach(ComponentMask required, const std::function<void(const EntityColumns&)>& fn) {
+    for (Archetype& archetype : mArchetypes) {
+        if ((archetype.mask & required) != required || archetype.entities.empty())
+            continue;
+
+        UParallelFor(archetype.entities.size(), PARALLEL_ROWS, [&](size_t begin, size_t end) {
+            fn(ColumnsOf(archetype, begin, end));
+        });
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef ENTITY_STORE_H
+#define ENTITY_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh_lod.h"
+#include "scene_graph.h"
+
+// Components an entity can carry. Entities with the same set of components share an
+// archetype, and each archetype stores every component in its own tightly packed column
+// so passes only touch the data they read.
+enum ComponentBits : uint32_t {
+    COMPONENT_TRANSFORM  = 1u << 0,   // world matrix
+    COMPONENT_BOUNDS     = 1u << 1,   // world-space bounding sphere
+    COMPONENT_MESH       = 1u << 2,   // index into the mesh table
+    COMPONENT_MATERIAL   = 1u << 3,   // index into the material table
+    COMPONENT_SCENE_NODE = 1u << 4,   // node in the SceneGraph driving the transform
+    COMPONENT_DYNAMIC    = 1u << 5,   // tag, no column: moves often, so it stays out of cached data
+    COMPONENT_LOD        = 1u << 6    // level of detail last drawn, for per-instance hysteresis
+};
+typedef uint32_t ComponentMask;
+
+typedef uint32_t MeshHandle;
+typedef uint32_t MaterialHandle;
+
+struct Bounds {
+    glm::vec3 center;
+    float radius;
+};
+
+struct Entity {
+    uint32_t index;
+    uint32_t generation;
+};
+
+// One archetype's rows, handed to iteration callbacks. Columns the archetype does not
+// have are null. Rows [begin, end) are the ones the callback should process.
+struct EntityColumns {
+    ComponentMask mask;   // every component of the archetype, tags included
+    size_t begin;
+    size_t end;
+    const Entity* entities;
+    glm::mat4* transforms;
+    Bounds* bounds;
+    MeshHandle* meshes;
+    MaterialHandle* materials;
+    SceneGraph::NodeId* nodes;
+    LodState* lods;
+};
+
+class EntityStore {
+public:
+    Entity Create(ComponentMask mask);
+    void Destroy(Entity entity);
+    bool IsAlive(Entity entity) const;
+
+    // Pre-sizes an archetype's columns before a large batch of Create() calls
+    void Reserve(ComponentMask mask, size_t count);
+
+    ComponentMask MaskOf(Entity entity) const;
+    glm::mat4& Transform(Entity entity);
+    Bounds& BoundsOf(Entity entity);
+    MeshHandle& Mesh(Entity entity);
+    MaterialHandle& Material(Entity entity);
+    SceneGraph::NodeId& Node(Entity entity);
+
+    // Visits every archetype containing all of the required components, one call per
+    // archetype covering all of its rows
+    void ForEach(ComponentMask required, const std::function<void(const EntityColumns&)>& fn);
+
+    // Same as ForEach, but large archetypes are split into row ranges processed
+    // on the worker pool; the callback must only write to its own rows
+    void ParallelForEach(ComponentMask required, const std::function<void(const EntityColumns&)>& fn);
+
+    size_t Count() const { return mAliveCount; }
+    size_t ArchetypeCount() const { return mArchetypes.size(); }
+
+private:
+    struct Archetype {
+        ComponentMask mask;
+        std::vector<Entity> entities;
+        std::vector<glm::mat4> transforms;
+        std::vector<Bounds> bounds;
+        std::vector<MeshHandle> meshes;
+        std::vector<MaterialHandle> materials;
+        std::vector<SceneGraph::NodeId> nodes;
+        std::vector<LodState> lods;
+    };
+
+    struct Record {
+        uint32_t archetype;
+        uint32_t row;
+        uint32_t generation;
+        bool alive;
+    };
+
+    uint32_t FindOrCreateArchetype(ComponentMask mask);
+    EntityColumns ColumnsOf(Archetype& archetype, size_t begin, size_t end);
+    const Record& RecordOf(Entity entity) const;
+
+    std::vector<Archetype> mArchetypes;
+    std::vector<Record> mRecords;
+    std::vector<uint32_t> mFreeIndices;
+    size_t mAliveCount = 0;
+};
+
+#endif
@@ -0,0 +1,327 @@
+#include "frame_capture.h"
+#include "gl_trace.h"
+#include "image_writer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#define popen _popen
+#define pclose _pclose
+#endif
+
+using namespace std;
+
+const size_t FrameCapture::SLOT_COUNT;
+
+FrameCapture::~FrameCapture() {
+    // Without a context the buffers are left to it; the writer thread must not outlive us
+    if (mWriter.joinable()) {
+        {
+            lock_guard<mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mWake.notify_one();
+        mWriter.join();
+    }
+}
+
+bool FrameCapture::Create(const char* path, int fps) {
+    Destroy();
+
+    string target(path);
+    mPipe = false;
+    mStream = nullptr;
+    if (target == "-") {
+        mFormat = FORMAT_Y4M;
+        mStream = stdout;
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    }
+    else if (!target.empty() && target[0] == '|') {
+        mFormat = FORMAT_Y4M;
+#ifdef _WIN32
+        mStream = popen(target.c_str() + 1, "wb");
+#else
+        mStream = popen(target.c_str() + 1, "w");
+#endif
+        mPipe = true;
+    }
+    else {
+        size_t dot = target.find_last_of('.');
+        mExtension = dot == string::npos ? string() : target.substr(dot);
+        mBasePath = target.substr(0, dot);
+        string extension(mExtension);
+        transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+        if (extension == ".png")
+            mFormat = FORMAT_PNG;
+        else if (extension == ".qoi")
+            mFormat = FORMAT_QOI;
+        else if (extension == ".y4m") {
+            mFormat = FORMAT_Y4M;
+            mStream = fopen(path, "wb");
+        }
+        else {
+            cout << "Unknown capture format " << path << "; use .png, .qoi, .y4m, - or |command" << endl;
+            return false;
+        }
+    }
+    if (mFormat == FORMAT_Y4M && mStream == nullptr) {
+        cout << "Failed to open capture stream " << path << endl;
+        return false;
+    }
+
+    mFps = max(fps, 1);
+    mStreamWidth = 0;
+    mStreamHeight = 0;
+    mSizeWarned = false;
+    mNext = 0;
+    mOldest = 0;
+    mReadingCount = 0;
+    mFramesCaptured = 0;
+    mStopping = false;
+    mStats = Stats();
+    mWriter = thread(&FrameCapture::WriterMain, this);
+    return true;
+}
+
+void FrameCapture::Destroy() {
+    if (!mWriter.joinable())
+        return;
+
+    while (mReadingCount > 0)
+        Collect(true);
+    {
+        lock_guard<mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mWake.notify_one();
+    mWriter.join();
+
+    for (Slot& slot : mSlots) {
+        if (slot.buffer != 0) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            glDeleteBuffers(1, &slot.buffer);
+        }
+        slot.buffer = 0;
+        slot.mapped = nullptr;
+        slot.capacity = 0;
+        slot.state.store(SLOT_FREE);
+    }
+
+    if (mStream != nullptr) {
+        if (mPipe)
+            pclose(mStream);
+        else if (mStream == stdout)
+            fflush(stdout);
+        else
+            fclose(mStream);
+    }
+    mStream = nullptr;
+}
+
+void FrameCapture::Capture(GLuint framebuffer, GLenum readBuffer, int width, int height) {
+    if (!Active() || width <= 0 || height <= 0)
+        return;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // Pass on whatever has finished; the slot about to be reused is waited for only if
+    // the GPU is SLOT_COUNT frames behind
+    Collect(false);
+    Slot& slot = mSlots[mNext];
+    if (slot.state.load(memory_order_acquire) == SLOT_READING)
+        Collect(true);
+
+    const size_t bytes = static_cast<size_t>(width) * height * 4;
+    if (slot.state.load(memory_order_acquire) == SLOT_WRITING || (slot.capacity < bytes && !Allocate(slot, bytes))) {
+        ++mStats.dropped;
+    }
+    else {
+        GLint previousRead = 0;
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glReadBuffer(readBuffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<GLuint>(previousRead));
+
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.width = width;
+        slot.height = height;
+        slot.frame = mFramesCaptured++;
+        slot.state.store(SLOT_READING, memory_order_relaxed);
+        if (mReadingCount++ == 0)
+            mOldest = mNext;
+        mNext = (mNext + 1) % SLOT_COUNT;
+        ++mStats.captured;
+    }
+
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    mStats.captureMs += ms;
+    mStats.maxCaptureMs = max(mStats.maxCaptureMs, ms);
+}
+
+void FrameCapture::Collect(bool wait) {
+    while (mReadingCount > 0) {
+        Slot& slot = mSlots[mOldest];
+        GLenum status = glClientWaitSync(slot.fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            if (!wait)
+                return;
+            ++mStats.fenceWaits;
+            do {
+                status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            } while (status == GL_TIMEOUT_EXPIRED);
+            wait = false;
+        }
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+
+        // Coherent mapping: once the fence has signalled the writer can read the pixels as they are
+        slot.state.store(SLOT_WRITING, memory_order_relaxed);
+        {
+            lock_guard<mutex> lock(mMutex);
+            mQueue.push_back(&slot);
+        }
+        mWake.notify_one();
+        mOldest = (mOldest + 1) % SLOT_COUNT;
+        --mReadingCount;
+    }
+}
+
+bool FrameCapture::Allocate(Slot& slot, size_t bytes) {
+    if (slot.buffer != 0) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glDeleteBuffers(1, &slot.buffer);
+    }
+
+    const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &slot.buffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glBufferStorage(GL_PIXEL_PACK_BUFFER, bytes, NULL, flags);
+    slot.mapped = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, flags));
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (slot.mapped == nullptr) {
+        cout << "Failed to map a capture buffer of " << bytes << " bytes" << endl;
+        glDeleteBuffers(1, &slot.buffer);
+        slot.buffer = 0;
+        slot.capacity = 0;
+        return false;
+    }
+    slot.capacity = bytes;
+    return true;
+}
+
+void FrameCapture::WriterMain() {
+    for (;;) {
+        Slot* slot = nullptr;
+        {
+            unique_lock<mutex> lock(mMutex);
+            mWake.wait(lock, [this] { return mStopping || !mQueue.empty(); });
+            if (mQueue.empty())
+                return;
+            slot = mQueue.front();
+            mQueue.pop_front();
+        }
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        WriteFrame(*slot);
+        mStats.writeMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        ++mStats.written;
+        slot->state.store(SLOT_FREE, memory_order_release);
+    }
+}
+
+void FrameCapture::WriteFrame(const Slot& slot) {
+    if (mFormat == FORMAT_Y4M) {
+        WriteY4m(slot);
+        return;
+    }
+
+    // GL rows start at the bottom; images start at the top. Alpha is dropped.
+    const int width = slot.width, height = slot.height;
+    mScratch.resize(static_cast<size_t>(width) * height * 3);
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* source = slot.mapped + static_cast<size_t>(height - 1 - y) * width * 4;
+        uint8_t* row = mScratch.data() + static_cast<size_t>(y) * width * 3;
+        for (int x = 0; x < width; ++x) {
+            row[x * 3 + 0] = source[x * 4 + 0];
+            row[x * 3 + 1] = source[x * 4 + 1];
+            row[x * 3 + 2] = source[x * 4 + 2];
+        }
+    }
+
+    ostringstream path;
+    path << mBasePath << setw(4) << setfill('0') << slot.frame << mExtension;
+    bool written = mFormat == FORMAT_PNG
+        ? UWritePng(path.str().c_str(), width, height, 3, mScratch.data(), width * 3)
+        : UWriteQoi(path.str().c_str(), width, height, 3, mScratch.data(), width * 3);
+    if (!written)
+        cout << "Failed to write " << path.str() << endl;
+}
+
+// Full-range BT.601 (JPEG) 4:2:0; chroma is the average of each 2x2 block
+void FrameCapture::WriteY4m(const Slot& slot) {
+    const int width = slot.width, height = slot.height;
+    if (mStreamWidth == 0) {
+        mStreamWidth = width;
+        mStreamHeight = height;
+        fprintf(mStream, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, mFps);
+    }
+    if (width != mStreamWidth || height != mStreamHeight) {
+        if (!mSizeWarned)
+            cout << "Capture: frames resized to " << width << "x" << height << " are left out of the "
+                << mStreamWidth << "x" << mStreamHeight << " video stream" << endl;
+        mSizeWarned = true;
+        return;
+    }
+
+    const int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+    const size_t lumaBytes = static_cast<size_t>(width) * height;
+    const size_t chromaBytes = static_cast<size_t>(chromaWidth) * chromaHeight;
+    mScratch.resize(lumaBytes + 2 * chromaBytes);
+    uint8_t* luma = mScratch.data();
+    uint8_t* cb = luma + lumaBytes;
+    uint8_t* cr = cb + chromaBytes;
+
+    auto pixel = [&slot, width, height](int x, int y) {
+        return slot.mapped + (static_cast<size_t>(height - 1 - min(y, height - 1)) * width + min(x, width - 1)) * 4;
+    };
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const uint8_t* p = pixel(x, y);
+            luma[static_cast<size_t>(y) * width + x] = static_cast<uint8_t>((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+        }
+    }
+    for (int y = 0; y < chromaHeight; ++y) {
+        for (int x = 0; x < chromaWidth; ++x) {
+            int r = 0, g = 0, b = 0;
+            for (int i = 0; i < 4; ++i) {
+                const uint8_t* p = pixel(2 * x + (i & 1), 2 * y + (i >> 1));
+                r += p[0];
+                g += p[1];
+                b += p[2];
+            }
+            // r, g and b are sums of four pixels, hence two more bits of shift; 32896 is 128.5 * 256
+            size_t index = static_cast<size_t>(y) * chromaWidth + x;
+            cb[index] = static_cast<uint8_t>(min(255, (-43 * r - 85 * g + 128 * b + (32896 << 2)) >> 10));
+            cr[index] = static_cast<uint8_t>(min(255, (128 * r - 107 * g - 21 * b + (32896 << 2)) >> 10));
+        }
+    }
+
+    fputs("FRAME\n", mStream);
+    fwrite(mScratch.data(), 1, mScratch.size(), mStream);
+}
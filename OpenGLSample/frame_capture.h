@@ -0,0 +1,120 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Captures rendered frames without stalling the GPU. Capture() issues glReadPixels
+// into one of SLOT_COUNT persistently mapped pixel-pack buffers and fences it; the
+// copy runs on the GPU while later frames are drawn. Once a fence has signalled, a
+// writer thread reads the pixels straight out of the mapping, encodes them and hands
+// the slot back. If every slot is still busy the frame is dropped and counted, so a
+// slow disk never holds up rendering.
+//
+// The output path picks the format:
+//   name.png, name.qoi   one image per frame, the frame number inserted before the extension
+//   name.y4m             one raw 4:2:0 video stream
+//   -                    Y4M to standard output
+//   |command             Y4M piped to a command, e.g. "|ffmpeg -i - out.mp4"
+// Create(), Capture() and Destroy() run on the GL thread.
+class FrameCapture {
+public:
+    static const size_t SLOT_COUNT = 4;
+
+    enum Format {
+        FORMAT_PNG,
+        FORMAT_QOI,
+        FORMAT_Y4M
+    };
+
+    struct Stats {
+        size_t captured = 0;        // readbacks issued
+        size_t written = 0;         // frames the writer finished
+        size_t dropped = 0;         // frames skipped because every slot was busy
+        size_t fenceWaits = 0;      // readbacks the GL thread had to wait for
+        double captureMs = 0.0;     // GL thread time spent in Capture(), all frames
+        double maxCaptureMs = 0.0;
+        double writeMs = 0.0;       // writer thread time encoding and writing
+    };
+
+    ~FrameCapture();
+
+    // fps only goes into the Y4M header
+    bool Create(const char* path, int fps);
+
+    // Waits for outstanding readbacks, lets the writer finish and releases everything
+    void Destroy();
+
+    bool Active() const { return mWriter.joinable(); }
+    Format GetFormat() const { return mFormat; }
+
+    // Reads the given colour buffer of a framebuffer. Call after the frame is drawn and
+    // before it is presented; the size may change between calls, except in a Y4M stream.
+    void Capture(GLuint framebuffer, GLenum readBuffer, int width, int height);
+
+    // Final once Destroy() has returned
+    const Stats& GetStats() const { return mStats; }
+
+private:
+    enum SlotState {
+        SLOT_FREE,
+        SLOT_READING,   // readback in flight on the GPU
+        SLOT_WRITING    // owned by the writer thread
+    };
+
+    struct Slot {
+        GLuint buffer = 0;
+        const uint8_t* mapped = nullptr;
+        size_t capacity = 0;
+        GLsync fence = 0;
+        int width = 0;
+        int height = 0;
+        size_t frame = 0;
+        std::atomic<int> state{ SLOT_FREE };
+    };
+
+    // GL thread: hands signalled readbacks to the writer in capture order; with wait
+    // set the oldest one is waited for
+    void Collect(bool wait);
+    bool Allocate(Slot& slot, size_t bytes);
+    void WriterMain();
+    void WriteFrame(const Slot& slot);
+    void WriteY4m(const Slot& slot);
+
+    Format mFormat = FORMAT_PNG;
+    std::string mBasePath;      // image sequences: path without the extension
+    std::string mExtension;
+    FILE* mStream = nullptr;    // Y4M output
+    bool mPipe = false;
+    int mFps = 60;
+    int mStreamWidth = 0;       // Y4M header size, fixed by the first frame
+    int mStreamHeight = 0;
+
+    Slot mSlots[SLOT_COUNT];
+    size_t mNext = 0;           // slot the next capture goes into
+    size_t mOldest = 0;         // oldest slot still reading, if any
+    size_t mReadingCount = 0;
+    size_t mFramesCaptured = 0;
+
+    std::thread mWriter;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::deque<Slot*> mQueue;
+    bool mStopping = false;
+    std::vector<uint8_t> mScratch;  // writer thread: top-down RGB or YUV planes
+    bool mSizeWarned = false;       // writer thread: a frame did not match the Y4M size
+
+    Stats mStats;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include "frame_clock.h"
+
+#include <algorithm>
+
+const size_t FrameClock::HISTORY_SIZE;
+
+FrameClock::FrameClock(double stepSeconds, int maxStepsPerFrame)
+    : mStepSeconds(stepSeconds), mMaxSteps(maxStepsPerFrame) {
+    mHistory.reserve(HISTORY_SIZE);
+}
+
+int FrameClock::BeginFrame() {
+    Clock::time_point now = Clock::now();
+    if (!mStarted) {
+        // The first frame has nothing to catch up on; simulate one step so state is valid
+        mStarted = true;
+        mLastTime = now;
+        mFrameSeconds = mStepSeconds;
+    }
+    else {
+        mFrameSeconds = std::chrono::duration<double>(now - mLastTime).count();
+        mLastTime = now;
+    }
+    if (mFixedFrameSeconds > 0.0)
+        mFrameSeconds = mFixedFrameSeconds;
+
+    float frameMs = static_cast<float>(mFrameSeconds * 1000.0);
+    if (mHistory.size() < HISTORY_SIZE)
+        mHistory.push_back(frameMs);
+    else
+        mHistory[mHistoryNext] = frameMs;
+    mHistoryNext = (mHistoryNext + 1) % HISTORY_SIZE;
+    ++mFrameCount;
+
+    mAccumulator += mFrameSeconds;
+    int steps = static_cast<int>(mAccumulator / mStepSeconds);
+    if (steps > mMaxSteps) {
+        // Drop the backlog rather than trying to simulate all of it
+        steps = mMaxSteps;
+        mAccumulator = mStepSeconds * mMaxSteps;
+    }
+    mAccumulator -= steps * mStepSeconds;
+    mSimulatedSeconds += steps * mStepSeconds;
+    return steps;
+}
+
+std::vector<float> FrameClock::History() const {
+    if (mHistory.size() < HISTORY_SIZE)
+        return mHistory;
+
+    std::vector<float> ordered(mHistory.begin() + mHistoryNext, mHistory.end());
+    ordered.insert(ordered.end(), mHistory.begin(), mHistory.begin() + mHistoryNext);
+    return ordered;
+}
+
+FrameClock::FrameStats FrameClock::ComputeStats() const {
+    FrameStats stats;
+    if (mHistory.empty())
+        return stats;
+
+    std::vector<float> sorted(mHistory);
+    std::sort(sorted.begin(), sorted.end());
+
+    double total = 0.0;
+    for (float ms : sorted)
+        total += ms;
+
+    stats.frames = sorted.size();
+    stats.averageMs = total / sorted.size();
+    stats.minMs = sorted.front();
+    stats.maxMs = sorted.back();
+    stats.p99Ms = sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)];
+    return stats;
+}
@@ -0,0 +1,62 @@
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+// Drives a fixed-timestep loop. Each frame, BeginFrame() measures the time since the
+// previous frame, adds it to an accumulator and returns how many fixed simulation steps
+// are due. Alpha() is how far the display time sits between the last two steps, for
+// interpolating what is drawn. The clock also keeps a history of recent frame times.
+class FrameClock {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static const size_t HISTORY_SIZE = 512;
+
+    struct FrameStats {
+        size_t frames = 0;
+        double averageMs = 0.0;
+        double minMs = 0.0;
+        double maxMs = 0.0;
+        double p99Ms = 0.0;
+    };
+
+    // maxStepsPerFrame caps catch-up after a stall so the loop cannot spiral
+    explicit FrameClock(double stepSeconds = 1.0 / 120.0, int maxStepsPerFrame = 8);
+
+    // Replaces the measured frame time with a constant, so a run simulates the same
+    // steps regardless of how fast frames are produced. Zero returns to the real clock.
+    void SetFixedFrameTime(double seconds) { mFixedFrameSeconds = seconds; }
+
+    // Starts a frame and returns the number of fixed steps to simulate
+    int BeginFrame();
+
+    double StepSeconds() const { return mStepSeconds; }
+    double Alpha() const { return mAccumulator / mStepSeconds; }
+    double FrameSeconds() const { return mFrameSeconds; }
+    double SimulatedSeconds() const { return mSimulatedSeconds; }
+    size_t FrameCount() const { return mFrameCount; }
+
+    // Frame times in milliseconds, oldest first, at most HISTORY_SIZE entries
+    std::vector<float> History() const;
+    FrameStats ComputeStats() const;
+
+private:
+    double mStepSeconds;
+    int mMaxSteps;
+    double mFixedFrameSeconds = 0.0;
+
+    bool mStarted = false;
+    Clock::time_point mLastTime;
+    double mAccumulator = 0.0;
+    double mFrameSeconds = 0.0;
+    double mSimulatedSeconds = 0.0;
+    size_t mFrameCount = 0;
+
+    std::vector<float> mHistory;   // ring buffer of frame times in ms
+    size_t mHistoryNext = 0;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include "frame_pacer.h"
+
+#include <algorithm>
+#include <thread>
+
+void FramePacer::SetMode(Mode mode, double targetFps) {
+    mMode = mode;
+    mTargetFps = mode == MODE_LIMITED ? targetFps : 0.0;
+    mPeriod = mTargetFps > 0.0
+        ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / mTargetFps))
+        : Clock::duration::zero();
+    mStarted = false;
+}
+
+void FramePacer::Wait() {
+    if (mMode != MODE_LIMITED || mPeriod == Clock::duration::zero())
+        return;
+
+    Clock::time_point now = Clock::now();
+    if (!mStarted) {
+        mStarted = true;
+        mDeadline = now + mPeriod;
+        return;
+    }
+
+    ++mStats.waits;
+    if (now >= mDeadline) {
+        // Already late: start the next period from now instead of rushing to catch up
+        ++mStats.missedDeadlines;
+        mDeadline = now + mPeriod;
+        return;
+    }
+
+    Clock::time_point wake = mDeadline - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(mSpinMargin));
+    if (now < wake) {
+        std::this_thread::sleep_until(wake);
+        Clock::time_point slept = Clock::now();
+        mStats.sleptMs += std::chrono::duration<double, std::milli>(slept - now).count();
+        now = slept;
+    }
+
+    Clock::time_point spinStart = now;
+    while (now < mDeadline)
+        now = Clock::now();
+    mStats.spunMs += std::chrono::duration<double, std::milli>(now - spinStart).count();
+    mStats.maxOvershootUs = std::max(mStats.maxOvershootUs, std::chrono::duration<double, std::micro>(now - mDeadline).count());
+
+    // Advance by whole periods so the average rate stays exact
+    mDeadline += mPeriod;
+}
+
+const char* FramePacer::ModeName(Mode mode) {
+    switch (mode) {
+    case MODE_VSYNC:
+        return "vsync";
+    case MODE_UNCAPPED:
+        return "uncapped";
+    case MODE_LIMITED:
+        return "limited";
+    }
+    return "unknown";
+}
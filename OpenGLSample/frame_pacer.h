@@ -0,0 +1,59 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <chrono>
+#include <cstddef>
+
+// Decides when the next frame may start.
+//   MODE_VSYNC      presentation waits for vertical blank (swap interval 1)
+//   MODE_UNCAPPED   no waiting at all, for benchmarks (swap interval 0)
+//   MODE_LIMITED    swap interval 0; Wait() holds each frame to a target rate by sleeping
+//                   until shortly before the deadline and spin-waiting the rest, since
+//                   OS sleeps can overshoot by a millisecond or more
+class FramePacer {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum Mode {
+        MODE_VSYNC,
+        MODE_UNCAPPED,
+        MODE_LIMITED
+    };
+
+    struct Stats {
+        size_t waits = 0;
+        size_t missedDeadlines = 0;    // frames that were already late when Wait() was called
+        double sleptMs = 0.0;
+        double spunMs = 0.0;
+        double maxOvershootUs = 0.0;   // worst wake-up past the deadline
+    };
+
+    // targetFps is only used by MODE_LIMITED
+    void SetMode(Mode mode, double targetFps = 0.0);
+    Mode GetMode() const { return mMode; }
+    double TargetFps() const { return mTargetFps; }
+
+    // Sleeping stops this far before the deadline; the remainder is spun
+    void SetSpinMargin(double seconds) { mSpinMargin = seconds; }
+
+    // Value for glfwSwapInterval on the thread that owns the context
+    int SwapInterval() const { return mMode == MODE_VSYNC ? 1 : 0; }
+
+    // Blocks until the next frame is due. Returns immediately outside MODE_LIMITED.
+    void Wait();
+
+    const Stats& GetStats() const { return mStats; }
+
+    static const char* ModeName(Mode mode);
+
+private:
+    Mode mMode = MODE_VSYNC;
+    double mTargetFps = 0.0;
+    double mSpinMargin = 0.002;
+    bool mStarted = false;
+    Clock::time_point mDeadline;
+    Clock::duration mPeriod = Clock::duration::zero();
+    Stats mStats;
+};
+
+#endif
@@ -0,0 +1,159 @@
+#include "frame_timeline.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+using namespace std;
+
+const size_t FrameTimeline::HISTORY_SIZE;
+const size_t FrameTimeline::QUERY_LATENCY;
+
+bool FrameTimeline::Create() {
+    Destroy();
+
+    for (PendingFrame& pending : mPending) {
+        glGenQueries(1, &pending.query);
+        pending.waiting = false;
+    }
+    mNextSlot = 0;
+    mCurrent = nullptr;
+    mHistory.clear();
+    mHistory.reserve(HISTORY_SIZE);
+    mHistoryNext = 0;
+    mQueryStalls = 0;
+
+    // Pair the GPU clock with the CPU clock once; both count real time, so the
+    // offset holds for the length of a session
+    mOrigin = Clock::now();
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    mGpuToCpuNs = -static_cast<int64_t>(gpuNow);
+
+    mCreated = true;
+    return glGetError() == GL_NO_ERROR;
+}
+
+void FrameTimeline::Destroy() {
+    if (!mCreated)
+        return;
+
+    for (PendingFrame& pending : mPending) {
+        if (pending.waiting)
+            Resolve(pending, true);
+        glDeleteQueries(1, &pending.query);
+        pending.query = 0;
+    }
+    mCurrent = nullptr;
+    mCreated = false;
+}
+
+double FrameTimeline::MillisecondsSinceOrigin(Clock::time_point time) const {
+    return chrono::duration<double, milli>(time - mOrigin).count();
+}
+
+void FrameTimeline::MarkSubmitted(uint64_t frame, Clock::time_point start) {
+    if (!mCreated)
+        return;
+
+    // Collect whatever the GPU has finished; only the slot being reused may have to wait
+    for (PendingFrame& pending : mPending) {
+        if (pending.waiting)
+            Resolve(pending, false);
+    }
+
+    PendingFrame& pending = mPending[mNextSlot];
+    mNextSlot = (mNextSlot + 1) % (QUERY_LATENCY + 1);
+    if (pending.waiting) {
+        ++mQueryStalls;
+        Resolve(pending, true);
+    }
+
+    pending.timing.frame = frame;
+    pending.timing.startMs = MillisecondsSinceOrigin(start);
+    pending.timing.submitMs = MillisecondsSinceOrigin(Clock::now());
+    pending.timing.swapMs = pending.timing.submitMs;
+    pending.timing.gpuCompleteMs = -1.0;
+    glQueryCounter(pending.query, GL_TIMESTAMP);
+    pending.waiting = true;
+    mCurrent = &pending;
+}
+
+void FrameTimeline::MarkSwapped() {
+    if (mCurrent == nullptr)
+        return;
+    mCurrent->timing.swapMs = MillisecondsSinceOrigin(Clock::now());
+    mCurrent = nullptr;
+}
+
+void FrameTimeline::Resolve(PendingFrame& pending, bool wait) {
+    if (!wait) {
+        GLint available = 0;
+        glGetQueryObjectiv(pending.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+    }
+
+    GLuint64 gpuTime = 0;
+    glGetQueryObjectui64v(pending.query, GL_QUERY_RESULT, &gpuTime);
+    pending.timing.gpuCompleteMs = (static_cast<int64_t>(gpuTime) + mGpuToCpuNs) / 1.0e6;
+    pending.waiting = false;
+
+    if (mHistory.size() < HISTORY_SIZE)
+        mHistory.push_back(pending.timing);
+    else
+        mHistory[mHistoryNext] = pending.timing;
+    mHistoryNext = (mHistoryNext + 1) % HISTORY_SIZE;
+}
+
+vector<FrameTimeline::FrameTiming> FrameTimeline::History() const {
+    vector<FrameTiming> ordered;
+    if (mHistory.size() < HISTORY_SIZE) {
+        ordered = mHistory;
+    }
+    else {
+        ordered.assign(mHistory.begin() + mHistoryNext, mHistory.end());
+        ordered.insert(ordered.end(), mHistory.begin(), mHistory.begin() + mHistoryNext);
+    }
+
+    // Queries can resolve out of order when an older slot is forced
+    sort(ordered.begin(), ordered.end(), [](const FrameTiming& a, const FrameTiming& b) { return a.frame < b.frame; });
+    return ordered;
+}
+
+FrameTimeline::Summary FrameTimeline::Summarize() const {
+    Summary summary;
+    summary.queryStalls = mQueryStalls;
+    if (mHistory.empty())
+        return summary;
+
+    vector<double> gpu;
+    gpu.reserve(mHistory.size());
+    for (const FrameTiming& timing : mHistory) {
+        summary.averageSubmitMs += timing.submitMs - timing.startMs;
+        summary.averageSwapMs += timing.swapMs - timing.startMs;
+        gpu.push_back(timing.gpuCompleteMs - timing.startMs);
+        summary.averageGpuCompleteMs += gpu.back();
+    }
+
+    summary.frames = mHistory.size();
+    summary.averageSubmitMs /= summary.frames;
+    summary.averageSwapMs /= summary.frames;
+    summary.averageGpuCompleteMs /= summary.frames;
+    sort(gpu.begin(), gpu.end());
+    summary.p99GpuCompleteMs = gpu[min(gpu.size() - 1, gpu.size() * 99 / 100)];
+    return summary;
+}
+
+bool FrameTimeline::WriteCsv(const char* path) const {
+    ofstream out(path);
+    if (!out)
+        return false;
+
+    out << "frame,start_ms,submit_ms,swap_ms,gpu_complete_ms" << "\n" << fixed << setprecision(3);
+    for (const FrameTiming& timing : History()) {
+        out << timing.frame << "," << timing.startMs << "," << timing.submitMs << ","
+            << timing.swapMs << "," << timing.gpuCompleteMs << "\n";
+    }
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,81 @@
+#ifndef FRAME_TIMELINE_H
+#define FRAME_TIMELINE_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Records where each frame's time goes, from the moment the main thread starts it
+// (input is sampled) to the moment the GPU finishes it. The GPU end is a GL_TIMESTAMP
+// query issued after the frame's last command; it is read back QUERY_LATENCY frames
+// later and mapped onto the CPU clock, so recording never stalls the pipeline.
+// Every method except History(), Summarize() and WriteCsv() runs on the GL thread.
+class FrameTimeline {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static const size_t HISTORY_SIZE = 512;
+    static const size_t QUERY_LATENCY = 3;
+
+    // Milliseconds since Create()
+    struct FrameTiming {
+        uint64_t frame;
+        double startMs;         // main thread began the frame
+        double submitMs;        // last GL command issued
+        double swapMs;          // SwapBuffers returned
+        double gpuCompleteMs;   // GPU finished the frame
+    };
+
+    // Averages and 99th percentiles, measured from each frame's start
+    struct Summary {
+        size_t frames = 0;
+        double averageSubmitMs = 0.0;
+        double averageSwapMs = 0.0;
+        double averageGpuCompleteMs = 0.0;
+        double p99GpuCompleteMs = 0.0;
+        size_t queryStalls = 0;     // readbacks that had to wait for the GPU
+    };
+
+    bool Create();
+    void Destroy();
+
+    // Call after the frame's last draw and before SwapBuffers
+    void MarkSubmitted(uint64_t frame, Clock::time_point start);
+
+    // Call as soon as SwapBuffers returns
+    void MarkSwapped();
+
+    // Completed frames, oldest first
+    std::vector<FrameTiming> History() const;
+    Summary Summarize() const;
+
+    // One row per completed frame: frame, start, submit, swap, gpu_complete (ms)
+    bool WriteCsv(const char* path) const;
+
+private:
+    struct PendingFrame {
+        FrameTiming timing;
+        GLuint query;
+        bool waiting;
+    };
+
+    double MillisecondsSinceOrigin(Clock::time_point time) const;
+    void Resolve(PendingFrame& pending, bool wait);
+
+    PendingFrame mPending[QUERY_LATENCY + 1];
+    size_t mNextSlot = 0;
+    PendingFrame* mCurrent = nullptr;
+
+    Clock::time_point mOrigin;
+    int64_t mGpuToCpuNs = 0;    // add to a GPU timestamp to get nanoseconds since mOrigin
+    size_t mQueryStalls = 0;
+    bool mCreated = false;
+
+    std::vector<FrameTiming> mHistory;  // ring buffer
+    size_t mHistoryNext = 0;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include "gbuffer.h"
+#include "gl_trace.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+    GLuint CreateTarget(GLenum internalFormat, GLenum format, GLenum type, int width, int height) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+}
+
+bool GBuffer::Create(int width, int height) {
+    Destroy();
+    mWidth = mRenderWidth = width;
+    mHeight = mRenderHeight = height;
+
+    mAlbedoSpec = CreateTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+    mNormal = CreateTarget(GL_RG16F, GL_RG, GL_HALF_FLOAT, width, height);
+    mDepth = CreateTarget(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &mFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mAlbedoSpec, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, mNormal, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, mDepth, 0);
+
+    const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        cout << "G-buffer framebuffer incomplete: 0x" << hex << status << dec << endl;
+        Destroy();
+        return false;
+    }
+
+    // Core profile refuses to draw without a bound VAO, even with no attributes
+    glGenVertexArrays(1, &mFullscreenVao);
+    return true;
+}
+
+void GBuffer::Destroy() {
+    if (mFramebuffer != 0)
+        glDeleteFramebuffers(1, &mFramebuffer);
+    GLuint textures[3] = { mAlbedoSpec, mNormal, mDepth };
+    for (GLuint texture : textures) {
+        if (texture != 0)
+            glDeleteTextures(1, &texture);
+    }
+    if (mFullscreenVao != 0)
+        glDeleteVertexArrays(1, &mFullscreenVao);
+
+    mFramebuffer = mAlbedoSpec = mNormal = mDepth = mFullscreenVao = 0;
+}
+
+void GBuffer::SetRenderSize(int width, int height) {
+    mRenderWidth = min(max(width, 1), mWidth);
+    mRenderHeight = min(max(height, 1), mHeight);
+}
+
+void GBuffer::BeginGeometryPass() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+    glViewport(0, 0, mRenderWidth, mRenderHeight);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void GBuffer::BindTextures(GLuint programId) const {
+    glActiveTexture(GL_TEXTURE0 + UNIT_ALBEDO_SPEC);
+    glBindTexture(GL_TEXTURE_2D, mAlbedoSpec);
+    glActiveTexture(GL_TEXTURE0 + UNIT_NORMAL);
+    glBindTexture(GL_TEXTURE_2D, mNormal);
+    glActiveTexture(GL_TEXTURE0 + UNIT_DEPTH);
+    glBindTexture(GL_TEXTURE_2D, mDepth);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform1i(glGetUniformLocation(programId, "gAlbedoSpec"), UNIT_ALBEDO_SPEC);
+    glUniform1i(glGetUniformLocation(programId, "gNormal"), UNIT_NORMAL);
+    glUniform1i(glGetUniformLocation(programId, "gDepth"), UNIT_DEPTH);
+    glUniform2f(glGetUniformLocation(programId, "gBufferScale"), static_cast<float>(mRenderWidth) / mWidth,
+        static_cast<float>(mRenderHeight) / mHeight);
+}
+
+void GBuffer::DrawFullscreen() const {
+    glBindVertexArray(mFullscreenVao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+}
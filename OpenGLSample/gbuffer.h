@@ -0,0 +1,58 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <GL/glew.h>
+
+// Render targets for the deferred path:
+//   attachment 0  RGBA8   albedo, specular strength in alpha
+//   attachment 1  RG16F   octahedral-packed world normal
+//   depth         24-bit depth texture, used to rebuild world positions
+// The lighting pass samples all three and shades each visible pixel once. The targets
+// may be larger than the scene drawn: SetRenderSize() confines both passes to their
+// lower-left corner, so a lower render scale needs no new targets.
+class GBuffer {
+public:
+    // Texture units BindTextures() uses, in attachment order
+    enum TextureUnit {
+        UNIT_ALBEDO_SPEC = 2,
+        UNIT_NORMAL = 3,
+        UNIT_DEPTH = 4
+    };
+
+    bool Create(int width, int height);
+    void Destroy();
+
+    // Size of the scene drawn into the targets, at most their own; Create() sets it to theirs
+    void SetRenderSize(int width, int height);
+
+    // Binds the framebuffer and clears it for the geometry pass
+    void BeginGeometryPass() const;
+
+    // Binds the attachments to their texture units and sets the lighting program's samplers,
+    // with the scale from its screen UVs to the drawn corner of the targets
+    void BindTextures(GLuint programId) const;
+
+    // Draws a triangle covering the viewport; the vertex shader derives it from gl_VertexID
+    void DrawFullscreen() const;
+
+    // Read by passes after lighting, such as the temporal upscaler's reprojection
+    GLuint DepthTexture() const { return mDepth; }
+
+    int Width() const { return mWidth; }
+    int Height() const { return mHeight; }
+    int RenderWidth() const { return mRenderWidth; }
+    int RenderHeight() const { return mRenderHeight; }
+
+private:
+    GLuint mFramebuffer = 0;
+    GLuint mAlbedoSpec = 0;
+    GLuint mNormal = 0;
+    GLuint mDepth = 0;
+    GLuint mFullscreenVao = 0;
+    int mWidth = 0;
+    int mHeight = 0;
+    int mRenderWidth = 0;
+    int mRenderHeight = 0;
+};
+
+#endif
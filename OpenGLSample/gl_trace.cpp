@@ -0,0 +1,532 @@
+#define GL_TRACE_NO_REDIRECT
+#include "gl_trace.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <vector>
+
+using namespace std;
+
+// Entry points reached through GLEW pointers: (name without the gl prefix, pointer type)
+#define GL_TRACE_POINTERS(X) \
+    X(UseProgram, PFNGLUSEPROGRAMPROC) \
+    X(LinkProgram, PFNGLLINKPROGRAMPROC) \
+    X(BindVertexArray, PFNGLBINDVERTEXARRAYPROC) \
+    X(BindBuffer, PFNGLBINDBUFFERPROC) \
+    X(BindBufferBase, PFNGLBINDBUFFERBASEPROC) \
+    X(BindBufferRange, PFNGLBINDBUFFERRANGEPROC) \
+    X(BindFramebuffer, PFNGLBINDFRAMEBUFFERPROC) \
+    X(ActiveTexture, PFNGLACTIVETEXTUREPROC) \
+    X(Uniform1i, PFNGLUNIFORM1IPROC) \
+    X(Uniform1f, PFNGLUNIFORM1FPROC) \
+    X(Uniform2f, PFNGLUNIFORM2FPROC) \
+    X(Uniform3ui, PFNGLUNIFORM3UIPROC) \
+    X(UniformMatrix4fv, PFNGLUNIFORMMATRIX4FVPROC) \
+    X(GetUniformLocation, PFNGLGETUNIFORMLOCATIONPROC) \
+    X(BindVertexBuffer, PFNGLBINDVERTEXBUFFERPROC) \
+    X(BufferData, PFNGLBUFFERDATAPROC) \
+    X(BufferSubData, PFNGLBUFFERSUBDATAPROC) \
+    X(DrawBuffers, PFNGLDRAWBUFFERSPROC) \
+    X(CopyImageSubData, PFNGLCOPYIMAGESUBDATAPROC) \
+    X(QueryCounter, PFNGLQUERYCOUNTERPROC) \
+    X(GetQueryObjectiv, PFNGLGETQUERYOBJECTIVPROC) \
+    X(GetQueryObjectui64v, PFNGLGETQUERYOBJECTUI64VPROC) \
+    X(GetInteger64v, PFNGLGETINTEGER64VPROC) \
+    X(ClientWaitSync, PFNGLCLIENTWAITSYNCPROC) \
+    X(DeleteSync, PFNGLDELETESYNCPROC) \
+    X(GenBuffers, PFNGLGENBUFFERSPROC) \
+    X(GenVertexArrays, PFNGLGENVERTEXARRAYSPROC) \
+    X(GenFramebuffers, PFNGLGENFRAMEBUFFERSPROC) \
+    X(GenQueries, PFNGLGENQUERIESPROC) \
+    X(CreateProgram, PFNGLCREATEPROGRAMPROC) \
+    X(CreateShader, PFNGLCREATESHADERPROC) \
+    X(FenceSync, PFNGLFENCESYNCPROC) \
+    X(DeleteBuffers, PFNGLDELETEBUFFERSPROC) \
+    X(DeleteVertexArrays, PFNGLDELETEVERTEXARRAYSPROC) \
+    X(DeleteFramebuffers, PFNGLDELETEFRAMEBUFFERSPROC) \
+    X(DeleteProgram, PFNGLDELETEPROGRAMPROC)
+
+// Entry points linked directly, reached through the wrappers declared in the header
+#define GL_TRACE_DIRECT(X) \
+    X(Enable, void) \
+    X(Disable, void) \
+    X(BindTexture, void) \
+    X(GenTextures, void) \
+    X(DeleteTextures, void) \
+    X(Viewport, void) \
+    X(ClearColor, void) \
+    X(Clear, void) \
+    X(DrawArrays, void) \
+    X(DrawElements, void) \
+    X(GetIntegerv, void)
+
+namespace {
+#define GL_TRACE_ENTRY(name, type) ENTRY_##name,
+    enum Entry {
+        GL_TRACE_POINTERS(GL_TRACE_ENTRY)
+        GL_TRACE_DIRECT(GL_TRACE_ENTRY)
+        ENTRY_COUNT
+    };
+#undef GL_TRACE_ENTRY
+
+#define GL_TRACE_NAME(name, type) "gl" #name,
+    const char* const ENTRY_NAMES[ENTRY_COUNT] = {
+        GL_TRACE_POINTERS(GL_TRACE_NAME)
+        GL_TRACE_DIRECT(GL_TRACE_NAME)
+    };
+#undef GL_TRACE_NAME
+
+#define GL_TRACE_ORIGINAL(name, type) type gReal##name = nullptr;
+    GL_TRACE_POINTERS(GL_TRACE_ORIGINAL)
+#undef GL_TRACE_ORIGINAL
+
+    struct EntryCounts {
+        size_t calls;
+        size_t redundant;
+    };
+
+    bool gInstalled = false;
+    size_t gFrame = 0;
+    EntryCounts gCounts[ENTRY_COUNT];
+    size_t gObjectsCreated = 0;
+
+    // Shadow copy of the state the wrappers set, keyed by (kind, object or target, index).
+    // Anything missing is unknown and never counted as redundant, so state set before
+    // the trace was installed or changed behind its back only costs a missed detection.
+    enum ShadowKind {
+        SHADOW_PROGRAM,
+        SHADOW_VERTEX_ARRAY,
+        SHADOW_BUFFER,
+        SHADOW_BUFFER_INDEXED,
+        SHADOW_FRAMEBUFFER,
+        SHADOW_ACTIVE_TEXTURE,
+        SHADOW_TEXTURE,
+        SHADOW_CAPABILITY,
+        SHADOW_VIEWPORT,
+        SHADOW_CLEAR_COLOR,
+        SHADOW_UNIFORM
+    };
+    typedef tuple<int, GLuint, GLint> ShadowKey;
+    map<ShadowKey, vector<uint32_t>> gShadow;
+
+    // Stores value under the key; returns true if it was already the current value
+    bool UpdateShadow(ShadowKind kind, GLuint object, GLint index, const void* value, size_t bytes) {
+        vector<uint32_t> words((bytes + 3) / 4, 0);
+        memcpy(words.data(), value, bytes);
+        pair<map<ShadowKey, vector<uint32_t>>::iterator, bool> inserted =
+            gShadow.insert(make_pair(ShadowKey(kind, object, index), words));
+        if (inserted.second)
+            return false;
+        if (inserted.first->second == words)
+            return true;
+        inserted.first->second.swap(words);
+        return false;
+    }
+
+    bool FindShadow(ShadowKind kind, GLuint object, GLint index, GLuint& value) {
+        map<ShadowKey, vector<uint32_t>>::const_iterator found = gShadow.find(ShadowKey(kind, object, index));
+        if (found == gShadow.end())
+            return false;
+        value = found->second[0];
+        return true;
+    }
+
+    void ForgetShadow(ShadowKind kind) {
+        gShadow.erase(gShadow.lower_bound(ShadowKey(kind, 0, INT_MIN)), gShadow.lower_bound(ShadowKey(kind + 1, 0, INT_MIN)));
+    }
+
+    void ForgetShadow(ShadowKind kind, GLuint object) {
+        gShadow.erase(gShadow.lower_bound(ShadowKey(kind, object, INT_MIN)),
+            gShadow.upper_bound(ShadowKey(kind, object, INT_MAX)));
+    }
+
+    void Count(Entry entry, bool redundant = false) {
+        ++gCounts[entry].calls;
+        if (redundant)
+            ++gCounts[entry].redundant;
+    }
+
+    void CountCreated(Entry entry, size_t objects) {
+        Count(entry);
+        gObjectsCreated += objects;
+    }
+
+    // Uniforms belong to the bound program; without a known program nothing is checked
+    template <typename T>
+    void CountUniform(Entry entry, GLint location, const T* values, size_t count) {
+        GLuint program = 0;
+        bool known = FindShadow(SHADOW_PROGRAM, 0, 0, program);
+        // GL silently ignores location -1, so the call did nothing at all
+        bool redundant = location == -1 || (known && UpdateShadow(SHADOW_UNIFORM, program, location, values, sizeof(T) * count));
+        Count(entry, redundant);
+    }
+
+    void GLAPIENTRY TraceUseProgram(GLuint program) {
+        Count(ENTRY_UseProgram, UpdateShadow(SHADOW_PROGRAM, 0, 0, &program, sizeof(program)));
+        gRealUseProgram(program);
+    }
+
+    void GLAPIENTRY TraceLinkProgram(GLuint program) {
+        Count(ENTRY_LinkProgram);
+        ForgetShadow(SHADOW_UNIFORM, program);
+        gRealLinkProgram(program);
+    }
+
+    void GLAPIENTRY TraceBindVertexArray(GLuint array) {
+        bool redundant = UpdateShadow(SHADOW_VERTEX_ARRAY, 0, 0, &array, sizeof(array));
+        Count(ENTRY_BindVertexArray, redundant);
+        // The element buffer binding is vertex array state
+        if (!redundant)
+            gShadow.erase(ShadowKey(SHADOW_BUFFER, GL_ELEMENT_ARRAY_BUFFER, 0));
+        gRealBindVertexArray(array);
+    }
+
+    void GLAPIENTRY TraceBindBuffer(GLenum target, GLuint buffer) {
+        Count(ENTRY_BindBuffer, UpdateShadow(SHADOW_BUFFER, target, 0, &buffer, sizeof(buffer)));
+        gRealBindBuffer(target, buffer);
+    }
+
+    void GLAPIENTRY TraceBindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+        // Stored as a whole-buffer range; also sets the generic binding point
+        GLint64 range[3] = { static_cast<GLint64>(buffer), 0, -1 };
+        Count(ENTRY_BindBufferBase, UpdateShadow(SHADOW_BUFFER_INDEXED, target, static_cast<GLint>(index), range, sizeof(range)));
+        UpdateShadow(SHADOW_BUFFER, target, 0, &buffer, sizeof(buffer));
+        gRealBindBufferBase(target, index, buffer);
+    }
+
+    void GLAPIENTRY TraceBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+        GLint64 range[3] = { static_cast<GLint64>(buffer), static_cast<GLint64>(offset), static_cast<GLint64>(size) };
+        Count(ENTRY_BindBufferRange, UpdateShadow(SHADOW_BUFFER_INDEXED, target, static_cast<GLint>(index), range, sizeof(range)));
+        UpdateShadow(SHADOW_BUFFER, target, 0, &buffer, sizeof(buffer));
+        gRealBindBufferRange(target, index, buffer, offset, size);
+    }
+
+    void GLAPIENTRY TraceBindFramebuffer(GLenum target, GLuint framebuffer) {
+        bool redundant;
+        if (target == GL_FRAMEBUFFER) {
+            bool draw = UpdateShadow(SHADOW_FRAMEBUFFER, GL_DRAW_FRAMEBUFFER, 0, &framebuffer, sizeof(framebuffer));
+            bool read = UpdateShadow(SHADOW_FRAMEBUFFER, GL_READ_FRAMEBUFFER, 0, &framebuffer, sizeof(framebuffer));
+            redundant = draw && read;
+        }
+        else {
+            redundant = UpdateShadow(SHADOW_FRAMEBUFFER, target, 0, &framebuffer, sizeof(framebuffer));
+        }
+        Count(ENTRY_BindFramebuffer, redundant);
+        gRealBindFramebuffer(target, framebuffer);
+    }
+
+    void GLAPIENTRY TraceActiveTexture(GLenum texture) {
+        Count(ENTRY_ActiveTexture, UpdateShadow(SHADOW_ACTIVE_TEXTURE, 0, 0, &texture, sizeof(texture)));
+        gRealActiveTexture(texture);
+    }
+
+    void GLAPIENTRY TraceUniform1i(GLint location, GLint v0) {
+        CountUniform(ENTRY_Uniform1i, location, &v0, 1);
+        gRealUniform1i(location, v0);
+    }
+
+    void GLAPIENTRY TraceUniform1f(GLint location, GLfloat v0) {
+        CountUniform(ENTRY_Uniform1f, location, &v0, 1);
+        gRealUniform1f(location, v0);
+    }
+
+    void GLAPIENTRY TraceUniform2f(GLint location, GLfloat v0, GLfloat v1) {
+        GLfloat values[2] = { v0, v1 };
+        CountUniform(ENTRY_Uniform2f, location, values, 2);
+        gRealUniform2f(location, v0, v1);
+    }
+
+    void GLAPIENTRY TraceUniform3ui(GLint location, GLuint v0, GLuint v1, GLuint v2) {
+        GLuint values[3] = { v0, v1, v2 };
+        CountUniform(ENTRY_Uniform3ui, location, values, 3);
+        gRealUniform3ui(location, v0, v1, v2);
+    }
+
+    void GLAPIENTRY TraceUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {
+        // Transposed uploads are rare enough to treat as always changing
+        if (transpose)
+            Count(ENTRY_UniformMatrix4fv);
+        else
+            CountUniform(ENTRY_UniformMatrix4fv, location, value, 16 * static_cast<size_t>(count));
+        gRealUniformMatrix4fv(location, count, transpose, value);
+    }
+
+    GLint GLAPIENTRY TraceGetUniformLocation(GLuint program, const GLchar* name) {
+        Count(ENTRY_GetUniformLocation);
+        return gRealGetUniformLocation(program, name);
+    }
+
+    void GLAPIENTRY TraceBindVertexBuffer(GLuint bindingindex, GLuint buffer, GLintptr offset, GLsizei stride) {
+        Count(ENTRY_BindVertexBuffer);
+        gRealBindVertexBuffer(bindingindex, buffer, offset, stride);
+    }
+
+    void GLAPIENTRY TraceBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+        Count(ENTRY_BufferData);
+        gRealBufferData(target, size, data, usage);
+    }
+
+    void GLAPIENTRY TraceBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data) {
+        Count(ENTRY_BufferSubData);
+        gRealBufferSubData(target, offset, size, data);
+    }
+
+    void GLAPIENTRY TraceDrawBuffers(GLsizei n, const GLenum* bufs) {
+        Count(ENTRY_DrawBuffers);
+        gRealDrawBuffers(n, bufs);
+    }
+
+    void GLAPIENTRY TraceCopyImageSubData(GLuint srcName, GLenum srcTarget, GLint srcLevel, GLint srcX, GLint srcY,
+        GLint srcZ, GLuint dstName, GLenum dstTarget, GLint dstLevel, GLint dstX, GLint dstY, GLint dstZ,
+        GLsizei srcWidth, GLsizei srcHeight, GLsizei srcDepth) {
+        Count(ENTRY_CopyImageSubData);
+        gRealCopyImageSubData(srcName, srcTarget, srcLevel, srcX, srcY, srcZ, dstName, dstTarget, dstLevel, dstX, dstY, dstZ,
+            srcWidth, srcHeight, srcDepth);
+    }
+
+    void GLAPIENTRY TraceQueryCounter(GLuint id, GLenum target) {
+        Count(ENTRY_QueryCounter);
+        gRealQueryCounter(id, target);
+    }
+
+    void GLAPIENTRY TraceGetQueryObjectiv(GLuint id, GLenum pname, GLint* params) {
+        Count(ENTRY_GetQueryObjectiv);
+        gRealGetQueryObjectiv(id, pname, params);
+    }
+
+    void GLAPIENTRY TraceGetQueryObjectui64v(GLuint id, GLenum pname, GLuint64* params) {
+        Count(ENTRY_GetQueryObjectui64v);
+        gRealGetQueryObjectui64v(id, pname, params);
+    }
+
+    void GLAPIENTRY TraceGetInteger64v(GLenum pname, GLint64* data) {
+        Count(ENTRY_GetInteger64v);
+        gRealGetInteger64v(pname, data);
+    }
+
+    GLenum GLAPIENTRY TraceClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout) {
+        Count(ENTRY_ClientWaitSync);
+        return gRealClientWaitSync(sync, flags, timeout);
+    }
+
+    void GLAPIENTRY TraceDeleteSync(GLsync sync) {
+        Count(ENTRY_DeleteSync);
+        gRealDeleteSync(sync);
+    }
+
+    void GLAPIENTRY TraceGenBuffers(GLsizei n, GLuint* buffers) {
+        CountCreated(ENTRY_GenBuffers, n);
+        gRealGenBuffers(n, buffers);
+    }
+
+    void GLAPIENTRY TraceGenVertexArrays(GLsizei n, GLuint* arrays) {
+        CountCreated(ENTRY_GenVertexArrays, n);
+        gRealGenVertexArrays(n, arrays);
+    }
+
+    void GLAPIENTRY TraceGenFramebuffers(GLsizei n, GLuint* framebuffers) {
+        CountCreated(ENTRY_GenFramebuffers, n);
+        gRealGenFramebuffers(n, framebuffers);
+    }
+
+    void GLAPIENTRY TraceGenQueries(GLsizei n, GLuint* ids) {
+        CountCreated(ENTRY_GenQueries, n);
+        gRealGenQueries(n, ids);
+    }
+
+    GLuint GLAPIENTRY TraceCreateProgram() {
+        CountCreated(ENTRY_CreateProgram, 1);
+        return gRealCreateProgram();
+    }
+
+    GLuint GLAPIENTRY TraceCreateShader(GLenum type) {
+        CountCreated(ENTRY_CreateShader, 1);
+        return gRealCreateShader(type);
+    }
+
+    GLsync GLAPIENTRY TraceFenceSync(GLenum condition, GLbitfield flags) {
+        CountCreated(ENTRY_FenceSync, 1);
+        return gRealFenceSync(condition, flags);
+    }
+
+    // Deleting an object unbinds it wherever it was bound; rather than track where,
+    // forget every binding of that kind
+    void GLAPIENTRY TraceDeleteBuffers(GLsizei n, const GLuint* buffers) {
+        Count(ENTRY_DeleteBuffers);
+        ForgetShadow(SHADOW_BUFFER);
+        ForgetShadow(SHADOW_BUFFER_INDEXED);
+        gRealDeleteBuffers(n, buffers);
+    }
+
+    void GLAPIENTRY TraceDeleteVertexArrays(GLsizei n, const GLuint* arrays) {
+        Count(ENTRY_DeleteVertexArrays);
+        ForgetShadow(SHADOW_VERTEX_ARRAY);
+        gShadow.erase(ShadowKey(SHADOW_BUFFER, GL_ELEMENT_ARRAY_BUFFER, 0));
+        gRealDeleteVertexArrays(n, arrays);
+    }
+
+    void GLAPIENTRY TraceDeleteFramebuffers(GLsizei n, const GLuint* framebuffers) {
+        Count(ENTRY_DeleteFramebuffers);
+        ForgetShadow(SHADOW_FRAMEBUFFER);
+        gRealDeleteFramebuffers(n, framebuffers);
+    }
+
+    void GLAPIENTRY TraceDeleteProgram(GLuint program) {
+        Count(ENTRY_DeleteProgram);
+        ForgetShadow(SHADOW_PROGRAM);
+        ForgetShadow(SHADOW_UNIFORM, program);
+        gRealDeleteProgram(program);
+    }
+}
+
+bool UInstallGLTrace() {
+    if (gInstalled)
+        return true;
+
+    // Every pointer must be loaded, or a wrapper would forward to null
+#define GL_TRACE_CHECK(name, type) if (gl##name == nullptr) return false;
+    GL_TRACE_POINTERS(GL_TRACE_CHECK)
+#undef GL_TRACE_CHECK
+
+#define GL_TRACE_SWAP(name, type) gReal##name = gl##name; gl##name = Trace##name;
+    GL_TRACE_POINTERS(GL_TRACE_SWAP)
+#undef GL_TRACE_SWAP
+
+    gShadow.clear();
+    memset(gCounts, 0, sizeof(gCounts));
+    gObjectsCreated = 0;
+    gFrame = 0;
+    gInstalled = true;
+    return true;
+}
+
+void URemoveGLTrace() {
+    if (!gInstalled)
+        return;
+
+#define GL_TRACE_RESTORE(name, type) gl##name = gReal##name;
+    GL_TRACE_POINTERS(GL_TRACE_RESTORE)
+#undef GL_TRACE_RESTORE
+    gInstalled = false;
+}
+
+bool UGLTraceActive() {
+    return gInstalled;
+}
+
+void UGLTraceEndFrame() {
+    if (!gInstalled)
+        return;
+
+    size_t calls = 0, redundant = 0;
+    vector<int> used;
+    for (int i = 0; i < ENTRY_COUNT; ++i) {
+        if (gCounts[i].calls == 0)
+            continue;
+        calls += gCounts[i].calls;
+        redundant += gCounts[i].redundant;
+        used.push_back(i);
+    }
+    sort(used.begin(), used.end(), [](int a, int b) { return gCounts[a].calls > gCounts[b].calls; });
+
+    cout << "GL frame " << gFrame << ": " << calls << " calls, " << redundant << " redundant, "
+        << gObjectsCreated << " objects created" << endl;
+    for (int i : used) {
+        cout << "  " << left << setw(24) << ENTRY_NAMES[i] << right << setw(6) << gCounts[i].calls;
+        if (gCounts[i].redundant > 0)
+            cout << setw(6) << gCounts[i].redundant << " redundant";
+        cout << endl;
+    }
+
+    memset(gCounts, 0, sizeof(gCounts));
+    gObjectsCreated = 0;
+    ++gFrame;
+}
+
+void GLAPIENTRY UTraceEnable(GLenum cap) {
+    if (gInstalled) {
+        GLboolean enabled = GL_TRUE;
+        Count(ENTRY_Enable, UpdateShadow(SHADOW_CAPABILITY, cap, 0, &enabled, sizeof(enabled)));
+    }
+    glEnable(cap);
+}
+
+void GLAPIENTRY UTraceDisable(GLenum cap) {
+    if (gInstalled) {
+        GLboolean enabled = GL_FALSE;
+        Count(ENTRY_Disable, UpdateShadow(SHADOW_CAPABILITY, cap, 0, &enabled, sizeof(enabled)));
+    }
+    glDisable(cap);
+}
+
+void GLAPIENTRY UTraceBindTexture(GLenum target, GLuint texture) {
+    if (gInstalled) {
+        // Texture bindings are per unit; without a known active unit nothing is checked
+        GLuint unit = 0;
+        if (FindShadow(SHADOW_ACTIVE_TEXTURE, 0, 0, unit))
+            Count(ENTRY_BindTexture, UpdateShadow(SHADOW_TEXTURE, target, static_cast<GLint>(unit), &texture, sizeof(texture)));
+        else
+            Count(ENTRY_BindTexture);
+    }
+    glBindTexture(target, texture);
+}
+
+void GLAPIENTRY UTraceGenTextures(GLsizei n, GLuint* textures) {
+    if (gInstalled)
+        CountCreated(ENTRY_GenTextures, n);
+    glGenTextures(n, textures);
+}
+
+void GLAPIENTRY UTraceDeleteTextures(GLsizei n, const GLuint* textures) {
+    if (gInstalled) {
+        Count(ENTRY_DeleteTextures);
+        ForgetShadow(SHADOW_TEXTURE);
+    }
+    glDeleteTextures(n, textures);
+}
+
+void GLAPIENTRY UTraceViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if (gInstalled) {
+        GLint viewport[4] = { x, y, width, height };
+        Count(ENTRY_Viewport, UpdateShadow(SHADOW_VIEWPORT, 0, 0, viewport, sizeof(viewport)));
+    }
+    glViewport(x, y, width, height);
+}
+
+void GLAPIENTRY UTraceClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {
+    if (gInstalled) {
+        GLfloat color[4] = { red, green, blue, alpha };
+        Count(ENTRY_ClearColor, UpdateShadow(SHADOW_CLEAR_COLOR, 0, 0, color, sizeof(color)));
+    }
+    glClearColor(red, green, blue, alpha);
+}
+
+void GLAPIENTRY UTraceClear(GLbitfield mask) {
+    if (gInstalled)
+        Count(ENTRY_Clear);
+    glClear(mask);
+}
+
+void GLAPIENTRY UTraceDrawArrays(GLenum mode, GLint first, GLsizei count) {
+    if (gInstalled)
+        Count(ENTRY_DrawArrays);
+    glDrawArrays(mode, first, count);
+}
+
+void GLAPIENTRY UTraceDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices) {
+    if (gInstalled)
+        Count(ENTRY_DrawElements);
+    glDrawElements(mode, count, type, indices);
+}
+
+void GLAPIENTRY UTraceGetIntegerv(GLenum pname, GLint* data) {
+    if (gInstalled)
+        Count(ENTRY_GetIntegerv);
+    glGetIntegerv(pname, data);
+}
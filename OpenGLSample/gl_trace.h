@@ -0,0 +1,58 @@
+#ifndef GL_TRACE_H
+#define GL_TRACE_H
+
+#include <cstddef>
+
+#include <GL/glew.h>
+
+// Optional GL call interception. UInstallGLTrace() swaps the GLEW function pointers
+// of the entry points the renderer uses for counting wrappers, which also keep a
+// shadow copy of the bindings, capabilities and uniform values they set. A call that
+// sets the value already current is counted as redundant; glGen*/glCreate*/glFenceSync
+// are counted as object creation. UGLTraceEndFrame() prints the frame's counts and
+// resets them. Output goes to stdout only, so it works without a visible window.
+// Install and end frames on the thread that owns the context.
+
+// Returns false if GLEW has not loaded the entry points yet
+bool UInstallGLTrace();
+
+// Restores the original function pointers
+void URemoveGLTrace();
+
+bool UGLTraceActive();
+
+// Prints a per-entry-point report for the frame just submitted and starts a new one
+void UGLTraceEndFrame();
+
+// GL 1.1 entry points are linked directly from opengl32 rather than loaded into
+// GLEW pointers, so they cannot be swapped at runtime. Files that include this
+// header route the per-frame ones through forwarding wrappers instead; the wrappers
+// only record while the trace is installed. Every file that calls one of them must
+// include this header, or the shadow state misses its changes.
+void GLAPIENTRY UTraceEnable(GLenum cap);
+void GLAPIENTRY UTraceDisable(GLenum cap);
+void GLAPIENTRY UTraceBindTexture(GLenum target, GLuint texture);
+void GLAPIENTRY UTraceGenTextures(GLsizei n, GLuint* textures);
+void GLAPIENTRY UTraceDeleteTextures(GLsizei n, const GLuint* textures);
+void GLAPIENTRY UTraceViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+void GLAPIENTRY UTraceClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+void GLAPIENTRY UTraceClear(GLbitfield mask);
+void GLAPIENTRY UTraceDrawArrays(GLenum mode, GLint first, GLsizei count);
+void GLAPIENTRY UTraceDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices);
+void GLAPIENTRY UTraceGetIntegerv(GLenum pname, GLint* data);
+
+#ifndef GL_TRACE_NO_REDIRECT
+#define glEnable UTraceEnable
+#define glDisable UTraceDisable
+#define glBindTexture UTraceBindTexture
+#define glGenTextures UTraceGenTextures
+#define glDeleteTextures UTraceDeleteTextures
+#define glViewport UTraceViewport
+#define glClearColor UTraceClearColor
+#define glClear UTraceClear
+#define glDrawArrays UTraceDrawArrays
+#define glDrawElements UTraceDrawElements
+#define glGetIntegerv UTraceGetIntegerv
+#endif
+
+#endif
@@ -0,0 +1,208 @@
+#include "gpu_profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+using namespace std;
+
+const size_t GpuProfiler::FRAME_LATENCY;
+const size_t GpuProfiler::MAX_SCOPES_PER_FRAME;
+const size_t GpuProfiler::HISTORY_SIZE;
+
+bool GpuProfiler::Create() {
+    Destroy();
+
+    for (FrameQueries& frame : mFrames) {
+        glGenQueries(MAX_SCOPES_PER_FRAME * 2, frame.queries);
+        frame.records.reserve(MAX_SCOPES_PER_FRAME);
+        frame.records.clear();
+        frame.used = 0;
+        frame.pending = false;
+    }
+    mCurrent = 0;
+    mCreated = true;
+    return glGetError() == GL_NO_ERROR;
+}
+
+void GpuProfiler::Destroy() {
+    if (!mCreated)
+        return;
+
+    for (FrameQueries& frame : mFrames) {
+        if (frame.pending)
+            Resolve(frame);
+        glDeleteQueries(MAX_SCOPES_PER_FRAME * 2, frame.queries);
+    }
+    mCreated = false;
+}
+
+void GpuProfiler::BeginFrame(uint64_t frameNumber) {
+    if (!mCreated)
+        return;
+
+    mCurrent = (mCurrent + 1) % (FRAME_LATENCY + 1);
+    FrameQueries& frame = mFrames[mCurrent];
+    if (frame.pending) {
+        // Queries complete in order, so the last one being ready means all of them are
+        GLint available = 0;
+        glGetQueryObjectiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+            Resolve(frame);
+        else
+            ++mFramesDropped;
+    }
+
+    frame.records.clear();
+    frame.used = 0;
+    frame.open = 0;
+    frame.overflowed = false;
+    frame.pending = false;
+    frame.frame = frameNumber;
+}
+
+int GpuProfiler::BeginScope(const char* name) {
+    if (!mCreated)
+        return -1;
+
+    // Enclosing scopes keep a slot each for their end queries
+    FrameQueries& frame = mFrames[mCurrent];
+    if (frame.used + 2 + frame.open > static_cast<int>(MAX_SCOPES_PER_FRAME * 2)) {
+        ++mScopesDropped;
+        frame.overflowed = true;
+        return -1;
+    }
+
+    map<string, size_t>::iterator found = mScopeIndex.find(name);
+    if (found == mScopeIndex.end()) {
+        found = mScopeIndex.insert(make_pair(string(name), mScopes.size())).first;
+        ScopeHistory history;
+        history.name = name;
+        history.samples.reserve(HISTORY_SIZE);
+        mScopes.push_back(history);
+        mFrameTotals.push_back(0.0);
+    }
+
+    ScopeRecord record = { found->second, frame.used++, -1 };
+    glQueryCounter(frame.queries[record.beginQuery], GL_TIMESTAMP);
+    frame.records.push_back(record);
+    ++frame.open;
+    return static_cast<int>(frame.records.size() - 1);
+}
+
+void GpuProfiler::EndScope(int id) {
+    if (!mCreated || id < 0)
+        return;
+
+    // A scope from another frame, or already ended, has no slot left to close it
+    FrameQueries& frame = mFrames[mCurrent];
+    if (id >= static_cast<int>(frame.records.size()) || frame.records[id].endQuery >= 0
+        || frame.used >= static_cast<int>(MAX_SCOPES_PER_FRAME * 2))
+        return;
+
+    ScopeRecord& record = frame.records[id];
+    record.endQuery = frame.used++;
+    --frame.open;
+    glQueryCounter(frame.queries[record.endQuery], GL_TIMESTAMP);
+    frame.pending = true;
+}
+
+void GpuProfiler::Resolve(FrameQueries& frame) {
+    fill(mFrameTotals.begin(), mFrameTotals.end(), -1.0);
+    for (const ScopeRecord& record : frame.records) {
+        if (record.endQuery < 0)
+            continue;
+
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(frame.queries[record.beginQuery], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(frame.queries[record.endQuery], GL_QUERY_RESULT, &end);
+        double& total = mFrameTotals[record.scope];
+        total = max(total, 0.0) + (end - begin) / 1.0e6;
+    }
+
+    for (size_t i = 0; i < mScopes.size(); ++i) {
+        if (mFrameTotals[i] < 0.0)
+            continue;
+
+        ScopeHistory& history = mScopes[i];
+        float ms = static_cast<float>(mFrameTotals[i]);
+        if (history.samples.size() < HISTORY_SIZE)
+            history.samples.push_back(ms);
+        else
+            history.samples[history.next] = ms;
+        history.next = (history.next + 1) % HISTORY_SIZE;
+    }
+
+    ++mFramesResolved;
+    mLatestFrame = frame.frame;
+    mLatestOverflowed = frame.overflowed;
+    frame.pending = false;
+}
+
+vector<GpuProfiler::ScopeStats> GpuProfiler::GetStats() const {
+    vector<ScopeStats> stats;
+    for (const ScopeHistory& history : mScopes) {
+        ScopeStats scope;
+        scope.name = history.name;
+        scope.samples = history.samples.size();
+        if (!history.samples.empty()) {
+            vector<float> sorted(history.samples);
+            sort(sorted.begin(), sorted.end());
+
+            double total = 0.0;
+            for (float ms : sorted)
+                total += ms;
+            scope.minMs = sorted.front();
+            scope.maxMs = sorted.back();
+            scope.averageMs = total / sorted.size();
+            scope.p50Ms = sorted[min(sorted.size() - 1, sorted.size() * 50 / 100)];
+            scope.p90Ms = sorted[min(sorted.size() - 1, sorted.size() * 90 / 100)];
+            scope.p99Ms = sorted[min(sorted.size() - 1, sorted.size() * 99 / 100)];
+        }
+        stats.push_back(scope);
+    }
+    return stats;
+}
+
+double GpuProfiler::LatestMs(const char* name) const {
+    map<string, size_t>::const_iterator found = mScopeIndex.find(name);
+    if (found == mScopeIndex.end())
+        return -1.0;
+
+    const ScopeHistory& history = mScopes[found->second];
+    if (history.samples.empty())
+        return -1.0;
+    return history.samples[(history.next + HISTORY_SIZE - 1) % HISTORY_SIZE];
+}
+
+bool GpuProfiler::WriteCsv(const char* path) const {
+    ofstream out(path);
+    if (!out)
+        return false;
+
+    out << "scope,samples,min_ms,avg_ms,p99_ms,max_ms\n" << fixed << setprecision(4);
+    for (const ScopeStats& scope : GetStats()) {
+        out << scope.name << "," << scope.samples << "," << scope.minMs << "," << scope.averageMs << ","
+            << scope.p99Ms << "," << scope.maxMs << "\n";
+    }
+    return static_cast<bool>(out);
+}
+
+bool GpuProfiler::WriteJson(const char* path) const {
+    ofstream out(path);
+    if (!out)
+        return false;
+
+    // Scope names are code literals, so they need no escaping
+    vector<ScopeStats> stats = GetStats();
+    out << "{\n  \"framesResolved\": " << mFramesResolved << ",\n  \"framesDropped\": " << mFramesDropped
+        << ",\n  \"scopesDropped\": " << mScopesDropped << ",\n  \"scopes\": [" << fixed << setprecision(4);
+    for (size_t i = 0; i < stats.size(); ++i) {
+        const ScopeStats& scope = stats[i];
+        out << (i == 0 ? "\n" : ",\n") << "    { \"name\": \"" << scope.name << "\", \"samples\": " << scope.samples
+            << ", \"minMs\": " << scope.minMs << ", \"avgMs\": " << scope.averageMs << ", \"p99Ms\": " << scope.p99Ms
+            << ", \"maxMs\": " << scope.maxMs << " }";
+    }
+    out << "\n  ]\n}\n";
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,118 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Scoped GPU timings. Each scope writes a GL_TIMESTAMP query at its start and end.
+// Timestamps rather than GL_TIME_ELAPSED because elapsed-time queries cannot nest.
+// Queries are pooled per frame and read back FRAME_LATENCY frames later. A frame
+// whose results are not ready by then is dropped rather than waited for, so
+// profiling never stalls the pipeline. Scopes with the same name in one frame are
+// summed. Statistics cover the last HISTORY_SIZE frames of each scope.
+// All methods except GetStats(), WriteCsv() and WriteJson() run on the GL thread.
+class GpuProfiler {
+public:
+    static const size_t FRAME_LATENCY = 4;
+    static const size_t MAX_SCOPES_PER_FRAME = 64;
+    static const size_t HISTORY_SIZE = 256;
+
+    struct ScopeStats {
+        std::string name;
+        size_t samples = 0;
+        double minMs = 0.0;
+        double averageMs = 0.0;
+        double p50Ms = 0.0;
+        double p90Ms = 0.0;
+        double p99Ms = 0.0;
+        double maxMs = 0.0;
+    };
+
+    // Times a block with a begin/end pair; does nothing while the profiler is not created
+    class Scope {
+    public:
+        Scope(GpuProfiler& profiler, const char* name) : mProfiler(profiler), mId(profiler.BeginScope(name)) {}
+        ~Scope() { mProfiler.EndScope(mId); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        GpuProfiler& mProfiler;
+        int mId;
+    };
+
+    bool Create();
+    void Destroy();
+    bool Enabled() const { return mCreated; }
+
+    // Collects the oldest frame's results, if ready, and starts recording a new frame;
+    // frame numbers the frame for LatestFrame()
+    void BeginFrame(uint64_t frame = 0);
+
+    // Returns an id for EndScope(), or -1 when the frame's query pool cannot hold this
+    // scope's two queries as well as the end queries of the scopes still open around it
+    int BeginScope(const char* name);
+    void EndScope(int id);
+
+    std::vector<ScopeStats> GetStats() const;
+
+    // The most recent frame read back for a scope, or -1 when it has none yet
+    double LatestMs(const char* name) const;
+    size_t FramesResolved() const { return mFramesResolved; }
+    // The number given to BeginFrame() for the frame read back last
+    uint64_t LatestFrame() const { return mLatestFrame; }
+    // Whether that frame dropped scopes for want of queries; its other times still stand,
+    // but the frame was not timed as drawn
+    bool LatestOverflowed() const { return mLatestOverflowed; }
+    size_t FramesDropped() const { return mFramesDropped; }
+
+    // One row/object per scope with the statistics above
+    bool WriteCsv(const char* path) const;
+    bool WriteJson(const char* path) const;
+
+private:
+    struct ScopeRecord {
+        size_t scope;
+        int beginQuery;
+        int endQuery;       // -1 until EndScope()
+    };
+
+    struct FrameQueries {
+        GLuint queries[MAX_SCOPES_PER_FRAME * 2];
+        std::vector<ScopeRecord> records;
+        int used = 0;
+        int open = 0;       // scopes begun and not yet ended, each owed an end query
+        bool overflowed = false;
+        bool pending = false;
+        uint64_t frame = 0;
+    };
+
+    struct ScopeHistory {
+        std::string name;
+        std::vector<float> samples;   // ring buffer of per-frame milliseconds
+        size_t next = 0;
+    };
+
+    void Resolve(FrameQueries& frame);
+
+    FrameQueries mFrames[FRAME_LATENCY + 1];
+    size_t mCurrent = 0;
+    bool mCreated = false;
+
+    std::map<std::string, size_t> mScopeIndex;
+    std::vector<ScopeHistory> mScopes;
+    std::vector<double> mFrameTotals;   // scratch, per scope
+    size_t mFramesResolved = 0;
+    uint64_t mLatestFrame = 0;
+    bool mLatestOverflowed = false;
+    size_t mFramesDropped = 0;
+    size_t mScopesDropped = 0;
+};
+
+#endif
@@ -0,0 +1,178 @@
+#include "headless_context.h"
+#include "gl_trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef HEADLESS_USE_EGL
+#include <EGL/eglext.h>
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+#else
+#include <GLFW/glfw3.h>
+#endif
+
+using namespace std;
+
+bool HeadlessContext::Create() {
+    Destroy();
+
+#ifdef HEADLESS_USE_EGL
+    // Prefer the surfaceless platform; the default display may go looking for an X server
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (getPlatformDisplay != nullptr && clientExtensions != nullptr
+        && strstr(clientExtensions, "EGL_MESA_platform_surfaceless") != nullptr)
+        mDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    else
+        mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major = 0, minor = 0;
+    if (mDisplay == EGL_NO_DISPLAY || !eglInitialize(mDisplay, &major, &minor)) {
+        cout << "Failed to initialize EGL" << endl;
+        mDisplay = EGL_NO_DISPLAY;
+        return false;
+    }
+
+    // Rendering only ever goes to the framebuffer object, so no surface is needed
+    const char* extensions = eglQueryString(mDisplay, EGL_EXTENSIONS);
+    if (extensions == nullptr || strstr(extensions, "EGL_KHR_surfaceless_context") == nullptr) {
+        cout << "EGL " << major << "." << minor << " display does not support surfaceless contexts" << endl;
+        Destroy();
+        return false;
+    }
+
+    const EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 4,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(mDisplay, configAttributes, &config, 1, &configCount)
+        || configCount == 0) {
+        cout << "No EGL config supports desktop OpenGL" << endl;
+        Destroy();
+        return false;
+    }
+
+    mContext = eglCreateContext(mDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+    if (mContext == EGL_NO_CONTEXT) {
+        cout << "Failed to create an OpenGL 4.4 core context through EGL" << endl;
+        Destroy();
+        return false;
+    }
+#else
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    mWindow = glfwCreateWindow(1, 1, "", NULL, NULL);
+    if (mWindow == nullptr) {
+        cout << "Failed to create a hidden GLFW window" << endl;
+        return false;
+    }
+#endif
+
+    return MakeCurrent();
+}
+
+void HeadlessContext::Destroy() {
+    if (mFramebuffer != 0) {
+        glDeleteFramebuffers(1, &mFramebuffer);
+        GLuint renderbuffers[2] = { mColor, mDepth };
+        glDeleteRenderbuffers(2, renderbuffers);
+    }
+    mFramebuffer = 0;
+    mColor = 0;
+    mDepth = 0;
+
+#ifdef HEADLESS_USE_EGL
+    if (mDisplay != EGL_NO_DISPLAY) {
+        eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (mContext != EGL_NO_CONTEXT)
+            eglDestroyContext(mDisplay, mContext);
+        eglTerminate(mDisplay);
+    }
+    mContext = EGL_NO_CONTEXT;
+    mDisplay = EGL_NO_DISPLAY;
+#else
+    if (mWindow != nullptr)
+        glfwDestroyWindow(mWindow);
+    mWindow = nullptr;
+#endif
+}
+
+bool HeadlessContext::CreateFramebuffer(int width, int height) {
+    mWidth = width;
+    mHeight = height;
+
+    glGenRenderbuffers(1, &mColor);
+    glBindRenderbuffer(GL_RENDERBUFFER, mColor);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &mDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, mDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &mFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mColor);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepth);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        cout << "Headless framebuffer incomplete: 0x" << hex << status << dec << endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return false;
+    }
+    // Left bound: with no window there is nothing else to draw to
+    return true;
+}
+
+bool HeadlessContext::MakeCurrent() {
+#ifdef HEADLESS_USE_EGL
+    if (!eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, mContext)) {
+        cout << "Failed to make the EGL context current: 0x" << hex << eglGetError() << dec << endl;
+        return false;
+    }
+#else
+    glfwMakeContextCurrent(mWindow);
+#endif
+    return true;
+}
+
+void HeadlessContext::ReleaseCurrent() {
+#ifdef HEADLESS_USE_EGL
+    eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+#else
+    glfwMakeContextCurrent(NULL);
+#endif
+}
+
+void HeadlessContext::ReadPixels(vector<uint8_t>& rgb) const {
+    const size_t rowBytes = static_cast<size_t>(mWidth) * 3;
+    rgb.resize(rowBytes * mHeight);
+
+    GLint readFramebuffer = 0;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, mFramebuffer);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, mWidth, mHeight, GL_RGB, GL_UNSIGNED_BYTE, rgb.data());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<GLuint>(readFramebuffer));
+
+    // GL rows start at the bottom; images start at the top
+    for (int y = 0; y < mHeight / 2; ++y)
+        swap_ranges(rgb.begin() + y * rowBytes, rgb.begin() + (y + 1) * rowBytes, rgb.begin() + (mHeight - 1 - y) * rowBytes);
+}
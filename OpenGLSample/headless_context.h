@@ -0,0 +1,55 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+
+#ifndef _WIN32
+#define HEADLESS_USE_EGL
+#include <EGL/egl.h>
+#else
+struct GLFWwindow;
+#endif
+
+// A GL 4.4 core context with no display, rendering into an RGBA8 + depth framebuffer
+// object that stands in for the window's default framebuffer. On Linux it uses EGL
+// on Mesa's surfaceless platform, so it runs on servers with no X or Wayland and no
+// GPU (LIBGL_ALWAYS_SOFTWARE=1 selects llvmpipe); GLEW must then be built with EGL
+// support. Windows has no surfaceless EGL, so there it falls back to a hidden GLFW window.
+class HeadlessContext {
+public:
+    // Creates the context and makes it current on the calling thread
+    bool Create();
+    void Destroy();
+
+    // Creates the framebuffer; needs the GL entry points loaded
+    bool CreateFramebuffer(int width, int height);
+
+    // Binds or releases the context on the calling thread
+    bool MakeCurrent();
+    void ReleaseCurrent();
+
+    // Reads the colour attachment as tightly packed RGB rows, top row first
+    void ReadPixels(std::vector<uint8_t>& rgb) const;
+
+    GLuint Framebuffer() const { return mFramebuffer; }
+    int Width() const { return mWidth; }
+    int Height() const { return mHeight; }
+
+private:
+#ifdef HEADLESS_USE_EGL
+    EGLDisplay mDisplay = EGL_NO_DISPLAY;
+    EGLContext mContext = EGL_NO_CONTEXT;
+#else
+    GLFWwindow* mWindow = nullptr;
+#endif
+    GLuint mFramebuffer = 0;
+    GLuint mColor = 0;
+    GLuint mDepth = 0;
+    int mWidth = 0;
+    int mHeight = 0;
+};
+
+#endif
@@ -0,0 +1,415 @@
+#include "image_writer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    const int LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+        67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const int LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    const int DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+        1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    const int DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+        11, 11, 12, 12, 13, 13 };
+
+    const int WINDOW_SIZE = 32768;
+    const int MIN_MATCH = 3;
+    const int MAX_MATCH = 258;
+    const int HASH_BITS = 15;
+    const int MAX_CHAIN = 16;       // candidates tried per position
+
+    uint32_t HashAt(const uint8_t* p) {
+        uint32_t key = (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2];
+        return (key * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+        static uint32_t table[256];
+        static bool tableReady = false;
+        if (!tableReady) {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                table[i] = c;
+            }
+            tableReady = true;
+        }
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i)
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    void PutBigEndian(vector<uint8_t>& out, uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+
+    void WriteChunk(ofstream& file, const char* type, const vector<uint8_t>& data) {
+        vector<uint8_t> chunk;
+        chunk.reserve(data.size() + 12);
+        PutBigEndian(chunk, static_cast<uint32_t>(data.size()));
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        PutBigEndian(chunk, Crc32(chunk.data() + 4, data.size() + 4));
+        file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+    }
+
+    vector<uint8_t> PngHeader(int width, int height, int channels) {
+        vector<uint8_t> header;
+        PutBigEndian(header, static_cast<uint32_t>(width));
+        PutBigEndian(header, static_cast<uint32_t>(height));
+        header.push_back(8);                                                // bits per channel
+        header.push_back(static_cast<uint8_t>(channels == 1 ? 0 : channels == 3 ? 2 : 6));
+        header.push_back(0);                                                // deflate
+        header.push_back(0);                                                // adaptive filtering
+        header.push_back(0);                                                // no interlace
+        return header;
+    }
+
+    const uint8_t PNG_SIGNATURE[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+
+    // Index of a colour in QOI's table of recently seen pixels
+    int QoiHash(const uint8_t* rgba) {
+        return (rgba[0] * 3 + rgba[1] * 5 + rgba[2] * 7 + rgba[3] * 11) % 64;
+    }
+
+    uint8_t Paeth(int left, int up, int upLeft) {
+        int p = left + up - upLeft;
+        int pa = abs(p - left), pb = abs(p - up), pc = abs(p - upLeft);
+        if (pa <= pb && pa <= pc)
+            return static_cast<uint8_t>(left);
+        return static_cast<uint8_t>(pb <= pc ? up : upLeft);
+    }
+
+    // Filters the row all five ways and appends the filter byte and the residuals of
+    // the one with the smallest sum
+    void FilterRow(const uint8_t* row, const uint8_t* above, size_t rowBytes, int channels, vector<uint8_t>& out) {
+        vector<uint8_t> candidate(rowBytes), best(rowBytes);
+        uint64_t bestCost = UINT64_MAX;
+        uint8_t bestFilter = 0;
+        for (uint8_t filter = 0; filter < 5; ++filter) {
+            uint64_t cost = 0;
+            for (size_t x = 0; x < rowBytes; ++x) {
+                int left = x >= static_cast<size_t>(channels) ? row[x - channels] : 0;
+                int upLeft = x >= static_cast<size_t>(channels) ? above[x - channels] : 0;
+                int up = above[x];
+                uint8_t predicted = 0;
+                switch (filter) {
+                case 1: predicted = static_cast<uint8_t>(left); break;
+                case 2: predicted = static_cast<uint8_t>(up); break;
+                case 3: predicted = static_cast<uint8_t>((left + up) / 2); break;
+                case 4: predicted = Paeth(left, up, upLeft); break;
+                default: break;
+                }
+                candidate[x] = static_cast<uint8_t>(row[x] - predicted);
+                cost += abs(static_cast<int8_t>(candidate[x]));
+            }
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestFilter = filter;
+                best.swap(candidate);
+            }
+        }
+        out.push_back(bestFilter);
+        out.insert(out.end(), best.begin(), best.end());
+    }
+}
+
+void DeflateStream::Begin() {
+    mOut.clear();
+    mOut.push_back(0x78);
+    mOut.push_back(0x01);
+    mBits = 0;
+    mBitCount = 0;
+    mAdlerA = 1;
+    mAdlerB = 0;
+}
+
+// Deflate writes values least significant bit first but Huffman codes most
+// significant bit first, so codes are reversed on the way in
+void DeflateStream::WriteBits(uint32_t bits, int count) {
+    mBits |= bits << mBitCount;
+    mBitCount += count;
+    while (mBitCount >= 8) {
+        mOut.push_back(static_cast<uint8_t>(mBits));
+        mBits >>= 8;
+        mBitCount -= 8;
+    }
+}
+
+void DeflateStream::WriteCode(uint32_t code, int length) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; ++i)
+        reversed |= ((code >> i) & 1u) << (length - 1 - i);
+    WriteBits(reversed, length);
+}
+
+// Fixed Huffman code for a literal/length symbol (RFC 1951, 3.2.6)
+void DeflateStream::WriteSymbol(int symbol) {
+    if (symbol <= 143)
+        WriteCode(0x30 + symbol, 8);
+    else if (symbol <= 255)
+        WriteCode(0x190 + symbol - 144, 9);
+    else if (symbol <= 279)
+        WriteCode(symbol - 256, 7);
+    else
+        WriteCode(0xC0 + symbol - 280, 8);
+}
+
+void DeflateStream::WriteMatch(int length, int distance) {
+    int code = 28;
+    while (LENGTH_BASE[code] > length)
+        --code;
+    WriteSymbol(257 + code);
+    WriteBits(length - LENGTH_BASE[code], LENGTH_EXTRA[code]);
+
+    code = 29;
+    while (DISTANCE_BASE[code] > distance)
+        --code;
+    WriteCode(code, 5);
+    WriteBits(distance - DISTANCE_BASE[code], DISTANCE_EXTRA[code]);
+}
+
+void DeflateStream::Compress(const uint8_t* data, size_t size, bool final) {
+    WriteBits(final ? 1 : 0, 1);
+    WriteBits(1, 2);   // fixed Huffman codes
+
+    const int n = static_cast<int>(size);
+    mHead.assign(1 << HASH_BITS, -1);
+    mPrevious.assign(WINDOW_SIZE, -1);
+    auto insert = [&](int position) {
+        if (position + MIN_MATCH > n)
+            return;
+        uint32_t hash = HashAt(data + position);
+        mPrevious[position & (WINDOW_SIZE - 1)] = mHead[hash];
+        mHead[hash] = position;
+    };
+
+    int i = 0;
+    while (i < n) {
+        int bestLength = 0;
+        int bestDistance = 0;
+        if (i + MIN_MATCH <= n) {
+            int limit = min(MAX_MATCH, n - i);
+            int candidate = mHead[HashAt(data + i)];
+            for (int chain = 0; candidate >= 0 && i - candidate <= WINDOW_SIZE && chain < MAX_CHAIN; ++chain) {
+                int length = 0;
+                while (length < limit && data[candidate + length] == data[i + length])
+                    ++length;
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestDistance = i - candidate;
+                    if (length == limit)
+                        break;
+                }
+                // A slot overwritten by a newer position ends the chain
+                int next = mPrevious[candidate & (WINDOW_SIZE - 1)];
+                if (next >= candidate)
+                    break;
+                candidate = next;
+            }
+        }
+
+        if (bestLength >= MIN_MATCH) {
+            WriteMatch(bestLength, bestDistance);
+            for (int j = 0; j < bestLength; ++j)
+                insert(i + j);
+            i += bestLength;
+        }
+        else {
+            WriteSymbol(data[i]);
+            insert(i);
+            ++i;
+        }
+    }
+    WriteSymbol(256);
+
+    for (size_t k = 0; k < size; ++k) {
+        mAdlerA = (mAdlerA + data[k]) % 65521;
+        mAdlerB = (mAdlerB + mAdlerA) % 65521;
+    }
+
+    if (final) {
+        if (mBitCount > 0)
+            mOut.push_back(static_cast<uint8_t>(mBits));
+        mBits = 0;
+        mBitCount = 0;
+        uint32_t adler = (mAdlerB << 16) | mAdlerA;
+        for (int shift = 24; shift >= 0; shift -= 8)
+            mOut.push_back(static_cast<uint8_t>(adler >> shift));
+    }
+}
+
+bool UWritePng(const char* path, int width, int height, int channels, const uint8_t* pixels, int stride) {
+    if (width <= 0 || height <= 0 || (channels != 1 && channels != 3 && channels != 4))
+        return false;
+
+    const size_t rowBytes = static_cast<size_t>(width) * channels;
+    vector<uint8_t> filtered;
+    filtered.reserve((rowBytes + 1) * height);
+    vector<uint8_t> zeroRow(rowBytes, 0);
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* row = pixels + static_cast<size_t>(y) * stride;
+        const uint8_t* above = y > 0 ? pixels + static_cast<size_t>(y - 1) * stride : zeroRow.data();
+        FilterRow(row, above, rowBytes, channels, filtered);
+    }
+
+    ofstream file(path, ios::binary);
+    if (!file)
+        return false;
+
+    DeflateStream deflate;
+    deflate.Begin();
+    deflate.Compress(filtered.data(), filtered.size(), true);
+
+    file.write(reinterpret_cast<const char*>(PNG_SIGNATURE), sizeof(PNG_SIGNATURE));
+    WriteChunk(file, "IHDR", PngHeader(width, height, channels));
+    WriteChunk(file, "IDAT", deflate.Output());
+    WriteChunk(file, "IEND", vector<uint8_t>());
+    return static_cast<bool>(file);
+}
+
+bool UWriteQoi(const char* path, int width, int height, int channels, const uint8_t* pixels, int stride) {
+    if (width <= 0 || height <= 0 || (channels != 3 && channels != 4))
+        return false;
+
+    vector<uint8_t> out;
+    out.reserve(static_cast<size_t>(width) * height * 2 + 22);
+    const char magic[4] = { 'q', 'o', 'i', 'f' };
+    out.insert(out.end(), magic, magic + 4);
+    PutBigEndian(out, static_cast<uint32_t>(width));
+    PutBigEndian(out, static_cast<uint32_t>(height));
+    out.push_back(static_cast<uint8_t>(channels));
+    out.push_back(0);   // sRGB with linear alpha
+
+    uint8_t seen[64][4] = {};
+    uint8_t previous[4] = { 0, 0, 0, 255 };
+    int run = 0;
+    const size_t pixelCount = static_cast<size_t>(width) * height;
+    for (size_t i = 0; i < pixelCount; ++i) {
+        const uint8_t* source = pixels + (i / width) * static_cast<size_t>(stride) + (i % width) * channels;
+        uint8_t pixel[4] = { source[0], source[1], source[2], channels == 4 ? source[3] : uint8_t(255) };
+
+        if (memcmp(pixel, previous, 4) == 0) {
+            if (++run == 62 || i + 1 == pixelCount) {
+                out.push_back(static_cast<uint8_t>(0xc0 | (run - 1)));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            out.push_back(static_cast<uint8_t>(0xc0 | (run - 1)));
+            run = 0;
+        }
+
+        int hash = QoiHash(pixel);
+        if (memcmp(seen[hash], pixel, 4) == 0) {
+            out.push_back(static_cast<uint8_t>(hash));
+        }
+        else {
+            memcpy(seen[hash], pixel, 4);
+            if (pixel[3] == previous[3]) {
+                // Differences wrap, as the format specifies
+                int dr = static_cast<int8_t>(pixel[0] - previous[0]);
+                int dg = static_cast<int8_t>(pixel[1] - previous[1]);
+                int db = static_cast<int8_t>(pixel[2] - previous[2]);
+                int drg = dr - dg, dbg = db - dg;
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                    out.push_back(static_cast<uint8_t>(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                }
+                else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                    out.push_back(static_cast<uint8_t>(0x80 | (dg + 32)));
+                    out.push_back(static_cast<uint8_t>((drg + 8) << 4 | (dbg + 8)));
+                }
+                else {
+                    out.push_back(0xfe);
+                    out.insert(out.end(), pixel, pixel + 3);
+                }
+            }
+            else {
+                out.push_back(0xff);
+                out.insert(out.end(), pixel, pixel + 4);
+            }
+        }
+        memcpy(previous, pixel, 4);
+    }
+
+    const uint8_t end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    out.insert(out.end(), end, end + 8);
+
+    ofstream file(path, ios::binary);
+    if (!file)
+        return false;
+    file.write(reinterpret_cast<const char*>(out.data()), out.size());
+    return static_cast<bool>(file);
+}
+
+const size_t PngStreamWriter::BLOCK_BYTES;
+
+bool PngStreamWriter::Begin(const char* path, int width, int height, int channels) {
+    if (width <= 0 || height <= 0 || (channels != 1 && channels != 3 && channels != 4))
+        return false;
+
+    mFile.close();
+    mFile.clear();
+    mFile.open(path, ios::binary);
+    if (!mFile)
+        return false;
+
+    mWidth = width;
+    mHeight = height;
+    mChannels = channels;
+    mRowsWritten = 0;
+    mPending.clear();
+    mPending.reserve(BLOCK_BYTES + static_cast<size_t>(width) * channels + 1);
+    mPreviousRow.assign(static_cast<size_t>(width) * channels, 0);
+    mDeflate.Begin();
+
+    mFile.write(reinterpret_cast<const char*>(PNG_SIGNATURE), sizeof(PNG_SIGNATURE));
+    WriteChunk(mFile, "IHDR", PngHeader(width, height, channels));
+    return static_cast<bool>(mFile);
+}
+
+bool PngStreamWriter::WriteRow(const uint8_t* row) {
+    if (mRowsWritten >= mHeight)
+        return false;
+
+    const size_t rowBytes = static_cast<size_t>(mWidth) * mChannels;
+    FilterRow(row, mPreviousRow.data(), rowBytes, mChannels, mPending);
+    mPreviousRow.assign(row, row + rowBytes);
+    ++mRowsWritten;
+
+    if (mPending.size() >= BLOCK_BYTES && mRowsWritten < mHeight)
+        WriteIdat(false);
+    return static_cast<bool>(mFile);
+}
+
+bool PngStreamWriter::Finish() {
+    if (mRowsWritten != mHeight) {
+        mFile.close();
+        return false;
+    }
+    WriteIdat(true);
+    WriteChunk(mFile, "IEND", vector<uint8_t>());
+    bool ok = static_cast<bool>(mFile);
+    mFile.close();
+    return ok;
+}
+
+// Deflates the pending rows and writes whatever whole bytes the stream has produced;
+// a partial byte stays in the stream for the next block
+void PngStreamWriter::WriteIdat(bool final) {
+    mDeflate.Compress(mPending.data(), mPending.size(), final);
+    mPending.clear();
+    if (!mDeflate.Output().empty())
+        WriteChunk(mFile, "IDAT", mDeflate.Output());
+    mDeflate.Output().clear();
+}
@@ -0,0 +1,74 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+// Writes 8-bit pixels as a PNG. channels is 1 (grey), 3 (RGB) or 4 (RGBA); rows run
+// top to bottom, stride bytes apart. Each row gets the PNG filter that minimises
+// its residuals and the result is deflated with fixed Huffman codes, which keeps
+// the encoder small while still shrinking rendered frames several times over.
+bool UWritePng(const char* path, int width, int height, int channels, const uint8_t* pixels, int stride);
+
+// Writes 8-bit RGB (channels 3) or RGBA (channels 4) pixels as a QOI image. QOI
+// encodes in one pass with no entropy coder, many times faster than PNG at a somewhat
+// larger size, which suits capturing every frame.
+bool UWriteQoi(const char* path, int width, int height, int channels, const uint8_t* pixels, int stride);
+
+// A zlib stream built from fixed-Huffman deflate blocks, compressed a block at a time.
+// LZ77 matches stay inside their block, so only the block being compressed is held.
+class DeflateStream {
+public:
+    // Starts a new stream with the zlib header
+    void Begin();
+
+    // Appends one block; the last one must be final, which also appends the checksum
+    void Compress(const uint8_t* data, size_t size, bool final);
+
+    // Compressed bytes so far; the caller may write them out and clear the vector
+    std::vector<uint8_t>& Output() { return mOut; }
+
+private:
+    void WriteBits(uint32_t bits, int count);
+    void WriteCode(uint32_t code, int length);
+    void WriteSymbol(int symbol);
+    void WriteMatch(int length, int distance);
+
+    std::vector<uint8_t> mOut;
+    uint32_t mBits = 0;
+    int mBitCount = 0;
+    uint32_t mAdlerA = 1;
+    uint32_t mAdlerB = 0;
+    std::vector<int> mHead;         // hash chains, reused between blocks
+    std::vector<int> mPrevious;
+};
+
+// Writes a PNG one row at a time, top to bottom. Filtered rows are deflated and
+// written out every BLOCK_BYTES, so memory use depends on the row width only and
+// images far larger than memory can be produced.
+class PngStreamWriter {
+public:
+    static const size_t BLOCK_BYTES = 1 << 20;
+
+    bool Begin(const char* path, int width, int height, int channels);
+    bool WriteRow(const uint8_t* row);
+
+    // Call after the last row; fails if fewer rows than the height were written
+    bool Finish();
+
+private:
+    void WriteIdat(bool final);
+
+    std::ofstream mFile;
+    DeflateStream mDeflate;
+    int mWidth = 0;
+    int mHeight = 0;
+    int mChannels = 0;
+    int mRowsWritten = 0;
+    std::vector<uint8_t> mPending;      // filtered rows not yet deflated
+    std::vector<uint8_t> mPreviousRow;
+};
+
+#endif
@@ -0,0 +1,242 @@
+#include "light_clusters.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+const unsigned int LightClusterGrid::TILES_X;
+const unsigned int LightClusterGrid::TILES_Y;
+const unsigned int LightClusterGrid::SLICES;
+const unsigned int LightClusterGrid::CLUSTER_COUNT;
+
+namespace {
+    const float POINT_LIGHT_MARKER = -2.0f;
+
+    struct TileRect {
+        int x0, y0, x1, y1;
+    };
+
+    // Uploads a whole array, orphaning the previous storage so the driver never waits
+    void UploadStorage(GLuint buffer, const void* data, size_t bytes) {
+        static const uint32_t placeholder[16] = { 0 };
+        if (bytes == 0) {
+            data = placeholder;
+            bytes = sizeof(placeholder);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, data);
+    }
+}
+
+ClusterLight UMakePointLight(const glm::vec3& position, float radius, const glm::vec3& color, float intensity) {
+    ClusterLight light;
+    light.positionRadius = glm::vec4(position, radius);
+    light.colorIntensity = glm::vec4(color, intensity);
+    light.directionCosOuter = glm::vec4(0.0f, -1.0f, 0.0f, POINT_LIGHT_MARKER);
+    light.spotParams = glm::vec4(0.0f);
+    return light;
+}
+
+ClusterLight UMakeSpotLight(const glm::vec3& position, float radius, const glm::vec3& direction,
+    float innerDegrees, float outerDegrees, const glm::vec3& color, float intensity) {
+    ClusterLight light;
+    light.positionRadius = glm::vec4(position, radius);
+    light.colorIntensity = glm::vec4(color, intensity);
+    light.directionCosOuter = glm::vec4(glm::normalize(direction), std::cos(glm::radians(outerDegrees)));
+    light.spotParams = glm::vec4(std::cos(glm::radians(innerDegrees)), 0.0f, 0.0f, 0.0f);
+    return light;
+}
+
+void LightClusterGrid::ComputeClusterBoxes(const glm::mat4& projection) {
+    // Unproject each tile's corner rays and cut them at the slice depths. Works for
+    // perspective and orthographic projections alike.
+    glm::mat4 inverseProjection = glm::inverse(projection);
+    mBoxes.resize(CLUSTER_COUNT);
+
+    for (unsigned int ty = 0; ty < TILES_Y; ++ty) {
+        for (unsigned int tx = 0; tx < TILES_X; ++tx) {
+            glm::vec3 rayNear[4], rayFar[4];
+            for (int corner = 0; corner < 4; ++corner) {
+                float x = -1.0f + 2.0f * (tx + (corner & 1)) / TILES_X;
+                float y = -1.0f + 2.0f * (ty + (corner >> 1)) / TILES_Y;
+                glm::vec4 n = inverseProjection * glm::vec4(x, y, -1.0f, 1.0f);
+                glm::vec4 f = inverseProjection * glm::vec4(x, y, 1.0f, 1.0f);
+                rayNear[corner] = glm::vec3(n) / n.w;
+                rayFar[corner] = glm::vec3(f) / f.w;
+            }
+
+            for (unsigned int s = 0; s < SLICES; ++s) {
+                float depths[2] = {
+                    mNear * std::pow(mFar / mNear, static_cast<float>(s) / SLICES),
+                    mNear * std::pow(mFar / mNear, static_cast<float>(s + 1) / SLICES)
+                };
+
+                ClusterBox box;
+                box.lo = glm::vec3(1.0e30f);
+                box.hi = glm::vec3(-1.0e30f);
+                for (int corner = 0; corner < 4; ++corner) {
+                    for (float depth : depths) {
+                        float t = (-depth - rayNear[corner].z) / (rayFar[corner].z - rayNear[corner].z);
+                        glm::vec3 p = rayNear[corner] + (rayFar[corner] - rayNear[corner]) * t;
+                        box.lo = glm::min(box.lo, p);
+                        box.hi = glm::max(box.hi, p);
+                    }
+                }
+                mBoxes[tx + TILES_X * (ty + TILES_Y * s)] = box;
+            }
+        }
+    }
+}
+
+void LightClusterGrid::Build(const std::vector<ClusterLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+    float nearPlane, float farPlane, int viewportWidth, int viewportHeight) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    mStats = Stats();
+    mStats.lights = lights.size();
+    mNear = nearPlane;
+    mFar = farPlane;
+    float logRatio = std::log(mFar / mNear);
+    mZScale = SLICES / logRatio;
+    mZBias = -(SLICES * std::log(mNear)) / logRatio;
+    mTileSize = glm::vec2(static_cast<float>(viewportWidth) / TILES_X, static_cast<float>(viewportHeight) / TILES_Y);
+
+    // Cluster boxes only depend on the projection and depth range
+    if (mBoxes.empty() || projection != mBoxProjection || mBoxNear != mNear || mBoxFar != mFar) {
+        ComputeClusterBoxes(projection);
+        mBoxProjection = projection;
+        mBoxNear = mNear;
+        mBoxFar = mFar;
+    }
+
+    mSliceLights.resize(SLICES);
+    for (std::vector<uint32_t>& list : mSliceLights)
+        list.clear();
+    mClusterLists.resize(CLUSTER_COUNT);
+
+    // View-space spheres, depth slice range and screen tile rectangle for every light
+    std::vector<glm::vec4> viewSpheres(lights.size());
+    std::vector<TileRect> rects(lights.size());
+    for (size_t i = 0; i < lights.size(); ++i) {
+        glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(lights[i].positionRadius), 1.0f));
+        float radius = lights[i].positionRadius.w;
+        viewSpheres[i] = glm::vec4(center, radius);
+
+        float zMin = -center.z - radius;
+        float zMax = -center.z + radius;
+        if (zMax < mNear || zMin > mFar)
+            continue;
+
+        // Project the sphere's bounding box; give up and cover the screen if it crosses the eye plane
+        glm::vec2 ndcLo(1.0e30f), ndcHi(-1.0e30f);
+        bool crossesEye = false;
+        for (int corner = 0; corner < 8 && !crossesEye; ++corner) {
+            glm::vec3 offset((corner & 1) ? radius : -radius, (corner & 2) ? radius : -radius, (corner & 4) ? radius : -radius);
+            glm::vec4 clip = projection * glm::vec4(center + offset, 1.0f);
+            if (clip.w <= 1.0e-5f) {
+                crossesEye = true;
+                break;
+            }
+            glm::vec2 ndc(clip.x / clip.w, clip.y / clip.w);
+            ndcLo = glm::min(ndcLo, ndc);
+            ndcHi = glm::max(ndcHi, ndc);
+        }
+
+        TileRect rect = { 0, 0, static_cast<int>(TILES_X) - 1, static_cast<int>(TILES_Y) - 1 };
+        if (!crossesEye) {
+            if (ndcHi.x < -1.0f || ndcLo.x > 1.0f || ndcHi.y < -1.0f || ndcLo.y > 1.0f)
+                continue;
+            rect.x0 = glm::clamp(static_cast<int>(std::floor((ndcLo.x * 0.5f + 0.5f) * TILES_X)), 0, static_cast<int>(TILES_X) - 1);
+            rect.x1 = glm::clamp(static_cast<int>(std::floor((ndcHi.x * 0.5f + 0.5f) * TILES_X)), 0, static_cast<int>(TILES_X) - 1);
+            rect.y0 = glm::clamp(static_cast<int>(std::floor((ndcLo.y * 0.5f + 0.5f) * TILES_Y)), 0, static_cast<int>(TILES_Y) - 1);
+            rect.y1 = glm::clamp(static_cast<int>(std::floor((ndcHi.y * 0.5f + 0.5f) * TILES_Y)), 0, static_cast<int>(TILES_Y) - 1);
+        }
+        rects[i] = rect;
+
+        int s0 = glm::clamp(static_cast<int>(std::floor(std::log(std::max(zMin, mNear)) * mZScale + mZBias)), 0, static_cast<int>(SLICES) - 1);
+        int s1 = glm::clamp(static_cast<int>(std::floor(std::log(std::min(zMax, mFar)) * mZScale + mZBias)), 0, static_cast<int>(SLICES) - 1);
+        for (int s = s0; s <= s1; ++s)
+            mSliceLights[s].push_back(static_cast<uint32_t>(i));
+        ++mStats.lightsInView;
+    }
+
+    // Each worker owns whole depth slices, so cluster lists are written without locks
+    UParallelFor(SLICES, 1, [&](size_t sliceBegin, size_t sliceEnd) {
+        for (size_t s = sliceBegin; s < sliceEnd; ++s) {
+            size_t sliceBase = s * TILES_X * TILES_Y;
+            for (size_t c = 0; c < TILES_X * TILES_Y; ++c)
+                mClusterLists[sliceBase + c].clear();
+
+            for (uint32_t lightIndex : mSliceLights[s]) {
+                const glm::vec4& sphere = viewSpheres[lightIndex];
+                glm::vec3 center(sphere);
+                float radiusSq = sphere.w * sphere.w;
+                const TileRect& rect = rects[lightIndex];
+
+                for (int ty = rect.y0; ty <= rect.y1; ++ty) {
+                    for (int tx = rect.x0; tx <= rect.x1; ++tx) {
+                        size_t cluster = sliceBase + tx + TILES_X * ty;
+                        const ClusterBox& box = mBoxes[cluster];
+                        glm::vec3 closest = glm::clamp(center, box.lo, box.hi);
+                        glm::vec3 d = center - closest;
+                        if (glm::dot(d, d) <= radiusSq)
+                            mClusterLists[cluster].push_back(lightIndex);
+                    }
+                }
+            }
+        }
+    });
+
+    // Flatten into offset/count ranges and one index array
+    mRanges.resize(CLUSTER_COUNT * 2);
+    uint32_t offset = 0;
+    for (size_t c = 0; c < CLUSTER_COUNT; ++c) {
+        uint32_t count = static_cast<uint32_t>(mClusterLists[c].size());
+        mRanges[c * 2] = offset;
+        mRanges[c * 2 + 1] = count;
+        offset += count;
+        if (count > 0)
+            ++mStats.occupiedClusters;
+        mStats.maxLightsPerCluster = std::max<size_t>(mStats.maxLightsPerCluster, count);
+    }
+
+    mIndices.resize(offset);
+    UParallelFor(CLUSTER_COUNT, 256, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+            if (!mClusterLists[c].empty())
+                memcpy(&mIndices[mRanges[c * 2]], mClusterLists[c].data(), mClusterLists[c].size() * sizeof(uint32_t));
+        }
+    });
+
+    mStats.indexCount = offset;
+    mStats.buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void LightClusterGrid::Upload(const std::vector<ClusterLight>& lights) {
+    if (mBuffers[0] == 0)
+        glGenBuffers(3, mBuffers);
+
+    UploadStorage(mBuffers[0], lights.empty() ? NULL : lights.data(), lights.size() * sizeof(ClusterLight));
+    UploadStorage(mBuffers[1], mRanges.data(), mRanges.size() * sizeof(uint32_t));
+    UploadStorage(mBuffers[2], mIndices.empty() ? NULL : mIndices.data(), mIndices.size() * sizeof(uint32_t));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void LightClusterGrid::Bind(GLuint programId) const {
+    for (GLuint binding = 0; binding < 3; ++binding)
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, mBuffers[binding]);
+
+    glUniform3ui(glGetUniformLocation(programId, "clusterGrid"), TILES_X, TILES_Y, SLICES);
+    glUniform2f(glGetUniformLocation(programId, "clusterTileSize"), mTileSize.x, mTileSize.y);
+    glUniform1f(glGetUniformLocation(programId, "clusterZScale"), mZScale);
+    glUniform1f(glGetUniformLocation(programId, "clusterZBias"), mZBias);
+}
+
+void LightClusterGrid::Destroy() {
+    if (mBuffers[0] != 0)
+        glDeleteBuffers(3, mBuffers);
+    mBuffers[0] = mBuffers[1] = mBuffers[2] = 0;
+}
@@ -0,0 +1,94 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Point or spot light as laid out in the shader storage buffer (std430, 64 bytes)
+struct ClusterLight {
+    glm::vec4 positionRadius;      // world position, radius of influence
+    glm::vec4 colorIntensity;
+    glm::vec4 directionCosOuter;   // spot direction, cos of outer cone; w = -2 for point lights
+    glm::vec4 spotParams;          // x = cos of inner cone
+};
+
+ClusterLight UMakePointLight(const glm::vec3& position, float radius, const glm::vec3& color, float intensity);
+ClusterLight UMakeSpotLight(const glm::vec3& position, float radius, const glm::vec3& direction,
+    float innerDegrees, float outerDegrees, const glm::vec3& color, float intensity);
+
+// Clustered light grid: the view frustum is split into screen tiles and exponential depth
+// slices (froxels), and every froxel gets the list of lights whose sphere touches it.
+// The fragment shader looks up its froxel and only walks that list, so shading cost
+// depends on the lights near a pixel rather than the total light count.
+class LightClusterGrid {
+public:
+    static const unsigned int TILES_X = 16;
+    static const unsigned int TILES_Y = 9;
+    static const unsigned int SLICES = 24;
+    static const unsigned int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+
+    struct Stats {
+        size_t lights = 0;
+        size_t lightsInView = 0;
+        size_t indexCount = 0;          // total light references across all clusters
+        size_t occupiedClusters = 0;
+        size_t maxLightsPerCluster = 0;
+        double buildMs = 0.0;
+    };
+
+    // Assigns lights to clusters on the worker pool. Depth slices are spread
+    // exponentially between nearPlane and farPlane.
+    void Build(const std::vector<ClusterLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+        float nearPlane, float farPlane, int viewportWidth, int viewportHeight);
+
+    // Uploads lights, cluster ranges and light indices to shader storage buffers
+    void Upload(const std::vector<ClusterLight>& lights);
+
+    // Binds the storage buffers and sets the lookup uniforms on a program
+    void Bind(GLuint programId) const;
+
+    void Destroy();
+
+    const Stats& GetStats() const { return mStats; }
+
+    // Per cluster: offset into Indices() and count, two entries per cluster
+    const std::vector<uint32_t>& Ranges() const { return mRanges; }
+    const std::vector<uint32_t>& Indices() const { return mIndices; }
+
+    // Slice mapping used by the shader: slice = log(viewDepth) * ZScale() + ZBias()
+    float ZScale() const { return mZScale; }
+    float ZBias() const { return mZBias; }
+    glm::vec2 TileSize() const { return mTileSize; }
+
+private:
+    struct ClusterBox {
+        glm::vec3 lo;
+        glm::vec3 hi;
+    };
+
+    void ComputeClusterBoxes(const glm::mat4& projection);
+
+    std::vector<ClusterBox> mBoxes;
+    glm::mat4 mBoxProjection = glm::mat4(1.0f);
+    float mBoxNear = 0.0f;
+    float mBoxFar = 0.0f;
+    std::vector<std::vector<uint32_t> > mSliceLights;    // candidate lights per depth slice
+    std::vector<std::vector<uint32_t> > mClusterLists;   // scratch list per cluster
+    std::vector<uint32_t> mRanges;
+    std::vector<uint32_t> mIndices;
+
+    float mNear = 0.1f;
+    float mFar = 200.0f;
+    float mZScale = 0.0f;
+    float mZBias = 0.0f;
+    glm::vec2 mTileSize = glm::vec2(1.0f);
+    Stats mStats;
+
+    GLuint mBuffers[3] = { 0, 0, 0 };
+};
+
+#endif
@@ -7,6 +7,8 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shader.h"
+#include "mesh_lod.h"
+#include "meshlet.h"
 
 #include <string>
 #include <vector>
@@ -37,6 +39,10 @@ public:
 	vector<Vertex>       vertices;
 	vector<unsigned int> indices;
 	vector<Texture>      textures;
+	// detail levels; all share the vertex buffer and index into one element buffer
+	vector<LodLevel>     lods;
+	// clusters of the full-detail level, for per-cluster culling
+	vector<Meshlet>      meshlets;
 	unsigned int VAO;
 
 	// constructor
@@ -50,8 +56,52 @@ public:
 		setupMesh();
 	}
 
-	// render the mesh
-	void Draw(Shader &shader)
+	// picks the level of detail for one instance at the given scale and camera distance
+	unsigned int SelectLod(float modelScale, float distance, float projectionScale, LodState &state) const
+	{
+		return USelectLod(lods, modelScale, distance, projectionScale, state);
+	}
+
+	// render the mesh at the given level of detail (0 is full detail)
+	void Draw(Shader &shader, unsigned int lod = 0)
+	{
+		bindTextures(shader);
+
+		// draw mesh
+		const LodLevel &level = lods[lod < lods.size() ? lod : lods.size() - 1];
+		glBindVertexArray(VAO);
+		glDrawElements(GL_TRIANGLES, (GLsizei)level.indexCount, GL_UNSIGNED_INT, (void*)(level.indexOffset * sizeof(unsigned int)));
+		glBindVertexArray(0);
+
+		// always good practice to set everything back to defaults once configured.
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	// render only the full-detail clusters that are on screen and facing the camera
+	void DrawMeshlets(Shader &shader, const glm::mat4 &viewProjection, const glm::mat4 &model, const glm::vec3 &cameraPosition)
+	{
+		UCullMeshlets(meshlets, viewProjection, model, cameraPosition, meshletDrawList);
+		if (meshletDrawList.counts.empty())
+			return;
+
+		bindTextures(shader);
+
+		glBindVertexArray(VAO);
+		glMultiDrawElements(GL_TRIANGLES, &meshletDrawList.counts[0], GL_UNSIGNED_INT, &meshletDrawList.offsets[0], (GLsizei)meshletDrawList.counts.size());
+		glBindVertexArray(0);
+
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	// what the last DrawMeshlets call submitted
+	const MeshletDrawList &LastMeshletDraw() const { return meshletDrawList; }
+
+private:
+	// render data 
+	unsigned int VBO, EBO;
+	MeshletDrawList meshletDrawList;
+
+	void bindTextures(Shader &shader)
 	{
 		// bind appropriate textures
 		unsigned int diffuseNr = 1;
@@ -78,23 +128,20 @@ public:
 			// and finally bind the texture
 			glBindTexture(GL_TEXTURE_2D, textures[i].id);
 		}
-
-		// draw mesh
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
-
-		// always good practice to set everything back to defaults once configured.
-		glActiveTexture(GL_TEXTURE0);
 	}
 
-private:
-	// render data 
-	unsigned int VBO, EBO;
-
 	// initializes all the buffer objects/arrays
 	void setupMesh()
 	{
+		// group triangles into meshlets; the full-detail level is drawn in cluster order
+		vector<unsigned int> clustered;
+		UBuildMeshlets(&vertices[0].Position.x, vertices.size(), sizeof(Vertex), indices, meshlets, clustered);
+		indices.swap(clustered);
+
+		// simplify at import time; every level is appended to one index buffer
+		vector<unsigned int> lodIndices;
+		lods = UBuildLodChain(&vertices[0].Position.x, vertices.size(), sizeof(Vertex), indices, lodIndices);
+
 		// create buffers/arrays
 		glGenVertexArrays(1, &VAO);
 		glGenBuffers(1, &VBO);
@@ -109,7 +156,7 @@ private:
 		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, lodIndices.size() * sizeof(unsigned int), &lodIndices[0], GL_STATIC_DRAW);
 
 		// set the vertex attribute pointers
 		// vertex Positions
@@ -0,0 +1,455 @@
+#include "mesh_lod.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+    // Boundary edges get constraint planes this much stronger than surface planes
+    const double BOUNDARY_WEIGHT = 10.0;
+    // A collapse may not turn any remaining triangle's normal by more than ~80 degrees
+    const double MIN_NORMAL_DOT = 0.2;
+
+    struct Point {
+        double x, y, z;
+    };
+
+    Point Sub(const Point& a, const Point& b) { return Point{ a.x - b.x, a.y - b.y, a.z - b.z }; }
+    Point Cross(const Point& a, const Point& b) { return Point{ a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+    double Dot(const Point& a, const Point& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+    // Symmetric 4x4 error quadric stored as its upper triangle
+    struct Quadric {
+        double q[10];
+
+        void AddPlane(const Point& n, double d, double weight) {
+            q[0] += weight * n.x * n.x; q[1] += weight * n.x * n.y; q[2] += weight * n.x * n.z; q[3] += weight * n.x * d;
+            q[4] += weight * n.y * n.y; q[5] += weight * n.y * n.z; q[6] += weight * n.y * d;
+            q[7] += weight * n.z * n.z; q[8] += weight * n.z * d;
+            q[9] += weight * d * d;
+        }
+
+        void Add(const Quadric& other) {
+            for (int i = 0; i < 10; ++i)
+                q[i] += other.q[i];
+        }
+
+        // Sum of squared distances from p to every accumulated plane
+        double Evaluate(const Point& p) const {
+            return q[0] * p.x * p.x + 2.0 * q[1] * p.x * p.y + 2.0 * q[2] * p.x * p.z + 2.0 * q[3] * p.x
+                + q[4] * p.y * p.y + 2.0 * q[5] * p.y * p.z + 2.0 * q[6] * p.y
+                + q[7] * p.z * p.z + 2.0 * q[8] * p.z
+                + q[9];
+        }
+    };
+
+    struct Collapse {
+        double cost;
+        uint32_t from;
+        uint32_t to;
+        uint32_t fromVersion;
+        uint32_t toVersion;
+
+        bool operator<(const Collapse& other) const { return cost > other.cost; }   // min-heap
+    };
+
+    struct PositionKey {
+        uint32_t bits[3];
+        bool operator==(const PositionKey& other) const { return memcmp(bits, other.bits, sizeof(bits)) == 0; }
+    };
+
+    struct PositionKeyHash {
+        size_t operator()(const PositionKey& key) const {
+            return (key.bits[0] * 73856093u) ^ (key.bits[1] * 19349663u) ^ (key.bits[2] * 83492791u);
+        }
+    };
+
+    // Progressive half-edge collapse simplifier. Works on welded position groups and
+    // rewrites triangle corners to the surviving group's representative vertex.
+    class Simplifier {
+    public:
+        Simplifier(const float* positions, size_t vertexCount, size_t strideBytes, const std::vector<unsigned int>& indices);
+
+        size_t LiveTriangles() const { return mLiveTris; }
+
+        void SimplifyTo(size_t targetTriangles);
+        double MeasureError();
+        void Emit(std::vector<unsigned int>& out) const;
+
+    private:
+        uint32_t Group(size_t corner) const { return mWeld[mCorners[corner]]; }
+        Point TriangleNormal(uint32_t t, uint32_t moved, const Point& movedTo) const;
+        double Cost(uint32_t from, uint32_t to) const;
+        void PushEdge(uint32_t a, uint32_t b);
+        bool CanCollapse(uint32_t from, uint32_t to) const;
+        void DoCollapse(uint32_t from, uint32_t to);
+        void Neighbors(uint32_t group, std::vector<uint32_t>& out) const;
+        uint32_t Survivor(uint32_t group);
+
+        std::vector<uint32_t> mWeld;      // vertex -> position group
+        std::vector<uint32_t> mRep;       // group -> representative vertex
+        std::vector<Point> mPos;          // group positions
+        std::vector<Quadric> mQuadric;
+        std::vector<uint32_t> mVersion;
+        std::vector<uint8_t> mGroupAlive;
+        std::vector<uint32_t> mCollapsedInto;     // group -> the group it collapsed onto, itself while alive
+        std::vector<std::vector<uint32_t> > mGroupTris;
+
+        std::vector<unsigned int> mCorners;
+        std::vector<uint8_t> mTriAlive;
+        size_t mLiveTris;
+
+        std::priority_queue<Collapse> mHeap;
+    };
+
+    Simplifier::Simplifier(const float* positions, size_t vertexCount, size_t strideBytes, const std::vector<unsigned int>& indices)
+        : mLiveTris(0) {
+        // Weld vertices that share a position
+        std::unordered_map<PositionKey, uint32_t, PositionKeyHash> groups;
+        mWeld.resize(vertexCount);
+        const unsigned char* base = reinterpret_cast<const unsigned char*>(positions);
+        for (size_t v = 0; v < vertexCount; ++v) {
+            const float* p = reinterpret_cast<const float*>(base + v * strideBytes);
+            PositionKey key;
+            memcpy(key.bits, p, sizeof(key.bits));
+
+            std::unordered_map<PositionKey, uint32_t, PositionKeyHash>::iterator it = groups.find(key);
+            if (it == groups.end()) {
+                uint32_t group = static_cast<uint32_t>(mPos.size());
+                groups[key] = group;
+                mPos.push_back(Point{ p[0], p[1], p[2] });
+                mRep.push_back(static_cast<uint32_t>(v));
+                mWeld[v] = group;
+            }
+            else {
+                mWeld[v] = it->second;
+            }
+        }
+
+        size_t groupCount = mPos.size();
+        Quadric zero;
+        memset(&zero, 0, sizeof(zero));
+        mQuadric.assign(groupCount, zero);
+        mVersion.assign(groupCount, 0);
+        mGroupAlive.assign(groupCount, 1);
+        mCollapsedInto.resize(groupCount);
+        for (uint32_t g = 0; g < groupCount; ++g)
+            mCollapsedInto[g] = g;
+        mGroupTris.resize(groupCount);
+
+        // Keep non-degenerate triangles and accumulate their planes
+        std::unordered_map<uint64_t, uint32_t> edgeUse;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            uint32_t g[3] = { mWeld[indices[i]], mWeld[indices[i + 1]], mWeld[indices[i + 2]] };
+            if (g[0] == g[1] || g[1] == g[2] || g[0] == g[2])
+                continue;
+
+            Point n = Cross(Sub(mPos[g[1]], mPos[g[0]]), Sub(mPos[g[2]], mPos[g[0]]));
+            double len = std::sqrt(Dot(n, n));
+            if (len <= 0.0)
+                continue;
+            n = Point{ n.x / len, n.y / len, n.z / len };
+
+            uint32_t t = static_cast<uint32_t>(mTriAlive.size());
+            mCorners.push_back(indices[i]);
+            mCorners.push_back(indices[i + 1]);
+            mCorners.push_back(indices[i + 2]);
+            mTriAlive.push_back(1);
+            ++mLiveTris;
+
+            double d = -Dot(n, mPos[g[0]]);
+            for (int k = 0; k < 3; ++k) {
+                mQuadric[g[k]].AddPlane(n, d, 1.0);
+                mGroupTris[g[k]].push_back(t);
+
+                uint32_t a = std::min(g[k], g[(k + 1) % 3]);
+                uint32_t b = std::max(g[k], g[(k + 1) % 3]);
+                ++edgeUse[(static_cast<uint64_t>(a) << 32) | b];
+            }
+        }
+
+        // Pin open borders with planes perpendicular to their triangle
+        for (uint32_t t = 0; t < mTriAlive.size(); ++t) {
+            uint32_t g[3] = { Group(t * 3), Group(t * 3 + 1), Group(t * 3 + 2) };
+            Point n = TriangleNormal(t, ~0u, Point{ 0.0, 0.0, 0.0 });
+            for (int k = 0; k < 3; ++k) {
+                uint32_t a = g[k];
+                uint32_t b = g[(k + 1) % 3];
+                uint64_t key = (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+                if (edgeUse[key] != 1)
+                    continue;
+
+                Point edge = Sub(mPos[b], mPos[a]);
+                Point side = Cross(edge, n);
+                double len = std::sqrt(Dot(side, side));
+                if (len <= 0.0)
+                    continue;
+                side = Point{ side.x / len, side.y / len, side.z / len };
+                double d = -Dot(side, mPos[a]);
+                mQuadric[a].AddPlane(side, d, BOUNDARY_WEIGHT);
+                mQuadric[b].AddPlane(side, d, BOUNDARY_WEIGHT);
+            }
+        }
+
+        for (uint32_t t = 0; t < mTriAlive.size(); ++t) {
+            for (int k = 0; k < 3; ++k)
+                PushEdge(Group(t * 3 + k), Group(t * 3 + (k + 1) % 3));
+        }
+    }
+
+    Point Simplifier::TriangleNormal(uint32_t t, uint32_t moved, const Point& movedTo) const {
+        Point p[3];
+        for (int k = 0; k < 3; ++k) {
+            uint32_t g = Group(t * 3 + k);
+            p[k] = g == moved ? movedTo : mPos[g];
+        }
+        Point n = Cross(Sub(p[1], p[0]), Sub(p[2], p[0]));
+        double len = std::sqrt(Dot(n, n));
+        return len > 0.0 ? Point{ n.x / len, n.y / len, n.z / len } : Point{ 0.0, 0.0, 0.0 };
+    }
+
+    double Simplifier::Cost(uint32_t from, uint32_t to) const {
+        Quadric q = mQuadric[from];
+        q.Add(mQuadric[to]);
+        return std::max(0.0, q.Evaluate(mPos[to]));
+    }
+
+    void Simplifier::PushEdge(uint32_t a, uint32_t b) {
+        double costAB = Cost(a, b);
+        double costBA = Cost(b, a);
+        Collapse collapse;
+        if (costAB <= costBA)
+            collapse = Collapse{ costAB, a, b, mVersion[a], mVersion[b] };
+        else
+            collapse = Collapse{ costBA, b, a, mVersion[b], mVersion[a] };
+        mHeap.push(collapse);
+    }
+
+    void Simplifier::Neighbors(uint32_t group, std::vector<uint32_t>& out) const {
+        out.clear();
+        for (uint32_t t : mGroupTris[group]) {
+            if (!mTriAlive[t])
+                continue;
+            for (int k = 0; k < 3; ++k) {
+                uint32_t g = Group(t * 3 + k);
+                if (g != group)
+                    out.push_back(g);
+            }
+        }
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+
+    bool Simplifier::CanCollapse(uint32_t from, uint32_t to) const {
+        // Link condition: the two vertices may only share the neighbours of their shared
+        // triangles, otherwise the collapse pinches the surface into a non-manifold edge
+        std::vector<uint32_t> fromNeighbors, toNeighbors, common;
+        Neighbors(from, fromNeighbors);
+        Neighbors(to, toNeighbors);
+        std::set_intersection(fromNeighbors.begin(), fromNeighbors.end(), toNeighbors.begin(), toNeighbors.end(),
+            std::back_inserter(common));
+
+        size_t sharedTris = 0;
+        for (uint32_t t : mGroupTris[from]) {
+            if (!mTriAlive[t])
+                continue;
+
+            bool hasTo = Group(t * 3) == to || Group(t * 3 + 1) == to || Group(t * 3 + 2) == to;
+            if (hasTo) {
+                ++sharedTris;
+                continue;
+            }
+
+            // Reject collapses that fold a surviving triangle over
+            Point before = TriangleNormal(t, ~0u, Point{ 0.0, 0.0, 0.0 });
+            Point after = TriangleNormal(t, from, mPos[to]);
+            if (Dot(after, after) == 0.0 || Dot(before, after) < MIN_NORMAL_DOT)
+                return false;
+        }
+        return common.size() <= sharedTris;
+    }
+
+    void Simplifier::DoCollapse(uint32_t from, uint32_t to) {
+        // Triangles along the collapsed edge pair each vertex of 'from' with the vertex of
+        // 'to' on the same side of any UV seam; the moved corners take that vertex
+        std::vector<std::pair<unsigned int, unsigned int> > moveTo;
+        for (uint32_t t : mGroupTris[from]) {
+            if (!mTriAlive[t])
+                continue;
+
+            int fromCorner = -1, toCorner = -1;
+            for (int k = 0; k < 3; ++k) {
+                uint32_t g = Group(t * 3 + k);
+                if (g == from)
+                    fromCorner = k;
+                else if (g == to)
+                    toCorner = k;
+            }
+            if (toCorner < 0)
+                continue;
+
+            moveTo.push_back(std::make_pair(mCorners[t * 3 + fromCorner], mCorners[t * 3 + toCorner]));
+            mTriAlive[t] = 0;
+            --mLiveTris;
+        }
+
+        for (uint32_t t : mGroupTris[from]) {
+            if (!mTriAlive[t])
+                continue;
+
+            for (int k = 0; k < 3; ++k) {
+                if (Group(t * 3 + k) != from)
+                    continue;
+                unsigned int vertex = mRep[to];
+                for (const std::pair<unsigned int, unsigned int>& move : moveTo) {
+                    if (move.first == mCorners[t * 3 + k]) {
+                        vertex = move.second;
+                        break;
+                    }
+                }
+                mCorners[t * 3 + k] = vertex;
+            }
+            mGroupTris[to].push_back(t);
+        }
+
+        mGroupTris[from].clear();
+        mGroupAlive[from] = 0;
+        mCollapsedInto[from] = to;
+        mQuadric[to].Add(mQuadric[from]);
+        ++mVersion[to];
+
+        std::vector<uint32_t>& tris = mGroupTris[to];
+        tris.erase(std::remove_if(tris.begin(), tris.end(), [this](uint32_t t) { return !mTriAlive[t]; }), tris.end());
+
+        std::vector<uint32_t> neighbors;
+        Neighbors(to, neighbors);
+        for (uint32_t n : neighbors)
+            PushEdge(to, n);
+    }
+
+    void Simplifier::SimplifyTo(size_t targetTriangles) {
+        while (mLiveTris > targetTriangles && !mHeap.empty()) {
+            Collapse c = mHeap.top();
+            mHeap.pop();
+
+            if (!mGroupAlive[c.from] || !mGroupAlive[c.to])
+                continue;
+            if (mVersion[c.from] != c.fromVersion || mVersion[c.to] != c.toVersion)
+                continue;
+            if (!CanCollapse(c.from, c.to))
+                continue;
+
+            DoCollapse(c.from, c.to);
+        }
+    }
+
+    uint32_t Simplifier::Survivor(uint32_t group) {
+        uint32_t survivor = group;
+        while (mCollapsedInto[survivor] != survivor)
+            survivor = mCollapsedInto[survivor];
+        while (mCollapsedInto[group] != survivor) {
+            uint32_t next = mCollapsedInto[group];
+            mCollapsedInto[group] = survivor;
+            group = next;
+        }
+        return survivor;
+    }
+
+    // Largest distance from an original vertex to the simplified surface, in model units.
+    // Each collapsed vertex is measured against the nearest triangle plane around the
+    // vertex it ended up in, so detail sliding along a flat surface costs nothing.
+    double Simplifier::MeasureError() {
+        double maxDistance = 0.0;
+        for (uint32_t g = 0; g < mPos.size(); ++g) {
+            uint32_t survivor = Survivor(g);
+            if (survivor == g)
+                continue;
+
+            double nearest = -1.0;
+            for (uint32_t t : mGroupTris[survivor]) {
+                if (!mTriAlive[t])
+                    continue;
+                Point n = TriangleNormal(t, ~0u, Point{ 0.0, 0.0, 0.0 });
+                double distance = std::fabs(Dot(n, Sub(mPos[g], mPos[survivor])));
+                if (nearest < 0.0 || distance < nearest)
+                    nearest = distance;
+            }
+            maxDistance = std::max(maxDistance, nearest);
+        }
+        return maxDistance;
+    }
+
+    void Simplifier::Emit(std::vector<unsigned int>& out) const {
+        for (size_t t = 0; t < mTriAlive.size(); ++t) {
+            if (!mTriAlive[t])
+                continue;
+            out.push_back(mCorners[t * 3]);
+            out.push_back(mCorners[t * 3 + 1]);
+            out.push_back(mCorners[t * 3 + 2]);
+        }
+    }
+}
+
+std::vector<LodLevel> UBuildLodChain(const float* positions, size_t vertexCount, size_t strideBytes,
+    const std::vector<unsigned int>& indices, std::vector<unsigned int>& combinedIndices, const LodSettings& settings) {
+    std::vector<LodLevel> levels;
+
+    combinedIndices.assign(indices.begin(), indices.end());
+    LodLevel base = { 0, indices.size(), 0.0f };
+    levels.push_back(base);
+    if (vertexCount == 0 || indices.size() < 3)
+        return levels;
+
+    Simplifier simplifier(positions, vertexCount, strideBytes, indices);
+    size_t previous = simplifier.LiveTriangles();
+
+    while (levels.size() < settings.maxLevels) {
+        size_t target = static_cast<size_t>(previous * settings.reductionPerLevel);
+        if (target < settings.minTriangles)
+            break;
+
+        simplifier.SimplifyTo(target);
+        size_t live = simplifier.LiveTriangles();
+
+        // Stop once the mesh resists further collapses
+        if (live * 10 > previous * 9)
+            break;
+
+        LodLevel level;
+        level.indexOffset = combinedIndices.size();
+        level.indexCount = live * 3;
+        level.geometricError = std::max(levels.back().geometricError, static_cast<float>(simplifier.MeasureError()));
+        simplifier.Emit(combinedIndices);
+        levels.push_back(level);
+        previous = live;
+    }
+
+    return levels;
+}
+
+float ULodProjectionScale(float fovyRadians, float viewportHeight) {
+    return viewportHeight / (2.0f * std::tan(fovyRadians * 0.5f));
+}
+
+unsigned int USelectLod(const std::vector<LodLevel>& levels, float modelScale, float distance, float projectionScale,
+    LodState& state, float thresholdPixels, float hysteresis) {
+    if (levels.size() <= 1 || distance <= 0.0f) {
+        state.level = 0;
+        return 0;
+    }
+
+    unsigned int level = std::min<unsigned int>(state.level, static_cast<unsigned int>(levels.size() - 1));
+    float pixelsPerUnit = modelScale * projectionScale / distance;
+
+    while (level + 1 < levels.size() && levels[level + 1].geometricError * pixelsPerUnit <= thresholdPixels * (1.0f - hysteresis))
+        ++level;
+    while (level > 0 && levels[level].geometricError * pixelsPerUnit > thresholdPixels)
+        --level;
+
+    state.level = level;
+    return level;
+}
@@ -0,0 +1,45 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <cstddef>
+#include <vector>
+
+// One level of detail: a range of a combined index buffer plus the largest distance
+// (in model units) from an original vertex to the simplified surface
+struct LodLevel {
+    size_t indexOffset;
+    size_t indexCount;
+    float geometricError;
+};
+
+// Per-object selection state, so hysteresis is tracked for each instance
+struct LodState {
+    unsigned int level = 0;
+};
+
+struct LodSettings {
+    float reductionPerLevel = 0.5f;   // each level keeps about this fraction of the previous one
+    size_t maxLevels = 6;
+    size_t minTriangles = 32;
+};
+
+// Builds a chain of simplified index lists over the same vertices using quadric error
+// metrics (edge collapses onto existing vertices, so no new vertices are created).
+// Level 0 is the original index list. All levels are appended to combinedIndices.
+// Vertices with identical positions are welded while simplifying so UV seams do not crack.
+std::vector<LodLevel> UBuildLodChain(const float* positions, size_t vertexCount, size_t strideBytes,
+    const std::vector<unsigned int>& indices, std::vector<unsigned int>& combinedIndices,
+    const LodSettings& settings = LodSettings());
+
+// Pixels per world unit at distance 1 for a perspective projection
+float ULodProjectionScale(float fovyRadians, float viewportHeight);
+
+// Picks the coarsest level whose projected error stays under thresholdPixels.
+// modelScale converts the levels' errors to world units (the largest axis scale of the
+// instance's model matrix); distance is in world units too.
+// Coarsening requires the error to drop a further 'hysteresis' fraction below the
+// threshold, which stops objects near a boundary from popping back and forth.
+unsigned int USelectLod(const std::vector<LodLevel>& levels, float modelScale, float distance, float projectionScale,
+    LodState& state, float thresholdPixels = 1.0f, float hysteresis = 0.25f);
+
+#endif
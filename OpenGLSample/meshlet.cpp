@@ -0,0 +1,197 @@
+#include "meshlet.h"
+#include "culling.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    glm::vec3 PositionOf(const unsigned char* base, size_t strideBytes, unsigned int vertex) {
+        const float* p = reinterpret_cast<const float*>(base + vertex * strideBytes);
+        return glm::vec3(p[0], p[1], p[2]);
+    }
+
+    // Bounding sphere and normal cone for the triangles [first, first + count)
+    void ComputeMeshletBounds(const unsigned char* base, size_t strideBytes,
+        const std::vector<unsigned int>& indices, Meshlet& meshlet) {
+        size_t first = meshlet.indexOffset;
+        size_t count = meshlet.triangleCount * 3;
+
+        glm::vec3 lo = PositionOf(base, strideBytes, indices[first]);
+        glm::vec3 hi = lo;
+        for (size_t i = first; i < first + count; ++i) {
+            glm::vec3 p = PositionOf(base, strideBytes, indices[i]);
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+        }
+
+        meshlet.center = (lo + hi) * 0.5f;
+        meshlet.radius = 0.0f;
+        for (size_t i = first; i < first + count; ++i)
+            meshlet.radius = std::max(meshlet.radius, glm::distance(meshlet.center, PositionOf(base, strideBytes, indices[i])));
+
+        // Area-weighted average normal, then the widest deviation from it
+        std::vector<glm::vec3> normals;
+        glm::vec3 axis(0.0f);
+        for (size_t i = first; i < first + count; i += 3) {
+            glm::vec3 a = PositionOf(base, strideBytes, indices[i]);
+            glm::vec3 b = PositionOf(base, strideBytes, indices[i + 1]);
+            glm::vec3 c = PositionOf(base, strideBytes, indices[i + 2]);
+            glm::vec3 n = glm::cross(b - a, c - a);
+            axis += n;
+            float len = glm::length(n);
+            if (len > 0.0f)
+                normals.push_back(n / len);
+        }
+
+        float axisLength = glm::length(axis);
+        if (axisLength <= 0.0f || normals.empty()) {
+            meshlet.coneAxis = glm::vec3(0.0f, 1.0f, 0.0f);
+            meshlet.coneCutoff = 1.0f;
+            return;
+        }
+        meshlet.coneAxis = axis / axisLength;
+
+        float minDot = 1.0f;
+        for (const glm::vec3& n : normals)
+            minDot = std::min(minDot, glm::dot(n, meshlet.coneAxis));
+
+        // Normals spread by acos(minDot); the cluster is back-facing when the view direction
+        // is within 90 degrees minus that spread of the axis, i.e. cos > sin(spread)
+        meshlet.coneCutoff = minDot <= 0.0f ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+    }
+}
+
+void UBuildMeshlets(const float* positions, size_t vertexCount, size_t strideBytes,
+    const std::vector<unsigned int>& indices, std::vector<Meshlet>& meshlets,
+    std::vector<unsigned int>& reorderedIndices) {
+    meshlets.clear();
+    reorderedIndices.clear();
+    reorderedIndices.reserve(indices.size());
+
+    size_t triangleCount = indices.size() / 3;
+    const unsigned char* base = reinterpret_cast<const unsigned char*>(positions);
+
+    // Vertex -> triangle adjacency in compressed rows
+    std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+        ++adjacencyStart[indices[i] + 1];
+    for (size_t v = 0; v < vertexCount; ++v)
+        adjacencyStart[v + 1] += adjacencyStart[v];
+    std::vector<uint32_t> adjacency(adjacencyStart.back());
+    std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        for (int k = 0; k < 3; ++k)
+            adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+    }
+
+    std::vector<uint8_t> used(triangleCount, 0);
+    std::vector<uint32_t> vertexStamp(vertexCount, ~0u);   // meshlet id that last claimed the vertex
+    std::vector<unsigned int> meshletVertices;
+    size_t nextSeed = 0;
+
+    while (true) {
+        while (nextSeed < triangleCount && used[nextSeed])
+            ++nextSeed;
+        if (nextSeed == triangleCount)
+            break;
+
+        uint32_t id = static_cast<uint32_t>(meshlets.size());
+        Meshlet meshlet = Meshlet();
+        meshlet.indexOffset = static_cast<uint32_t>(reorderedIndices.size());
+        meshletVertices.clear();
+
+        size_t candidate = nextSeed;
+        for (;;) {
+            // Claim the triangle and its vertices
+            used[candidate] = 1;
+            for (int k = 0; k < 3; ++k) {
+                unsigned int v = indices[candidate * 3 + k];
+                reorderedIndices.push_back(v);
+                if (vertexStamp[v] != id) {
+                    vertexStamp[v] = id;
+                    meshletVertices.push_back(v);
+                }
+            }
+            ++meshlet.triangleCount;
+            if (meshlet.triangleCount == MESHLET_MAX_TRIANGLES)
+                break;
+
+            // Next: the unused neighbour that adds the fewest new vertices
+            size_t best = triangleCount;
+            int bestNew = 4;
+            for (size_t m = 0; m < meshletVertices.size() && bestNew > 0; ++m) {
+                unsigned int v = meshletVertices[m];
+                for (uint32_t a = adjacencyStart[v]; a < adjacencyStart[v + 1]; ++a) {
+                    uint32_t t = adjacency[a];
+                    if (used[t])
+                        continue;
+                    int fresh = 0;
+                    for (int k = 0; k < 3; ++k)
+                        fresh += vertexStamp[indices[t * 3 + k]] != id ? 1 : 0;
+                    if (fresh < bestNew) {
+                        bestNew = fresh;
+                        best = t;
+                    }
+                }
+            }
+
+            if (best == triangleCount || meshletVertices.size() + bestNew > MESHLET_MAX_VERTICES)
+                break;
+            candidate = best;
+        }
+
+        meshlet.vertexCount = static_cast<uint32_t>(meshletVertices.size());
+        ComputeMeshletBounds(base, strideBytes, reorderedIndices, meshlet);
+        meshlets.push_back(meshlet);
+    }
+}
+
+void UCullMeshlets(const std::vector<Meshlet>& meshlets, const glm::mat4& viewProjection,
+    const glm::mat4& model, const glm::vec3& cameraPosition, MeshletDrawList& drawList, size_t indexBytes) {
+    drawList.counts.clear();
+    drawList.offsets.clear();
+    drawList.meshletsVisible = 0;
+    drawList.trianglesVisible = 0;
+
+    // Bring the frustum and the camera into model space instead of moving every meshlet
+    Frustum frustum = Frustum::FromMatrix(viewProjection * model);
+    glm::vec3 eye = glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.0f));
+
+    size_t runStart = 0, runEnd = 0;   // index range of the current merged run
+    bool inRun = false;
+
+    for (const Meshlet& meshlet : meshlets) {
+        bool visible = frustum.IntersectsSphere(meshlet.center, meshlet.radius);
+        if (visible) {
+            glm::vec3 toCenter = meshlet.center - eye;
+            visible = glm::dot(toCenter, meshlet.coneAxis) < meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+        }
+
+        size_t begin = meshlet.indexOffset;
+        size_t end = begin + meshlet.triangleCount * 3;
+        if (visible) {
+            ++drawList.meshletsVisible;
+            drawList.trianglesVisible += meshlet.triangleCount;
+            if (inRun && runEnd == begin) {
+                runEnd = end;
+                continue;
+            }
+        }
+
+        if (inRun) {
+            drawList.counts.push_back(static_cast<int>(runEnd - runStart));
+            drawList.offsets.push_back(reinterpret_cast<const void*>(runStart * indexBytes));
+            inRun = false;
+        }
+        if (visible) {
+            runStart = begin;
+            runEnd = end;
+            inRun = true;
+        }
+    }
+
+    if (inRun) {
+        drawList.counts.push_back(static_cast<int>(runEnd - runStart));
+        drawList.offsets.push_back(reinterpret_cast<const void*>(runStart * indexBytes));
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Cluster limits, matching common mesh shader hardware sizes
+const size_t MESHLET_MAX_VERTICES = 64;
+const size_t MESHLET_MAX_TRIANGLES = 124;
+
+// A cluster of neighbouring triangles occupying a contiguous run of the index buffer
+struct Meshlet {
+    uint32_t indexOffset;
+    uint32_t triangleCount;
+    uint32_t vertexCount;
+    glm::vec3 center;      // bounding sphere, model space
+    float radius;
+    glm::vec3 coneAxis;    // average facing direction of the triangles
+    float coneCutoff;      // sin of the normal spread; 1 means the cone never culls
+};
+
+// Surviving clusters as ranges ready for glMultiDrawElements; neighbouring visible
+// meshlets are merged into one range
+struct MeshletDrawList {
+    std::vector<int> counts;
+    std::vector<const void*> offsets;
+    size_t meshletsVisible = 0;
+    size_t trianglesVisible = 0;
+};
+
+// Splits an indexed triangle list into meshlets, growing each cluster through shared
+// vertices so it stays compact. reorderedIndices receives the same triangles grouped
+// by meshlet; draw with it in place of the original index list.
+void UBuildMeshlets(const float* positions, size_t vertexCount, size_t strideBytes,
+    const std::vector<unsigned int>& indices, std::vector<Meshlet>& meshlets,
+    std::vector<unsigned int>& reorderedIndices);
+
+// Culls meshlets against the view frustum and their normal cones. Works in model space,
+// so it assumes the model matrix scales uniformly. indexBytes is the size of one element
+// in the index buffer the offsets point into.
+void UCullMeshlets(const std::vector<Meshlet>& meshlets, const glm::mat4& viewProjection,
+    const glm::mat4& model, const glm::vec3& cameraPosition, MeshletDrawList& drawList,
+    size_t indexBytes = sizeof(unsigned int));
+
+#endif
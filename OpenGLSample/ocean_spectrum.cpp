@@ -0,0 +1,385 @@
+#include "ocean_spectrum.h"
+#include "cpu_profiler.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCEAN_SSE 1
+#include <emmintrin.h>
+#else
+#define OCEAN_SSE 0
+#endif
+
+using namespace std;
+
+const int OceanSpectrum::MIN_RESOLUTION;
+const int OceanSpectrum::MAX_RESOLUTION;
+const int OceanSpectrum::FIELD_COUNT;
+const float OceanSpectrum::GRAVITY = 9.81f;
+
+namespace {
+    const double TWO_PI = 6.283185307179586;
+
+    // Columns per worker task: one cache line of floats per row
+    const size_t COLUMNS_PER_TASK = 16;
+    // Rows per transpose task, and the side of the tiles it copies
+    const size_t TRANSPOSE_BLOCK = 16;
+    // Waves travelling against the wind keep this share of their energy
+    const float AGAINST_WIND = 0.07f;
+
+    double MillisecondsSince(chrono::steady_clock::time_point start) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    // Two radix-2 stages in one pass: (a, b) and (c, d) with w1, then (a, c) with w2
+    // and (b, d) with w3. The SSE version below performs the same operations in the
+    // same order, so both give identical bits.
+    inline void Radix4(float* ar, float* ai, float* br, float* bi, float* cr, float* ci, float* dr, float* di,
+        float w1r, float w1i, float w2r, float w2i, float w3r, float w3i) {
+        float tbr = *br * w1r - *bi * w1i, tbi = *br * w1i + *bi * w1r;
+        float tdr = *dr * w1r - *di * w1i, tdi = *dr * w1i + *di * w1r;
+        float a1r = *ar + tbr, a1i = *ai + tbi, b1r = *ar - tbr, b1i = *ai - tbi;
+        float c1r = *cr + tdr, c1i = *ci + tdi, d1r = *cr - tdr, d1i = *ci - tdi;
+
+        float tcr = c1r * w2r - c1i * w2i, tci = c1r * w2i + c1i * w2r;
+        float ter = d1r * w3r - d1i * w3i, tei = d1r * w3i + d1i * w3r;
+        *ar = a1r + tcr;
+        *ai = a1i + tci;
+        *cr = a1r - tcr;
+        *ci = a1i - tci;
+        *br = b1r + ter;
+        *bi = b1i + tei;
+        *dr = b1r - ter;
+        *di = b1i - tei;
+    }
+
+#if OCEAN_SSE
+    // x * w for four complex values and one twiddle
+    inline void ComplexMultiply(__m128 xr, __m128 xi, __m128 wr, __m128 wi, __m128& outR, __m128& outI) {
+        outR = _mm_sub_ps(_mm_mul_ps(xr, wr), _mm_mul_ps(xi, wi));
+        outI = _mm_add_ps(_mm_mul_ps(xr, wi), _mm_mul_ps(xi, wr));
+    }
+
+    inline void Radix4Lanes(float* ar, float* ai, float* br, float* bi, float* cr, float* ci, float* dr, float* di,
+        __m128 w1r, __m128 w1i, __m128 w2r, __m128 w2i, __m128 w3r, __m128 w3i) {
+        __m128 tbr, tbi, tdr, tdi;
+        ComplexMultiply(_mm_loadu_ps(br), _mm_loadu_ps(bi), w1r, w1i, tbr, tbi);
+        ComplexMultiply(_mm_loadu_ps(dr), _mm_loadu_ps(di), w1r, w1i, tdr, tdi);
+        __m128 xar = _mm_loadu_ps(ar), xai = _mm_loadu_ps(ai), xcr = _mm_loadu_ps(cr), xci = _mm_loadu_ps(ci);
+        __m128 a1r = _mm_add_ps(xar, tbr), a1i = _mm_add_ps(xai, tbi), b1r = _mm_sub_ps(xar, tbr), b1i = _mm_sub_ps(xai, tbi);
+        __m128 c1r = _mm_add_ps(xcr, tdr), c1i = _mm_add_ps(xci, tdi), d1r = _mm_sub_ps(xcr, tdr), d1i = _mm_sub_ps(xci, tdi);
+
+        __m128 tcr, tci, ter, tei;
+        ComplexMultiply(c1r, c1i, w2r, w2i, tcr, tci);
+        ComplexMultiply(d1r, d1i, w3r, w3i, ter, tei);
+        _mm_storeu_ps(ar, _mm_add_ps(a1r, tcr));
+        _mm_storeu_ps(ai, _mm_add_ps(a1i, tci));
+        _mm_storeu_ps(cr, _mm_sub_ps(a1r, tcr));
+        _mm_storeu_ps(ci, _mm_sub_ps(a1i, tci));
+        _mm_storeu_ps(br, _mm_add_ps(b1r, ter));
+        _mm_storeu_ps(bi, _mm_add_ps(b1i, tei));
+        _mm_storeu_ps(dr, _mm_sub_ps(b1r, ter));
+        _mm_storeu_ps(di, _mm_sub_ps(b1i, tei));
+    }
+#endif
+}
+
+bool OceanSpectrum::Create(const Settings& settings) {
+    int log2 = 0;
+    while ((1 << log2) < settings.resolution)
+        ++log2;
+    if (settings.resolution < MIN_RESOLUTION || settings.resolution > MAX_RESOLUTION || (1 << log2) != settings.resolution)
+        return false;
+
+    mSettings = settings;
+    mSize = static_cast<size_t>(settings.resolution);
+    mLog2 = log2;
+    mVersion = 0;
+    mStats = Stats();
+
+    const size_t n = mSize;
+    const size_t bins = n * n;
+    mBitReverse.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t reversed = 0;
+        for (int bit = 0; bit < log2; ++bit)
+            reversed |= ((i >> bit) & 1u) << (log2 - 1 - bit);
+        mBitReverse[i] = reversed;
+    }
+    mTwiddleRe.resize(n / 2);
+    mTwiddleIm.resize(n / 2);
+    for (size_t t = 0; t < n / 2; ++t) {
+        mTwiddleRe[t] = static_cast<float>(cos(TWO_PI * t / n));
+        mTwiddleIm[t] = static_cast<float>(sin(TWO_PI * t / n));
+    }
+
+    for (int field = 0; field < FIELD_COUNT; ++field) {
+        mRe[field].assign(bins, 0.0f);
+        mIm[field].assign(bins, 0.0f);
+        mScratchRe[field].assign(bins, 0.0f);
+        mScratchIm[field].assign(bins, 0.0f);
+    }
+
+    // Phillips spectrum; the longest waves the wind sustains are windSpeed^2 / g long
+    glm::vec2 wind = glm::normalize(settings.windDirection);
+    float largest = settings.windSpeed * settings.windSpeed / GRAVITY;
+    float smallest = largest * 0.001f;
+    uint32_t seed = settings.seed;
+    auto random01 = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (static_cast<double>(seed >> 8) + 1.0) / 16777216.0;    // (0, 1], safe for log
+    };
+
+    mH0.resize(bins);
+    mOmega.resize(bins);
+    mWaveVector.resize(bins);
+    for (size_t row = 0; row < n; ++row) {
+        for (size_t column = 0; column < n; ++column) {
+            // Bins past the middle hold negative frequencies
+            int m = static_cast<int>(column) - (column < n / 2 ? 0 : static_cast<int>(n));
+            int l = static_cast<int>(row) - (row < n / 2 ? 0 : static_cast<int>(n));
+            glm::vec2 k(static_cast<float>(TWO_PI * m / settings.patchSize), static_cast<float>(TWO_PI * l / settings.patchSize));
+            float length = glm::length(k);
+            size_t bin = row * n + column;
+
+            // Box-Muller, drawn for every bin so the sequence does not depend on the spectrum
+            double radius = sqrt(-2.0 * log(random01()));
+            double angle = TWO_PI * random01();
+            glm::vec2 gaussian(static_cast<float>(radius * cos(angle)), static_cast<float>(radius * sin(angle)));
+
+            // k = 0 carries no wave. The Nyquist bins are their own mirror, so only a real
+            // value would keep the fields real there; they are left empty instead.
+            float phillips = 0.0f;
+            if (length > 0.0f && column != n / 2 && row != n / 2) {
+                float alignment = glm::dot(k / length, wind);
+                float kl = length * largest;
+                phillips = settings.amplitude * exp(-1.0f / (kl * kl)) / (length * length * length * length)
+                    * alignment * alignment * exp(-length * length * smallest * smallest);
+                if (alignment < 0.0f)
+                    phillips *= AGAINST_WIND;
+            }
+
+            mH0[bin] = gaussian * sqrt(phillips * 0.5f);
+            mOmega[bin] = sqrt(GRAVITY * length);
+            mWaveVector[bin] = glm::vec3(k.x, k.y, length > 0.0f ? 1.0f / length : 0.0f);
+        }
+    }
+
+    mH0MinusConjugate.resize(bins);
+    for (size_t row = 0; row < n; ++row) {
+        for (size_t column = 0; column < n; ++column) {
+            const glm::vec2& mirror = mH0[((n - row) % n) * n + (n - column) % n];
+            mH0MinusConjugate[row * n + column] = glm::vec2(mirror.x, -mirror.y);
+        }
+    }
+    return true;
+}
+
+void OceanSpectrum::Update(double time, Maps& maps) {
+    PROFILE_ZONE("OceanUpdate");
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    UParallelFor(mSize, TRANSPOSE_BLOCK, [this, time](size_t begin, size_t end) { EvaluateRows(time, begin, end); });
+    double spectrumMs = MillisecondsSince(start);
+
+    chrono::steady_clock::time_point fftStart = chrono::steady_clock::now();
+    InverseFFT2D();
+    double fftMs = MillisecondsSince(fftStart);
+
+    chrono::steady_clock::time_point assembleStart = chrono::steady_clock::now();
+    size_t bins = mSize * mSize;
+    maps.displacement.resize(bins);
+    maps.normals.resize(bins);
+    UParallelFor(mSize, TRANSPOSE_BLOCK, [this, &maps](size_t begin, size_t end) { AssembleRows(maps, begin, end); });
+    maps.version = ++mVersion;
+    maps.resolution = mSettings.resolution;
+    maps.time = time;
+    double assembleMs = MillisecondsSince(assembleStart);
+
+    ++mStats.updates;
+    mStats.spectrumMs += spectrumMs;
+    mStats.fftMs += fftMs;
+    mStats.assembleMs += assembleMs;
+    mStats.maxUpdateMs = max(mStats.maxUpdateMs, MillisecondsSince(start));
+}
+
+void OceanSpectrum::EvaluateRows(double time, size_t begin, size_t end) {
+    const size_t n = mSize;
+    const float choppiness = mSettings.choppiness;
+    for (size_t row = begin; row < end; ++row) {
+        for (size_t bin = row * n; bin < (row + 1) * n; ++bin) {
+            // Phase wrapped in double precision, so long runs keep their accuracy
+            double phase = fmod(static_cast<double>(mOmega[bin]) * time, TWO_PI);
+            float c = static_cast<float>(cos(phase));
+            float s = static_cast<float>(sin(phase));
+
+            // h(k, t) = h0(k) e^(i w t) + conj(h0(-k)) e^(-i w t)
+            const glm::vec2& h0 = mH0[bin];
+            const glm::vec2& h0m = mH0MinusConjugate[bin];
+            float hr = (h0.x * c - h0.y * s) + (h0m.x * c + h0m.y * s);
+            float hi = (h0.x * s + h0.y * c) + (h0m.y * c - h0m.x * s);
+
+            const glm::vec3& k = mWaveVector[bin];
+            float kx = k.x, kz = k.y, inverseLength = k.z;
+
+            // Slopes i k h, choppy displacement -i k / |k| h, and its derivatives
+            float slopeXr = -kx * hi, slopeXi = kx * hr;
+            float slopeZr = -kz * hi, slopeZi = kz * hr;
+            float dx = choppiness * kx * inverseLength, dz = choppiness * kz * inverseLength;
+            float displaceXr = dx * hi, displaceXi = -dx * hr;
+            float displaceZr = dz * hi, displaceZi = -dz * hr;
+            float jxx = dx * kx, jzz = dz * kz, jxz = dx * kz;
+
+            // Two real fields per transform: A + iB
+            mRe[0][bin] = hr - slopeXi;
+            mIm[0][bin] = hi + slopeXr;
+            mRe[1][bin] = slopeZr - displaceXi;
+            mIm[1][bin] = slopeZi + displaceXr;
+            mRe[2][bin] = displaceZr - jxx * hi;
+            mIm[2][bin] = displaceZi + jxx * hr;
+            mRe[3][bin] = jzz * hr - jxz * hi;
+            mIm[3][bin] = jzz * hi + jxz * hr;
+        }
+    }
+}
+
+void OceanSpectrum::InverseFFT2D() {
+    const size_t n = mSize;
+    const size_t columnTasks = n / COLUMNS_PER_TASK;
+    const size_t transposeTasks = n / TRANSPOSE_BLOCK;
+
+    auto columns = [this, n, columnTasks](vector<float>* re, vector<float>* im) {
+        UParallelFor(FIELD_COUNT * columnTasks, 1, [this, re, im, columnTasks](size_t begin, size_t end) {
+            for (size_t task = begin; task < end; ++task) {
+                size_t field = task / columnTasks;
+                size_t first = (task % columnTasks) * COLUMNS_PER_TASK;
+                TransformColumns(re[field].data(), im[field].data(), first, first + COLUMNS_PER_TASK);
+            }
+        });
+    };
+    auto transpose = [this, transposeTasks](vector<float>* fromRe, vector<float>* fromIm, vector<float>* toRe, vector<float>* toIm) {
+        UParallelFor(FIELD_COUNT * transposeTasks, 1, [=](size_t begin, size_t end) {
+            for (size_t task = begin; task < end; ++task) {
+                size_t field = task / transposeTasks;
+                size_t first = (task % transposeTasks) * TRANSPOSE_BLOCK;
+                Transpose(fromRe[field].data(), toRe[field].data(), first, first + TRANSPOSE_BLOCK);
+                Transpose(fromIm[field].data(), toIm[field].data(), first, first + TRANSPOSE_BLOCK);
+            }
+        });
+    };
+
+    // Columns, then rows as the columns of the transpose, then back to row order
+    columns(mRe, mIm);
+    transpose(mRe, mIm, mScratchRe, mScratchIm);
+    columns(mScratchRe, mScratchIm);
+    transpose(mScratchRe, mScratchIm, mRe, mIm);
+}
+
+void OceanSpectrum::TransformColumns(float* re, float* im, size_t begin, size_t end) const {
+    const size_t n = mSize;
+#if OCEAN_SSE
+    const bool simd = mSettings.simd;
+#endif
+
+    // Bit-reversed row order, so the passes below run in place
+    for (size_t row = 0; row < n; ++row) {
+        size_t other = mBitReverse[row];
+        if (other <= row)
+            continue;
+        for (size_t column = begin; column < end; ++column) {
+            swap(re[row * n + column], re[other * n + column]);
+            swap(im[row * n + column], im[other * n + column]);
+        }
+    }
+
+    size_t half = 1;
+    if (mLog2 & 1) {
+        // Radix-2 pass over pairs of rows; its twiddles are all 1
+        for (size_t row = 0; row < n; row += 2) {
+            float* ar = re + row * n;
+            float* ai = im + row * n;
+            float* br = ar + n;
+            float* bi = ai + n;
+            for (size_t column = begin; column < end; ++column) {
+                float tr = br[column], ti = bi[column];
+                br[column] = ar[column] - tr;
+                bi[column] = ai[column] - ti;
+                ar[column] = ar[column] + tr;
+                ai[column] = ai[column] + ti;
+            }
+        }
+        half = 2;
+    }
+
+    for (; half < n; half *= 4) {
+        // Twiddle for span m is table entry j * n / m
+        const size_t step1 = n / (2 * half);
+        const size_t step2 = n / (4 * half);
+        for (size_t base = 0; base < n; base += 4 * half) {
+            for (size_t j = 0; j < half; ++j) {
+                float w1r = mTwiddleRe[j * step1], w1i = mTwiddleIm[j * step1];
+                float w2r = mTwiddleRe[j * step2], w2i = mTwiddleIm[j * step2];
+                float w3r = mTwiddleRe[(j + half) * step2], w3i = mTwiddleIm[(j + half) * step2];
+                size_t a = (base + j) * n, b = a + half * n, c = b + half * n, d = c + half * n;
+
+                size_t column = begin;
+#if OCEAN_SSE
+                if (simd) {
+                    __m128 v1r = _mm_set1_ps(w1r), v1i = _mm_set1_ps(w1i);
+                    __m128 v2r = _mm_set1_ps(w2r), v2i = _mm_set1_ps(w2i);
+                    __m128 v3r = _mm_set1_ps(w3r), v3i = _mm_set1_ps(w3i);
+                    for (; column + 4 <= end; column += 4) {
+                        Radix4Lanes(re + a + column, im + a + column, re + b + column, im + b + column,
+                            re + c + column, im + c + column, re + d + column, im + d + column, v1r, v1i, v2r, v2i, v3r, v3i);
+                    }
+                }
+#endif
+                for (; column < end; ++column) {
+                    Radix4(re + a + column, im + a + column, re + b + column, im + b + column,
+                        re + c + column, im + c + column, re + d + column, im + d + column, w1r, w1i, w2r, w2i, w3r, w3i);
+                }
+            }
+        }
+    }
+}
+
+void OceanSpectrum::Transpose(const float* source, float* destination, size_t begin, size_t end) const {
+    const size_t n = mSize;
+    for (size_t column = 0; column < n; column += TRANSPOSE_BLOCK) {
+        for (size_t row = begin; row < end; ++row) {
+            for (size_t i = column; i < column + TRANSPOSE_BLOCK; ++i)
+                destination[i * n + row] = source[row * n + i];
+        }
+    }
+}
+
+void OceanSpectrum::AssembleRows(Maps& maps, size_t begin, size_t end) const {
+    const size_t n = mSize;
+    for (size_t bin = begin * n; bin < end * n; ++bin) {
+        float height = mRe[0][bin], slopeX = mIm[0][bin];
+        float slopeZ = mRe[1][bin], displaceX = mIm[1][bin];
+        float displaceZ = mRe[2][bin], jxx = mIm[2][bin];
+        float jzz = mRe[3][bin], jxz = mIm[3][bin];
+
+        maps.displacement[bin] = glm::vec4(displaceX, height, displaceZ, 0.0f);
+        glm::vec3 normal = glm::normalize(glm::vec3(-slopeX, 1.0f, -slopeZ));
+        float jacobian = (1.0f + jxx) * (1.0f + jzz) - jxz * jxz;
+        maps.normals[bin] = glm::vec4(normal.x, normal.y, normal.z, jacobian);
+    }
+}
+
+uint64_t OceanSpectrum::Checksum(const Maps& maps) {
+    uint64_t hash = 14695981039346656037ull;
+    const vector<glm::vec4>* arrays[2] = { &maps.displacement, &maps.normals };
+    for (const vector<glm::vec4>* values : arrays) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values->data());
+        for (size_t i = 0; i < values->size() * sizeof(glm::vec4); ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    }
+    return hash;
+}
@@ -0,0 +1,105 @@
+#ifndef OCEAN_SPECTRUM_H
+#define OCEAN_SPECTRUM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Tessendorf-style ocean: a Phillips wave spectrum with random phases, advanced in time
+// by the deep-water dispersion relation and turned back into a surface with an inverse
+// FFT on every update. The result tiles seamlessly every patchSize world units. Each
+// update fills a displacement map (choppy horizontal offset and height) and a normal map
+// whose w holds the Jacobian of the horizontal displacement, below zero where a crest
+// folds over.
+//
+// The eight real fields come from four complex transforms, two fields each: the spectrum
+// of a real field is Hermitian, so the inverse transform of A + iB returns a in the real
+// part and b in the imaginary part. A 2D transform runs radix-4 passes (plus one radix-2
+// pass for odd powers of two) down the columns, four columns at a time with SSE2, then
+// transposes and repeats. Columns, rows and fields are spread over the worker pool. No
+// value depends on how the work is split or on the SIMD path, so for a given seed and
+// build the output is bit-identical from run to run.
+class OceanSpectrum {
+public:
+    static const int MIN_RESOLUTION = 16;
+    static const int MAX_RESOLUTION = 1024;
+    static const float GRAVITY;
+
+    struct Settings {
+        int resolution = 256;                   // grid side, a power of two
+        float patchSize = 8.0f;                 // world units covered by one tile
+        float windSpeed = 4.0f;                 // sets the longest waves, windSpeed^2 / GRAVITY
+        glm::vec2 windDirection = glm::vec2(1.0f, 0.4f);
+        float amplitude = 4e-4f;                // Phillips spectrum constant
+        float choppiness = 1.0f;                // scale of the horizontal displacement
+        uint32_t seed = 1u;
+        bool simd = true;                       // false runs the scalar butterflies, for comparison
+    };
+
+    // One update's output, resolution x resolution texels, bottom row first
+    struct Maps {
+        uint64_t version = 0;                   // increases with every update
+        int resolution = 0;
+        double time = 0.0;
+        std::vector<glm::vec4> displacement;    // x, y, z offset; w unused
+        std::vector<glm::vec4> normals;         // unit normal in xyz, Jacobian in w
+    };
+
+    struct Stats {
+        size_t updates = 0;
+        double spectrumMs = 0.0;                // totals over all updates
+        double fftMs = 0.0;
+        double assembleMs = 0.0;
+        double maxUpdateMs = 0.0;
+    };
+
+    // Draws the random initial spectrum; fails unless the resolution is a power of two in range
+    bool Create(const Settings& settings);
+
+    // Evaluates the surface time seconds in
+    void Update(double time, Maps& maps);
+
+    // FNV-1a over the bits of both maps
+    static uint64_t Checksum(const Maps& maps);
+
+    int Resolution() const { return mSettings.resolution; }
+    const Settings& GetSettings() const { return mSettings; }
+    const Stats& GetStats() const { return mStats; }
+
+private:
+    // Complex fields transformed per update
+    static const int FIELD_COUNT = 4;
+
+    void EvaluateRows(double time, size_t begin, size_t end);
+    void InverseFFT2D();
+    void TransformColumns(float* re, float* im, size_t begin, size_t end) const;
+    void Transpose(const float* source, float* destination, size_t begin, size_t end) const;
+    void AssembleRows(Maps& maps, size_t begin, size_t end) const;
+
+    Settings mSettings;
+    size_t mSize = 0;
+    int mLog2 = 0;
+    uint64_t mVersion = 0;
+
+    // Per bin, constant after Create()
+    std::vector<glm::vec2> mH0;                 // h0(k)
+    std::vector<glm::vec2> mH0MinusConjugate;   // conj(h0(-k))
+    std::vector<float> mOmega;
+    std::vector<glm::vec3> mWaveVector;         // kx, kz, 1 / |k| (0 at k = 0)
+
+    std::vector<uint32_t> mBitReverse;
+    std::vector<float> mTwiddleRe;              // e^(2 pi i t / N) for t < N / 2
+    std::vector<float> mTwiddleIm;
+
+    // Split real and imaginary parts, one pair per field, and a transpose target each
+    std::vector<float> mRe[FIELD_COUNT];
+    std::vector<float> mIm[FIELD_COUNT];
+    std::vector<float> mScratchRe[FIELD_COUNT];
+    std::vector<float> mScratchIm[FIELD_COUNT];
+
+    Stats mStats;
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include "ocean_surface.h"
+#include "gl_trace.h"
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+const GLuint OceanSurface::DISPLACEMENT_UNIT;
+const GLuint OceanSurface::NORMAL_UNIT;
+const size_t OceanSurface::BUFFER_COUNT;
+
+namespace {
+    GLuint CreateTexture(int resolution, GLsizei levels, const void* data) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, levels, GL_RGBA16F, resolution, resolution);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, resolution, resolution, GL_RGBA, GL_FLOAT, data);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        if (levels > 1)
+            glGenerateMipmap(GL_TEXTURE_2D);
+        return texture;
+    }
+}
+
+bool OceanSurface::Create(int resolution, float patchSize) {
+    Destroy();
+    mResolution = resolution;
+    mPatchSize = patchSize;
+
+    // Calm sea until the first maps arrive
+    size_t texels = static_cast<size_t>(resolution) * resolution;
+    vector<glm::vec4> flat(texels, glm::vec4(0.0f));
+    vector<glm::vec4> up(texels, glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
+    GLsizei levels = 1;
+    while ((resolution >> levels) > 0)
+        ++levels;
+    mDisplacement = CreateTexture(resolution, 1, flat.data());
+    mNormals = CreateTexture(resolution, levels, up.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Each buffer holds both maps, displacement first
+    glGenBuffers(BUFFER_COUNT, mBuffers);
+    for (GLuint buffer : mBuffers) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, 2 * texels * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    mNext = 0;
+    mVersion = 0;
+    mStats = Stats();
+    return glGetError() == GL_NO_ERROR;
+}
+
+void OceanSurface::Destroy() {
+    for (GLsync& fence : mFences) {
+        if (fence != 0)
+            glDeleteSync(fence);
+        fence = 0;
+    }
+    if (mBuffers[0] != 0)
+        glDeleteBuffers(BUFFER_COUNT, mBuffers);
+    if (mDisplacement != 0)
+        glDeleteTextures(1, &mDisplacement);
+    if (mNormals != 0)
+        glDeleteTextures(1, &mNormals);
+    mBuffers[0] = mBuffers[1] = mDisplacement = mNormals = 0;
+    mResolution = 0;
+}
+
+void OceanSurface::Upload(const OceanSpectrum::Maps& maps) {
+    if (mDisplacement == 0 || maps.resolution != mResolution || maps.version == mVersion)
+        return;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    GLsync& fence = mFences[mNext];
+    if (fence != 0) {
+        // Poll first; with two buffers the copy out of this one is normally long done
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            ++mStats.fenceWaits;
+            chrono::steady_clock::time_point waitStart = chrono::steady_clock::now();
+            do {
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            } while (status == GL_TIMEOUT_EXPIRED);
+            mStats.fenceWaitMs += chrono::duration<double, milli>(chrono::steady_clock::now() - waitStart).count();
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    size_t bytes = maps.displacement.size() * sizeof(glm::vec4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mBuffers[mNext]);
+    void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, 2 * bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped != nullptr) {
+        memcpy(mapped, maps.displacement.data(), bytes);
+        memcpy(static_cast<char*>(mapped) + bytes, maps.normals.data(), bytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        // With an unpack buffer bound the data pointers are offsets into it
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, mDisplacement);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, mResolution, mResolution, GL_RGBA, GL_FLOAT, reinterpret_cast<const void*>(0));
+        glBindTexture(GL_TEXTURE_2D, mNormals);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, mResolution, mResolution, GL_RGBA, GL_FLOAT, reinterpret_cast<const void*>(bytes));
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        mNext = (mNext + 1) % BUFFER_COUNT;
+        mVersion = maps.version;
+        ++mStats.uploads;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    mStats.uploadMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void OceanSurface::Bind(GLuint programId) const {
+    glActiveTexture(GL_TEXTURE0 + DISPLACEMENT_UNIT);
+    glBindTexture(GL_TEXTURE_2D, mDisplacement);
+    glActiveTexture(GL_TEXTURE0 + NORMAL_UNIT);
+    glBindTexture(GL_TEXTURE_2D, mNormals);
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(glGetUniformLocation(programId, "oceanDisplacement"), DISPLACEMENT_UNIT);
+    glUniform1i(glGetUniformLocation(programId, "oceanNormals"), NORMAL_UNIT);
+    glUniform1f(glGetUniformLocation(programId, "oceanPatchSize"), mPatchSize);
+}
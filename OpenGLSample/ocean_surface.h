@@ -0,0 +1,53 @@
+#ifndef OCEAN_SURFACE_H
+#define OCEAN_SURFACE_H
+
+#include "ocean_spectrum.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+// The ocean's GPU side: a displacement texture read by the vertex shader and a mipmapped
+// normal texture (Jacobian in w) read by the fragment shader, both RGBA16F and repeating
+// so one patch tiles the whole sea. Upload() streams a new pair of maps through two pixel
+// unpack buffers used in turn: the CPU fills one while the GPU may still be copying out
+// of the other, and a buffer is only written again once the fence placed after its copy
+// has signalled. Maps already uploaded (same version) are skipped.
+class OceanSurface {
+public:
+    static const GLuint DISPLACEMENT_UNIT = 7;
+    static const GLuint NORMAL_UNIT = 8;
+    static const size_t BUFFER_COUNT = 2;
+
+    struct Stats {
+        size_t uploads = 0;
+        double uploadMs = 0.0;          // CPU time spent copying into the buffers and issuing the copies
+        size_t fenceWaits = 0;          // uploads whose buffer was still being read
+        double fenceWaitMs = 0.0;
+    };
+
+    bool Create(int resolution, float patchSize);
+    void Destroy();
+    bool Created() const { return mDisplacement != 0; }
+
+    void Upload(const OceanSpectrum::Maps& maps);
+
+    // Binds both textures for an ocean draw and sets the shader's patch size
+    void Bind(GLuint programId) const;
+
+    const Stats& GetStats() const { return mStats; }
+
+private:
+    int mResolution = 0;
+    float mPatchSize = 0.0f;
+    GLuint mDisplacement = 0;
+    GLuint mNormals = 0;
+    GLuint mBuffers[BUFFER_COUNT] = { 0, 0 };
+    GLsync mFences[BUFFER_COUNT] = { 0, 0 };
+    size_t mNext = 0;                   // buffer the next upload writes
+    uint64_t mVersion = 0;              // last uploaded maps
+    Stats mStats;
+};
+
+#endif
@@ -0,0 +1,138 @@
+#include "parallel.h"
+#include "cpu_profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+    struct ParallelJob {
+        const std::function<void(size_t, size_t)>* fn;
+        size_t count;
+        size_t chunk;
+        std::atomic<size_t> next;
+        int activeWorkers;  // guarded by gPoolMutex
+    };
+
+    std::mutex gSubmitMutex;     // one job in flight at a time
+    std::mutex gPoolMutex;
+    std::condition_variable gWake;
+    std::condition_variable gDone;
+    std::vector<std::thread> gWorkers;
+    ParallelJob* gJob = nullptr;
+    uint64_t gJobSerial = 0;
+    bool gQuit = false;
+    bool gStarted = false;
+    thread_local bool tInsideWorker = false;
+
+    void RunChunks(ParallelJob& job) {
+        for (;;) {
+            size_t begin = job.next.fetch_add(job.chunk);
+            if (begin >= job.count)
+                return;
+            (*job.fn)(begin, std::min(begin + job.chunk, job.count));
+        }
+    }
+
+    void WorkerMain() {
+        PROFILE_THREAD("worker");
+        tInsideWorker = true;
+        uint64_t seenSerial = 0;
+        std::unique_lock<std::mutex> lock(gPoolMutex);
+        for (;;) {
+            gWake.wait(lock, [&] { return gQuit || (gJob != nullptr && gJobSerial != seenSerial); });
+            if (gQuit)
+                return;
+
+            seenSerial = gJobSerial;
+            ParallelJob* job = gJob;
+            ++job->activeWorkers;
+            lock.unlock();
+
+            RunChunks(*job);
+
+            lock.lock();
+            if (--job->activeWorkers == 0)
+                gDone.notify_all();
+        }
+    }
+
+    void StartWorkers() {
+        if (gStarted)
+            return;
+        gStarted = true;
+
+        unsigned hw = std::thread::hardware_concurrency();
+        unsigned workers = hw > 1 ? hw - 1 : 0;
+        for (unsigned i = 0; i < workers; ++i)
+            gWorkers.emplace_back(WorkerMain);
+    }
+}
+
+void UParallelFor(size_t count, size_t minChunk, const std::function<void(size_t, size_t)>& fn) {
+    if (count == 0)
+        return;
+    if (minChunk == 0)
+        minChunk = 1;
+
+    if (tInsideWorker || count <= minChunk) {
+        fn(0, count);
+        return;
+    }
+
+    std::lock_guard<std::mutex> submit(gSubmitMutex);
+    StartWorkers();
+    if (gWorkers.empty()) {
+        fn(0, count);
+        return;
+    }
+
+    // A few chunks per thread keeps the load balanced when chunks finish unevenly
+    size_t threads = gWorkers.size() + 1;
+    size_t chunk = std::max(minChunk, (count + threads * 4 - 1) / (threads * 4));
+
+    ParallelJob job;
+    job.fn = &fn;
+    job.count = count;
+    job.chunk = chunk;
+    job.next = 0;
+    job.activeWorkers = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(gPoolMutex);
+        gJob = &job;
+        ++gJobSerial;
+    }
+    gWake.notify_all();
+
+    bool wasInside = tInsideWorker;
+    tInsideWorker = true;
+    RunChunks(job);
+    tInsideWorker = wasInside;
+
+    std::unique_lock<std::mutex> lock(gPoolMutex);
+    gJob = nullptr;
+    gDone.wait(lock, [&] { return job.activeWorkers == 0; });
+}
+
+unsigned UParallelThreadCount() {
+    std::lock_guard<std::mutex> submit(gSubmitMutex);
+    StartWorkers();
+    return static_cast<unsigned>(gWorkers.size()) + 1;
+}
+
+void UShutdownParallel() {
+    std::lock_guard<std::mutex> submit(gSubmitMutex);
+    {
+        std::lock_guard<std::mutex> lock(gPoolMutex);
+        gQuit = true;
+    }
+    gWake.notify_all();
+    for (std::thread& worker : gWorkers)
+        worker.join();
+    gWorkers.clear();
+}
@@ -0,0 +1,19 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+// Splits [0, count) into chunks of at least minChunk items and runs fn(begin, end)
+// on each chunk across a persistent pool of worker threads. The calling thread takes
+// part in the work and the call returns once every chunk has finished.
+// Calls made from inside a worker run inline, so nested loops are safe.
+void UParallelFor(size_t count, size_t minChunk, const std::function<void(size_t, size_t)>& fn);
+
+// Number of threads UParallelFor spreads work over, including the caller
+unsigned UParallelThreadCount();
+
+// Joins the worker threads; call once before exit
+void UShutdownParallel();
+
+#endif
@@ -0,0 +1,129 @@
+#include "pipeline_stats.h"
+
+using namespace std;
+
+const size_t PipelineStatistics::FRAME_LATENCY;
+const size_t PipelineStatistics::MAX_PASSES_PER_FRAME;
+
+namespace {
+    const GLenum COUNTER_TARGETS[] = { GL_VERTEX_SHADER_INVOCATIONS_ARB, GL_FRAGMENT_SHADER_INVOCATIONS_ARB, GL_SAMPLES_PASSED };
+}
+
+bool PipelineStatistics::Create() {
+    Destroy();
+    if (!GLEW_ARB_pipeline_statistics_query)
+        return false;
+
+    for (FrameQueries& frame : mFrames) {
+        glGenQueries(MAX_PASSES_PER_FRAME * COUNTER_COUNT, &frame.queries[0][0]);
+        frame.used = 0;
+        frame.pending = false;
+    }
+    mCurrent = 0;
+    mCreated = true;
+    return glGetError() == GL_NO_ERROR;
+}
+
+void PipelineStatistics::Destroy() {
+    if (!mCreated)
+        return;
+
+    for (FrameQueries& frame : mFrames) {
+        if (frame.pending)
+            Resolve(frame);
+        glDeleteQueries(MAX_PASSES_PER_FRAME * COUNTER_COUNT, &frame.queries[0][0]);
+    }
+    mCreated = false;
+}
+
+void PipelineStatistics::BeginFrame(size_t pixels) {
+    if (!mCreated)
+        return;
+
+    mCurrent = (mCurrent + 1) % (FRAME_LATENCY + 1);
+    FrameQueries& frame = mFrames[mCurrent];
+    if (frame.pending) {
+        // Queries complete in order, so the last one being ready means all of them are
+        GLint available = 0;
+        glGetQueryObjectiv(frame.queries[frame.used - 1][COUNTER_COUNT - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+            Resolve(frame);
+        else
+            ++mFramesDropped;
+    }
+
+    frame.used = 0;
+    frame.pixels = pixels;
+    frame.pending = false;
+}
+
+int PipelineStatistics::BeginPass(const char* name) {
+    if (!mCreated)
+        return -1;
+
+    FrameQueries& frame = mFrames[mCurrent];
+    if (frame.used == static_cast<int>(MAX_PASSES_PER_FRAME))
+        return -1;
+
+    size_t pass = 0;
+    while (pass < mPasses.size() && mPasses[pass].name != name)
+        ++pass;
+    if (pass == mPasses.size()) {
+        PassTotals totals;
+        totals.name = name;
+        mPasses.push_back(totals);
+    }
+
+    int id = frame.used++;
+    frame.passes[id] = pass;
+    for (int counter = 0; counter < COUNTER_COUNT; ++counter)
+        glBeginQuery(COUNTER_TARGETS[counter], frame.queries[id][counter]);
+    return id;
+}
+
+void PipelineStatistics::EndPass(int id) {
+    if (!mCreated || id < 0)
+        return;
+
+    for (int counter = 0; counter < COUNTER_COUNT; ++counter)
+        glEndQuery(COUNTER_TARGETS[counter]);
+    mFrames[mCurrent].pending = true;
+}
+
+void PipelineStatistics::Resolve(FrameQueries& frame) {
+    for (int id = 0; id < frame.used; ++id) {
+        GLuint64 counts[COUNTER_COUNT];
+        for (int counter = 0; counter < COUNTER_COUNT; ++counter)
+            glGetQueryObjectui64v(frame.queries[id][counter], GL_QUERY_RESULT, &counts[counter]);
+
+        PassTotals& totals = mPasses[frame.passes[id]];
+        ++totals.frames;
+        totals.vertices += counts[COUNTER_VERTICES];
+        totals.fragments += counts[COUNTER_FRAGMENTS];
+        totals.samples += counts[COUNTER_SAMPLES];
+        totals.pixels += frame.pixels;
+    }
+
+    ++mFramesResolved;
+    frame.pending = false;
+}
+
+vector<PipelineStatistics::PassStats> PipelineStatistics::GetStats() const {
+    vector<PassStats> stats;
+    for (const PassTotals& totals : mPasses) {
+        PassStats pass;
+        pass.name = totals.name;
+        pass.frames = totals.frames;
+        if (totals.frames > 0) {
+            pass.vertexInvocations = static_cast<double>(totals.vertices) / totals.frames;
+            pass.fragmentInvocations = static_cast<double>(totals.fragments) / totals.frames;
+            pass.samplesPassed = static_cast<double>(totals.samples) / totals.frames;
+        }
+        if (totals.pixels > 0) {
+            pass.fragmentsPerPixel = static_cast<double>(totals.fragments) / totals.pixels;
+            pass.samplesPerPixel = static_cast<double>(totals.samples) / totals.pixels;
+        }
+        stats.push_back(pass);
+    }
+    return stats;
+}
@@ -0,0 +1,94 @@
+#ifndef PIPELINE_STATS_H
+#define PIPELINE_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Vertex and fragment shader invocation counts per render pass, from
+// ARB_pipeline_statistics_query, and the samples that passed the depth test. Drivers
+// that test depth inside the fragment shader count invocations before the test; the
+// samples show how many fragments survived it either way. Like GpuProfiler, queries
+// are pooled per frame and read back FRAME_LATENCY frames later, and a frame whose
+// results are not ready by then is dropped rather than waited for. A query cannot
+// nest inside another of the same kind, so passes must not overlap. Totals cover
+// every frame read back.
+class PipelineStatistics {
+public:
+    static const size_t FRAME_LATENCY = 4;
+    static const size_t MAX_PASSES_PER_FRAME = 8;
+
+    struct PassStats {
+        std::string name;
+        size_t frames = 0;
+        double vertexInvocations = 0.0;     // per frame
+        double fragmentInvocations = 0.0;   // per frame
+        double samplesPassed = 0.0;         // per frame
+        double fragmentsPerPixel = 0.0;     // fragment invocations over the frame's pixels
+        double samplesPerPixel = 0.0;
+    };
+
+    // Counts one pass; does nothing while the statistics are not created
+    class Scope {
+    public:
+        Scope(PipelineStatistics& statistics, const char* name) : mStatistics(statistics), mId(statistics.BeginPass(name)) {}
+        ~Scope() { mStatistics.EndPass(mId); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        PipelineStatistics& mStatistics;
+        int mId;
+    };
+
+    // Fails when the driver lacks ARB_pipeline_statistics_query
+    bool Create();
+    void Destroy();
+    bool Enabled() const { return mCreated; }
+
+    // Collects the oldest frame's counts, if ready, and starts a frame of pixels pixels
+    void BeginFrame(size_t pixels);
+
+    int BeginPass(const char* name);
+    void EndPass(int id);
+
+    std::vector<PassStats> GetStats() const;
+    size_t FramesResolved() const { return mFramesResolved; }
+    size_t FramesDropped() const { return mFramesDropped; }
+
+private:
+    enum Counter { COUNTER_VERTICES, COUNTER_FRAGMENTS, COUNTER_SAMPLES, COUNTER_COUNT };
+
+    struct FrameQueries {
+        GLuint queries[MAX_PASSES_PER_FRAME][COUNTER_COUNT];
+        size_t passes[MAX_PASSES_PER_FRAME];
+        int used = 0;
+        size_t pixels = 0;
+        bool pending = false;
+    };
+
+    struct PassTotals {
+        std::string name;
+        size_t frames = 0;
+        uint64_t vertices = 0;
+        uint64_t fragments = 0;
+        uint64_t samples = 0;
+        uint64_t pixels = 0;
+    };
+
+    void Resolve(FrameQueries& frame);
+
+    FrameQueries mFrames[FRAME_LATENCY + 1];
+    size_t mCurrent = 0;
+    bool mCreated = false;
+
+    std::vector<PassTotals> mPasses;
+    size_t mFramesResolved = 0;
+    size_t mFramesDropped = 0;
+};
+
+#endif
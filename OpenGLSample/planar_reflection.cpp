@@ -0,0 +1,183 @@
+#include "planar_reflection.h"
+#include "gl_trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace std;
+
+const GLuint PlanarReflection::TEXTURE_UNIT;
+
+void ReflectionSchedule::Configure(const Settings& settings) {
+    mSettings = settings;
+    mSettings.interval = max(settings.interval, 1);
+    mTurnCosine = cos(glm::radians(settings.turnDegrees));
+    mHasUpdated = false;
+    mFramesSinceUpdate = 0;
+    mStats = Stats();
+}
+
+bool ReflectionSchedule::ShouldUpdate(const glm::vec3& position, const glm::vec3& front) {
+    ++mStats.frames;
+    ++mFramesSinceUpdate;
+
+    glm::vec3 direction = glm::normalize(front);
+    bool due = !mHasUpdated || mFramesSinceUpdate >= mSettings.interval;
+    bool moved = !due && (glm::length(position - mPosition) > mSettings.moveThreshold || glm::dot(direction, mFront) < mTurnCosine);
+    if (!due && !moved)
+        return false;
+
+    ++mStats.updates;
+    if (moved)
+        ++mStats.motionUpdates;
+    else
+        ++mStats.intervalUpdates;
+    mHasUpdated = true;
+    mFramesSinceUpdate = 0;
+    mPosition = position;
+    mFront = direction;
+    return true;
+}
+
+bool PlanarReflection::Create(float scale) {
+    Destroy();
+    mScale = min(max(scale, 0.05f), 1.0f);
+    glGenQueries(2, mTimers);
+    mTimerPending = false;
+    mStats = Stats();
+    return glGetError() == GL_NO_ERROR;
+}
+
+void PlanarReflection::Destroy() {
+    if (mFramebuffer != 0)
+        glDeleteFramebuffers(1, &mFramebuffer);
+    if (mColor != 0)
+        glDeleteTextures(1, &mColor);
+    if (mDepth != 0)
+        glDeleteRenderbuffers(1, &mDepth);
+    if (mTimers[0] != 0)
+        glDeleteQueries(2, mTimers);
+    mFramebuffer = mColor = mDepth = mTimers[0] = mTimers[1] = 0;
+    mWidth = mHeight = 0;
+    mReady = false;
+}
+
+bool PlanarReflection::Resize(int width, int height) {
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    int targetWidth = max(1, min(static_cast<int>(width * mScale + 0.5f), static_cast<int>(maxSize)));
+    int targetHeight = max(1, min(static_cast<int>(height * mScale + 0.5f), static_cast<int>(maxSize)));
+    if (mFramebuffer != 0 && targetWidth == mWidth && targetHeight == mHeight)
+        return false;
+
+    if (mFramebuffer != 0) {
+        glDeleteFramebuffers(1, &mFramebuffer);
+        glDeleteTextures(1, &mColor);
+        glDeleteRenderbuffers(1, &mDepth);
+    }
+    mWidth = targetWidth;
+    mHeight = targetHeight;
+    mReady = false;
+
+    // Linear filtering smooths over the reduced resolution where the surface samples it
+    glGenTextures(1, &mColor);
+    glBindTexture(GL_TEXTURE_2D, mColor);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, mWidth, mHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &mDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, mDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mWidth, mHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &mFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mColor, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepth);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        cout << "Reflection framebuffer incomplete: 0x" << hex << status << dec << endl;
+    return true;
+}
+
+void PlanarReflection::Begin() {
+    mBeginCpu = chrono::steady_clock::now();
+    CollectTiming();
+    if (!mTimerPending)
+        glQueryCounter(mTimers[0], GL_TIMESTAMP);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+    glViewport(0, 0, mWidth, mHeight);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void PlanarReflection::End(const glm::mat4& viewProjection) {
+    if (!mTimerPending) {
+        glQueryCounter(mTimers[1], GL_TIMESTAMP);
+        mTimerPending = true;
+    }
+    mViewProjection = viewProjection;
+    mReady = true;
+    ++mStats.renders;
+    mStats.cpuMs += chrono::duration<double, milli>(chrono::steady_clock::now() - mBeginCpu).count();
+}
+
+void PlanarReflection::CollectTiming() {
+    if (!mTimerPending)
+        return;
+
+    GLint available = 0;
+    glGetQueryObjectiv(mTimers[1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return;
+
+    GLuint64 begin = 0, end = 0;
+    glGetQueryObjectui64v(mTimers[0], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(mTimers[1], GL_QUERY_RESULT, &end);
+    mStats.gpuMs += (end - begin) / 1e6;
+    ++mStats.timedRenders;
+    mTimerPending = false;
+}
+
+void PlanarReflection::Bind(GLuint programId) const {
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, mColor);
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(glGetUniformLocation(programId, "reflectionTexture"), TEXTURE_UNIT);
+    glUniformMatrix4fv(glGetUniformLocation(programId, "reflectionViewProjection"), 1, GL_FALSE, glm::value_ptr(mViewProjection));
+    glUniform1i(glGetUniformLocation(programId, "hasReflection"), mReady ? GL_TRUE : GL_FALSE);
+}
+
+glm::mat4 PlanarReflection::MirrorView(const glm::mat4& view, const glm::vec4& plane) {
+    // Householder reflection through the plane: p - 2 (n.p + w) n
+    glm::vec3 n(plane);
+    glm::mat4 mirror(1.0f);
+    for (int column = 0; column < 3; ++column) {
+        for (int row = 0; row < 3; ++row)
+            mirror[column][row] -= 2.0f * n[row] * n[column];
+    }
+    for (int row = 0; row < 3; ++row)
+        mirror[3][row] = -2.0f * plane.w * n[row];
+    return view * mirror;
+}
+
+glm::mat4 PlanarReflection::ObliqueProjection(const glm::mat4& projection, const glm::vec4& clipPlane) {
+    // The frustum corner opposite the plane, back in view space
+    glm::vec4 corner = glm::inverse(projection) * glm::vec4(clipPlane.x < 0.0f ? -1.0f : 1.0f, clipPlane.y < 0.0f ? -1.0f : 1.0f, 1.0f, 1.0f);
+    glm::vec4 scaled = clipPlane * (2.0f / glm::dot(clipPlane, corner));
+
+    // Replace the third row, which produces clip-space z
+    glm::mat4 oblique = projection;
+    for (int column = 0; column < 4; ++column)
+        oblique[column][2] = scaled[column] - projection[column][3];
+    return oblique;
+}
@@ -0,0 +1,113 @@
+#ifndef PLANAR_REFLECTION_H
+#define PLANAR_REFLECTION_H
+
+#include <chrono>
+#include <cstddef>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Decides on the main thread which frames re-render the planar reflection: every
+// interval frames, or sooner once the camera has moved or turned past a threshold since
+// the last update. Frames in between reuse the previous reflection.
+class ReflectionSchedule {
+public:
+    struct Settings {
+        int interval = 4;               // frames between updates; 1 updates every frame
+        float moveThreshold = 0.25f;    // world units the camera may move before an early update
+        float turnDegrees = 5.0f;       // and degrees it may turn
+    };
+
+    struct Stats {
+        size_t frames = 0;
+        size_t updates = 0;
+        size_t intervalUpdates = 0;     // updates that the interval came round for
+        size_t motionUpdates = 0;       // updates brought forward by camera motion
+    };
+
+    void Configure(const Settings& settings);
+
+    // Call once per frame with the camera; true when this frame should update the reflection
+    bool ShouldUpdate(const glm::vec3& position, const glm::vec3& front);
+
+    const Settings& GetSettings() const { return mSettings; }
+    const Stats& GetStats() const { return mStats; }
+
+private:
+    Settings mSettings;
+    float mTurnCosine = 1.0f;
+    bool mHasUpdated = false;
+    int mFramesSinceUpdate = 0;
+    glm::vec3 mPosition = glm::vec3(0.0f);
+    glm::vec3 mFront = glm::vec3(0.0f, 0.0f, -1.0f);
+    Stats mStats;
+};
+
+// Reflection of the scene in a mirror plane, drawn from the mirrored camera
+// into a colour and depth target a fraction of the scene's size. The mirrored projection
+// moves its near plane onto the mirror, so nothing below the surface leaks into the
+// reflection. Surfaces project their world position with the view-projection of the
+// last update to sample it, which keeps a reflection that is a few frames old anchored
+// to the scene. GPU cost is measured with timestamp queries read back on a later
+// update, never waited for.
+class PlanarReflection {
+public:
+    static const GLuint TEXTURE_UNIT = 9;
+
+    struct Stats {
+        size_t renders = 0;
+        size_t timedRenders = 0;        // renders covered by gpuMs
+        double gpuMs = 0.0;
+        double cpuMs = 0.0;             // time spent issuing the reflection pass
+    };
+
+    // scale is the target's size relative to the scene
+    bool Create(float scale);
+    void Destroy();
+
+    // Sizes the target for a scene of width x height, within the largest texture GL
+    // supports; true when it was recreated and holds no reflection until the next
+    // Begin() and End()
+    bool Resize(int width, int height);
+
+    // Binds and clears the target for drawing with the mirrored camera
+    void Begin();
+    // Finishes the pass drawn with viewProjection; the caller restores its framebuffer
+    // and viewport
+    void End(const glm::mat4& viewProjection);
+
+    // Whether a reflection has been drawn since the target was last created
+    bool Ready() const { return mReady; }
+
+    // Binds the reflection for a mirror surface and tells the shader to use it
+    void Bind(GLuint programId) const;
+
+    int Width() const { return mWidth; }
+    int Height() const { return mHeight; }
+    const Stats& GetStats() const { return mStats; }
+
+    // The view for a camera mirrored in plane (unit normal in xyz, n.p + w = 0 on the plane)
+    static glm::mat4 MirrorView(const glm::mat4& view, const glm::vec4& plane);
+
+    // projection with its near plane replaced by clipPlane, given in view space with the
+    // kept side positive (Lengyel's oblique frustum); far clipping is only approximate
+    static glm::mat4 ObliqueProjection(const glm::mat4& projection, const glm::vec4& clipPlane);
+
+private:
+    void CollectTiming();
+
+    float mScale = 0.5f;
+    int mWidth = 0;
+    int mHeight = 0;
+    GLuint mFramebuffer = 0;
+    GLuint mColor = 0;
+    GLuint mDepth = 0;
+    bool mReady = false;
+    glm::mat4 mViewProjection = glm::mat4(1.0f);
+    GLuint mTimers[2] = { 0, 0 };               // timestamps around a reflection pass
+    bool mTimerPending = false;
+    std::chrono::steady_clock::time_point mBeginCpu;
+    Stats mStats;
+};
+
+#endif
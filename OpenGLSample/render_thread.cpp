@@ -0,0 +1,142 @@
+#include "render_thread.h"
+
+#include <algorithm>
+
+const uint32_t FramePacket::ALL_MESHLETS;
+const size_t RenderThread::PACKET_COUNT;
+
+namespace {
+    double MillisecondsBetween(FramePacket::Clock::time_point from, FramePacket::Clock::time_point to) {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+
+    // Spin briefly, then sleep, so a thread waiting on the other does not burn a core
+    // for a whole vsync interval
+    void WaitBriefly(unsigned& spins) {
+        if (++spins < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+RenderThread::~RenderThread() {
+    Stop();
+}
+
+void RenderThread::Start(bool threaded, const std::function<void()>& attach,
+    const std::function<void(const FramePacket&)>& render, const std::function<void()>& detach) {
+    mThreaded = threaded;
+    mAttach = attach;
+    mRender = render;
+    mDetach = detach;
+    mStopping = false;
+    mRunning = true;
+
+    for (size_t i = 0; i < PACKET_COUNT; ++i)
+        mFree.TryPush(&mPackets[i]);
+
+    if (mThreaded)
+        mThread = std::thread(&RenderThread::ThreadMain, this);
+    else
+        mAttach();
+}
+
+FramePacket& RenderThread::Acquire() {
+    unsigned spins = 0;
+    while (!mFree.TryPop(mCurrent))
+        WaitBriefly(spins);
+
+    mCurrent->frame = mNextFrame++;
+    mCurrent->buildStart = Clock::now();
+    if (mCurrent->frame == 0)
+        mFirstBuild = mCurrent->buildStart;
+    return *mCurrent;
+}
+
+void RenderThread::Submit() {
+    mCurrent->submitted = Clock::now();
+    mBuildMs += MillisecondsBetween(mCurrent->buildStart, mCurrent->submitted);
+
+    if (!mThreaded) {
+        RenderPacket(*mCurrent);
+        mFree.TryPush(mCurrent);
+    }
+    else {
+        // Cannot fail: at most PACKET_COUNT packets exist
+        mReady.TryPush(mCurrent);
+    }
+    mCurrent = nullptr;
+}
+
+void RenderThread::Stop() {
+    if (!mRunning)
+        return;
+    mRunning = false;
+
+    mStopping.store(true, std::memory_order_release);
+    if (mThread.joinable())
+        mThread.join();
+    else
+        mDetach();
+}
+
+void RenderThread::WaitIdle() {
+    unsigned spins = 0;
+    while (mFramesDone.load(std::memory_order_acquire) != mNextFrame)
+        WaitBriefly(spins);
+}
+
+void RenderThread::ThreadMain() {
+    mAttach();
+
+    unsigned spins = 0;
+    for (;;) {
+        FramePacket* packet = nullptr;
+        if (!mReady.TryPop(packet)) {
+            // Check the queue once more after seeing the stop flag, so the last packet is not lost
+            if (!mStopping.load(std::memory_order_acquire)) {
+                WaitBriefly(spins);
+                continue;
+            }
+            if (!mReady.TryPop(packet))
+                break;
+        }
+
+        spins = 0;
+        RenderPacket(*packet);
+        mFree.TryPush(packet);
+    }
+
+    mDetach();
+}
+
+void RenderThread::RenderPacket(FramePacket& packet) {
+    Clock::time_point start = Clock::now();
+    mRender(packet);
+    mLastPresent = Clock::now();
+
+    double latencyMs = MillisecondsBetween(packet.buildStart, mLastPresent);
+    ++mFrames;
+    mRenderMs += MillisecondsBetween(start, mLastPresent);
+    mQueueMs += MillisecondsBetween(packet.submitted, start);
+    mLatencyMs += latencyMs;
+    mMaxLatencyMs = std::max(mMaxLatencyMs, latencyMs);
+    mFramesDone.fetch_add(1, std::memory_order_release);
+}
+
+RenderThread::Stats RenderThread::GetStats() const {
+    Stats stats;
+    stats.frames = mFrames;
+    if (mFrames == 0)
+        return stats;
+
+    stats.buildMs = mBuildMs;
+    stats.renderMs = mRenderMs;
+    stats.wallMs = MillisecondsBetween(mFirstBuild, mLastPresent);
+    stats.overlapMs = std::max(0.0, mBuildMs + mRenderMs - stats.wallMs);
+    stats.averageQueueMs = mQueueMs / mFrames;
+    stats.averageLatencyMs = mLatencyMs / mFrames;
+    stats.maxLatencyMs = mMaxLatencyMs;
+    return stats;
+}
@@ -0,0 +1,171 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include "entity_store.h"
+#include "light_clusters.h"
+#include "ocean_spectrum.h"
+#include "spsc_queue.h"
+#include "water_simulation.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Everything needed to draw one frame, captured by the main thread. Once submitted the
+// packet is read-only until the render thread hands it back, so rendering never reads
+// live simulation state.
+struct FramePacket {
+    typedef std::chrono::steady_clock Clock;
+
+    // firstMeshletRange indexes meshletCounts/meshletOffsets, or is ALL_MESHLETS when the
+    // draw submits its whole level
+    static const uint32_t ALL_MESHLETS = 0xFFFFFFFFu;
+
+    struct Draw {
+        glm::mat4 model;
+        MeshHandle mesh;
+        MaterialHandle material;
+        uint32_t lod;                   // level of the mesh's LOD chain, 0 for full detail
+        uint32_t firstMeshletRange;
+        uint32_t meshletRanges;         // index ranges left after meshlet culling; 0 draws nothing
+    };
+
+    struct ShadowCaster {
+        glm::mat4 model;
+        MeshHandle mesh;
+    };
+
+    uint64_t frame = 0;
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::mat4 projection = glm::mat4(1.0f);
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
+    int framebufferWidth = 0;
+    int framebufferHeight = 0;
+    int renderWidth = 0;                // scene resolution under --dynamic-res, 0 to draw at the framebuffer size
+    int renderHeight = 0;
+    glm::vec2 jitter = glm::vec2(0.0f); // sub-pixel offset already applied to projection
+    bool deferred = false;
+    bool depthPrepass = false;          // forward path lays down depth first, then shades with GL_EQUAL
+    bool capture = false;               // read this frame back (screenshot or --capture)
+
+    std::vector<Draw> draws;            // visible entities, sorted by material then mesh
+    std::vector<uint32_t> depthOrder;   // indices into draws, nearest first; empty when draws already are
+    std::vector<int> meshletCounts;     // glMultiDrawElements ranges of the culled full-detail draws
+    std::vector<const void*> meshletOffsets;
+    size_t triangles = 0;               // submitted by draws, after LOD and meshlet culling
+    std::shared_ptr<const std::vector<ShadowCaster> > staticCasters;   // shared snapshot, replaced when staticShadowVersion changes
+    std::vector<ShadowCaster> dynamicCasters;
+    uint64_t staticShadowVersion = 0;
+
+    // Shared snapshot; the main thread replaces the pointer rather than editing the lights
+    std::shared_ptr<const std::vector<ClusterLight> > lights;
+
+    // --water: surface texels changed since the previous packet, or with --water-gpu the
+    // steps for the render thread to run, with their disturbances sorted by step
+    WaterRect waterRect;
+    std::vector<glm::vec4> waterTexels;
+    size_t waterSteps = 0;
+    std::vector<WaterDisturbance> waterDisturbances;
+
+    // --ocean: this frame's maps, shared with the main thread's pool of map sets
+    std::shared_ptr<const OceanSpectrum::Maps> oceanMaps;
+
+    // --reflections: the camera mirrored in the first visible pool, with its near plane on
+    // the water; reflectionUpdate marks the frames that redraw the reflection
+    bool reflection = false;
+    bool reflectionUpdate = false;
+    glm::mat4 reflectionView = glm::mat4(1.0f);
+    glm::mat4 reflectionProjection = glm::mat4(1.0f);
+    int reflectionWidth = 0;            // image the reflection spans, larger than the framebuffer when tiled
+    int reflectionHeight = 0;
+
+    Clock::time_point buildStart;       // main thread started the frame (input, simulation, culling)
+    Clock::time_point submitted;        // packet handed to the render thread
+};
+
+// Owns the GL context on a second thread. The main thread fills one packet while the
+// render thread submits the previous one; PACKET_COUNT packets circulate between a
+// "ready" queue (main to render) and a "free" queue (render to main).
+// When started unthreaded, Submit() renders inline, which gives a serial baseline.
+class RenderThread {
+public:
+    typedef FramePacket::Clock Clock;
+    static const size_t PACKET_COUNT = 2;
+
+    struct Stats {
+        size_t frames = 0;
+        double buildMs = 0.0;           // main thread time from Acquire() to Submit()
+        double renderMs = 0.0;          // render thread time submitting and presenting
+        double wallMs = 0.0;            // first packet started to last frame presented
+        double overlapMs = 0.0;         // buildMs + renderMs - wallMs, never below zero
+        double averageQueueMs = 0.0;    // time a submitted packet waited for the render thread
+        double averageLatencyMs = 0.0;  // build start to present
+        double maxLatencyMs = 0.0;
+    };
+
+    ~RenderThread();
+
+    // attach and detach run on the thread that renders, before the first frame and after
+    // the last, to make the GL context current there and release it again
+    void Start(bool threaded, const std::function<void()>& attach,
+        const std::function<void(const FramePacket&)>& render, const std::function<void()>& detach);
+
+    // Main thread: waits for a free packet and returns it for filling. Call it before
+    // sampling input, so latency and build time cover the whole main-thread frame.
+    FramePacket& Acquire();
+
+    // Main thread: hands the packet from Acquire() to the render thread
+    void Submit();
+
+    // Main thread: waits until every submitted packet has been rendered and presented
+    void WaitIdle();
+
+    // Renders every packet still queued, then joins the render thread
+    void Stop();
+
+    bool Threaded() const { return mThreaded; }
+
+    // Valid once Stop() has returned
+    Stats GetStats() const;
+
+private:
+    void ThreadMain();
+    void RenderPacket(FramePacket& packet);
+
+    FramePacket mPackets[PACKET_COUNT];
+    SpscQueue<FramePacket*, PACKET_COUNT> mReady;
+    SpscQueue<FramePacket*, PACKET_COUNT> mFree;
+    FramePacket* mCurrent = nullptr;
+    uint64_t mNextFrame = 0;
+    std::atomic<uint64_t> mFramesDone{ 0 };
+
+    std::thread mThread;
+    std::atomic<bool> mStopping{ false };
+    bool mThreaded = false;
+    bool mRunning = false;
+    std::function<void()> mAttach;
+    std::function<void(const FramePacket&)> mRender;
+    std::function<void()> mDetach;
+
+    // Main thread timings
+    Clock::time_point mFirstBuild;
+    double mBuildMs = 0.0;
+
+    // Render thread timings
+    Clock::time_point mLastPresent;
+    size_t mFrames = 0;
+    double mRenderMs = 0.0;
+    double mQueueMs = 0.0;
+    double mLatencyMs = 0.0;
+    double mMaxLatencyMs = 0.0;
+};
+
+#endif
@@ -0,0 +1,119 @@
+#include "ring_buffer.h"
+#include "gl_trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+const size_t PersistentRingBuffer::REGION_COUNT;
+
+bool PersistentRingBuffer::Create(size_t regionSize) {
+    Destroy();
+
+    GLint uniformAlignment = 0;
+    GLint storageAlignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+    mUniformAlignment = max<size_t>(static_cast<size_t>(uniformAlignment), 16);
+    mStorageAlignment = max<size_t>(static_cast<size_t>(storageAlignment), 16);
+
+    // Regions start on an alignment boundary that suits every binding target
+    size_t alignment = max(mUniformAlignment, mStorageAlignment);
+    mRegionSize = (regionSize + alignment - 1) / alignment * alignment;
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &mBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, mRegionSize * REGION_COUNT, NULL, flags);
+    mMapped = static_cast<uint8_t*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, mRegionSize * REGION_COUNT, flags));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (mMapped == nullptr) {
+        cout << "Failed to map the persistent ring buffer" << endl;
+        Destroy();
+        return false;
+    }
+
+    // BeginFrame() advances first, so the first frame lands in region 0
+    mRegion = REGION_COUNT - 1;
+    mHead = 0;
+    return true;
+}
+
+void PersistentRingBuffer::Destroy() {
+    for (GLsync& fence : mFences) {
+        if (fence != 0)
+            glDeleteSync(fence);
+        fence = 0;
+    }
+    if (mBuffer != 0) {
+        if (mMapped != nullptr) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &mBuffer);
+    }
+    mBuffer = 0;
+    mMapped = nullptr;
+}
+
+void PersistentRingBuffer::BeginFrame() {
+    mRegion = (mRegion + 1) % REGION_COUNT;
+    mHead = 0;
+    ++mStats.frames;
+
+    GLsync& fence = mFences[mRegion];
+    if (fence == 0)
+        return;
+
+    // Poll first; only a region the GPU is still reading costs a real wait
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        ++mStats.fenceWaits;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        do {
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        } while (status == GL_TIMEOUT_EXPIRED);
+        mStats.fenceWaitMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+    glDeleteSync(fence);
+    fence = 0;
+}
+
+void PersistentRingBuffer::EndFrame() {
+    GLsync& fence = mFences[mRegion];
+    if (fence != 0)
+        glDeleteSync(fence);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    mStats.peakFrameBytes = max(mStats.peakFrameBytes, mHead);
+}
+
+bool PersistentRingBuffer::Allocate(size_t bytes, size_t alignment, Allocation& allocation) {
+    size_t begin = (mHead + alignment - 1) / alignment * alignment;
+    if (mMapped == nullptr || begin + bytes > mRegionSize) {
+        ++mStats.failedAllocations;
+        return false;
+    }
+
+    size_t offset = mRegion * mRegionSize + begin;
+    allocation.cpu = mMapped + offset;
+    allocation.offset = static_cast<GLintptr>(offset);
+    allocation.size = static_cast<GLsizeiptr>(bytes);
+    mHead = begin + bytes;
+    return true;
+}
+
+void PersistentRingBuffer::BindUniform(GLuint bindingIndex, const Allocation& allocation) const {
+    glBindBufferRange(GL_UNIFORM_BUFFER, bindingIndex, mBuffer, allocation.offset, allocation.size);
+}
+
+void PersistentRingBuffer::BindStorage(GLuint bindingIndex, const Allocation& allocation) const {
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, bindingIndex, mBuffer, allocation.offset, allocation.size);
+}
+
+void PersistentRingBuffer::BindVertex(GLuint bindingIndex, const Allocation& allocation, GLsizei stride) const {
+    glBindVertexBuffer(bindingIndex, mBuffer, allocation.offset, stride);
+}
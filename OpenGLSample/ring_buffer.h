@@ -0,0 +1,68 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+// One GL buffer, persistently and coherently mapped, split into REGION_COUNT regions.
+// Each frame writes into its own region with a bump allocator and fences it after
+// submission; a region is only reused once its fence has signalled, which with three
+// regions is normally long past, so CPU writes never wait on the GPU. Coherent mapping
+// means no explicit flushes are needed before drawing.
+class PersistentRingBuffer {
+public:
+    static const size_t REGION_COUNT = 3;
+
+    // A sub-range of the current region. cpu is where to write; offset is what to bind.
+    struct Allocation {
+        void* cpu = nullptr;
+        GLintptr offset = 0;
+        GLsizeiptr size = 0;
+    };
+
+    struct Stats {
+        size_t frames = 0;
+        size_t fenceWaits = 0;      // frames whose region was still in use by the GPU
+        double fenceWaitMs = 0.0;
+        size_t peakFrameBytes = 0;
+        size_t failedAllocations = 0;
+    };
+
+    // Creates the buffer with regionSize bytes per region (glBufferStorage, GL 4.4)
+    bool Create(size_t regionSize);
+    void Destroy();
+
+    // Moves to the next region, waiting on its fence only if the GPU still reads it
+    void BeginFrame();
+
+    // Fences the current region; call after the frame's last command that reads it
+    void EndFrame();
+
+    // Bump-allocates from the current region. Fails when the region is full.
+    bool Allocate(size_t bytes, size_t alignment, Allocation& allocation);
+    bool AllocateUniform(size_t bytes, Allocation& allocation) { return Allocate(bytes, mUniformAlignment, allocation); }
+    bool AllocateStorage(size_t bytes, Allocation& allocation) { return Allocate(bytes, mStorageAlignment, allocation); }
+
+    void BindUniform(GLuint bindingIndex, const Allocation& allocation) const;
+    void BindStorage(GLuint bindingIndex, const Allocation& allocation) const;
+    // Binds the range as a vertex buffer for the current VAO (separate attribute format)
+    void BindVertex(GLuint bindingIndex, const Allocation& allocation, GLsizei stride) const;
+
+    GLuint Buffer() const { return mBuffer; }
+    const Stats& GetStats() const { return mStats; }
+
+private:
+    GLuint mBuffer = 0;
+    uint8_t* mMapped = nullptr;
+    size_t mRegionSize = 0;
+    size_t mRegion = 0;
+    size_t mHead = 0;               // bytes used in the current region
+    GLsync mFences[REGION_COUNT] = { 0, 0, 0 };
+    size_t mUniformAlignment = 256;
+    size_t mStorageAlignment = 256;
+    Stats mStats;
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include "scene_graph.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+
+const SceneGraph::NodeId SceneGraph::kNoParent;
+const size_t SceneGraph::kParallelLevelSize;
+
+SceneGraph::NodeId SceneGraph::CreateNode(NodeId parent, const glm::mat4& local) {
+    NodeId id = static_cast<NodeId>(mSlotOf.size());
+    uint32_t depth = parent == kNoParent ? 0 : mDepthOf[parent] + 1;
+
+    mParentOf.push_back(parent);
+    mDepthOf.push_back(depth);
+    mSlotOf.push_back(id);
+
+    // New nodes go at the end and are moved into depth order by the next Update()
+    mNodeAt.push_back(id);
+    mParentSlot.push_back(kNoParent);
+    mLocal.push_back(local);
+    mWorld.push_back(local);
+    mDirty.push_back(1);
+    mChangedFrame.push_back(0);
+
+    ++mDirtyCount;
+    mLayoutDirty = true;
+    return id;
+}
+
+void SceneGraph::SetLocal(NodeId node, const glm::mat4& local) {
+    uint32_t slot = mSlotOf[node];
+    mLocal[slot] = local;
+    if (mDirty[slot])
+        return;
+
+    mDirty[slot] = 1;
+    ++mDirtyCount;
+    if (!mLayoutDirty)
+        ++mLevelDirty[mDepthOf[node]];
+}
+
+void SceneGraph::Rebuild() {
+    size_t count = mSlotOf.size();
+
+    // Counting sort by depth; stable, so siblings keep their creation order
+    uint32_t maxDepth = 0;
+    for (uint32_t depth : mDepthOf)
+        maxDepth = depth > maxDepth ? depth : maxDepth;
+
+    mLevelStart.assign(maxDepth + 2, 0);
+    for (uint32_t depth : mDepthOf)
+        ++mLevelStart[depth + 1];
+    for (size_t d = 1; d < mLevelStart.size(); ++d)
+        mLevelStart[d] += mLevelStart[d - 1];
+
+    std::vector<size_t> cursor(mLevelStart.begin(), mLevelStart.end() - 1);
+    std::vector<NodeId> nodeAt(count);
+    std::vector<glm::mat4> local(count), world(count);
+    std::vector<uint8_t> dirty(count);
+    std::vector<uint32_t> changedFrame(count);
+
+    for (NodeId id = 0; id < count; ++id) {
+        uint32_t oldSlot = mSlotOf[id];
+        size_t newSlot = cursor[mDepthOf[id]]++;
+        nodeAt[newSlot] = id;
+        local[newSlot] = mLocal[oldSlot];
+        world[newSlot] = mWorld[oldSlot];
+        dirty[newSlot] = mDirty[oldSlot];
+        changedFrame[newSlot] = mChangedFrame[oldSlot];
+        mSlotOf[id] = static_cast<uint32_t>(newSlot);
+    }
+
+    mNodeAt.swap(nodeAt);
+    mLocal.swap(local);
+    mWorld.swap(world);
+    mDirty.swap(dirty);
+    mChangedFrame.swap(changedFrame);
+
+    mParentSlot.resize(count);
+    mLevelDirty.assign(maxDepth + 1, 0);
+    for (size_t slot = 0; slot < count; ++slot) {
+        NodeId id = mNodeAt[slot];
+        NodeId parent = mParentOf[id];
+        mParentSlot[slot] = parent == kNoParent ? kNoParent : mSlotOf[parent];
+        if (mDirty[slot])
+            ++mLevelDirty[mDepthOf[id]];
+    }
+
+    mLayoutDirty = false;
+}
+
+size_t SceneGraph::UpdateRange(size_t begin, size_t end) {
+    size_t updated = 0;
+    for (size_t slot = begin; slot < end; ++slot) {
+        uint32_t parent = mParentSlot[slot];
+        bool parentChanged = parent != kNoParent && mChangedFrame[parent] == mFrame;
+        if (!mDirty[slot] && !parentChanged)
+            continue;
+
+        mWorld[slot] = parent == kNoParent ? mLocal[slot] : mWorld[parent] * mLocal[slot];
+        mDirty[slot] = 0;
+        mChangedFrame[slot] = mFrame;
+        ++updated;
+    }
+    return updated;
+}
+
+void SceneGraph::Update() {
+    mStats = Stats();
+    mStats.nodeCount = mSlotOf.size();
+
+    if (mLayoutDirty)
+        Rebuild();
+
+    // Frame stamps let children see that a parent moved without clearing a flag array
+    if (++mFrame == 0) {
+        std::fill(mChangedFrame.begin(), mChangedFrame.end(), 0u);
+        mFrame = 1;
+    }
+
+    if (mDirtyCount == 0)
+        return;
+
+    bool parentLevelChanged = false;
+    for (size_t depth = 0; depth + 1 < mLevelStart.size(); ++depth) {
+        if (mLevelDirty[depth] == 0 && !parentLevelChanged)
+            continue;
+
+        size_t begin = mLevelStart[depth];
+        size_t end = mLevelStart[depth + 1];
+        size_t updated = 0;
+        ++mStats.levelsVisited;
+
+        if (end - begin >= kParallelLevelSize) {
+            std::atomic<size_t> counter(0);
+            UParallelFor(end - begin, 1024, [&](size_t b, size_t e) {
+                counter += UpdateRange(begin + b, begin + e);
+            });
+            updated = counter;
+            ++mStats.levelsParallel;
+        }
+        else {
+            updated = UpdateRange(begin, end);
+        }
+
+        mLevelDirty[depth] = 0;
+        parentLevelChanged = updated > 0;
+        mStats.nodesUpdated += updated;
+    }
+
+    mDirtyCount = 0;
+}
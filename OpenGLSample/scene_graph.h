@@ -0,0 +1,71 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Parent/child transform hierarchy kept in flat arrays sorted by depth, so every
+// parent is stored before its children and a level can be processed in one pass.
+// World matrices are only recomputed for nodes whose local matrix changed and for
+// the subtrees below them; a scene where nothing moves costs no matrix work.
+class SceneGraph {
+public:
+    typedef uint32_t NodeId;
+    static const NodeId kNoParent = 0xFFFFFFFFu;
+
+    // Levels with at least this many nodes are split across the worker pool
+    static const size_t kParallelLevelSize = 4096;
+
+    struct Stats {
+        size_t nodeCount = 0;
+        size_t nodesUpdated = 0;     // world matrices recomputed by the last Update()
+        size_t levelsVisited = 0;    // levels that had to be scanned
+        size_t levelsParallel = 0;   // levels that were split across threads
+    };
+
+    NodeId CreateNode(NodeId parent, const glm::mat4& local);
+    void SetLocal(NodeId node, const glm::mat4& local);
+
+    const glm::mat4& GetLocal(NodeId node) const { return mLocal[mSlotOf[node]]; }
+    const glm::mat4& GetWorld(NodeId node) const { return mWorld[mSlotOf[node]]; }
+
+    // True when the node's world matrix was recomputed by the last Update()
+    bool ChangedLastUpdate(NodeId node) const { return mChangedFrame[mSlotOf[node]] == mFrame; }
+
+    // Recomputes world matrices for dirty subtrees
+    void Update();
+
+    const Stats& GetStats() const { return mStats; }
+    size_t NodeCount() const { return mSlotOf.size(); }
+
+private:
+    void Rebuild();
+    size_t UpdateRange(size_t begin, size_t end);
+
+    // Indexed by NodeId
+    std::vector<NodeId> mParentOf;
+    std::vector<uint32_t> mSlotOf;
+    std::vector<uint32_t> mDepthOf;
+
+    // Indexed by slot, sorted by depth
+    std::vector<NodeId> mNodeAt;
+    std::vector<uint32_t> mParentSlot;
+    std::vector<glm::mat4> mLocal;
+    std::vector<glm::mat4> mWorld;
+    std::vector<uint8_t> mDirty;
+    std::vector<uint32_t> mChangedFrame;
+
+    // mLevelStart[d]..mLevelStart[d + 1] is the slot range of depth d
+    std::vector<size_t> mLevelStart;
+    std::vector<size_t> mLevelDirty;
+
+    uint32_t mFrame = 1;
+    size_t mDirtyCount = 0;
+    bool mLayoutDirty = false;
+    Stats mStats;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include "shadow_cache.h"
+#include "gl_trace.h"
+
+#include <iostream>
+
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace std;
+
+const GLuint ShadowCache::TEXTURE_UNIT;
+
+namespace {
+    // Depth texture set up for hardware depth comparison (sampler2DShadow)
+    GLuint CreateShadowTexture(int size) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, size, size);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        const GLfloat border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };   // outside the map is lit
+        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        return texture;
+    }
+
+    GLuint CreateDepthFramebuffer(GLuint depthTexture) {
+        GLuint framebuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        return framebuffer;
+    }
+}
+
+bool ShadowCache::Create(int size) {
+    Destroy();
+    mSize = size;
+
+    mStaticDepth = CreateShadowTexture(size);
+    mCompositeDepth = CreateShadowTexture(size);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    mStaticFramebuffer = CreateDepthFramebuffer(mStaticDepth);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    mCompositeFramebuffer = CreateDepthFramebuffer(mCompositeDepth);
+    if (status == GL_FRAMEBUFFER_COMPLETE)
+        status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        cout << "Shadow map framebuffer incomplete: 0x" << hex << status << dec << endl;
+        Destroy();
+        return false;
+    }
+    return true;
+}
+
+void ShadowCache::Destroy() {
+    GLuint framebuffers[2] = { mStaticFramebuffer, mCompositeFramebuffer };
+    GLuint textures[2] = { mStaticDepth, mCompositeDepth };
+    if (framebuffers[0] != 0)
+        glDeleteFramebuffers(2, framebuffers);
+    if (textures[0] != 0)
+        glDeleteTextures(2, textures);
+
+    mStaticFramebuffer = mCompositeFramebuffer = mStaticDepth = mCompositeDepth = 0;
+    mValid = false;
+}
+
+bool ShadowCache::BeginStatic(const glm::mat4& lightViewProjection, uint64_t staticVersion) {
+    ++mStats.frames;
+    mUseComposite = false;
+
+    if (mValid && staticVersion == mStaticVersion && lightViewProjection == mLightViewProjection) {
+        ++mStats.cacheHits;
+        return false;
+    }
+
+    mValid = true;
+    mStaticVersion = staticVersion;
+    mLightViewProjection = lightViewProjection;
+    ++mStats.staticRenders;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, mStaticFramebuffer);
+    glViewport(0, 0, mSize, mSize);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    return true;
+}
+
+void ShadowCache::BeginDynamic() {
+    // A GPU-side copy; the static layer never leaves video memory
+    glCopyImageSubData(mStaticDepth, GL_TEXTURE_2D, 0, 0, 0, 0,
+        mCompositeDepth, GL_TEXTURE_2D, 0, 0, 0, 0, mSize, mSize, 1);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, mCompositeFramebuffer);
+    glViewport(0, 0, mSize, mSize);
+    mUseComposite = true;
+    ++mStats.dynamicComposites;
+}
+
+void ShadowCache::End() {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ShadowCache::Bind(GLuint programId) const {
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, mUseComposite ? mCompositeDepth : mStaticDepth);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform1i(glGetUniformLocation(programId, "shadowMap"), TEXTURE_UNIT);
+    glUniformMatrix4fv(glGetUniformLocation(programId, "lightSpace"), 1, GL_FALSE, glm::value_ptr(mLightViewProjection));
+}
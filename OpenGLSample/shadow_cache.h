@@ -0,0 +1,63 @@
+#ifndef SHADOW_CACHE_H
+#define SHADOW_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Directional shadow map split into two layers. Static casters are rendered into a
+// cached depth map that is kept until the light moves or the static version changes.
+// When dynamic casters are present, the cache is copied into a second map each frame
+// and the dynamic casters are drawn on top; otherwise the cache is sampled directly,
+// so a scene where nothing moves costs no shadow rendering at all.
+class ShadowCache {
+public:
+    // Texture unit Bind() uses for the shadow map
+    static const GLuint TEXTURE_UNIT = 5;
+
+    struct Stats {
+        size_t frames = 0;
+        size_t cacheHits = 0;           // frames that reused the static layer
+        size_t staticRenders = 0;       // frames that re-rendered the static layer
+        size_t dynamicComposites = 0;   // frames that drew dynamic casters over the cache
+    };
+
+    bool Create(int size);
+    void Destroy();
+
+    // Starts a frame. Returns true when the static layer is stale; the static framebuffer
+    // is then bound and cleared, and the caller draws every static caster.
+    // staticVersion must change whenever a static caster moves or is added or removed.
+    bool BeginStatic(const glm::mat4& lightViewProjection, uint64_t staticVersion);
+
+    // Copies the static layer into the composite map and binds it for drawing the
+    // dynamic casters. Skip it on frames without dynamic casters.
+    void BeginDynamic();
+
+    // Restores the default framebuffer; the caller resets the viewport
+    void End();
+
+    // Binds the map this frame's shading should use and sets the shadowMap/lightSpace uniforms
+    void Bind(GLuint programId) const;
+
+    const glm::mat4& LightViewProjection() const { return mLightViewProjection; }
+    int Size() const { return mSize; }
+    const Stats& GetStats() const { return mStats; }
+
+private:
+    GLuint mStaticDepth = 0;
+    GLuint mCompositeDepth = 0;
+    GLuint mStaticFramebuffer = 0;
+    GLuint mCompositeFramebuffer = 0;
+    int mSize = 0;
+
+    bool mValid = false;
+    bool mUseComposite = false;
+    uint64_t mStaticVersion = 0;
+    glm::mat4 mLightViewProjection = glm::mat4(1.0f);
+    Stats mStats;
+};
+
+#endif
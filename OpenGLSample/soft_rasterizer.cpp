@@ -0,0 +1,685 @@
+#include "soft_rasterizer.h"
+#include "cpu_profiler.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFT_RASTER_SSE 1
+#include <emmintrin.h>
+#else
+#define SOFT_RASTER_SSE 0
+#endif
+
+const int SoftRasterizer::TILE_SIZE;
+
+namespace {
+    const float SUBPIXEL_STEPS = 256.0f;        // vertices snap to 1/256 pixel, as on most GPUs
+    const float POOL_COLOR[3] = { 0.0f, 0.4f, 0.7f };
+
+    // Lane order of a 2x2 quad: bottom-left, bottom-right, top-left, top-right
+    const float LANE_X[4] = { 0.0f, 1.0f, 0.0f, 1.0f };
+    const float LANE_Y[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+
+    // Runs fn(i) for every i in [0, count) on at most threads threads, handing out
+    // indices one at a time so uneven items still balance
+    template <typename Fn>
+    void RunJobs(size_t count, unsigned threads, const Fn& fn) {
+        std::atomic<size_t> next(0);
+        UParallelFor(std::min<size_t>(threads, count), 1, [&](size_t, size_t) {
+            for (size_t i = next++; i < count; i = next++)
+                fn(i);
+        });
+    }
+
+    float Clamp01(float value) {
+        return value > 0.0f ? (value < 1.0f ? value : 1.0f) : 0.0f;
+    }
+
+    float Smoothstep(float edge0, float edge1, float x) {
+        float t = Clamp01((x - edge0) / (edge1 - edge0));
+        return t * t * (3.0f - 2.0f * t);
+    }
+
+    uint8_t ToUnorm8(float value) {
+        return static_cast<uint8_t>(Clamp01(value) * 255.0f + 0.5f);
+    }
+
+    double Milliseconds(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+struct SoftRasterizer::ClipVertex {
+    glm::vec4 clip;
+    glm::vec2 texCoord;
+    glm::vec3 world;
+};
+
+void SoftTexture::Create(const uint8_t* pixels, int width, int height, int channels) {
+    mLevels.clear();
+    Level base = { width, height, std::vector<uint8_t>(static_cast<size_t>(width) * height * 3) };
+    for (size_t i = 0; i < static_cast<size_t>(width) * height; ++i) {
+        for (int c = 0; c < 3; ++c)
+            base.texels[i * 3 + c] = pixels[i * channels + std::min(c, channels - 1)];
+    }
+    mLevels.push_back(std::move(base));
+
+    // Each level averages 2x2 texels of the one above; odd edges repeat their last texel
+    while (mLevels.back().width > 1 || mLevels.back().height > 1) {
+        const Level& above = mLevels.back();
+        Level level = { std::max(1, above.width / 2), std::max(1, above.height / 2), std::vector<uint8_t>() };
+        level.texels.resize(static_cast<size_t>(level.width) * level.height * 3);
+        for (int y = 0; y < level.height; ++y) {
+            int y0 = std::min(y * 2, above.height - 1), y1 = std::min(y * 2 + 1, above.height - 1);
+            for (int x = 0; x < level.width; ++x) {
+                int x0 = std::min(x * 2, above.width - 1), x1 = std::min(x * 2 + 1, above.width - 1);
+                for (int c = 0; c < 3; ++c) {
+                    int sum = above.texels[(static_cast<size_t>(y0) * above.width + x0) * 3 + c]
+                        + above.texels[(static_cast<size_t>(y0) * above.width + x1) * 3 + c]
+                        + above.texels[(static_cast<size_t>(y1) * above.width + x0) * 3 + c]
+                        + above.texels[(static_cast<size_t>(y1) * above.width + x1) * 3 + c];
+                    level.texels[(static_cast<size_t>(y) * level.width + x) * 3 + c] = static_cast<uint8_t>((sum + 2) / 4);
+                }
+            }
+        }
+        mLevels.push_back(std::move(level));
+    }
+}
+
+glm::vec3 SoftTexture::SampleLevel(const Level& level, const glm::vec2& uv) const {
+    float x = uv.x * level.width - 0.5f;
+    float y = uv.y * level.height - 0.5f;
+    float fx = std::floor(x), fy = std::floor(y);
+    float tx = x - fx, ty = y - fy;
+    int x0 = static_cast<int>(fx) % level.width, y0 = static_cast<int>(fy) % level.height;
+    if (x0 < 0)
+        x0 += level.width;
+    if (y0 < 0)
+        y0 += level.height;
+    int x1 = x0 + 1 < level.width ? x0 + 1 : 0;
+    int y1 = y0 + 1 < level.height ? y0 + 1 : 0;
+
+    const uint8_t* t00 = &level.texels[(static_cast<size_t>(y0) * level.width + x0) * 3];
+    const uint8_t* t10 = &level.texels[(static_cast<size_t>(y0) * level.width + x1) * 3];
+    const uint8_t* t01 = &level.texels[(static_cast<size_t>(y1) * level.width + x0) * 3];
+    const uint8_t* t11 = &level.texels[(static_cast<size_t>(y1) * level.width + x1) * 3];
+    glm::vec3 color;
+    for (int c = 0; c < 3; ++c) {
+        float bottom = t00[c] + (t10[c] - t00[c]) * tx;
+        float top = t01[c] + (t11[c] - t01[c]) * tx;
+        color[c] = (bottom + (top - bottom) * ty) * (1.0f / 255.0f);
+    }
+    return color;
+}
+
+glm::vec3 SoftTexture::Sample(const glm::vec2& uv, float lod) const {
+    if (mLevels.empty())
+        return glm::vec3(1.0f);
+    if (!(lod > 0.0f))
+        return SampleLevel(mLevels[0], uv);
+
+    float last = static_cast<float>(mLevels.size() - 1);
+    lod = std::min(lod, last);
+    size_t level = static_cast<size_t>(lod);
+    float blend = lod - level;
+    glm::vec3 color = SampleLevel(mLevels[level], uv);
+    if (blend > 0.0f)
+        color += (SampleLevel(mLevels[level + 1], uv) - color) * blend;
+    return color;
+}
+
+void SoftRasterizer::Resize(int width, int height) {
+    if (width == mWidth && height == mHeight)
+        return;
+    mWidth = width;
+    mHeight = height;
+    mColor.assign(static_cast<size_t>(width) * height * 4, 0);
+    mDepth.assign(static_cast<size_t>(width) * height, 1.0f);
+}
+
+unsigned SoftRasterizer::ThreadCount() const {
+    unsigned pool = UParallelThreadCount();
+    return mThreadCount == 0 ? pool : std::min(mThreadCount, pool);
+}
+
+void SoftRasterizer::BeginFrame(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition,
+    const SoftLighting& lighting) {
+    mView = view;
+    mProjection = projection;
+    mCameraPosition = cameraPosition;
+    mLighting = lighting;
+    mDraws.clear();
+    mCasters.clear();
+}
+
+void SoftRasterizer::AddDraw(const SoftMesh& mesh, const glm::mat4& model, const SoftTexture* texture, bool isPool) {
+    Draw draw = { &mesh, model, texture, isPool };
+    mDraws.push_back(draw);
+}
+
+void SoftRasterizer::AddShadowCaster(const SoftMesh& mesh, const glm::mat4& model) {
+    Draw caster = { &mesh, model, nullptr, false };
+    mCasters.push_back(caster);
+}
+
+bool SoftRasterizer::ShadowsStale() const {
+    return !mShadowValid || mShadowRenderedVersion != mShadowVersion || mShadowLightSpace != mLighting.lightSpace;
+}
+
+void SoftRasterizer::Render() {
+    PROFILE_FUNCTION();
+    mStats = Stats();
+    mStats.draws = mDraws.size();
+
+    // Same light space and depth convention as the GL shadow pass
+    if (ShadowsStale()) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        mShadowDepth.assign(static_cast<size_t>(mShadowSize) * mShadowSize, 1.0f);
+        int tiles = (mShadowSize + TILE_SIZE - 1) / TILE_SIZE;
+        Target shadow = { mShadowSize, mShadowSize, tiles, tiles, mShadowDepth.data(), nullptr };
+        RunPass(mCasters, mLighting.lightSpace, shadow, false);
+        mShadowValid = true;
+        mShadowRenderedVersion = mShadowVersion;
+        mShadowLightSpace = mLighting.lightSpace;
+        mStats.shadowTriangles = mStats.triangles;
+        mStats.shadowMs = Milliseconds(start);
+        mStats.triangles = mStats.trianglesBinned = mStats.pixelsShaded = 0;
+        mStats.setupMs = mStats.rasterMs = 0.0;
+    }
+
+    BuildLightRects();
+    Target target = { mWidth, mHeight, (mWidth + TILE_SIZE - 1) / TILE_SIZE, (mHeight + TILE_SIZE - 1) / TILE_SIZE,
+        mDepth.data(), mColor.data() };
+    RunPass(mDraws, mProjection * mView, target, true);
+}
+
+// Screen rectangle of every extra light's sphere: the projected corners of its view-space
+// box, or the whole screen when the box reaches behind the camera
+void SoftRasterizer::BuildLightRects() {
+    mLightRects.clear();
+    if (mLighting.lights == nullptr)
+        return;
+
+    for (const ClusterLight& light : *mLighting.lights) {
+        glm::vec3 center = glm::vec3(mView * glm::vec4(glm::vec3(light.positionRadius), 1.0f));
+        float radius = light.positionRadius.w;
+        glm::vec2 lo(1e30f), hi(-1e30f);
+        bool wholeScreen = false;
+        for (int corner = 0; corner < 8 && !wholeScreen; ++corner) {
+            glm::vec3 offset((corner & 1) ? radius : -radius, (corner & 2) ? radius : -radius, (corner & 4) ? radius : -radius);
+            glm::vec4 clip = mProjection * glm::vec4(center + offset, 1.0f);
+            if (clip.w <= 1e-5f) {
+                wholeScreen = true;
+                break;
+            }
+            glm::vec2 ndc = glm::vec2(clip.x, clip.y) / clip.w;
+            lo = glm::min(lo, ndc);
+            hi = glm::max(hi, ndc);
+        }
+
+        glm::ivec4 rect(0, 0, mWidth - 1, mHeight - 1);
+        if (!wholeScreen) {
+            rect.x = static_cast<int>(std::floor((lo.x * 0.5f + 0.5f) * mWidth));
+            rect.y = static_cast<int>(std::floor((lo.y * 0.5f + 0.5f) * mHeight));
+            rect.z = static_cast<int>(std::floor((hi.x * 0.5f + 0.5f) * mWidth));
+            rect.w = static_cast<int>(std::floor((hi.y * 0.5f + 0.5f) * mHeight));
+        }
+        mLightRects.push_back(rect);
+    }
+}
+
+void SoftRasterizer::RunPass(const std::vector<Draw>& draws, const glm::mat4& viewProjection, const Target& target, bool shade) {
+    const unsigned threads = ThreadCount();
+    const size_t tileCount = static_cast<size_t>(target.tilesX) * target.tilesY;
+
+    // Contiguous runs of draws per bin, so walking the bins in order keeps submission order
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    mActiveBins = std::min<size_t>(draws.size(), threads * 4);
+    if (mBins.size() < mActiveBins)
+        mBins.resize(mActiveBins);
+    RunJobs(mActiveBins, threads, [&](size_t b) {
+        Bin& bin = mBins[b];
+        bin.triangles.clear();
+        bin.tiles.resize(tileCount);
+        for (std::vector<uint32_t>& tile : bin.tiles)
+            tile.clear();
+        SetupDraws(draws, b * draws.size() / mActiveBins, (b + 1) * draws.size() / mActiveBins, viewProjection, target, shade, mBins[b]);
+    });
+    for (size_t b = 0; b < mActiveBins; ++b) {
+        mStats.triangles += mBins[b].triangles.size();
+        for (const std::vector<uint32_t>& tile : mBins[b].tiles)
+            mStats.trianglesBinned += tile.size();
+    }
+    mStats.setupMs += Milliseconds(start);
+
+    start = std::chrono::steady_clock::now();
+    std::atomic<size_t> pixels(0);
+    RunJobs(tileCount, threads, [&](size_t tile) {
+        pixels += RasterizeTile(target, static_cast<int>(tile), shade);
+    });
+    mStats.pixelsShaded += pixels.load();
+    mStats.rasterMs += Milliseconds(start);
+}
+
+void SoftRasterizer::SetupDraws(const std::vector<Draw>& draws, size_t begin, size_t end, const glm::mat4& viewProjection,
+    const Target& target, bool shade, Bin& bin) const {
+    thread_local std::vector<ClipVertex> vertices;
+    for (size_t d = begin; d < end; ++d) {
+        const Draw& draw = draws[d];
+        const SoftMesh& mesh = *draw.mesh;
+        const glm::mat4 mvp = viewProjection * draw.model;
+
+        vertices.resize(mesh.positions.size());
+        for (size_t i = 0; i < mesh.positions.size(); ++i) {
+            ClipVertex& vertex = vertices[i];
+            vertex.clip = mvp * glm::vec4(mesh.positions[i], 1.0f);
+            if (shade) {
+                vertex.texCoord = i < mesh.texCoords.size() ? mesh.texCoords[i] : glm::vec2(0.0f);
+                vertex.world = glm::vec3(draw.model * glm::vec4(mesh.positions[i], 1.0f));
+            }
+        }
+
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            const ClipVertex* corners[3] = { &vertices[mesh.indices[i]], &vertices[mesh.indices[i + 1]], &vertices[mesh.indices[i + 2]] };
+
+            // Entirely outside one side of the frustum
+            bool outside = false;
+            bool crossesDepth = false;
+            for (int axis = 0; axis < 3 && !outside; ++axis) {
+                int below = 0, above = 0;
+                for (const ClipVertex* corner : corners) {
+                    below += corner->clip[axis] < -corner->clip.w;
+                    above += corner->clip[axis] > corner->clip.w;
+                }
+                outside = below == 3 || above == 3;
+                if (axis == 2)
+                    crossesDepth = below + above > 0;
+            }
+            if (outside)
+                continue;
+
+            if (!crossesDepth) {
+                const ClipVertex triangle[3] = { *corners[0], *corners[1], *corners[2] };
+                EmitTriangle(triangle, static_cast<uint32_t>(d), target, bin);
+                continue;
+            }
+
+            // Clip against the near and far planes (GL clips depth; x and y are left to the
+            // rasterizer's bounds), then fan the polygon back into triangles
+            ClipVertex polygon[2][5];
+            int count = 3;
+            for (int i2 = 0; i2 < 3; ++i2)
+                polygon[0][i2] = *corners[i2];
+            int current = 0;
+            for (int plane = 0; plane < 2 && count >= 3; ++plane) {
+                const float sign = plane == 0 ? 1.0f : -1.0f;   // near: z + w >= 0, far: w - z >= 0
+                const ClipVertex* in = polygon[current];
+                ClipVertex* out = polygon[1 - current];
+                int outCount = 0;
+                for (int v = 0; v < count; ++v) {
+                    const ClipVertex& a = in[v];
+                    const ClipVertex& b = in[(v + 1) % count];
+                    float da = a.clip.w + sign * a.clip.z;
+                    float db = b.clip.w + sign * b.clip.z;
+                    if (da >= 0.0f)
+                        out[outCount++] = a;
+                    if ((da >= 0.0f) != (db >= 0.0f)) {
+                        float t = da / (da - db);
+                        ClipVertex& cut = out[outCount++];
+                        cut.clip = a.clip + (b.clip - a.clip) * t;
+                        cut.texCoord = a.texCoord + (b.texCoord - a.texCoord) * t;
+                        cut.world = a.world + (b.world - a.world) * t;
+                    }
+                }
+                count = outCount;
+                current = 1 - current;
+            }
+            for (int v = 1; v + 1 < count; ++v) {
+                const ClipVertex triangle[3] = { polygon[current][0], polygon[current][v], polygon[current][v + 1] };
+                EmitTriangle(triangle, static_cast<uint32_t>(d), target, bin);
+            }
+        }
+    }
+}
+
+void SoftRasterizer::EmitTriangle(const ClipVertex* vertices, uint32_t draw, const Target& target, Bin& bin) const {
+    Triangle triangle;
+    triangle.draw = draw;
+    for (int i = 0; i < 3; ++i) {
+        const ClipVertex& vertex = vertices[i];
+        float inverseW = 1.0f / vertex.clip.w;
+        float x = (vertex.clip.x * inverseW * 0.5f + 0.5f) * target.width;
+        float y = (vertex.clip.y * inverseW * 0.5f + 0.5f) * target.height;
+        triangle.screen[i] = glm::vec3(std::floor(x * SUBPIXEL_STEPS + 0.5f) / SUBPIXEL_STEPS,
+            std::floor(y * SUBPIXEL_STEPS + 0.5f) / SUBPIXEL_STEPS, vertex.clip.z * inverseW * 0.5f + 0.5f);
+        triangle.inverseW[i] = inverseW;
+        triangle.texCoord[i] = vertex.texCoord;
+        triangle.world[i] = vertex.world;
+    }
+
+    // No face culling in the GL path either; clockwise triangles are flipped
+    const glm::vec3* s = triangle.screen;
+    double area = (static_cast<double>(s[1].x) - s[0].x) * (static_cast<double>(s[2].y) - s[0].y)
+        - (static_cast<double>(s[2].x) - s[0].x) * (static_cast<double>(s[1].y) - s[0].y);
+    if (area == 0.0 || !(std::fabs(area) < 1e30))
+        return;
+    if (area < 0.0) {
+        std::swap(triangle.screen[1], triangle.screen[2]);
+        std::swap(triangle.inverseW[1], triangle.inverseW[2]);
+        std::swap(triangle.texCoord[1], triangle.texCoord[2]);
+        std::swap(triangle.world[1], triangle.world[2]);
+    }
+
+    // Pixels whose centres can fall inside
+    float minX = std::min(s[0].x, std::min(s[1].x, s[2].x)), maxX = std::max(s[0].x, std::max(s[1].x, s[2].x));
+    float minY = std::min(s[0].y, std::min(s[1].y, s[2].y)), maxY = std::max(s[0].y, std::max(s[1].y, s[2].y));
+    int x0 = std::max(0, static_cast<int>(std::ceil(std::max(minX, -1.0f) - 0.5f)));
+    int y0 = std::max(0, static_cast<int>(std::ceil(std::max(minY, -1.0f) - 0.5f)));
+    int x1 = std::min(target.width - 1, static_cast<int>(std::floor(std::min(maxX, target.width + 1.0f) - 0.5f)));
+    int y1 = std::min(target.height - 1, static_cast<int>(std::floor(std::min(maxY, target.height + 1.0f) - 0.5f)));
+    if (x0 > x1 || y0 > y1)
+        return;
+
+    double A[3], B[3], C[3];
+    for (int i = 0; i < 3; ++i) {
+        const glm::vec3& a = s[(i + 1) % 3];
+        const glm::vec3& b = s[(i + 2) % 3];
+        A[i] = static_cast<double>(a.y) - b.y;
+        B[i] = static_cast<double>(b.x) - a.x;
+        C[i] = static_cast<double>(a.x) * b.y - static_cast<double>(b.x) * a.y;
+    }
+
+    const uint32_t index = static_cast<uint32_t>(bin.triangles.size());
+    bin.triangles.push_back(triangle);
+    int tx0 = x0 / TILE_SIZE, tx1 = x1 / TILE_SIZE, ty0 = y0 / TILE_SIZE, ty1 = y1 / TILE_SIZE;
+    bool singleTile = tx0 == tx1 && ty0 == ty1;
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            // Skip tiles the bounding box touches but the triangle misses: test each edge
+            // at the tile corner furthest along its inside direction
+            bool touches = true;
+            if (!singleTile) {
+                double cx0 = tx * TILE_SIZE + 0.5, cx1 = std::min((tx + 1) * TILE_SIZE, target.width) - 0.5;
+                double cy0 = ty * TILE_SIZE + 0.5, cy1 = std::min((ty + 1) * TILE_SIZE, target.height) - 0.5;
+                for (int i = 0; i < 3 && touches; ++i)
+                    touches = A[i] * (A[i] > 0.0 ? cx1 : cx0) + B[i] * (B[i] > 0.0 ? cy1 : cy0) + C[i] >= 0.0;
+            }
+            if (touches)
+                bin.tiles[static_cast<size_t>(ty) * target.tilesX + tx].push_back(index);
+        }
+    }
+}
+
+size_t SoftRasterizer::RasterizeTile(const Target& target, int tile, bool shade) const {
+    const int x0 = (tile % target.tilesX) * TILE_SIZE;
+    const int y0 = (tile / target.tilesX) * TILE_SIZE;
+    const int x1 = std::min(x0 + TILE_SIZE, target.width);
+    const int y1 = std::min(y0 + TILE_SIZE, target.height);
+
+    // The tile is cleared by the thread that draws it, while it is in that core's cache
+    for (int y = y0; y < y1; ++y) {
+        std::fill(target.depth + static_cast<size_t>(y) * target.width + x0, target.depth + static_cast<size_t>(y) * target.width + x1, 1.0f);
+        if (target.color != nullptr) {
+            uint8_t* row = target.color + (static_cast<size_t>(y) * target.width + x0) * 4;
+            for (int x = x0; x < x1; ++x, row += 4) {
+                row[0] = row[1] = row[2] = 0;
+                row[3] = 255;
+            }
+        }
+    }
+
+    // Extra lights whose screen rectangle overlaps the tile
+    thread_local std::vector<uint32_t> lights;
+    lights.clear();
+    if (shade) {
+        for (size_t i = 0; i < mLightRects.size(); ++i) {
+            const glm::ivec4& rect = mLightRects[i];
+            if (rect.x < x1 && rect.z >= x0 && rect.y < y1 && rect.w >= y0)
+                lights.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    size_t pixels = 0;
+    for (size_t b = 0; b < mActiveBins; ++b) {
+        const Bin& bin = mBins[b];
+        for (uint32_t index : bin.tiles[tile])
+            pixels += RasterizeTriangle(target, bin.triangles[index], x0, y0, x1, y1, shade, lights);
+    }
+    return pixels;
+}
+
+size_t SoftRasterizer::RasterizeTriangle(const Target& target, const Triangle& triangle, int x0, int y0, int x1, int y1,
+    bool shade, const std::vector<uint32_t>& lights) const {
+    const glm::vec3* s = triangle.screen;
+
+    // Edge i runs between the other two vertices and is positive on the triangle's side.
+    // Its constant is taken at the tile origin in double precision, so the two triangles
+    // sharing an edge evaluate exactly opposite values and the tie rule gives each pixel
+    // on it to exactly one of them.
+    float A[3], B[3], C[3];
+    bool includeZero[3];
+    double area = 0.0;
+    for (int i = 0; i < 3; ++i) {
+        const glm::vec3& a = s[(i + 1) % 3];
+        const glm::vec3& b = s[(i + 2) % 3];
+        A[i] = a.y - b.y;
+        B[i] = b.x - a.x;
+        double c = static_cast<double>(a.x) * b.y - static_cast<double>(b.x) * a.y;
+        area += c;
+        C[i] = static_cast<float>(A[i] * (x0 + 0.5) + B[i] * (y0 + 0.5) + c);
+        includeZero[i] = A[i] > 0.0f || (A[i] == 0.0f && B[i] > 0.0f);
+    }
+    const float inverseArea = static_cast<float>(1.0 / area);
+
+    // Quads aligned to even pixels, over the part of the tile the triangle can cover
+    float minX = std::min(s[0].x, std::min(s[1].x, s[2].x)), maxX = std::max(s[0].x, std::max(s[1].x, s[2].x));
+    float minY = std::min(s[0].y, std::min(s[1].y, s[2].y)), maxY = std::max(s[0].y, std::max(s[1].y, s[2].y));
+    int qx0 = std::max(x0, static_cast<int>(std::ceil(std::max(minX, x0 - 1.0f) - 0.5f))) & ~1;
+    int qy0 = std::max(y0, static_cast<int>(std::ceil(std::max(minY, y0 - 1.0f) - 0.5f))) & ~1;
+    int qx1 = std::min(x1, static_cast<int>(std::floor(std::min(maxX, x1 + 1.0f) - 0.5f)) + 1);
+    int qy1 = std::min(y1, static_cast<int>(std::floor(std::min(maxY, y1 + 1.0f) - 0.5f)) + 1);
+
+    const float limitX = static_cast<float>(x1 - x0);
+    const float limitY = static_cast<float>(y1 - y0);
+    const Draw* draw = shade ? &mDraws[triangle.draw] : nullptr;
+    size_t pixels = 0;
+
+#if SOFT_RASTER_SSE
+    const __m128 laneX = _mm_loadu_ps(LANE_X), laneY = _mm_loadu_ps(LANE_Y);
+    const __m128 zero = _mm_setzero_ps();
+    __m128 edgeA[3], edgeB[3], edgeC[3], edgeTie[3];
+    for (int i = 0; i < 3; ++i) {
+        edgeA[i] = _mm_set1_ps(A[i]);
+        edgeB[i] = _mm_set1_ps(B[i]);
+        edgeC[i] = _mm_set1_ps(C[i]);
+        edgeTie[i] = _mm_castsi128_ps(_mm_set1_epi32(includeZero[i] ? -1 : 0));
+    }
+#endif
+
+    for (int y = qy0; y < qy1; y += 2) {
+        const float fy = static_cast<float>(y - y0);
+        for (int x = qx0; x < qx1; x += 2) {
+            const float fx = static_cast<float>(x - x0);
+            float edge[3][4], depth[4], stored[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+            const size_t row0 = static_cast<size_t>(y) * target.width + x;
+            const size_t row1 = row0 + target.width;
+            bool inTile[4] = { true, x + 1 < x1, y + 1 < y1, x + 1 < x1 && y + 1 < y1 };
+            for (int lane = 0; lane < 4; ++lane) {
+                if (inTile[lane])
+                    stored[lane] = target.depth[(lane < 2 ? row0 : row1) + (lane & 1)];
+            }
+            int mask = 0;
+
+#if SOFT_RASTER_SSE
+            __m128 px = _mm_add_ps(_mm_set1_ps(fx), laneX);
+            __m128 py = _mm_add_ps(_mm_set1_ps(fy), laneY);
+            __m128 inside = _mm_and_ps(_mm_cmplt_ps(px, _mm_set1_ps(limitX)), _mm_cmplt_ps(py, _mm_set1_ps(limitY)));
+            __m128 e[3];
+            for (int i = 0; i < 3; ++i) {
+                e[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edgeA[i], px), _mm_mul_ps(edgeB[i], py)), edgeC[i]);
+                __m128 covered = _mm_or_ps(_mm_cmpgt_ps(e[i], zero), _mm_and_ps(_mm_cmpeq_ps(e[i], zero), edgeTie[i]));
+                inside = _mm_and_ps(inside, covered);
+                _mm_storeu_ps(edge[i], e[i]);
+            }
+            if (_mm_movemask_ps(inside) == 0)
+                continue;
+            __m128 scale = _mm_set1_ps(inverseArea);
+            __m128 z = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(_mm_mul_ps(e[0], scale), _mm_set1_ps(s[0].z)),
+                _mm_mul_ps(_mm_mul_ps(e[1], scale), _mm_set1_ps(s[1].z))),
+                _mm_mul_ps(_mm_mul_ps(e[2], scale), _mm_set1_ps(s[2].z)));
+            inside = _mm_and_ps(inside, _mm_cmplt_ps(z, _mm_loadu_ps(stored)));
+            mask = _mm_movemask_ps(inside);
+            _mm_storeu_ps(depth, z);
+#else
+            for (int lane = 0; lane < 4; ++lane) {
+                float px = fx + LANE_X[lane];
+                float py = fy + LANE_Y[lane];
+                bool inside = px < limitX && py < limitY;
+                for (int i = 0; i < 3; ++i) {
+                    edge[i][lane] = A[i] * px + B[i] * py + C[i];
+                    inside = inside && (edge[i][lane] > 0.0f || (edge[i][lane] == 0.0f && includeZero[i]));
+                }
+                depth[lane] = edge[0][lane] * inverseArea * s[0].z + edge[1][lane] * inverseArea * s[1].z
+                    + edge[2][lane] * inverseArea * s[2].z;
+                if (inside && depth[lane] < stored[lane])
+                    mask |= 1 << lane;
+            }
+#endif
+            if (mask == 0)
+                continue;
+
+            float weights[4][3];
+            glm::vec2 uv[4];
+            float lod = 0.0f;
+            if (shade) {
+                // Perspective-correct weights for all four lanes; lanes outside the
+                // triangle still give the quad its texture derivatives
+                for (int lane = 0; lane < 4; ++lane) {
+                    float q[3];
+                    for (int i = 0; i < 3; ++i)
+                        q[i] = edge[i][lane] * triangle.inverseW[i];
+                    float sum = q[0] + q[1] + q[2];
+                    float inverseSum = sum != 0.0f ? 1.0f / sum : 0.0f;
+                    for (int i = 0; i < 3; ++i)
+                        weights[lane][i] = q[i] * inverseSum;
+                    uv[lane] = triangle.texCoord[0] * weights[lane][0] + triangle.texCoord[1] * weights[lane][1]
+                        + triangle.texCoord[2] * weights[lane][2];
+                }
+                if (draw->texture != nullptr) {
+                    glm::vec2 size(static_cast<float>(draw->texture->Width()), static_cast<float>(draw->texture->Height()));
+                    glm::vec2 dx = (uv[1] - uv[0]) * size;
+                    glm::vec2 dy = (uv[2] - uv[0]) * size;
+                    float rho = std::max(glm::length(dx), glm::length(dy));
+                    lod = rho > 0.0f ? std::log2(rho) : 0.0f;
+                }
+            }
+
+            for (int lane = 0; lane < 4; ++lane) {
+                if ((mask & (1 << lane)) == 0)
+                    continue;
+                size_t pixel = (lane < 2 ? row0 : row1) + (lane & 1);
+                target.depth[pixel] = depth[lane];
+                if (shade) {
+                    glm::vec3 color = Shade(triangle, weights[lane], uv[lane], lod, lights);
+                    uint8_t* out = target.color + pixel * 4;
+                    out[0] = ToUnorm8(color.r);
+                    out[1] = ToUnorm8(color.g);
+                    out[2] = ToUnorm8(color.b);
+                }
+                ++pixels;
+            }
+        }
+    }
+    return pixels;
+}
+
+// fragmentShaderSource and its lighting library, term for term
+glm::vec3 SoftRasterizer::Shade(const Triangle& triangle, const float weights[3], const glm::vec2& uv, float lod,
+    const std::vector<uint32_t>& lights) const {
+    const Draw& draw = mDraws[triangle.draw];
+    const SoftLighting& l = mLighting;
+    const glm::vec3 worldPos = triangle.world[0] * weights[0] + triangle.world[1] * weights[1] + triangle.world[2] * weights[2];
+    const glm::vec3 norm(0.0f, 1.0f, 0.0f);
+
+    glm::vec3 lightDir = glm::normalize(l.lightPosition - worldPos);
+    float diff = std::max(glm::dot(norm, lightDir), 0.0f);
+    glm::vec3 diffuse = l.lightDiffuseStrength * diff * l.lightColor;
+
+    glm::vec3 viewDir = glm::normalize(mCameraPosition - worldPos);
+    glm::vec3 reflectDir = glm::reflect(-lightDir, norm);
+    float spec = std::pow(std::max(glm::dot(viewDir, reflectDir), 0.0f), 128.0f);
+    glm::vec3 specular = l.lightSpecularStrength * spec * l.lightColor;
+
+    glm::vec3 ambient = l.lightAmbientStrength * l.lightColor;
+    glm::vec3 result = ambient + (diffuse + specular) * ShadowVisibility(worldPos, norm);
+
+    glm::vec3 spotlightDir = glm::normalize(l.spotlightPosition - worldPos);
+    float theta = glm::dot(spotlightDir, glm::normalize(-l.spotlightDirection));
+    float epsilon = l.spotlightCutOff - l.spotlightOuterCutOff;
+    float intensity = Clamp01((theta - l.spotlightOuterCutOff) / epsilon);
+    glm::vec3 spotlightEffect = intensity * (l.spotlightAmbientStrength * ambient + l.spotlightDiffuseStrength * diffuse
+        + l.spotlightSpecularStrength * specular) * l.spotlightColor;
+    result += spotlightEffect * intensity;
+
+    // Clustered lights; the tile list stands in for the cluster list
+    glm::vec3 clusterViewDir = glm::normalize(mCameraPosition - worldPos);
+    for (uint32_t index : lights) {
+        const ClusterLight& light = (*l.lights)[index];
+        glm::vec3 toLight = glm::vec3(light.positionRadius) - worldPos;
+        float dist = glm::length(toLight);
+        if (dist >= light.positionRadius.w)
+            continue;
+
+        glm::vec3 dir = toLight / std::max(dist, 1e-4f);
+        float window = Clamp01(1.0f - std::pow(dist / light.positionRadius.w, 4.0f));
+        float attenuation = window * window / (dist * dist + 1.0f);
+        if (light.directionCosOuter.w > -1.5f)
+            attenuation *= Smoothstep(light.directionCosOuter.w, light.spotParams.x, glm::dot(-dir, glm::vec3(light.directionCosOuter)));
+
+        float lightDiff = std::max(glm::dot(norm, dir), 0.0f);
+        float lightSpec = std::pow(std::max(glm::dot(clusterViewDir, glm::reflect(-dir, norm)), 0.0f), 32.0f);
+        result += (lightDiff + 0.5f * lightSpec) * attenuation * glm::vec3(light.colorIntensity) * light.colorIntensity.a;
+    }
+
+    glm::vec3 texel = draw.texture != nullptr ? draw.texture->Sample(uv, lod) : glm::vec3(1.0f);
+    if (draw.isPool)
+        return result * (glm::vec3(POOL_COLOR[0], POOL_COLOR[1], POOL_COLOR[2]) + (texel - glm::vec3(POOL_COLOR[0], POOL_COLOR[1], POOL_COLOR[2])) * 0.5f);
+    return result * texel;
+}
+
+// 3x3 PCF of bilinear depth comparisons, like sampler2DShadow with GL_LINEAR
+float SoftRasterizer::ShadowVisibility(const glm::vec3& worldPos, const glm::vec3& norm) const {
+    glm::vec4 clip = mShadowLightSpace * glm::vec4(worldPos + norm * 0.01f, 1.0f);
+    glm::vec3 coord = glm::vec3(clip) / clip.w * 0.5f + 0.5f;
+    if (coord.z > 1.0f)
+        return 1.0f;
+
+    const float reference = coord.z - 0.002f;
+    const int size = mShadowSize;
+    auto lit = [&](int x, int y) {
+        // Outside the map the border depth of 1 applies
+        if (x < 0 || y < 0 || x >= size || y >= size)
+            return reference <= 1.0f ? 1.0f : 0.0f;
+        return reference <= mShadowDepth[static_cast<size_t>(y) * size + x] ? 1.0f : 0.0f;
+    };
+
+    float total = 0.0f;
+    for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            float x = (coord.x + dx / static_cast<float>(size)) * size - 0.5f;
+            float y = (coord.y + dy / static_cast<float>(size)) * size - 0.5f;
+            float fx = std::floor(x), fy = std::floor(y);
+            int ix = static_cast<int>(fx), iy = static_cast<int>(fy);
+            float tx = x - fx, ty = y - fy;
+            float bottom = lit(ix, iy) + (lit(ix + 1, iy) - lit(ix, iy)) * tx;
+            float top = lit(ix, iy + 1) + (lit(ix + 1, iy + 1) - lit(ix, iy + 1)) * tx;
+            total += bottom + (top - bottom) * ty;
+        }
+    }
+    return total / 9.0f;
+}
@@ -0,0 +1,194 @@
+#ifndef SOFT_RASTERIZER_H
+#define SOFT_RASTERIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "light_clusters.h"
+
+// Geometry as the software rasterizer reads it: model-space positions and texture
+// coordinates, three indices per triangle
+struct SoftMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texCoords;
+    std::vector<uint32_t> indices;
+};
+
+// An 8-bit RGB texture with a box-filtered mip chain, sampled the way the GL path
+// samples its textures: GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR
+class SoftTexture {
+public:
+    // Rows bottom first, as they are uploaded to GL; channels beyond the third are ignored
+    void Create(const uint8_t* pixels, int width, int height, int channels);
+
+    int Width() const { return mLevels.empty() ? 0 : mLevels[0].width; }
+    int Height() const { return mLevels.empty() ? 0 : mLevels[0].height; }
+
+    // lod is log2 of the texel footprint of one pixel on level 0
+    glm::vec3 Sample(const glm::vec2& uv, float lod) const;
+
+private:
+    struct Level {
+        int width;
+        int height;
+        std::vector<uint8_t> texels;
+    };
+
+    glm::vec3 SampleLevel(const Level& level, const glm::vec2& uv) const;
+
+    std::vector<Level> mLevels;
+};
+
+// The forward shader's light, camera spotlight and shadow inputs
+struct SoftLighting {
+    glm::vec3 lightPosition = glm::vec3(0.0f);
+    glm::vec3 lightColor = glm::vec3(1.0f);
+    float lightAmbientStrength = 0.0f;
+    float lightDiffuseStrength = 0.0f;
+    float lightSpecularStrength = 0.0f;
+
+    glm::vec3 spotlightPosition = glm::vec3(0.0f);
+    glm::vec3 spotlightDirection = glm::vec3(0.0f, 0.0f, -1.0f);
+    glm::vec3 spotlightColor = glm::vec3(1.0f);
+    float spotlightCutOff = 1.0f;
+    float spotlightOuterCutOff = 1.0f;
+    float spotlightAmbientStrength = 0.0f;
+    float spotlightDiffuseStrength = 0.0f;
+    float spotlightSpecularStrength = 0.0f;
+
+    glm::mat4 lightSpace = glm::mat4(1.0f);
+    const std::vector<ClusterLight>* lights = nullptr;
+};
+
+// CPU renderer for the courtyard, producing what the forward shader produces. Each pass
+// transforms, clips and sets up triangles on the worker pool, binning them into
+// TILE_SIZE square screen tiles; the tiles are then rasterized in parallel, each one by
+// a single thread, so no two threads ever touch the same pixel. Edge functions are
+// evaluated for a 2x2 pixel quad at a time (SSE2 where available, scalar otherwise),
+// which also gives the texture derivatives a GPU would compute. Triangles keep their
+// submission order within a tile and depth is tested with GL_LESS, so ties resolve as
+// on the GPU. The shadow map is rendered by the same depth-only pipeline and cached
+// until a caster or the light moves, like ShadowCache.
+class SoftRasterizer {
+public:
+    static const int TILE_SIZE = 64;
+
+    struct Stats {
+        size_t draws = 0;
+        size_t triangles = 0;           // triangles set up for the colour pass, after clipping
+        size_t trianglesBinned = 0;     // triangle-tile pairs rasterized
+        size_t pixelsShaded = 0;
+        size_t shadowTriangles = 0;     // zero when the cached shadow map was reused
+        double setupMs = 0.0;
+        double rasterMs = 0.0;
+        double shadowMs = 0.0;
+    };
+
+    void Resize(int width, int height);
+
+    // Threads the passes spread over, the caller included; 0 uses the whole worker pool
+    void SetThreadCount(unsigned threads) { mThreadCount = threads; }
+    unsigned ThreadCount() const;
+
+    void SetShadowMapSize(int size) { mShadowSize = size; }
+
+    // Starts a frame; draws and shadow casters added after this are rendered by Render()
+    void BeginFrame(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition,
+        const SoftLighting& lighting);
+    void AddDraw(const SoftMesh& mesh, const glm::mat4& model, const SoftTexture* texture, bool isPool);
+
+    // version changes whenever a caster moves; the shadow map is kept while it and the
+    // light stay the same
+    void AddShadowCaster(const SoftMesh& mesh, const glm::mat4& model);
+    void SetShadowVersion(uint64_t version) { mShadowVersion = version; }
+    void InvalidateShadows() { mShadowValid = false; }
+    // Whether Render() will redraw the shadow map; after BeginFrame(), SetShadowVersion()
+    // and InvalidateShadows(), casters only need adding when it will
+    bool ShadowsStale() const;
+
+    void Render();
+
+    int Width() const { return mWidth; }
+    int Height() const { return mHeight; }
+
+    // RGBA8, rows bottom first as glReadPixels returns them
+    const std::vector<uint8_t>& Color() const { return mColor; }
+
+    const Stats& GetStats() const { return mStats; }
+
+private:
+    struct Draw {
+        const SoftMesh* mesh;
+        glm::mat4 model;
+        const SoftTexture* texture;
+        bool isPool;
+    };
+
+    // One triangle after clipping and viewport transform, oriented counter-clockwise
+    struct Triangle {
+        glm::vec3 screen[3];        // window x, y and depth
+        float inverseW[3];
+        glm::vec2 texCoord[3];
+        glm::vec3 world[3];
+        uint32_t draw;
+    };
+
+    // Triangles set up by one job, and per tile the ones that touch it
+    struct Bin {
+        std::vector<Triangle> triangles;
+        std::vector<std::vector<uint32_t> > tiles;
+    };
+
+    struct ClipVertex;
+
+    struct Target {
+        int width;
+        int height;
+        int tilesX;
+        int tilesY;
+        float* depth;
+        uint8_t* color;             // null for depth-only passes
+    };
+
+    void RunPass(const std::vector<Draw>& draws, const glm::mat4& viewProjection, const Target& target, bool shade);
+    void SetupDraws(const std::vector<Draw>& draws, size_t begin, size_t end, const glm::mat4& viewProjection,
+        const Target& target, bool shade, Bin& bin) const;
+    void EmitTriangle(const ClipVertex* vertices, uint32_t draw, const Target& target, Bin& bin) const;
+    size_t RasterizeTile(const Target& target, int tile, bool shade) const;
+    size_t RasterizeTriangle(const Target& target, const Triangle& triangle, int x0, int y0, int x1, int y1,
+        bool shade, const std::vector<uint32_t>& lights) const;
+    glm::vec3 Shade(const Triangle& triangle, const float weights[3], const glm::vec2& uv, float lod,
+        const std::vector<uint32_t>& lights) const;
+    float ShadowVisibility(const glm::vec3& worldPos, const glm::vec3& norm) const;
+    void BuildLightRects();
+
+    int mWidth = 0;
+    int mHeight = 0;
+    unsigned mThreadCount = 0;
+    std::vector<uint8_t> mColor;
+    std::vector<float> mDepth;
+
+    glm::mat4 mView = glm::mat4(1.0f);
+    glm::mat4 mProjection = glm::mat4(1.0f);
+    glm::vec3 mCameraPosition = glm::vec3(0.0f);
+    SoftLighting mLighting;
+    std::vector<Draw> mDraws;
+    std::vector<Draw> mCasters;
+    std::vector<Bin> mBins;
+    size_t mActiveBins = 0;
+    std::vector<glm::ivec4> mLightRects;    // screen pixels each extra light can reach
+
+    int mShadowSize = 2048;
+    std::vector<float> mShadowDepth;
+    bool mShadowValid = false;
+    uint64_t mShadowVersion = 0;
+    uint64_t mShadowRenderedVersion = 0;
+    glm::mat4 mShadowLightSpace = glm::mat4(1.0f);
+
+    Stats mStats;
+};
+
+#endif
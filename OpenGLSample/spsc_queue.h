@@ -0,0 +1,41 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Head and tail only ever grow; a slot is index % Capacity. The producer publishes a
+// slot with a release store of the tail and the consumer frees it with a release
+// store of the head, so neither side ever blocks the other.
+template <typename T, size_t Capacity>
+class SpscQueue {
+public:
+    // Producer only. Returns false when the queue is full.
+    bool TryPush(const T& value) {
+        size_t tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mHead.load(std::memory_order_acquire) == Capacity)
+            return false;
+        mSlots[tail % Capacity] = value;
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false when the queue is empty.
+    bool TryPop(T& value) {
+        size_t head = mHead.load(std::memory_order_relaxed);
+        if (head == mTail.load(std::memory_order_acquire))
+            return false;
+        value = mSlots[head % Capacity];
+        mHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T mSlots[Capacity];
+    // Kept on separate cache lines so the two threads do not false-share
+    alignas(64) std::atomic<size_t> mHead{ 0 };   // advanced by the consumer
+    alignas(64) std::atomic<size_t> mTail{ 0 };   // advanced by the producer
+};
+
+#endif
@@ -0,0 +1,108 @@
+#include "stress_scene.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtx/transform.hpp>
+
+using namespace std;
+
+namespace {
+    const int MIN_TABLES = 2;
+    const int MAX_TABLES = 10;
+
+    class Random {
+    public:
+        explicit Random(uint32_t seed) : mState(seed) {}
+
+        float Next01() {
+            mState = mState * 1664525u + 1013904223u;
+            return static_cast<float>(mState >> 8) / 16777216.0f;
+        }
+
+        float Range(float low, float high) { return low + (high - low) * Next01(); }
+
+        uint32_t Below(uint32_t count) {
+            return min(static_cast<uint32_t>(Next01() * count), count - 1);
+        }
+
+    private:
+        uint32_t mState;
+    };
+
+    // Picks one of the mesh variants belonging to a kind
+    uint32_t PickMesh(Random& random, StressObjectKind kind, size_t uniqueMeshes) {
+        uint32_t variantsOfKind = static_cast<uint32_t>((uniqueMeshes - kind + STRESS_KIND_COUNT - 1) / STRESS_KIND_COUNT);
+        return kind + STRESS_KIND_COUNT * random.Below(variantsOfKind);
+    }
+}
+
+StressSceneInfo UGenerateStressScene(const StressSceneSettings& settings,
+    const std::function<void(const StressObject&)>& emit) {
+    StressSceneInfo info;
+    if (settings.objects == 0)
+        return info;
+
+    const size_t uniqueMeshes = max(settings.uniqueMeshes, static_cast<size_t>(STRESS_KIND_COUNT));
+    const uint32_t uniqueTextures = static_cast<uint32_t>(max(settings.uniqueTextures, size_t(1)));
+
+    // Enough grid cells for the worst case of every courtyard holding MIN_TABLES tables
+    const size_t maxCourtyards = (settings.objects + MIN_TABLES + 1) / (MIN_TABLES + 2);
+    const int side = static_cast<int>(ceil(sqrt(static_cast<double>(maxCourtyards))));
+    const int origin = (side - 1) / 2;
+
+    Random random(settings.seed);
+    info.boundsMin = glm::vec3(1e30f);
+    info.boundsMax = glm::vec3(-1e30f);
+    for (int cell = 0; info.objects < settings.objects; ++cell) {
+        int gridX = cell % side - origin;
+        int gridZ = cell / side - origin;
+        glm::vec3 center(gridX * STRESS_COURTYARD_SPACING, 0.0f, gridZ * STRESS_COURTYARD_SPACING);
+
+        // Quarter turns keep the walkway square on the grid
+        float turn = 90.0f * random.Below(4);
+        float scale = random.Range(0.85f, 1.15f);
+        glm::mat4 courtyard = glm::translate(center) * glm::rotate(glm::radians(turn), glm::vec3(0.0f, 1.0f, 0.0f))
+            * glm::scale(glm::vec3(scale));
+        uint32_t walkwayTexture = random.Below(uniqueTextures);
+
+        StressObject object;
+        object.model = courtyard * glm::translate(glm::vec3(0.0f, -0.5f, 0.0f));
+        object.kind = STRESS_POOL;
+        object.meshVariant = PickMesh(random, STRESS_POOL, uniqueMeshes);
+        object.textureVariant = 0;
+        emit(object);
+        ++info.objects;
+
+        object.kind = STRESS_WALKWAY;
+        object.meshVariant = PickMesh(random, STRESS_WALKWAY, uniqueMeshes);
+        object.textureVariant = walkwayTexture;
+        if (info.objects < settings.objects) {
+            emit(object);
+            ++info.objects;
+        }
+
+        // Tables line the two long sides, like the hand-built courtyard
+        int tables = MIN_TABLES + static_cast<int>(random.Below(MAX_TABLES - MIN_TABLES + 1));
+        for (int i = 0; i < tables && info.objects < settings.objects; ++i) {
+            float x = (i % 2 == 0) ? 1.4f : -1.4f;
+            glm::vec3 position(x + random.Range(-0.1f, 0.1f), -0.4f, random.Range(-1.0f, 1.0f));
+            float tableScale = random.Range(0.15f, 0.25f);
+            object.model = courtyard * glm::translate(position)
+                * glm::rotate(glm::radians(random.Range(0.0f, 90.0f)), glm::vec3(0.0f, 1.0f, 0.0f))
+                * glm::scale(glm::vec3(tableScale));
+            object.kind = STRESS_TABLE;
+            object.meshVariant = PickMesh(random, STRESS_TABLE, uniqueMeshes);
+            object.textureVariant = random.Below(uniqueTextures);
+            emit(object);
+            ++info.objects;
+        }
+
+        // Walkway corners at the largest scale, plus room for the tables
+        const float reach = 1.6f * 1.15f;
+        info.boundsMin = glm::min(info.boundsMin, center - glm::vec3(reach, 0.6f, reach));
+        info.boundsMax = glm::max(info.boundsMax, center + glm::vec3(reach, 0.2f, reach));
+        ++info.courtyards;
+    }
+    return info;
+}
@@ -0,0 +1,51 @@
+#ifndef STRESS_SCENE_H
+#define STRESS_SCENE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include <glm/glm.hpp>
+
+// Procedural scenes for scaling benchmarks: copies of the courtyard (pool, walkway and
+// a varying set of tables) tiled on a square grid, each rotated, scaled and furnished
+// differently from a seeded generator. The generator only decides where things go;
+// objects are streamed to a callback one at a time, so a ten-million-object layout
+// never has to exist as a list.
+enum StressObjectKind : uint32_t {
+    STRESS_POOL,
+    STRESS_WALKWAY,
+    STRESS_TABLE,
+    STRESS_KIND_COUNT
+};
+
+struct StressSceneSettings {
+    size_t objects = 0;         // total objects, courtyards included; the last courtyard is cut short
+    size_t uniqueMeshes = 3;    // mesh variants, shared round-robin between the three kinds; at least 3
+    size_t uniqueTextures = 1;  // texture variants for walkways and tables; pools keep the water
+    uint32_t seed = 2024u;
+};
+
+struct StressObject {
+    glm::mat4 model;
+    StressObjectKind kind;
+    uint32_t meshVariant;       // in [0, uniqueMeshes); variant % STRESS_KIND_COUNT == kind
+    uint32_t textureVariant;    // in [0, uniqueTextures)
+};
+
+struct StressSceneInfo {
+    size_t courtyards = 0;
+    size_t objects = 0;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+};
+
+// Distance between courtyard centres; the walkway is 2.4 wide and tables stand just outside it
+const float STRESS_COURTYARD_SPACING = 4.0f;
+
+// Calls emit for every object, in courtyard order. The first courtyard is centred on
+// the origin, where the default camera looks; the grid grows from there.
+StressSceneInfo UGenerateStressScene(const StressSceneSettings& settings,
+    const std::function<void(const StressObject&)>& emit);
+
+#endif
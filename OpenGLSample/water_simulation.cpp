@@ -0,0 +1,307 @@
+#include "water_simulation.h"
+#include "cpu_profiler.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WATER_SSE 1
+#include <emmintrin.h>
+#else
+#define WATER_SSE 0
+#endif
+
+using namespace std;
+
+const float WaterSimulation::SETTLE_HEIGHT = 1e-5f;
+
+namespace {
+    // Rows per worker chunk; a row of the default grid is about a microsecond of work
+    const size_t ROWS_PER_CHUNK = 16;
+
+    WaterRect Union(const WaterRect& a, const WaterRect& b) {
+        if (a.Empty())
+            return b;
+        if (b.Empty())
+            return a;
+        WaterRect rect;
+        rect.x = min(a.x, b.x);
+        rect.y = min(a.y, b.y);
+        rect.width = max(a.x + a.width, b.x + b.width) - rect.x;
+        rect.height = max(a.y + a.height, b.y + b.height) - rect.y;
+        return rect;
+    }
+
+    // Grows rect by border texels, clamped to the grid, with x widened to whole groups of 4
+    WaterRect Expand(const WaterRect& rect, int border, int resolution) {
+        if (rect.Empty())
+            return rect;
+        int x0 = max(0, rect.x - border) & ~3;
+        int y0 = max(0, rect.y - border);
+        int x1 = min(resolution, (rect.x + rect.width + border + 3) & ~3);
+        int y1 = min(resolution, rect.y + rect.height + border);
+        WaterRect expanded;
+        expanded.x = x0;
+        expanded.y = y0;
+        expanded.width = x1 - x0;
+        expanded.height = y1 - y0;
+        return expanded;
+    }
+}
+
+void WaterSimulation::Create(const Settings& settings) {
+    mSettings = settings;
+    mSettings.resolution = max(4, (settings.resolution + 3) & ~3);
+    mSettings.maxStepsPerAdvance = max(1, settings.maxStepsPerAdvance);
+
+    int resolution = mSettings.resolution;
+    mStride = resolution + 2;
+    mCurrent.assign(static_cast<size_t>(mStride) * mStride, 0.0f);
+    mPrevious.assign(mCurrent.size(), 0.0f);
+    mTexels.assign(static_cast<size_t>(resolution) * resolution, glm::vec4(0.0f, 1.0f, 0.0f, 0.0f));
+    mRowActivity.assign(resolution, glm::ivec2(resolution, -1));
+    mDirty = WaterRect();
+
+    mAccumulator = 0.0;
+    mDropAccumulator = 0.0f;
+    mRandom = settings.seed;
+    mQueued.clear();
+    mPendingDisturbances.clear();
+    mPendingSteps = 0;
+    mStats = Stats();
+}
+
+void WaterSimulation::Disturb(const WaterDisturbance& disturbance) {
+    mQueued.push_back(disturbance);
+}
+
+int WaterSimulation::Advance(double seconds) {
+    mAccumulator += seconds;
+    int steps = 0;
+    while (mAccumulator >= mSettings.stepSeconds && steps < mSettings.maxStepsPerAdvance) {
+        mAccumulator -= mSettings.stepSeconds;
+        Step();
+        ++steps;
+    }
+
+    // After a stall the backlog is dropped rather than replayed over the next frames
+    if (mAccumulator >= mSettings.stepSeconds)
+        mAccumulator = fmod(mAccumulator, mSettings.stepSeconds);
+    return steps;
+}
+
+void WaterSimulation::QueueRain() {
+    auto random01 = [this]() {
+        mRandom = mRandom * 1664525u + 1013904223u;
+        return static_cast<float>(mRandom >> 8) / 16777216.0f;
+    };
+
+    mDropAccumulator += mSettings.dropsPerSecond * static_cast<float>(mSettings.stepSeconds);
+    while (mDropAccumulator >= 1.0f) {
+        mDropAccumulator -= 1.0f;
+        float radius = mSettings.dropRadius;
+        WaterDisturbance drop;
+        drop.uv = glm::vec2(radius + (1.0f - 2.0f * radius) * random01(), radius + (1.0f - 2.0f * radius) * random01());
+        drop.radius = radius;
+        drop.strength = mSettings.dropStrength * (0.5f + 0.5f * random01());
+        drop.step = 0;
+        mQueued.push_back(drop);
+    }
+}
+
+void WaterSimulation::Step() {
+    PROFILE_ZONE("WaterStep");
+    QueueRain();
+    ++mStats.steps;
+    mStats.disturbances += mQueued.size();
+
+    if (!mSettings.simulate) {
+        for (WaterDisturbance& disturbance : mQueued) {
+            disturbance.step = static_cast<uint32_t>(mPendingSteps);
+            mPendingDisturbances.push_back(disturbance);
+        }
+        mQueued.clear();
+        ++mPendingSteps;
+        return;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    int resolution = mSettings.resolution;
+
+    // Disturbed cells change height even where the step happens to leave them alone
+    WaterRect changed;
+    for (const WaterDisturbance& disturbance : mQueued) {
+        ApplyDisturbance(disturbance);
+        float extent = disturbance.radius * resolution;
+        WaterRect rect;
+        rect.x = static_cast<int>(floor(disturbance.uv.x * resolution - extent));
+        rect.y = static_cast<int>(floor(disturbance.uv.y * resolution - extent));
+        rect.width = static_cast<int>(ceil(2.0f * extent)) + 2;
+        rect.height = rect.width;
+        changed = Union(changed, Expand(rect, 0, resolution));
+    }
+    mQueued.clear();
+
+    UParallelFor(resolution, ROWS_PER_CHUNK, [this](size_t begin, size_t end) { StepRows(begin, end); });
+    mCurrent.swap(mPrevious);
+
+    for (int y = 0; y < resolution; ++y) {
+        glm::ivec2 activity = mRowActivity[y];
+        if (activity.y < activity.x)
+            continue;
+        WaterRect row;
+        row.x = activity.x;
+        row.y = y;
+        row.width = activity.y - activity.x + 1;
+        row.height = 1;
+        changed = Union(changed, row);
+    }
+
+    // A texel's normal depends on its neighbours' heights
+    WaterRect rect = Expand(changed, 1, resolution);
+    if (!rect.Empty()) {
+        UParallelFor(rect.height, ROWS_PER_CHUNK, [this, &rect](size_t begin, size_t end) {
+            UpdateNormals(rect, rect.y + begin, rect.y + end);
+        });
+        mDirty = Union(mDirty, rect);
+    }
+
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    mStats.stepMs += ms;
+    mStats.maxStepMs = max(mStats.maxStepMs, ms);
+}
+
+void WaterSimulation::ApplyDisturbance(const WaterDisturbance& disturbance) {
+    const float pi = 3.14159265f;
+    int resolution = mSettings.resolution;
+    float radius = disturbance.radius * resolution;
+    glm::vec2 centre = disturbance.uv * static_cast<float>(resolution);
+    int x0 = max(0, static_cast<int>(floor(centre.x - radius)));
+    int y0 = max(0, static_cast<int>(floor(centre.y - radius)));
+    int x1 = min(resolution - 1, static_cast<int>(ceil(centre.x + radius)));
+    int y1 = min(resolution - 1, static_cast<int>(ceil(centre.y + radius)));
+
+    for (int y = y0; y <= y1; ++y) {
+        float* row = &mCurrent[static_cast<size_t>(y + 1) * mStride + 1];
+        for (int x = x0; x <= x1; ++x) {
+            // Same cell centres as the compute shader
+            float distance = glm::length(glm::vec2(x + 0.5f, y + 0.5f) - centre);
+            if (distance < radius)
+                row[x] += disturbance.strength * 0.5f * (1.0f + cos(pi * distance / radius));
+        }
+    }
+}
+
+void WaterSimulation::StepRows(size_t begin, size_t end) {
+    const int resolution = mSettings.resolution;
+    const float damping = mSettings.damping;
+
+    for (size_t y = begin; y < end; ++y) {
+        const float* current = &mCurrent[(y + 1) * mStride + 1];
+        const float* above = current + mStride;
+        const float* below = current - mStride;
+        float* next = &mPrevious[(y + 1) * mStride + 1];   // holds the previous heights until overwritten
+        int first = resolution, last = -1;
+
+#if WATER_SSE
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 scale = _mm_set1_ps(damping);
+        const __m128 settle = _mm_set1_ps(SETTLE_HEIGHT);
+        const __m128 signBit = _mm_set1_ps(-0.0f);
+        for (int x = 0; x < resolution; x += 4) {
+            __m128 centre = _mm_loadu_ps(current + x);
+            __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(current + x - 1), _mm_loadu_ps(current + x + 1)),
+                _mm_add_ps(_mm_loadu_ps(above + x), _mm_loadu_ps(below + x)));
+            __m128 height = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(sum, half), _mm_loadu_ps(next + x)), scale);
+            height = _mm_and_ps(height, _mm_cmpge_ps(_mm_andnot_ps(signBit, height), settle));
+            _mm_storeu_ps(next + x, height);
+            if (_mm_movemask_ps(_mm_cmpneq_ps(height, centre)) != 0) {
+                first = min(first, x);
+                last = x + 3;
+            }
+        }
+#else
+        for (int x = 0; x < resolution; ++x) {
+            float sum = current[x - 1] + current[x + 1] + above[x] + below[x];
+            float height = (sum * 0.5f - next[x]) * damping;
+            if (fabs(height) < SETTLE_HEIGHT)
+                height = 0.0f;
+            next[x] = height;
+            if (height != current[x]) {
+                first = min(first, x);
+                last = x;
+            }
+        }
+#endif
+        mRowActivity[y] = glm::ivec2(first, last);
+    }
+}
+
+void WaterSimulation::UpdateNormals(const WaterRect& rect, size_t begin, size_t end) {
+    const float twoCells = 2.0f * CellSize();
+    const int x0 = rect.x, x1 = rect.x + rect.width;
+    const int resolution = mSettings.resolution;
+
+    // Central differences, with +y up and rows running along +z
+    for (size_t y = begin; y < end; ++y) {
+        const float* heights = &mCurrent[(y + 1) * mStride + 1];
+        const float* above = heights + mStride;
+        const float* below = heights - mStride;
+        glm::vec4* texels = &mTexels[y * resolution];
+
+#if WATER_SSE
+        const __m128 up = _mm_set1_ps(twoCells);
+        const __m128 one = _mm_set1_ps(1.0f);
+        for (int x = x0; x < x1; x += 4) {
+            __m128 nx = _mm_sub_ps(_mm_loadu_ps(heights + x - 1), _mm_loadu_ps(heights + x + 1));
+            __m128 ny = up;
+            __m128 nz = _mm_sub_ps(_mm_loadu_ps(below + x), _mm_loadu_ps(above + x));
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+            __m128 inverse = _mm_div_ps(one, length);
+            nx = _mm_mul_ps(nx, inverse);
+            ny = _mm_mul_ps(ny, inverse);
+            nz = _mm_mul_ps(nz, inverse);
+            __m128 h = _mm_loadu_ps(heights + x);
+
+            // Four cells' components to four texels
+            _MM_TRANSPOSE4_PS(nx, ny, nz, h);
+            float* out = &texels[x].x;
+            _mm_storeu_ps(out, nx);
+            _mm_storeu_ps(out + 4, ny);
+            _mm_storeu_ps(out + 8, nz);
+            _mm_storeu_ps(out + 12, h);
+        }
+#else
+        for (int x = x0; x < x1; ++x) {
+            glm::vec3 normal(heights[x - 1] - heights[x + 1], twoCells, below[x] - above[x]);
+            texels[x] = glm::vec4(glm::normalize(normal), heights[x]);
+        }
+#endif
+    }
+}
+
+WaterRect WaterSimulation::TakeDirty(vector<glm::vec4>& texels) {
+    WaterRect rect = mDirty;
+    mDirty = WaterRect();
+    texels.clear();
+    if (rect.Empty())
+        return rect;
+
+    texels.resize(static_cast<size_t>(rect.width) * rect.height);
+    for (int y = 0; y < rect.height; ++y) {
+        const glm::vec4* source = &mTexels[static_cast<size_t>(rect.y + y) * mSettings.resolution + rect.x];
+        copy(source, source + rect.width, &texels[static_cast<size_t>(y) * rect.width]);
+    }
+    mStats.texelsChanged += texels.size();
+    return rect;
+}
+
+size_t WaterSimulation::TakeSteps(vector<WaterDisturbance>& disturbances) {
+    disturbances.swap(mPendingDisturbances);
+    mPendingDisturbances.clear();
+    size_t steps = mPendingSteps;
+    mPendingSteps = 0;
+    return steps;
+}
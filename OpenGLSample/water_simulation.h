@@ -0,0 +1,108 @@
+#ifndef WATER_SIMULATION_H
+#define WATER_SIMULATION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// A push on the water: a cosine-shaped bump added to the heights before a step
+struct WaterDisturbance {
+    glm::vec2 uv;           // centre, in surface texture coordinates
+    float radius;           // in texture coordinates
+    float strength;         // height added at the centre, in world units
+    uint32_t step;          // step it applies before, counted from the last TakeSteps()
+};
+
+// Texels of the surface texture, x and y in texels
+struct WaterRect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+
+    bool Empty() const { return width <= 0 || height <= 0; }
+};
+
+// Heightfield wave simulation for the pool surface. Each fixed step solves the damped
+// wave equation on a square grid (next = (sum of 4 neighbours / 2 - previous) * damping)
+// with still water beyond the edges. Rows are spread over the worker pool and each row
+// is updated four cells at a time with SSE2. Heights that decay below a threshold are
+// flushed to zero, so a calm surface stops changing; only the texels around cells that
+// moved get new normals, and only those are handed to the renderer.
+// Steps run at their own fixed rate whatever the frame rate. Disturbances come from
+// Disturb() and from simulated rain. With simulate off, the grid is left to the GPU:
+// steps and disturbances are only counted and queued for TakeSteps().
+class WaterSimulation {
+public:
+    struct Settings {
+        int resolution = 256;               // rounded up to a multiple of 4
+        float extent = 2.0f;                // world size of the surface's side
+        double stepSeconds = 1.0 / 60.0;
+        int maxStepsPerAdvance = 4;         // catch-up cap after a stall
+        float damping = 0.985f;
+        float dropsPerSecond = 3.0f;
+        float dropRadius = 0.03f;
+        float dropStrength = 0.006f;
+        uint32_t seed = 1u;
+        bool simulate = true;
+    };
+
+    struct Stats {
+        size_t steps = 0;
+        size_t disturbances = 0;
+        double stepMs = 0.0;                // total
+        double maxStepMs = 0.0;
+        size_t texelsChanged = 0;           // summed over TakeDirty() rectangles
+    };
+
+    // Heights below this are flushed to zero
+    static const float SETTLE_HEIGHT;
+
+    void Create(const Settings& settings);
+
+    // Queues a disturbance for the next step; its step field is ignored
+    void Disturb(const WaterDisturbance& disturbance);
+
+    // Runs the steps due after seconds more of simulated time; returns how many ran
+    int Advance(double seconds);
+
+    // Texels changed since the last call, packed row by row, bottom row first: normal
+    // in xyz, height in w. Returns an empty rectangle when nothing changed.
+    WaterRect TakeDirty(std::vector<glm::vec4>& texels);
+
+    // With simulate off: steps queued since the last call, and their disturbances
+    size_t TakeSteps(std::vector<WaterDisturbance>& disturbances);
+
+    int Resolution() const { return mSettings.resolution; }
+    float CellSize() const { return mSettings.extent / mSettings.resolution; }
+    const Settings& GetSettings() const { return mSettings; }
+    const Stats& GetStats() const { return mStats; }
+
+private:
+    void QueueRain();
+    void Step();
+    void ApplyDisturbance(const WaterDisturbance& disturbance);
+    void StepRows(size_t begin, size_t end);
+    void UpdateNormals(const WaterRect& rect, size_t begin, size_t end);
+
+    Settings mSettings;
+    int mStride = 0;                        // padded row length; a ring of zero cells surrounds the grid
+    std::vector<float> mCurrent;
+    std::vector<float> mPrevious;           // overwritten with the next heights each step
+    std::vector<glm::vec4> mTexels;
+    std::vector<glm::ivec2> mRowActivity;   // per row, first and last column that moved this step
+    WaterRect mDirty;
+
+    double mAccumulator = 0.0;
+    float mDropAccumulator = 0.0f;
+    uint32_t mRandom = 1u;
+    std::vector<WaterDisturbance> mQueued;  // for the next step
+    std::vector<WaterDisturbance> mPendingDisturbances;
+    size_t mPendingSteps = 0;
+
+    Stats mStats;
+};
+
+#endif
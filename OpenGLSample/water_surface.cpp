@@ -0,0 +1,161 @@
+#include "water_surface.h"
+#include "gl_trace.h"
+
+#include <algorithm>
+
+using namespace std;
+
+const GLuint WaterSurface::TEXTURE_UNIT;
+const int WaterSurface::LOCAL_SIZE;
+const size_t WaterSurface::MAX_DISTURBANCES;
+
+namespace {
+    // Values of the compute shader's waterPass uniform
+    enum WaterPass {
+        PASS_DISTURB = 0,
+        PASS_STEP = 1,
+        PASS_SURFACE = 2
+    };
+
+    GLuint CreateTexture(GLenum internalFormat, int resolution, GLenum format, const void* data) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, resolution, resolution);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, resolution, resolution, format, GL_FLOAT, data);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+}
+
+bool WaterSurface::Create(int resolution, bool compute) {
+    Destroy();
+    mResolution = resolution;
+
+    // Still water: straight up, zero height
+    vector<glm::vec4> flat(static_cast<size_t>(resolution) * resolution, glm::vec4(0.0f, 1.0f, 0.0f, 0.0f));
+    mTexture = CreateTexture(GL_RGBA16F, resolution, GL_RGBA, flat.data());
+    if (compute) {
+        vector<float> zero(flat.size(), 0.0f);
+        for (GLuint& heights : mHeights)
+            heights = CreateTexture(GL_R32F, resolution, GL_RED, zero.data());
+        glGenQueries(2, mTimers);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    mCurrent = 0;
+    mTimerSteps = 0;
+    mStats = Stats();
+    return glGetError() == GL_NO_ERROR;
+}
+
+void WaterSurface::Destroy() {
+    if (mTexture != 0)
+        glDeleteTextures(1, &mTexture);
+    if (mHeights[0] != 0)
+        glDeleteTextures(2, mHeights);
+    if (mTimers[0] != 0)
+        glDeleteQueries(2, mTimers);
+    mTexture = mHeights[0] = mHeights[1] = mTimers[0] = mTimers[1] = 0;
+    mResolution = 0;
+}
+
+void WaterSurface::Upload(const WaterRect& rect, const vector<glm::vec4>& texels) {
+    if (mTexture == 0 || rect.Empty())
+        return;
+
+    glBindTexture(GL_TEXTURE_2D, mTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.width, rect.height, GL_RGBA, GL_FLOAT, texels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    ++mStats.uploads;
+    mStats.texelsUploaded += texels.size();
+}
+
+void WaterSurface::Simulate(GLuint programId, size_t steps, const vector<WaterDisturbance>& disturbances,
+    float damping, float cellSize) {
+    if (mHeights[0] == 0 || steps == 0)
+        return;
+
+    CollectTiming();
+    bool timed = mTimerSteps == 0;
+    if (timed)
+        glQueryCounter(mTimers[0], GL_TIMESTAMP);
+
+    glUseProgram(programId);
+    glUniform1i(glGetUniformLocation(programId, "resolution"), mResolution);
+    glUniform1f(glGetUniformLocation(programId, "damping"), damping);
+    glUniform1f(glGetUniformLocation(programId, "cellSize"), cellSize);
+    glUniform1f(glGetUniformLocation(programId, "settleHeight"), WaterSimulation::SETTLE_HEIGHT);
+    GLint disturbanceLoc = glGetUniformLocation(programId, "disturbances");
+    GLint countLoc = glGetUniformLocation(programId, "disturbanceCount");
+
+    size_t next = 0;
+    for (size_t step = 0; step < steps; ++step) {
+        glBindImageTexture(0, mHeights[mCurrent], 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+        glBindImageTexture(1, mHeights[1 - mCurrent], 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+
+        while (next < disturbances.size() && disturbances[next].step <= step) {
+            glm::vec4 batch[MAX_DISTURBANCES];
+            GLsizei count = 0;
+            for (; next < disturbances.size() && disturbances[next].step <= step && count < static_cast<GLsizei>(MAX_DISTURBANCES); ++next) {
+                const WaterDisturbance& disturbance = disturbances[next];
+                batch[count++] = glm::vec4(disturbance.uv.x, disturbance.uv.y, disturbance.radius, disturbance.strength);
+            }
+            glUniform4fv(disturbanceLoc, count, &batch[0].x);
+            glUniform1i(countLoc, count);
+            Dispatch(programId, PASS_DISTURB);
+        }
+
+        // Writes the next heights over the previous ones
+        Dispatch(programId, PASS_STEP);
+        mCurrent = 1 - mCurrent;
+    }
+
+    glBindImageTexture(0, mHeights[mCurrent], 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+    glBindImageTexture(2, mTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    Dispatch(programId, PASS_SURFACE);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    if (timed) {
+        glQueryCounter(mTimers[1], GL_TIMESTAMP);
+        mTimerSteps = steps;
+    }
+    mStats.gpuSteps += steps;
+}
+
+void WaterSurface::Dispatch(GLuint programId, int pass) {
+    GLuint groups = static_cast<GLuint>((mResolution + LOCAL_SIZE - 1) / LOCAL_SIZE);
+    glUniform1i(glGetUniformLocation(programId, "waterPass"), pass);
+    glDispatchCompute(groups, groups, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+void WaterSurface::CollectTiming() {
+    if (mTimerSteps == 0)
+        return;
+
+    GLint available = 0;
+    glGetQueryObjectiv(mTimers[1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return;
+
+    GLuint64 begin = 0, end = 0;
+    glGetQueryObjectui64v(mTimers[0], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(mTimers[1], GL_QUERY_RESULT, &end);
+    mStats.gpuMs += (end - begin) / 1e6;
+    mStats.timedSteps += mTimerSteps;
+    mTimerSteps = 0;
+}
+
+void WaterSurface::Bind(GLuint programId) const {
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, mTexture);
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(glGetUniformLocation(programId, "waterTexture"), TEXTURE_UNIT);
+    glUniform1i(glGetUniformLocation(programId, "hasWater"), mTexture != 0 ? GL_TRUE : GL_FALSE);
+}
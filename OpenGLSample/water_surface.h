@@ -0,0 +1,62 @@
+#ifndef WATER_SURFACE_H
+#define WATER_SURFACE_H
+
+#include "water_simulation.h"
+
+#include <cstddef>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// The pool water's texture: normal in xyz, height in w, one texel per simulation cell.
+// The CPU simulation's changed texels arrive through Upload(), which replaces just that
+// rectangle with glTexSubImage2D. Created for compute, the grid lives here instead:
+// heights ping-pong between two R32F images and Simulate() runs the steps with a
+// compute program using the same rules as WaterSimulation, then rewrites the texture.
+// GPU step cost is measured with a pair of timestamp queries read back on a later
+// call, never waited for.
+class WaterSurface {
+public:
+    static const GLuint TEXTURE_UNIT = 6;
+    static const int LOCAL_SIZE = 8;                // compute work group side, as in the shader
+    static const size_t MAX_DISTURBANCES = 16;      // per dispatch, as in the shader
+
+    struct Stats {
+        size_t uploads = 0;
+        size_t texelsUploaded = 0;
+        size_t gpuSteps = 0;
+        size_t timedSteps = 0;                      // steps covered by gpuMs
+        double gpuMs = 0.0;
+    };
+
+    bool Create(int resolution, bool compute);
+    void Destroy();
+    bool Created() const { return mTexture != 0; }
+
+    // Replaces rect with texels, packed row by row
+    void Upload(const WaterRect& rect, const std::vector<glm::vec4>& texels);
+
+    // Runs steps on the GPU; disturbances are sorted by step
+    void Simulate(GLuint programId, size_t steps, const std::vector<WaterDisturbance>& disturbances,
+        float damping, float cellSize);
+
+    // Binds the texture for a pool draw and tells the shader to use it
+    void Bind(GLuint programId) const;
+
+    const Stats& GetStats() const { return mStats; }
+
+private:
+    void Dispatch(GLuint programId, int pass);
+    void CollectTiming();
+
+    int mResolution = 0;
+    GLuint mTexture = 0;
+    GLuint mHeights[2] = { 0, 0 };
+    int mCurrent = 0;                               // image holding the latest heights
+    GLuint mTimers[2] = { 0, 0 };                   // timestamps before and after a Simulate()
+    size_t mTimerSteps = 0;                         // steps between them while in flight; 0 when idle
+    Stats mStats;
+};
+
+#endif